@@ -0,0 +1,282 @@
+#include "Includes.h"
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+
+// Settings of a benchmark run, parsed from the command line
+struct BenchmarkOptions {
+	unsigned int scene = 1;				// scene number (1-3)
+	std::string sceneFile;				// scene description file, replaces the scene number
+	RenderMode mode = RenderMode::Caching;
+	unsigned int threads = 3;			// threads of the multi threaded strategies
+	unsigned int warmup = 60;			// frames rendered before measuring
+	unsigned int frames = 300;			// measured frames
+	unsigned int seed = 1;				// seed of the random values used to build the scene
+	bool compressDepth = false;			// per tile depth planes (tiled strategies)
+	float gouraudDistance = 0.f;		// lambert meshes farther than this are lit per vertex (0 = never)
+	bool shadows = false;				// sun shadow map, added to the light of the scene
+	bool depthPrepass = false;			// depth only pass per tile before shading (tiled strategies)
+	float textureBudget = 0.f;			// megabytes of resident texture levels (0 = DEFAULT_TEXTURE_BUDGET)
+	unsigned int msaa = 1;				// samples per pixel (1, 4 or 8)
+	bool asyncPresent = false;			// present on the output thread (Renderer::startAsyncPresent)
+	std::string out;					// JSON file, empty to only print
+	std::string trace;					// Chrome trace of the measured frames, empty for none
+	std::string capture;				// path and file name prefix of the recorded measured frames, empty for none
+	CaptureFormat captureFormat = CaptureFormat::QOI;
+};
+
+// Parses "--key value" pairs
+// Returns false and prints usage on an unknown option
+static bool parseBenchmarkOptions(int argc, char** argv, BenchmarkOptions& o) {
+	for (int i = 0; i < argc; i++) {
+		std::string key = argv[i];
+		const char* value = i + 1 < argc ? argv[i + 1] : "";
+		if (key == "--compress-depth") { o.compressDepth = true; continue; }
+		if (key == "--shadows") { o.shadows = true; continue; }
+		if (key == "--depth-prepass") { o.depthPrepass = true; continue; }
+		if (key == "--async-present") { o.asyncPresent = true; continue; }
+
+		bool known = true;
+		if (key == "--scene") known = parseCount(value, 1, o.scene);
+		else if (key == "--threads") known = parseCount(value, 1, o.threads);
+		else if (key == "--warmup") known = parseCount(value, 0, o.warmup);
+		else if (key == "--frames") known = parseCount(value, 1, o.frames);
+		else if (key == "--seed") known = parseCount(value, 0, o.seed);
+		else if (key == "--scene-file") o.sceneFile = value;
+		else if (key == "--out") o.out = value;
+		else if (key == "--trace") o.trace = value;
+		else if (key == "--capture") o.capture = value;
+		else if (key == "--capture-format") {
+			known = false;
+			for (size_t f = 0; f < std::size(captureFormatNames); f++)
+				if (strcmp(value, captureFormatNames[f]) == 0) { o.captureFormat = static_cast<CaptureFormat>(f); known = true; }
+		}
+		else if (key == "--gouraud-beyond") known = parseAmount(value, o.gouraudDistance);
+		else if (key == "--texture-budget") known = parseAmount(value, o.textureBudget);
+		else if (key == "--msaa") known = parseCount(value, 1, o.msaa);
+		else if (key == "--mode") {
+			known = false;
+			for (size_t m = 0; m < std::size(renderModeNames); m++)
+				if (strcmp(value, renderModeNames[m]) == 0) { o.mode = static_cast<RenderMode>(m); known = true; }
+		}
+		else known = false;
+
+		if (!known || o.scene > 3 || (o.msaa != 1 && o.msaa != 4 && o.msaa != 8)) {
+			std::cerr << "usage: --bench [--scene 1|2|3 | --scene-file file] [--mode caching|sharedcounter|sentinelqueue|tiled|pipelined]\n"
+				"               [--threads n] [--warmup n] [--frames n] [--seed n] [--compress-depth] [--out file.json]\n"
+				"               [--trace trace.json] [--gouraud-beyond distance] [--shadows] [--depth-prepass]\n"
+				"               [--texture-budget megabytes] [--msaa 1|4|8] [--async-present]\n"
+				"               [--capture prefix] [--capture-format raw|ppm|qoi|y4m]\n";
+			return false;
+		}
+		i++;
+	}
+	return true;
+}
+
+// FNV-1a hash of an image, equal across runs when rendering is deterministic
+static unsigned long long hashImage(const Framebuffer& image) {
+	unsigned long long h = 14695981039346656037ull;
+	const unsigned int* p = image.data();
+	for (size_t i = 0; i < (size_t)image.getWidth() * image.getHeight(); i++)
+		h = (h ^ p[i]) * 1099511628211ull;
+	return h;
+}
+
+// Renders the current state of a scene once with and once without a tiled renderer option that
+// must not change the image: compressed tiles store the depth the raw kernels test, and the depth
+// pre-pass stores the depth the colour pass tests. A frame without the option is drawn first to
+// settle what the measured frames left behind (the pipelined mode ends with the geometry of a
+// frame it never drew).
+// Input Variables:
+// - scene, renderer : scene and renderer of the benchmark, the framebuffer is overwritten
+// - threads : threads of the tiled renderer
+// - option : the option (Renderer::compressDepth or Renderer::depthPrepass), left on
+// Returns true if the images are equal.
+static bool optionMatchesPlain(Scene& scene, Renderer& renderer, unsigned int threads, bool Renderer::* option) {
+	unsigned long long hashes[2];
+	for (int pass = 0; pass < 3; pass++) {
+		bool on = pass == 2;
+		renderer.*option = on;
+		renderer.clear();
+		render(scene.meshes, renderer, scene.L, RenderMode::Tiled, threads);
+		renderer.present();
+		hashes[on ? 1 : 0] = hashImage(renderer.framebuffer);
+	}
+	return hashes[0] == hashes[1];
+}
+
+// Value at a percentile of sorted samples (nearest rank)
+static double percentile(const std::vector<double>& sorted, double p) {
+	size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * sorted.size()));
+	return sorted[rank ? rank - 1 : 0];
+}
+
+// Runs a scene headless with a fixed seed and reports frame time statistics as JSON
+// Input Variables:
+// - argc, argv : benchmark options (see parseBenchmarkOptions)
+// Returns the process exit code.
+int runBenchmark(int argc, char** argv) {
+	BenchmarkOptions o;
+	if (!parseBenchmarkOptions(argc, argv, o)) return 1;
+
+	Renderer renderer(true);
+	renderer.compressDepth = o.compressDepth;
+	renderer.gouraudDistance = o.gouraudDistance;
+	renderer.depthPrepass = o.depthPrepass;
+	renderer.setMultisampling(o.msaa);
+	if (o.asyncPresent) renderer.startAsyncPresent();
+
+	Scene scene;
+	if (!o.sceneFile.empty()) {
+		if (!loadSceneFile(o.sceneFile, scene, o.seed)) return 1;
+	}
+	else {
+		switch (o.scene) {
+		case 1: makeScene1(scene, o.seed); break;
+		case 2: makeScene2(scene, o.seed); break;
+		default: makeScene3(scene, o.seed); break;
+		}
+	}
+	if (o.shadows) scene.L.castShadows = true;
+	if (o.textureBudget > 0.f) scene.streaming.setBudget(static_cast<size_t>(o.textureBudget * 1048576.0));
+
+	bool pipelined = o.mode == RenderMode::Pipelined;
+	FramePipeline pipeline(renderer, o.threads);
+	auto update = [&]() { scene.step(renderer); };
+
+	std::vector<double> times;
+	times.reserve(o.frames);
+	RenderStats stats;	// summed over the measured frames
+	unsigned long long casRetries = 0, lostRaces = 0;	// depth contention of the concurrent modes, summed over the measured frames
+	DepthCompressionStats compression;	// depth footprint of the compressed frames, summed over the measured frames
+	for (unsigned int f = 0; f < o.warmup + o.frames; f++) {
+		// only the measured frames are traced and recorded
+		if (f == o.warmup && !o.trace.empty()) Profiler::get().enabled = true;
+		if (f == o.warmup && !o.capture.empty() && !renderer.startCapture(o.capture, o.captureFormat)) {
+			std::cerr << "could not write " << o.capture << std::endl;
+			return 1;
+		}
+
+		auto start = std::chrono::steady_clock::now();
+
+		if (pipelined)
+			pipeline.frame(scene.meshes, scene.L, update);
+		else {
+			PROFILE_ZONE("frame");
+			renderer.clear();
+			{
+				PROFILE_ZONE("update");
+				scene.step(renderer);
+			}
+			render(scene.meshes, renderer, scene.L, o.mode, o.threads);
+			renderer.present();
+		}
+
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		if (f >= o.warmup) {
+			times.push_back(ms);
+			stats += RenderStats::lastFrame();
+			unsigned long long retries, lost;
+			renderer.getContention(retries, lost);
+			casRetries += retries;
+			lostRaces += lost;
+			if (o.compressDepth) compression += renderer.getDepthCompression();
+		}
+	}
+	if (pipelined) pipeline.finish();
+	renderer.stopAsyncPresent(); // the last frame is back in the framebuffer
+	renderer.stopCapture();		 // the frames drawn by the checks below are not recorded
+	unsigned long long imageHash = hashImage(pipelined ? renderer.backBuffer : renderer.framebuffer);
+	bool compressionMatches = !o.compressDepth || optionMatchesPlain(scene, renderer, o.threads, &Renderer::compressDepth);
+	bool prepassMatches = true;
+	if (o.depthPrepass) {
+		renderer.compressDepth = false; // compressed tiles are drawn without the pre-pass
+		prepassMatches = optionMatchesPlain(scene, renderer, o.threads, &Renderer::depthPrepass);
+	}
+
+	Profiler::get().enabled = false;
+	if (!o.trace.empty() && !Profiler::get().exportChromeTrace(o.trace)) {
+		std::cerr << "could not write " << o.trace << std::endl;
+		return 1;
+	}
+
+	double total = 0.0;
+	for (double t : times) total += t;
+	double mean = total / times.size();
+	std::vector<double> sorted = times;
+	std::sort(sorted.begin(), sorted.end());
+
+	size_t triangles = scene.triangleCount();
+	double seconds = total / 1000.0;
+
+	std::ostringstream json;
+	json << "{\n"
+		<< "  \"scene\": " << (o.sceneFile.empty() ? std::to_string(o.scene) : "\"" + o.sceneFile + "\"") << ",\n"
+		<< "  \"mode\": \"" << renderModeNames[static_cast<int>(o.mode)] << "\",\n"
+		<< "  \"threads\": " << o.threads << ",\n"
+		<< "  \"seed\": " << o.seed << ",\n"
+		<< "  \"compressDepth\": " << (o.compressDepth ? "true" : "false") << ",\n"
+		<< "  \"gouraudDistance\": " << o.gouraudDistance << ",\n"
+		<< "  \"shadows\": " << (scene.L.castShadows ? "true" : "false") << ",\n"
+		<< "  \"depthPrepass\": " << (o.depthPrepass ? "true" : "false") << ",\n"
+		<< "  \"asyncPresent\": " << (o.asyncPresent ? "true" : "false") << ",\n"
+		<< "  \"msaa\": " << renderer.getMultisampling() << ",\n";
+	if (o.depthPrepass)
+		json << "  \"depthPrepassMatchesPlain\": " << (prepassMatches ? "true" : "false") << ",\n";
+	json
+		<< "  \"warmupFrames\": " << o.warmup << ",\n"
+		<< "  \"frames\": " << o.frames << ",\n"
+		<< "  \"width\": " << renderer.framebuffer.getWidth() << ",\n"
+		<< "  \"height\": " << renderer.framebuffer.getHeight() << ",\n"
+		<< "  \"trianglesPerFrame\": " << triangles << ",\n"
+		<< "  \"frameTimeMs\": { \"mean\": " << mean << ", \"min\": " << sorted.front()
+		<< ", \"p50\": " << percentile(sorted, 50) << ", \"p95\": " << percentile(sorted, 95)
+		<< ", \"p99\": " << percentile(sorted, 99) << ", \"max\": " << sorted.back() << " },\n"
+		<< "  \"trianglesPerSecond\": " << static_cast<unsigned long long>(triangles * times.size() / seconds) << ",\n"
+		<< "  \"pixelsShadedPerSecond\": " << static_cast<unsigned long long>(stats.pixelsShaded / seconds) << ",\n";	// 0 without RENDER_STATS_ENABLED
+	if (!o.capture.empty())
+		json << "  \"capture\": { \"format\": \"" << captureFormatNames[static_cast<int>(o.captureFormat)]
+			<< "\", \"frames\": " << renderer.getCapturedFrames() << ", \"stalls\": " << renderer.getCaptureStalls() << " },\n";
+	if (!scene.streaming.empty())
+		json << "  \"textureStreaming\": { \"residentBytes\": " << scene.streaming.getResidentBytes()
+			<< ", \"levelsLoaded\": " << scene.streaming.getLoads() << ", \"levelsEvicted\": " << scene.streaming.getEvictions()
+			<< ", \"failedLoads\": " << scene.streaming.getFailures() << " },\n";
+	if (RENDER_STATS_ENABLED && (o.mode == RenderMode::SharedCounter || o.mode == RenderMode::SentinelQueue))	// counted through RENDER_STAT
+		json << "  \"depthContentionPerFrame\": { \"casRetries\": " << static_cast<double>(casRetries) / times.size()
+			<< ", \"lostRaces\": " << static_cast<double>(lostRaces) / times.size() << " },\n";
+	if (o.compressDepth) {
+		double perFrame = 1.0 / times.size();
+		json << "  \"depthCompressionPerFrame\": { \"compressedTiles\": " << compression.compressedTiles * perFrame
+			<< ", \"rawTiles\": " << compression.rawTiles * perFrame << ", \"depthBytes\": " << compression.bytes * perFrame
+			<< ", \"rawDepthBytes\": " << compression.rawBytes * perFrame
+			<< ", \"savedPercent\": " << (compression.rawBytes ? 100.0 - 100.0 * compression.bytes / compression.rawBytes : 0.0)
+			<< ", \"hizCulled\": " << compression.hizCulled * perFrame
+			<< ", \"matchesRaw\": " << (compressionMatches ? "true" : "false") << " },\n";
+	}
+	json << "  \"statsPerFrame\": {\n";
+	stats.writeJSON(json, 1.0 / times.size(), "    ");
+	json << "  },\n"
+		<< "  \"imageHash\": \"" << std::hex << imageHash << std::dec << "\"\n"
+		<< "}\n";
+
+	std::cout << json.str();
+	if (!o.out.empty()) {
+		std::ofstream file(o.out);
+		if (!file) {
+			std::cerr << "could not write " << o.out << std::endl;
+			return 1;
+		}
+		file << json.str();
+	}
+	if (!compressionMatches) {
+		std::cerr << "compressed depth drew a different image than raw depth" << std::endl;
+		return 1;
+	}
+	if (!prepassMatches) {
+		std::cerr << "the depth pre-pass drew a different image than the frame without it" << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -33,7 +33,7 @@ public:
 	// output operator overload
 	friend std::ostream& operator<<(std::ostream& _os, const ChronoTimer& _timer)
 	{
-		auto diff = std::chrono::duration<double, std::milli>(Clock::now() - start);
+		auto diff = std::chrono::duration<double, std::milli>(Clock::now() - _timer.start);
 		return _os << diff.count() << std::endl;
 	}
 };
@@ -57,26 +57,25 @@ namespace GamesEngineeringBase
 	{
 	private:
 		// Private member variables
-		HWND hwnd;                               // Handle to the window
+		HWND hwnd = nullptr;                     // Handle to the window
 		HINSTANCE hinstance;                     // Handle to the application instance
 		float invZoom;                           // Inverse of the zoom factor
 		std::string name;                        // Window name/title
-		ID3D11Device* dev;                       // Direct3D device
-		ID3D11DeviceContext* devcontext;         // Direct3D device context
-		IDXGISwapChain* sc;                      // Swap chain for double buffering
-		ID3D11RenderTargetView* rtv;             // Render target view
+		ID3D11Device* dev = nullptr;             // Direct3D device
+		ID3D11DeviceContext* devcontext = nullptr; // Direct3D device context
+		IDXGISwapChain* sc = nullptr;            // Swap chain for double buffering
+		ID3D11RenderTargetView* rtv = nullptr;   // Render target view
 		D3D11_VIEWPORT vp;                       // Viewport configuration
-		ID3D11Texture2D* tex;                    // Texture for pixel data
-		ID3D11ShaderResourceView* srv;           // Shader resource view
-		ID3D11PixelShader* ps;                   // Pixel shader
-		ID3D11VertexShader* vs;                  // Vertex shader
-		std::atomic<unsigned char>* image;                    // Back buffer image data
-		bool keys[256];                          // Keyboard state array
+		ID3D11Texture2D* tex = nullptr;          // Texture for pixel data
+		ID3D11ShaderResourceView* srv = nullptr; // Shader resource view
+		ID3D11PixelShader* ps = nullptr;         // Pixel shader
+		ID3D11VertexShader* vs = nullptr;        // Vertex shader
+		bool keys[256] = {};                     // Keyboard state array
 		int mousex;                              // Mouse X-coordinate
 		int mousey;                              // Mouse Y-coordinate
 		bool mouseButtons[3];                    // Mouse button states (left, middle, right)
 		int mouseWheel;                          // Mouse wheel value
-		bool quit;								 // to check if window exit is pressed
+		bool quit = false;						 // to check if window exit is pressed
 		unsigned int width;                      // Window width
 		unsigned int height;                     // Window height
 
@@ -343,11 +342,11 @@ namespace GamesEngineeringBase
 			// Create the texture description for the back buffer image
 			D3D11_TEXTURE2D_DESC texdesc;
 			memset(&texdesc, 0, sizeof(D3D11_TEXTURE2D_DESC));
-			texdesc.Width = width * 3; // Width times 3 for RGB channels
+			texdesc.Width = width; // One packed 32-bit pixel per texel
 			texdesc.Height = height;
 			texdesc.MipLevels = 1;
 			texdesc.ArraySize = 1;
-			texdesc.Format = DXGI_FORMAT_R8_UNORM;
+			texdesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
 			texdesc.SampleDesc.Count = 1;
 			texdesc.Usage = D3D11_USAGE_DYNAMIC;
 			texdesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
@@ -357,7 +356,7 @@ namespace GamesEngineeringBase
 			// Create the texture and shader resource view
 			dev->CreateTexture2D(&texdesc, NULL, &tex);
 			D3D11_SHADER_RESOURCE_VIEW_DESC srvdesc;
-			srvdesc.Format = DXGI_FORMAT_R8_UNORM;
+			srvdesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
 			srvdesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
 			srvdesc.Texture2D.MostDetailedMip = 0;
 			srvdesc.Texture2D.MipLevels = 1;
@@ -390,10 +389,8 @@ namespace GamesEngineeringBase
             };\
             float4 PS(VSOut psInput) : SV_Target0\
             {\
-                int3 texcoordsr = int3(psInput.pos.x * 3, psInput.pos.y, 0);\
-                int3 texcoordsg = texcoordsr + int3(1, 0, 0);\
-                int3 texcoordsb = texcoordsr + int3(2, 0, 0);\
-                return float4(tex.Load(texcoordsb).r, tex.Load(texcoordsr).r, tex.Load(texcoordsg).r, 1.0f);\
+                float4 c = tex.Load(int3(psInput.pos.xy, 0));\
+                return float4(c.rgb, 1.0f);\
             }";
 
 			// Compile the shaders
@@ -436,10 +433,6 @@ namespace GamesEngineeringBase
 			devcontext->PSSetShader(ps, NULL, 0);
 			devcontext->PSSetShaderResources(0, 1, &srv);
 
-			// Allocate memory for the back buffer image data
-			image = new std::atomic<unsigned char>[width * height * 3];
-			clear(); // Clear the image data
-
 			// Initialize input states
 			memset(keys, 0, 256 * sizeof(bool));
 			memset(mouseButtons, 0, 3 * sizeof(bool));
@@ -457,63 +450,31 @@ namespace GamesEngineeringBase
 			pumpLoop();
 		}
 
-		// Returns a pointer to the back buffer image data
-		std::atomic<unsigned char>* backBuffer()
-		{
-			return image;
-		}
-
-		// Draws a pixel at (x, y) with the specified RGB color
-		void drawCaching(int x, int y, unsigned char r, unsigned char g, unsigned char b)
-		{
-			int index = ((y * width) + x) * 3;
-			image[index].store(r);
-			image[index + 1].store(g);
-			image[index + 2].store(b);
-		}
-
-		// Draws a pixel at the specified pixel index with the given RGB color
-		void drawCaching(int pixelIndex, unsigned char r, unsigned char g, unsigned char b)
-		{
-			int index = pixelIndex * 3;
-			image[index].store(r);
-			image[index + 1].store(g);
-			image[index + 2].store(b);
-		}
-
-		// Draws a pixel at the specified pixel index with the given pixel array
-		void drawCaching(int pixelIndex, unsigned char* pixel)
-		{
-			int index = pixelIndex * 3;
-			image[index].store(pixel[0]);
-			image[index + 1].store(pixel[1]);
-			image[index + 2].store(pixel[2]);
-		}
-
-		// Draws a pixel at (x, y) using the color from the provided pixel array
-		void drawCaching(int x, int y, unsigned char* pixel)
+		// Presents a packed 32-bit image (width * height pixels, red in the lowest byte) to the screen
+		void present(const unsigned int* image)
 		{
-			int index = ((y * width) + x) * 3;
-			image[index] = pixel[0];
-			image[index + 1] = pixel[1];
-			image[index + 2] = pixel[2];
-		}
+			display(image);
 
-		// Clears the back buffer by setting all pixels to black
-		void clear()
-		{
-			memset(image, 0, width * height * 3 * sizeof(unsigned char));
+			// Process any pending messages
+			pumpLoop();
 		}
 
-		// Presents the back buffer to the screen
-		void present()
+		// Uploads and presents an image without processing window messages.
+		// Can be called from an output thread, as long as it is the only thread using the device
+		// context; messages must then be pumped by the thread owning the window (checkInput).
+		void display(const unsigned int* image)
 		{
 			// Map the texture to update its data
 			D3D11_MAPPED_SUBRESOURCE res;
 			devcontext->Map(tex, 0, D3D11_MAP_WRITE_DISCARD, 0, &res);
 
-			// Copy the image data to the texture
-			memcpy(res.pData, image, width * height * 3 * sizeof(unsigned char));
+			// Copy the image data to the texture, row by row if the driver padded the rows
+			unsigned int rowBytes = width * sizeof(unsigned int);
+			if (res.RowPitch == rowBytes)
+				memcpy(res.pData, image, rowBytes * height);
+			else
+				for (unsigned int y = 0; y < height; y++)
+					memcpy(static_cast<unsigned char*>(res.pData) + y * res.RowPitch, image + y * width, rowBytes);
 
 			// Unmap the texture
 			devcontext->Unmap(tex, 0);
@@ -527,9 +488,6 @@ namespace GamesEngineeringBase
 
 			// Present the swap chain
 			sc->Present(0, 0);
-
-			// Process any pending messages
-			pumpLoop();
 		}
 
 		bool IsQuit() const { return quit; }
@@ -598,16 +556,17 @@ namespace GamesEngineeringBase
 			ClipCursor(&rect);
 		}
 
-		// Destructor to release resources
+		// Destructor to release resources (nothing to release if create() was never called)
 		~Window()
 		{
-			vs->Release();
-			ps->Release();
-			srv->Release();
-			tex->Release();
-			rtv->Release();
-			sc->Release();
-			devcontext->Release();
+			if (!dev) return;
+			if (vs) vs->Release();
+			if (ps) ps->Release();
+			if (srv) srv->Release();
+			if (tex) tex->Release();
+			if (rtv) rtv->Release();
+			if (sc) sc->Release();
+			if (devcontext) devcontext->Release();
 			dev->Release();
 			CoUninitialize();
 		}
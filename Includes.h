@@ -9,3 +9,5 @@
 #include "colour.h"
 #include "utilities.h"
 #include "render.h"
+#include "pipeline.h"
+#include "scene.h"
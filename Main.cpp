@@ -1,11 +1,29 @@
+#include <cstring>
+#include <string>
+#include <vector>
 
 void scene1();
 void scene2();
 void scene3();
+void sceneFiles(const std::vector<std::string>& files);
+int runBenchmark(int argc, char** argv);
+int runMicrobench(int argc, char** argv);
 
 // Entry point of the application
-// No input variables
-int main() {
+// Input Variables:
+// - argc, argv : "--bench [options]" runs the headless benchmark instead of a scene,
+//				  "--microbench [options]" the kernel micro-benchmarks,
+//				  "--scene-file file..." renders scene files (keys 1-9 switch between them)
+int main(int argc, char** argv) {
+	if (argc > 1 && strcmp(argv[1], "--bench") == 0)
+		return runBenchmark(argc - 2, argv + 2);
+	if (argc > 1 && strcmp(argv[1], "--microbench") == 0)
+		return runMicrobench(argc - 2, argv + 2);
+	if (argc > 1 && strcmp(argv[1], "--scene-file") == 0) {
+		sceneFiles(std::vector<std::string>(argv + 2, argv + argc));
+		return 0;
+	}
+
 	// Uncomment the desired scene function to run
 
 	scene1();
@@ -13,4 +31,4 @@ int main() {
 	//scene3();
 
 	return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,516 @@
+#include "Includes.h"
+#include <intrin.h>
+#include <string>
+#include <cstring>
+#include <iomanip>
+
+// Micro-benchmarks of the math and raster kernels in isolation.
+// Every kernel runs over a fixed batch of synthetic data several times; the fastest repetition
+// is reported (least disturbed by the OS) as TSC cycles per operation, nanoseconds per operation
+// and million operations per second. TSC cycles tick at the nominal clock, not the boost clock.
+
+// pixel loops only the raster kernel benchmarks select (see the end of triangle.h)
+template const triangle::KernelFn* triangle::kernelTable<RasterKernel::Caching, false>();
+template const triangle::KernelFn* triangle::kernelTable<RasterKernel::Caching, true>();
+template const triangle::KernelFn* triangle::kernelTable<RasterKernel::IncrementalSIMD, false>();
+template const triangle::KernelFn* triangle::kernelTable<RasterKernel::IncrementalSIMD, true>();
+
+// keeps results alive so the compiler cannot remove the measured work
+static volatile float microSink;
+
+// cost of one call of a kernel
+struct kernelTime {
+	double cycles = 0.0;
+	double ns = 0.0;
+};
+
+// Times the fastest of several calls of a kernel
+// Input Variables:
+// - reps : repetitions
+// - body : kernel to measure
+template<typename F>
+static kernelTime timeKernel(unsigned int reps, F&& body) {
+	body(); // warm caches and branch predictors
+
+	kernelTime best{ 1e300, 0.0 };
+	for (unsigned int r = 0; r < reps; r++) {
+		auto start = std::chrono::steady_clock::now();
+		unsigned long long c0 = __rdtsc();
+		body();
+		double cycles = static_cast<double>(__rdtsc() - c0);
+		double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+		if (cycles < best.cycles) best = { cycles, ns };
+	}
+	return best;
+}
+
+// Measures a kernel and prints one result row
+// Input Variables:
+// - name : kernel name
+// - ops : operations performed by one call of body
+// - reps : repetitions, the fastest is reported
+// - body : kernel to measure
+// - pixels : pixels touched by one call of body (0 to skip the pixel rate)
+// - baseline : cost of setup work inside body that is not part of the kernel (subtracted)
+template<typename F>
+static void measureKernel(const std::string& name, size_t ops, unsigned int reps, F&& body, double pixels = 0.0, kernelTime baseline = {}) {
+	kernelTime t = timeKernel(reps, body);
+	double bestCycles = max(t.cycles - baseline.cycles, 0.0);
+	double bestNs = max(t.ns - baseline.ns, 1.0);
+
+	std::cout << std::left << std::setw(36) << name << std::right << std::fixed
+		<< std::setw(12) << std::setprecision(2) << bestCycles / ops
+		<< std::setw(12) << std::setprecision(2) << bestNs / ops
+		<< std::setw(12) << std::setprecision(2) << ops * 1000.0 / bestNs;
+	if (pixels > 0.0)
+		std::cout << std::setw(12) << std::setprecision(1) << pixels * 1000.0 / bestNs;
+	std::cout << std::defaultfloat << "\n";
+}
+
+// Synthetic triangle distributions
+enum class TriangleShape { Tiny, Medium, Huge, Thin };
+static const char* triangleShapeNames[] = { "tiny", "medium", "huge", "thin" };
+
+// Builds screen space triangles of one shape, counter clockwise so they pass the inside test
+// Input Variables:
+// - shape : size distribution
+// - count : number of triangles
+// - width, height : screen size
+// Output Variables:
+// - corners : three vertices per triangle
+// - area : summed pixel area of the triangles
+static void makeTriangles(TriangleShape shape, unsigned int count, unsigned int width, unsigned int height,
+	std::vector<Vertex>& corners, double& area)
+{
+	RandomNumberGenerator& rng = RandomNumberGenerator::getInstance();
+	corners.clear();
+	area = 0.0;
+
+	for (unsigned int t = 0; t < count; t++) {
+		float cx = rng.getRandomFloat(0.f, static_cast<float>(width));
+		float cy = rng.getRandomFloat(0.f, static_cast<float>(height));
+		float z = rng.getRandomFloat(0.1f, 0.9f);
+
+		Vertex v[3];
+		switch (shape) {
+		case TriangleShape::Thin: {
+			// long sliver, 1-2 pixels wide
+			float angle = rng.getRandomFloat(0.f, 2.0f * M_PI);
+			float length = rng.getRandomFloat(150.f, 300.f), w = rng.getRandomFloat(1.f, 2.f);
+			float dx = std::cos(angle), dy = std::sin(angle);
+			v[0].p = vec4(cx, cy, z, 1.f);
+			v[1].p = vec4(cx + dx * length, cy + dy * length, z, 1.f);
+			v[2].p = vec4(cx + dx * length - dy * w, cy + dy * length + dx * w, z, 1.f);
+			break;
+		}
+		default: {
+			float radius = shape == TriangleShape::Tiny ? rng.getRandomFloat(1.5f, 3.f) :
+				shape == TriangleShape::Medium ? rng.getRandomFloat(10.f, 30.f) : rng.getRandomFloat(200.f, 400.f);
+			float angle = rng.getRandomFloat(0.f, 2.0f * M_PI);
+			for (int i = 0; i < 3; i++) {
+				float a = angle + i * 2.0f * M_PI / 3.0f + rng.getRandomFloat(-0.3f, 0.3f);
+				v[i].p = vec4(cx + std::cos(a) * radius, cy + std::sin(a) * radius, z, 1.f);
+			}
+			break;
+		}
+		}
+
+		for (int i = 0; i < 3; i++) {
+			v[i].normal = vec4(0.f, 0.f, 1.f, 0.f);
+			v[i].rgb = color(1.f, 1.f, 1.f);
+		}
+
+		// signed area as computed by the triangle, flip the winding if negative
+		float e0x = v[1].p[0] - v[0].p[0], e0y = v[1].p[1] - v[0].p[1];
+		float e1x = v[2].p[0] - v[1].p[0], e1y = v[2].p[1] - v[1].p[1];
+		float signedArea = e0x * e1y - e1x * e0y;
+		if (signedArea < 0.f) std::swap(v[1], v[2]);
+
+		corners.insert(corners.end(), { v[0], v[1], v[2] });
+		area += std::fabs(signedArea) * 0.5;
+	}
+}
+
+// Runs the micro-benchmark suite and prints a table of results
+// Input Variables:
+// - argc, argv : "--reps n" repetitions per kernel, "--seed n" seed of the synthetic data
+// Returns the process exit code.
+int runMicrobench(int argc, char** argv) {
+	unsigned int reps = 20, seed = 1;
+	for (int i = 0; i < argc; i += 2) {
+		const char* value = i + 1 < argc ? argv[i + 1] : "";
+		bool known = false;
+		if (strcmp(argv[i], "--reps") == 0) known = parseCount(value, 1, reps);
+		else if (strcmp(argv[i], "--seed") == 0) known = parseCount(value, 0, seed);
+		if (!known) {
+			std::cerr << "usage: --microbench [--reps n] [--seed n]\n";
+			return 1;
+		}
+	}
+
+	RandomNumberGenerator& rng = RandomNumberGenerator::getInstance();
+	rng.seed(seed);
+
+	std::cout << std::left << std::setw(36) << "kernel" << std::right << std::setw(12) << "cycles/op"
+		<< std::setw(12) << "ns/op" << std::setw(12) << "Mops/s" << std::setw(12) << "Mpix/s" << "\n";
+
+	// random number generation, scalar stream against eight SIMD lanes
+	{
+		const unsigned int count = 1 << 16;
+		std::vector<float> out(count);
+		RandomStream stream(seed);
+		RandomStream8 stream8(RandomStream(seed, 1));
+		std::mt19937 mt(seed);
+		measureKernel("std::mt19937 + uniform_real", count, reps, [&] {
+			std::uniform_real_distribution<float> distribution(0.f, 1.f);
+			for (unsigned int i = 0; i < count; i++) out[i] = distribution(mt);
+			microSink = out[count - 1];
+		});
+		measureKernel("RandomStream::fill", count, reps, [&] {
+			stream.fill(out.data(), count, 0.f, 1.f);
+			microSink = out[count - 1];
+		});
+		measureKernel("RandomStream8::fill", count, reps, [&] {
+			stream8.fill(out.data(), count, 0.f, 1.f);
+			microSink = out[count - 1];
+		});
+	}
+
+	// matrix * matrix
+	{
+		const unsigned int count = 1024;
+		std::vector<matrix> a(count), b(count), out(count);
+		for (unsigned int i = 0; i < count; i++) {
+			a[i] = matrix::makeRotateXYZ(rng.getRandomFloat(-1.f, 1.f), rng.getRandomFloat(-1.f, 1.f), rng.getRandomFloat(-1.f, 1.f));
+			b[i] = matrix::makeTranslation(rng.getRandomFloat(-5.f, 5.f), rng.getRandomFloat(-5.f, 5.f), rng.getRandomFloat(-5.f, 5.f));
+		}
+		measureKernel("matrix::mul", count, reps, [&] {
+			for (unsigned int i = 0; i < count; i++) out[i] = a[i].mul(b[i]);
+			microSink = out[count - 1][3];
+		});
+		measureKernel("matrix::mul_avx", count, reps, [&] {
+			for (unsigned int i = 0; i < count; i++) out[i] = a[i].mul_avx(b[i]);
+			microSink = out[count - 1][3];
+		});
+		measureKernel("matrix::multiplyMany", count, reps, [&] {
+			matrix::multiplyMany(a[0], b, out);
+			microSink = out[count - 1][3];
+		});
+		measureKernel("matrix::makeInverse", count, reps, [&] {
+			for (unsigned int i = 0; i < count; i++) out[i] = matrix::makeInverse(a[i]);
+			microSink = out[count - 1][3];
+		});
+	}
+
+	// per frame spin of instances: matrix products against the quaternion animator
+	{
+		const unsigned int count = 8000;
+		struct rRot { float x; float y; float z; };
+		std::vector<rRot> rotations(count);
+		std::vector<matrix> worlds(count);
+		TransformHierarchy transforms;
+		SpinAnimator animation;
+		for (unsigned int i = 0; i < count; i++) {
+			rotations[i] = { rng.getRandomFloat(-.1f, .1f), rng.getRandomFloat(-.1f, .1f), rng.getRandomFloat(-.1f, .1f) };
+			worlds[i] = matrix::makeTranslation(rng.getRandomFloat(-20.f, 20.f), rng.getRandomFloat(-20.f, 20.f), rng.getRandomFloat(-40.f, -4.f));
+			animation.add(transforms.add(worlds[i]), worlds[i], rotations[i].x, rotations[i].y, rotations[i].z);
+		}
+		measureKernel("spin (world * makeRotateXYZ)", count, reps, [&] {
+			for (unsigned int i = 0; i < count; i++)
+				worlds[i] = worlds[i] * matrix::makeRotateXYZ(rotations[i].x, rotations[i].y, rotations[i].z);
+			microSink = worlds[count - 1][0];
+		});
+		measureKernel("SpinAnimator::update (1 thread)", count, reps, [&] {
+			animation.update(transforms, 1.f, 1);
+			microSink = matrix(transforms.getLocal(count - 1))[0];
+		});
+	}
+
+	// matrix * point and the full vertex transform
+	{
+		const unsigned int count = 4096;
+		unsigned int width = 1024, height = 768;
+		matrix world = matrix::makeRotateXYZ(0.3f, 0.2f, 0.1f);
+		matrix p = matrix::makePerspective(90.0f * M_PI / 180.0f, 4.0f / 3.0f, 0.1f, 100.0f) * matrix::makeTranslation(0.f, 0.f, -5.f) * world;
+		std::vector<Vertex> in(count), out(count);
+		for (auto& v : in) {
+			v.p = vec4(rng.getRandomFloat(-1.f, 1.f), rng.getRandomFloat(-1.f, 1.f), rng.getRandomFloat(-1.f, 1.f), 1.f);
+			v.normal = vec4(0.f, 0.f, 1.f, 0.f);
+			v.rgb = color(1.f, 1.f, 1.f);
+		}
+		measureKernel("matrix::mul_point", count, reps, [&] {
+			for (unsigned int i = 0; i < count; i++) out[i].p = p.mul_point(in[i].p);
+			microSink = out[count - 1].p[0];
+		});
+		measureKernel("matrix::mul_point_avx", count, reps, [&] {
+			for (unsigned int i = 0; i < count; i++) out[i].p = p.mul_point_avx(in[i].p);
+			microSink = out[count - 1].p[0];
+		});
+		measureKernel("matrix::transformPoints", count, reps, [&] {
+			matrix::transformPoints(p, &in[0].p, sizeof(Vertex), &out[0].p, sizeof(Vertex), count);
+			microSink = out[count - 1].p[0];
+		});
+		measureKernel("processVertex", count, reps, [&] {
+			for (unsigned int i = 0; i < count; i++) processVertex(p, world, in[i], width, height, out[i]);
+			microSink = out[count - 1].p[0];
+		});
+		measureKernel("processVertices", count, reps, [&] {
+			processVertices(p, world, in, width, height, out);
+			microSink = out[count - 1].p[0];
+		});
+		VertexLight vertexLight{ vec4(0.f, 0.70710678f, 0.70710678f, 0.f), color(0.1f, 0.1f, 0.1f), color(1.f, 1.f, 1.f) };
+		measureKernel("processVerticesLit", count, reps, [&] {
+			processVerticesLit(p, vertexLight, in, width, height, out);
+			microSink = out[count - 1].p[0];
+		});
+	}
+
+	// vertex and bin stages of a frame of untextured meshes: a 10x10x10 grid of spheres in front of the camera
+	{
+		const int side = 10;
+		unsigned int width = 1024, height = 768;
+		Mesh sphere = Mesh::makeSphere(1.f, 10, 10);
+		std::vector<Mesh> instances;
+		instances.reserve(side * side * side);
+		std::vector<Mesh*> meshes;
+		for (int i = 0; i < side * side * side; i++) {
+			instances.push_back(Mesh::makeInstance(sphere));
+			instances.back().world = matrix::makeTranslation((i % side - side / 2) * 2.f, (i / side % side - side / 2) * 2.f, -(i / (side * side)) * 2.f - 4.f);
+			meshes.push_back(&instances.back());
+		}
+		matrix vp = matrix::makePerspective(90.0f * M_PI / 180.0f, 4.0f / 3.0f, 0.1f, 100.0f);
+		Light sun{ vec4(0.f, 0.70710678f, 0.70710678f, 0.f), color(1.f, 1.f, 1.f), color(0.1f, 0.1f, 0.1f) };
+		TileGrid tiles;
+		tiles.create(width, height);
+		std::vector<triangleData> triangles;
+		std::vector<std::vector<unsigned int>> bins;
+		size_t count = meshes.size() * sphere.triangles.size();
+		measureKernel("processGeometry (untextured)", count, reps, [&] {
+			processGeometry(meshes, vp, 1, sun, vec4(0.f, 0.f, 0.f, 1.f), 0.f, width, height, triangles);
+			microSink = static_cast<float>(triangles.size());
+		});
+		measureKernel("binTriangles (untextured)", count, reps, [&] {
+			binTriangles(triangles, tiles, width, height, false, bins);
+			microSink = static_cast<float>(bins[0].size());
+		});
+	}
+
+	Renderer renderer(true);
+	unsigned int width = renderer.framebuffer.getWidth(), height = renderer.framebuffer.getHeight();
+	tileRect screen{ 0, 0, static_cast<int>(width), static_cast<int>(height) };
+	Light L{ vec4(0.f, 1.f, 1.f, 0.f), color(1.f, 1.f, 1.f), color(0.1f, 0.1f, 0.1f) };
+	L.omega_i.normalise();
+	LightParams light = makeLightParams(L, vec4(0.f, 0.f, 1.f, 0.f));
+	ShadeParams shade = makeShadeParams(L, 1.f, 1.f, Material());
+
+	// depth test against a cleared buffer
+	{
+		const unsigned int count = 1 << 16;
+		std::vector<unsigned int> indices(count);
+		std::vector<float> depths(count);
+		for (unsigned int i = 0; i < count; i++) {
+			indices[i] = rng.getRandomInt(0, width * height - 1);
+			depths[i] = rng.getRandomFloat(0.1f, 0.9f);
+		}
+		renderer.clear();
+		renderer.prepareRect(0, 0, width, height);
+		measureKernel("Renderer::depthTest (random)", count, reps, [&] {
+			unsigned int passed = 0;
+			for (unsigned int i = 0; i < count; i++) passed += renderer.depthTest<false>(indices[i], depths[i]);
+			microSink = static_cast<float>(passed);
+		});
+		measureKernel("Renderer::depthTest (linear)", count, reps, [&] {
+			unsigned int passed = 0;
+			for (unsigned int i = 0; i < count; i++) passed += renderer.depthTest<false>(i, depths[i]);
+			microSink = static_cast<float>(passed);
+		});
+	}
+
+	// every raster repetition starts from a cleared frame, the clear is measured once and subtracted
+	auto clearFrame = [&] {
+		renderer.clear();
+		renderer.prepareRect(0, 0, width, height);
+	};
+	kernelTime clearTime = timeKernel(reps, clearFrame);
+
+	// triangle setup and raster per shape
+	static const char* kernelNames[] = { "drawCaching", "drawIncremental", "drawIncrementalSIMD" };
+	static const unsigned int counts[] = { 20000, 2000, 20, 500 };
+	std::vector<Vertex> corners;
+	std::vector<triangle> tris;
+	DepthTarget depthTarget;	// target of the depth only kernel
+	depthTarget.create(width, height);
+	kernelTime depthClearTime = timeKernel(reps, [&] { depthTarget.clear(); });
+	for (int s = 0; s < 4; s++) {
+		double area;
+		makeTriangles(static_cast<TriangleShape>(s), counts[s], width, height, corners, area);
+
+		tris.resize(counts[s]);
+		measureKernel(std::string("triangle setup (") + triangleShapeNames[s] + ")", tris.size(), reps, [&] {
+			for (size_t i = 0; i < tris.size(); i++) tris[i] = triangle(corners[i * 3], corners[i * 3 + 1], corners[i * 3 + 2]);
+		});
+
+		for (int k = 0; k < 3; k++) {
+			RasterKernel kernel = static_cast<RasterKernel>(k);
+			measureKernel(std::string(kernelNames[k]) + " (" + triangleShapeNames[s] + ")", tris.size(), reps, [&] {
+				clearFrame();
+				for (auto& t : tris) t.draw(kernel, renderer, light, shade, screen);
+			}, area, clearTime);
+		}
+
+		// the depth only kernel of shadow maps and depth pre-passes
+		measureKernel(std::string("rasterDepth (") + triangleShapeNames[s] + ")", tris.size(), reps, [&] {
+			depthTarget.clear();
+			for (size_t i = 0; i < tris.size(); i++) rasterDepth(depthTarget, corners[i * 3].p, corners[i * 3 + 1].p, corners[i * 3 + 2].p, screen);
+		}, area, depthClearTime);
+	}
+
+	// pixel shaders per shading model (medium triangles, incremental kernel)
+	{
+		double area;
+		makeTriangles(TriangleShape::Medium, counts[1], width, height, corners, area);
+		tris.resize(counts[1]);
+		for (size_t i = 0; i < tris.size(); i++) tris[i] = triangle(corners[i * 3], corners[i * 3 + 1], corners[i * 3 + 2]);
+
+		for (unsigned int m = 0; m < SHADING_MODELS; m++) {
+			Material material;
+			material.model = static_cast<ShadingModel>(m);
+			ShadeParams modelShade = makeShadeParams(L, 1.f, 1.f, material);
+			measureKernel(std::string("shader ") + shadingModelNames[m] + " (medium)", tris.size(), reps, [&] {
+				clearFrame();
+				for (auto& t : tris) t.draw(RasterKernel::Incremental, renderer, light, modelShade, screen);
+			}, area, clearTime);
+		}
+
+		// sun shadows: drawing the map (no casters, so clear and resolve only) and the filtered
+		// lookup added to every fragment of the lambert shader (all fragments lie inside the map)
+		Light sun = L;
+		sun.castShadows = true;
+		std::vector<Mesh*> casters;
+		matrix camera = matrix::makePerspective(90.0f * M_PI / 180.0f, 4.0f / 3.0f, 0.1f, 100.0f);
+		ShadowMaps maps;
+		measureKernel("ShadowMaps::build (sun, no casters)", 1, reps, [&] {
+			maps.build(casters, sun, camera, vec4(0.f, 0.f, 0.f, 1.f), vec4(0.f, 0.f, 1.f, 0.f), width, height, 1);
+		});
+		LightParams shadowed = makeLightParams(sun, vec4(0.f, 0.f, 1.f, 0.f), nullptr, &maps);
+		measureKernel("shader lambert + sun shadow (medium)", tris.size(), reps, [&] {
+			clearFrame();
+			for (auto& t : tris) t.draw(RasterKernel::Incremental, renderer, shadowed, shade, screen);
+		}, area, clearTime);
+	}
+
+	// multisampling: the coverage kernel on medium triangles and the resolve of the whole canvas
+	{
+		double area;
+		makeTriangles(TriangleShape::Medium, counts[1], width, height, corners, area);
+		tris.resize(counts[1]);
+		for (size_t i = 0; i < tris.size(); i++) tris[i] = triangle(corners[i * 3], corners[i * 3 + 1], corners[i * 3 + 2]);
+		std::vector<unsigned int> resolved(renderer.layout.size());
+
+		for (unsigned int samples : { 4u, 8u }) {
+			renderer.setMultisampling(samples);
+			std::string suffix = " " + std::to_string(samples) + "x";
+			kernelTime msaaClearTime = timeKernel(reps, clearFrame);
+			measureKernel("drawMultisample" + suffix + " (medium)", tris.size(), reps, [&] {
+				clearFrame();
+				for (auto& t : tris) t.draw(RasterKernel::Multisample, renderer, light, shade, screen);
+			}, area, msaaClearTime);
+			measureKernel("MultisampleTarget::resolveRange" + suffix, resolved.size(), reps, [&] {
+				renderer.getMultisampleTarget().resolveRange(resolved.data(), 0, static_cast<unsigned int>(resolved.size()));
+				microSink = static_cast<float>(resolved[resolved.size() / 2]);
+			});
+		}
+		renderer.setMultisampling(1);
+	}
+
+	// check: four squares meeting at a tile corner resolve to one colour, whether drawn tile by
+	// tile from the bins or by the whole canvas draw (samples left of and above the pixel position
+	// of the first column and row of a tile belong to triangles ending on the tile border)
+	{
+		const int corner = TILE_SIZE, size = 24;
+		std::vector<triangleData> squares;
+		for (int sy = -1; sy <= 0; sy++)
+			for (int sx = -1; sx <= 0; sx++) {
+				float x0 = static_cast<float>(corner + sx * size), y0 = static_cast<float>(corner + sy * size);
+				Vertex v[4];
+				for (int i = 0; i < 4; i++) {
+					v[i].p = vec4(x0 + (i == 1 || i == 2 ? size : 0), y0 + (i >= 2 ? size : 0), 0.5f, 1.f);
+					v[i].normal = vec4(0.f, 0.f, 1.f, 0.f);
+					v[i].rgb = color(1.f, 1.f, 1.f);
+				}
+				// split along the diagonal no sample of the 4x and 8x patterns lies on
+				squares.emplace_back(triangle(v[0], v[1], v[2]), shade);
+				squares.emplace_back(triangle(v[0], v[2], v[3]), shade);
+			}
+
+		std::vector<std::vector<unsigned int>> bins;
+		for (unsigned int samples : { 4u, 8u })
+			for (bool tiled : { true, false }) {
+				renderer.setMultisampling(samples);
+				renderer.clear();
+				if (tiled) {
+					binTriangles(squares, renderer.tiles, width, height, true, bins);
+					rasterTiles(squares, bins, renderer, light, 1);
+				}
+				else
+					for (auto& s : squares) s.tri.draw(renderer, light, s.shade);
+				renderer.present();
+
+				const unsigned int* image = renderer.framebuffer.data();
+				unsigned int expected = image[(size_t)(corner - size / 2) * width + corner - size / 2];
+				for (int y = corner - size + 2; y < corner + size - 2; y++)
+					for (int x = corner - size + 2; x < corner + size - 2; x++)
+						if (image[(size_t)y * width + x] != expected) {
+							std::cerr << "multisample " << samples << "x " << (tiled ? "tiled" : "canvas")
+								<< ": pixel (" << x << ", " << y << ") is " << std::hex << image[(size_t)y * width + x]
+								<< " instead of " << expected << std::dec << " next to the tile corner\n";
+							return 1;
+						}
+			}
+		renderer.setMultisampling(1);
+	}
+
+	// texture sampling: the sampler alone at random positions and levels, then a textured shader
+	{
+		Texture texture;
+		texture.makeChecker(512, 16, color(1.f, 1.f, 1.f), color(0.2f, 0.3f, 0.6f));
+		unsigned int count = counts[0];
+		std::vector<float> u(count), v(count), lod(count);
+		RandomStream rng(7);
+		for (unsigned int i = 0; i < count; i++) {
+			u[i] = rng.getRandomFloat(-4.f, 4.f);
+			v[i] = rng.getRandomFloat(-4.f, 4.f);
+			lod[i] = rng.getRandomFloat(0.f, 6.f);
+		}
+		for (TextureFilter filter : { TextureFilter::Bilinear, TextureFilter::Trilinear }) {
+			texture.setFilter(filter);
+			measureKernel(filter == TextureFilter::Bilinear ? "Texture::sample (bilinear)" : "Texture::sample (trilinear)", count, reps, [&] {
+				color sum;
+				for (unsigned int i = 0; i < count; i++) sum = sum + texture.sample(u[i], v[i], lod[i]);
+				microSink = sum[color::RED];
+			});
+		}
+
+		// medium triangles with texture coordinates following the screen (about one texel per pixel)
+		double area;
+		makeTriangles(TriangleShape::Medium, counts[1], width, height, corners, area);
+		Mesh texturedMesh;
+		texturedMesh.material.texture = &texture;
+		for (size_t i = 0; i < corners.size(); i++) {
+			corners[i].p[3] = 1.f;	// 1 / w
+			texturedMesh.texCoords.push_back({ corners[i].p[0] / 512.f, corners[i].p[1] / 512.f });
+		}
+		for (unsigned int i = 0; i < tris.size(); i++) {
+			tris[i] = triangle(corners[i * 3], corners[i * 3 + 1], corners[i * 3 + 2], i);
+			texturedMesh.addTriangle(i * 3, i * 3 + 1, i * 3 + 2);
+		}
+		ShadeParams texturedShade = makeShadeParams(L, 1.f, 1.f, texturedMesh.material);
+		texturedShade.mesh = &texturedMesh;
+		measureKernel("shader lambert textured (medium)", tris.size(), reps, [&] {
+			clearFrame();
+			for (auto& t : tris) t.draw(RasterKernel::Incremental, renderer, light, texturedShade, screen);
+		}, area, clearTime);
+	}
+
+	return 0;
+}
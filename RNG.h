@@ -1,7 +1,173 @@
 #pragma once
 
 #include <random>
+#include <immintrin.h>
 
+// Fast seedable random stream (xoshiro128**, https://prng.di.unimi.it).
+// The state is four 32-bit words, a value costs a handful of shifts and xors. jump() advances
+// the stream by 2^64 values, so streams derived from one seed by jumping never overlap and can
+// be handed to different threads: stream k of a seed is the seeded stream jumped k times.
+class RandomStream {
+	unsigned int s[4];
+
+	static unsigned int rotl(unsigned int x, int k) {
+		return (x << k) | (x >> (32 - k));
+	}
+
+	// splitmix64 step, spreads a seed over the state
+	static unsigned long long splitmix(unsigned long long& x) {
+		unsigned long long z = (x += 0x9E3779B97F4A7C15ull);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+		return z ^ (z >> 31);
+	}
+
+	friend class RandomStream8;
+
+public:
+	// Input Variables:
+	// - seed : seed of the stream
+	// - stream : index of the independent stream of that seed
+	RandomStream(unsigned long long seed = 1, unsigned int stream = 0) {
+		this->seed(seed);
+		for (unsigned int i = 0; i < stream; i++)
+			jump();
+	}
+
+	// Restarts the stream from a seed
+	void seed(unsigned long long seed) {
+		unsigned long long a = splitmix(seed), b = splitmix(seed);
+		s[0] = static_cast<unsigned int>(a);
+		s[1] = static_cast<unsigned int>(a >> 32);
+		s[2] = static_cast<unsigned int>(b);
+		s[3] = static_cast<unsigned int>(b >> 32);
+		if (!(s[0] | s[1] | s[2] | s[3])) s[0] = 1; // the all zero state never leaves zero
+	}
+
+	// Next 32 random bits
+	unsigned int next() {
+		unsigned int result = rotl(s[1] * 5, 7) * 9;
+		unsigned int t = s[1] << 9;
+		s[2] ^= s[0];
+		s[3] ^= s[1];
+		s[1] ^= s[2];
+		s[0] ^= s[3];
+		s[2] ^= t;
+		s[3] = rotl(s[3], 11);
+		return result;
+	}
+
+	// Advances the stream by 2^64 values (start of the next independent stream)
+	void jump() {
+		static const unsigned int JUMP[] = { 0x8764000b, 0xf542d2d3, 0x6fa035c3, 0x77f2db5b };
+		unsigned int t[4] = { 0, 0, 0, 0 };
+		for (unsigned int j : JUMP) {
+			for (int b = 0; b < 32; b++) {
+				if (j & (1u << b)) {
+					t[0] ^= s[0];
+					t[1] ^= s[1];
+					t[2] ^= s[2];
+					t[3] ^= s[3];
+				}
+				next();
+			}
+		}
+		s[0] = t[0];
+		s[1] = t[1];
+		s[2] = t[2];
+		s[3] = t[3];
+	}
+
+	// Generate a random integer within a range (both ends included)
+	int getRandomInt(int min, int max) {
+		unsigned long long range = static_cast<unsigned long long>(static_cast<long long>(max) - min) + 1;
+		return static_cast<int>(min + static_cast<long long>((next() * range) >> 32));
+	}
+
+	// Generate a random float within a range
+	float getRandomFloat(float min, float max) {
+		return min + (max - min) * ((next() >> 8) * (1.0f / 16777216.0f));
+	}
+
+	// Fills an array with random floats within a range
+	// Input Variables:
+	// - out : array to fill
+	// - count : number of values
+	// - min, max : range
+	void fill(float* out, size_t count, float min, float max) {
+		for (size_t i = 0; i < count; i++)
+			out[i] = getRandomFloat(min, max);
+	}
+};
+
+// Eight xoshiro128** streams advanced together in the lanes of AVX2 registers, for bulk
+// generation. Lane k runs stream k of the base it was created from, so the values differ
+// from the scalar stream but are just as reproducible.
+class RandomStream8 {
+	__m256i s0, s1, s2, s3;
+
+	static __m256i rotl(__m256i x, int k) {
+		return _mm256_or_si256(_mm256_slli_epi32(x, k), _mm256_srli_epi32(x, 32 - k));
+	}
+
+public:
+	// Input Variables:
+	// - base : lane 0 starts at this stream, lane k at the stream jumped k times
+	RandomStream8(RandomStream base = RandomStream()) {
+		alignas(32) unsigned int lanes[4][8];
+		for (int k = 0; k < 8; k++) {
+			for (int w = 0; w < 4; w++)
+				lanes[w][k] = base.s[w];
+			base.jump();
+		}
+		s0 = _mm256_load_si256(reinterpret_cast<const __m256i*>(lanes[0]));
+		s1 = _mm256_load_si256(reinterpret_cast<const __m256i*>(lanes[1]));
+		s2 = _mm256_load_si256(reinterpret_cast<const __m256i*>(lanes[2]));
+		s3 = _mm256_load_si256(reinterpret_cast<const __m256i*>(lanes[3]));
+	}
+
+	// Next 32 random bits of every lane
+	__m256i next() {
+		__m256i x5 = _mm256_add_epi32(s1, _mm256_slli_epi32(s1, 2));	// s1 * 5
+		__m256i r = rotl(x5, 7);
+		__m256i result = _mm256_add_epi32(r, _mm256_slli_epi32(r, 3));	// * 9
+		__m256i t = _mm256_slli_epi32(s1, 9);
+		s2 = _mm256_xor_si256(s2, s0);
+		s3 = _mm256_xor_si256(s3, s1);
+		s1 = _mm256_xor_si256(s1, s2);
+		s0 = _mm256_xor_si256(s0, s3);
+		s2 = _mm256_xor_si256(s2, t);
+		s3 = rotl(s3, 11);
+		return result;
+	}
+
+	// Eight random floats within a range
+	__m256 nextFloat(__m256 min, __m256 range) {
+		__m256 u = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(next(), 8)), _mm256_set1_ps(1.0f / 16777216.0f));
+		return _mm256_fmadd_ps(u, range, min);
+	}
+
+	// Fills an array with random floats within a range
+	// Input Variables:
+	// - out : array to fill
+	// - count : number of values
+	// - min, max : range
+	void fill(float* out, size_t count, float min, float max) {
+		__m256 vmin = _mm256_set1_ps(min), range = _mm256_set1_ps(max - min);
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8)
+			_mm256_storeu_ps(out + i, nextFloat(vmin, range));
+		if (i < count) {
+			alignas(32) float rest[8];
+			_mm256_store_ps(rest, nextFloat(vmin, range));
+			for (size_t k = 0; i < count; i++, k++)
+				out[i] = rest[k];
+		}
+	}
+};
+
+// Shared random stream for code running on a single thread (interactive scenes, micro-benchmarks).
+// Not thread safe: threads draw from their own RandomStream (see parallelGenerate).
 class RandomNumberGenerator {
 public:
     // Delete copy constructor and assignment operator
@@ -14,22 +180,27 @@ public:
         return instance;
     }
 
+    // Restart the sequence from a fixed seed, making the values reproducible
+    void seed(unsigned int s) {
+        rng.seed(s);
+    }
+
     // Generate a random integer within a range
     int getRandomInt(int min, int max) {
-        std::uniform_int_distribution<int> distribution(min, max);
-        return distribution(rng);
+        return rng.getRandomInt(min, max);
     }
 
     // Generate a random integer within a range
     float getRandomFloat(float min, float max) {
-        std::uniform_real_distribution<float> distribution(min, max);
-        return distribution(rng);
+        return rng.getRandomFloat(min, max);
     }
 
+    // Underlying stream (e.g. to derive a RandomStream8 from)
+    RandomStream& stream() { return rng; }
+
 private:
     // Private constructor for Singleton
     RandomNumberGenerator() : rng(std::random_device{}()) {}
 
-    // Mersenne Twister random number generator
-    std::mt19937 rng;
-};
\ No newline at end of file
+    RandomStream rng;
+};
@@ -0,0 +1,14 @@
+#include "Includes.h"
+
+// Kernel tables of the pixel loops triangle::draw() and triangle::drawCompressed() pick from
+// (the caching and SIMD tables only the micro-benchmarks select are built in Microbench.cpp)
+
+template const triangle::KernelFn* triangle::kernelTable<RasterKernel::Incremental, false>();
+template const triangle::KernelFn* triangle::kernelTable<RasterKernel::Incremental, true>();
+template const triangle::KernelFn* triangle::kernelTable<RasterKernel::Multisample, false>();
+
+const triangle::CompressedFn* triangle::compressedTable() {
+	constexpr size_t size = SHADING_MODELS * SHADER_FEATURE_COMBINATIONS;
+	static constexpr std::array<CompressedFn, size> table = makeCompressedTable(std::make_index_sequence<size>());
+	return table.data();
+}
@@ -1,69 +1,87 @@
 #include "Includes.h"
 
+// Builds a scene of 40 cubes with random rotations and a camera flying back and forth
+// Input Variables:
+// - scene : scene to fill
+// - seed : seed of the random rotations
+void makeScene1(Scene& scene, unsigned int seed) {
+	// Create a scene of 40 cubes with random rotations, two rows of 20 (left and right)
+	scene.meshes.resize(40);
+	parallelGenerate(40, seed, [&](unsigned int i, RandomStream& rng) {
+		Mesh* m = new Mesh();
+		*m = Mesh::makeCube(1.f);
+		m->world = matrix::makeTranslation(i % 2 ? 2.0f : -2.0f, 0.0f, (-3 * static_cast<float>(i / 2))) * makeRandomRotation(rng);
+		scene.meshes[i] = m;
+	});
+
+	float zoffset = 8.0f; // Initial camera Z-offset
+	float step = -0.1f;  // Step size for camera movement
+
+	scene.attachMeshes();
+
+	// Rotate the first two cubes in the scene, the other 38 keep their cached transforms
+	scene.animation.add(0, scene.transforms.getLocal(0), 0.1f, 0.1f, 0.0f);
+	scene.animation.add(1, scene.transforms.getLocal(1), 0.0f, 0.1f, 0.2f);
+
+	scene.update = [zoffset, step](Renderer& renderer) mutable {
+		matrix camera = matrix::makeTranslation(0, 0, -zoffset); // Update camera position
+
+		zoffset += step;
+		if (zoffset < -60.f || zoffset > 8.f)
+			step *= -1.f;
+
+		// update view projection matrix before rendering
+		renderer.updateVP(camera);
+	};
+}
+
 // Function to render a scene with multiple objects and dynamic transformations
+// (V cycles the overdraw and depth complexity heat maps, M cycles 1, 4 and 8 samples per pixel)
 // No input variables
 void scene1() {
 	Renderer renderer;
-	matrix camera;
-	Light L{ vec4(0.f, 1.f, 1.f, 0.f), color(1.0f, 1.0f, 1.0f), color(0.1f, 0.1f, 0.1f) };
+	Scene scene;
+	makeScene1(scene, std::random_device{}()); // different scene every run
 
-	bool running = true;
+	// hand finished frames to an output thread so drawing the next frame starts at once
+	//renderer.startAsyncPresent();
 
-	std::vector<Mesh*> scene;
+	// record the presented frames (flushed and reported after the loop)
+	//renderer.startCapture("scene1", CaptureFormat::QOI);
 
-	// Create a scene of 40 cubes with random rotations
-	for (unsigned int i = 0; i < 20; i++) {
-		Mesh* m = new Mesh();
-		*m = Mesh::makeCube(1.f);
-		m->world = matrix::makeTranslation(-2.0f, 0.0f, (-3 * static_cast<float>(i))) * makeRandomRotation();
-		scene.push_back(m);
-		m = new Mesh();
-		*m = Mesh::makeCube(1.f);
-		m->world = matrix::makeTranslation(2.0f, 0.0f, (-3 * static_cast<float>(i))) * makeRandomRotation();
-		scene.push_back(m);
-	}
+	bool viewPressed = false;		// V was down last frame
+	bool samplesPressed = false;	// M was down last frame
 
-	float zoffset = 8.0f; // Initial camera Z-offset
-	float step = -0.1f;  // Step size for camera movement
-
-	auto start = std::chrono::high_resolution_clock::now();
-	std::chrono::time_point<std::chrono::high_resolution_clock> end;
-	int cycle = 0;
+	bool running = true;
 
 	// Main rendering loop
 	while (running) {
 		renderer.canvas.checkInput();
 		if (renderer.canvas.keyPressed(VK_ESCAPE) || renderer.canvas.IsQuit()) break;
 
-		renderer.clear();
-
-		camera = matrix::makeTranslation(0, 0, -zoffset); // Update camera position
+		// shaded frame, overdraw, depth complexity, shaded frame, ...
+		if (renderer.canvas.keyPressed('V') && !viewPressed)
+			renderer.setDebugView(static_cast<DebugView>((static_cast<int>(renderer.getDebugView()) + 1) % 3));
+		viewPressed = renderer.canvas.keyPressed('V');
 
-		// Rotate the first two cubes in the scene
-		scene[0]->world = scene[0]->world * matrix::makeRotateXYZ(0.1f, 0.1f, 0.0f);
-		scene[1]->world = scene[1]->world * matrix::makeRotateXYZ(0.0f, 0.1f, 0.2f);
+		// smooth the triangle edges with 4, then 8 samples per pixel, then back to 1
+		if (renderer.canvas.keyPressed('M') && !samplesPressed)
+			renderer.setMultisampling(renderer.getMultisampling() == 1 ? 4 : renderer.getMultisampling() == 4 ? 8 : 1);
+		samplesPressed = renderer.canvas.keyPressed('M');
 
-		zoffset += step;
-		if (zoffset < -60.f || zoffset > 8.f) {
-			step *= -1.f;
-			if (++cycle % 2 == 0) {
-				end = std::chrono::high_resolution_clock::now();
-				std::cout << std::chrono::duration<double, std::milli>(end - start).count() << "\n";
-				start = std::chrono::high_resolution_clock::now();
-			}
-		}
+		renderer.clear();
 
-		// update view projection matrix before rendering
-		renderer.updateVP(camera);
+		scene.step(renderer);
 
 		// render all objects in a scene
-		render(scene, renderer, L);
+		render(scene.meshes, renderer, scene.L);
 
-		//renderSharedCounter(scene, renderer, L, 3);
+		//renderSharedCounter(scene.meshes, renderer, scene.L, 3);
 
 		renderer.present();
 	}
 
-	for (auto& m : scene)
-		delete m;
-}
\ No newline at end of file
+	renderer.stopCapture();
+	if (renderer.getCapturedFrames() > 0)
+		std::cout << "captured " << renderer.getCapturedFrames() << " frames, " << renderer.getCaptureStalls() << " waited for the encoders" << std::endl;
+}
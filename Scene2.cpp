@@ -1,42 +1,54 @@
 #include "Includes.h"
 
-// Scene with a grid of cubes and a moving sphere
-// No input variables
-void scene2() {
-	Renderer renderer;
-	matrix camera = matrix::makeIdentity();
-	Light L{ vec4(0.f, 1.f, 1.f, 0.f), color(1.0f, 1.0f, 1.0f), color(0.1f, 0.1f, 0.1f) };
-
-	std::vector<Mesh*> scene;
-
-	struct rRot { float x; float y; float z; }; // Structure to store random rotation parameters
-	std::vector<rRot> rotations;
-
-	RandomNumberGenerator& rng = RandomNumberGenerator::getInstance();
-
-	// Create a grid of cubes with random rotations
-	for (unsigned int y = 0; y < 6; y++) {
-		for (unsigned int x = 0; x < 8; x++) {
-			Mesh* m = new Mesh();
-			*m = Mesh::makeCube(1.f);
-			scene.push_back(m);
-			m->world = matrix::makeTranslation(-7.0f + (static_cast<float>(x) * 2.f), 5.0f - (static_cast<float>(y) * 2.f), -8.f);
-			rRot r{ rng.getRandomFloat(-.1f, .1f), rng.getRandomFloat(-.1f, .1f), rng.getRandomFloat(-.1f, .1f) };
-			rotations.push_back(r);
-		}
-	}
+// Builds a grid of cubes with random rotations and a sphere moving across it
+// Input Variables:
+// - scene : scene to fill
+// - seed : seed of the random rotation speeds
+void makeScene2(Scene& scene, unsigned int seed) {
+	// Create a grid of 8x6 cubes with random rotations
+	const unsigned int cubes = 6 * 8;
+	scene.meshes.resize(cubes);
+	scene.transforms.resize(cubes);
+	scene.animation.resize(cubes);
+	parallelGenerate(cubes, seed, [&](unsigned int i, RandomStream& rng) {
+		unsigned int x = i % 8, y = i / 8;
+		Mesh* m = new Mesh();
+		*m = Mesh::makeCube(1.f);
+		matrix local = matrix::makeTranslation(-7.0f + (static_cast<float>(x) * 2.f), 5.0f - (static_cast<float>(y) * 2.f), -8.f);
+		scene.meshes[i] = m;
+		scene.transforms.set(i, local, -1, m);
+		float rx = rng.getRandomFloat(-.1f, .1f), ry = rng.getRandomFloat(-.1f, .1f), rz = rng.getRandomFloat(-.1f, .1f);
+		scene.animation.set(i, i, local, rx, ry, rz);
+	});
 
 	// Create a sphere and add it to the scene
 	Mesh* sphere = new Mesh();
 	*sphere = Mesh::makeSphere(1.0f, 10, 20);
-	scene.push_back(sphere);
+	scene.meshes.push_back(sphere);
 	float sphereOffset = -6.f;
 	float sphereStep = 0.1f;
 	sphere->world = matrix::makeTranslation(sphereOffset, 0.f, -6.f);
 
-	auto start = std::chrono::high_resolution_clock::now();
-	std::chrono::time_point<std::chrono::high_resolution_clock> end;
-	int cycle = 0;
+	scene.attachMeshes();
+	int sphereNode = static_cast<int>(scene.meshes.size()) - 1;
+	scene.update = [&transforms = scene.transforms, sphereNode, sphereOffset, sphereStep](Renderer& renderer) mutable {
+		// Move the sphere back and forth
+		sphereOffset += sphereStep;
+		transforms.setLocal(sphereNode, matrix::makeTranslation(sphereOffset, 0.f, -6.f));
+		if (sphereOffset > 6.0f || sphereOffset < -6.0f)
+			sphereStep *= -1.f;
+
+		// update view projection matrix before rendering
+		renderer.updateVP(matrix::makeIdentity());
+	};
+}
+
+// Scene with a grid of cubes and a moving sphere
+// No input variables
+void scene2() {
+	Renderer renderer;
+	Scene scene;
+	makeScene2(scene, std::random_device{}()); // different scene every run
 
 	bool running = true;
 	while (running) {
@@ -45,31 +57,10 @@ void scene2() {
 
 		renderer.clear();
 
-		// Rotate each cube in the grid
-		for (int i = 0; i < rotations.size(); i++)
-			scene[i]->world = scene[i]->world * matrix::makeRotateXYZ(rotations[i].x, rotations[i].y, rotations[i].z);
+		scene.step(renderer);
 
-
-		// Move the sphere back and forth
-		sphereOffset += sphereStep;
-		sphere->world = matrix::makeTranslation(sphereOffset, 0.f, -6.f);
-		if (sphereOffset > 6.0f || sphereOffset < -6.0f) {
-			sphereStep *= -1.f;
-			if (++cycle % 2 == 0) {
-				end = std::chrono::high_resolution_clock::now();
-				std::cout << std::chrono::duration<double, std::milli>(end - start).count() << "\n";
-				start = std::chrono::high_resolution_clock::now();
-			}
-		}
-
-		// update view projection matrix before rendering
-		renderer.updateVP(camera);
-
-		render(scene, renderer, L);
+		render(scene.meshes, renderer, scene.L);
 
 		renderer.present();
 	}
-
-	for (auto& m : scene)
-		delete m;
-}
\ No newline at end of file
+}
@@ -1,86 +1,104 @@
 #include "Includes.h"
+#include <memory>
 
 // debug timer
 static ChronoTimer timer;
 
-// Test scene function to demonstrate rendering with user-controlled transformations
-// No input variables
-void scene3() {
-	Renderer renderer;
-
-	// create light source {direction, diffuse intensity, ambient intensity}
-	Light L{ vec4(0.f, 1.f, 1.f, 0.f), color(1.0f, 1.0f, 1.0f), color(0.1f, 0.1f, 0.1f) };
+// Builds a 20x20x20 grid of rotating spheres viewed by a user-controlled camera
+// (WASD/QE move the camera, P toggles pipelined frames, no keys are pressed in headless runs)
+// Input Variables:
+// - scene : scene to fill
+// - seed : seed of the random rotation speeds
+void makeScene3(Scene& scene, unsigned int seed) {
+	// Create the grid of spheres, tessellated in parallel (i, j, k order as a nested loop would)
+	int totalX = 20, totalY = 20, totalZ = 20, space = 2;
+	unsigned int total = totalX * totalY * totalZ;
+	scene.meshes.resize(total);
+	scene.transforms.resize(total);
+	scene.animation.resize(total);
+	parallelGenerate(total, seed, [&](unsigned int n, RandomStream& rng) {
+		int i = n / (totalY * totalZ), j = (n / totalZ) % totalY, k = n % totalZ;
+		//Mesh mesh = Mesh::makeCube(2);
+		Mesh* mesh = new Mesh();
+		*mesh = Mesh::makeSphere(1.f, 10, 10);
+		//*mesh = Mesh::makeCube(1);
+		matrix local = matrix::makeTranslation((i - totalX / 2) * space, (j - totalY / 2) * space, -k * space - 4);
+		scene.meshes[n] = mesh;
+		scene.transforms.set(n, local, -1, mesh);
+		float rx = rng.getRandomFloat(-.1f, .1f), ry = rng.getRandomFloat(-.1f, .1f), rz = rng.getRandomFloat(-.1f, .1f);
+		scene.animation.set(n, n, local, rx, ry, rz);
+	});
 
-	// camera is just a matrix
-	matrix camera = matrix::makeIdentity(); // Initialize the camera with identity matrix
+	float x = 0.0f, y = 0.0f, z = -4.0f; // Initial translation parameters
 
-	RandomNumberGenerator& rng = RandomNumberGenerator::getInstance();
+	// Handle user inputs and update the view projection matrix (the spheres spin in scene.animation)
+	// keys come from scene.input, sampled on the main thread, as the update may run on the geometry thread
+	scene.update = [&input = scene.input, x, y, z](Renderer& renderer) mutable {
+		if (input.keyPressed('A')) x += 0.1f;
+		if (input.keyPressed('D')) x += -0.1f;
+		if (input.keyPressed('W')) z += 0.1f;
+		if (input.keyPressed('S')) z += -0.1f;
+		if (input.keyPressed('Q')) y += 0.1f;
+		if (input.keyPressed('E')) y += -0.1f;
 
-	std::vector<Mesh*> scene; // Vector to store scene objects
+		// Apply transformations to the camera
+		matrix camera = matrix::makeTranslation(x, y, z);
 
-	struct rRot { float x; float y; float z; }; // Structure to store random rotation parameters
-	std::vector<rRot> rotations;
+		// update view projection matrix before rendering
+		renderer.updateVP(camera);
+	};
+}
 
-	// Create a sphere and a rectangle mesh
-	int totalX = 20, totalY = 20, totalZ = 20, space = 2;
-	for (int i = 0; i < totalX; i++)
-	{
-		for (int j = 0; j < totalY; j++)
-		{
-			for (int k = 0; k < totalZ; k++)
-			{
-				//Mesh mesh = Mesh::makeCube(2);
-				Mesh* mesh = new Mesh();
-				*mesh = Mesh::makeSphere(1.f, 10, 10);
-				//*mesh = Mesh::makeCube(1);
-				mesh->world = matrix::makeTranslation((i - totalX / 2) * space, (j - totalY / 2) * space, -k * space - 4);
-				scene.push_back(mesh);
-				rRot r{ rng.getRandomFloat(-.1f, .1f), rng.getRandomFloat(-.1f, .1f), rng.getRandomFloat(-.1f, .1f) };
-				rotations.push_back(r);
-			}
-		}
-	}
+// Test scene function to demonstrate rendering with user-controlled transformations
+// No input variables
+void scene3() {
+	Renderer renderer;
+	Scene scene;
+	makeScene3(scene, std::random_device{}()); // different scene every run
 
-	float x = 0.0f, y = 0.0f, z = -4.0f; // Initial translation parameters
+	// overlap geometry, rasterization and present of consecutive frames, toggled with P
+	std::unique_ptr<FramePipeline> pipeline;	// built when enabled, nullptr while frames are drawn one by one
+	bool togglePressed = false;					// P was down last frame
+	auto update = [&]() { scene.step(renderer); };
 
 	bool running = true; // Main loop control variable
 	// Main rendering loop
 	while (running) {
 		renderer.canvas.checkInput(); // Handle user input
 		if (renderer.canvas.keyPressed(VK_ESCAPE) || renderer.canvas.IsQuit()) break;
+		scene.input.sample(renderer.canvas); // read by the update, on the geometry thread when pipelined
 
-		renderer.clear(); // Clear the canvas for the next frame
+		// a fresh pipeline every time it is enabled, so no geometry of an earlier frame is drawn
+		if (scene.input.keyPressed('P') && !togglePressed) {
+			if (pipeline) {
+				pipeline->finish();
+				pipeline.reset();
+			}
+			else pipeline = std::make_unique<FramePipeline>(renderer);
+		}
+		togglePressed = scene.input.keyPressed('P');
 
 		//timer.enable = renderer.canvas.keyPressed(VK_SPACE);
 
-		// Handle user inputs for transformations
-		if (renderer.canvas.keyPressed(VK_ESCAPE)) break;
-		if (renderer.canvas.keyPressed('A')) x += 0.1f;
-		if (renderer.canvas.keyPressed('D')) x += -0.1f;
-		if (renderer.canvas.keyPressed('W')) z += 0.1f;
-		if (renderer.canvas.keyPressed('S')) z += -0.1f;
-		if (renderer.canvas.keyPressed('Q')) y += 0.1f;
-		if (renderer.canvas.keyPressed('E')) y += -0.1f;
-
-		// Apply transformations to the camera
-		camera = matrix::makeTranslation(x, y, z);
+		if (pipeline) {
+			timer.reset();
+			pipeline->frame(scene.meshes, scene.L, update);
+			timer.elapsed();
+			continue;
+		}
 
-		// Rotate each cube in the grid
-		for (unsigned int i = 0; i < rotations.size(); i++)
-			scene[i]->world = scene[i]->world * matrix::makeRotateXYZ(rotations[i].x, rotations[i].y, rotations[i].z);
+		renderer.clear(); // Clear the canvas for the next frame
 
-		// update view projection matrix before rendering
-		renderer.updateVP(camera);
+		scene.step(renderer);
 
 		timer.reset();
 
-		render(scene, renderer, L);
+		render(scene.meshes, renderer, scene.L);
 
 		timer.elapsed();
 
 		renderer.present(); // Display the rendered frame
 	}
 
-	for (auto& m : scene)
-		delete m;
-}
\ No newline at end of file
+	if (pipeline) pipeline->finish();
+}
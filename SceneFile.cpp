@@ -0,0 +1,618 @@
+#include "Includes.h"
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+
+// Scene description files.
+// Plain text, one statement per line, '#' starts a comment. Angles are in radians, distances
+// in world units, animation speeds are per frame.
+//
+//   light <dx dy dz> <r g b> <ambient r g b> [shadows [distance]]
+//                                                      light direction and colours, shadows draws a
+//                                                      shadow map covering distance in front of the camera
+//   point-light <x y z> <r g b> <radius>               point light reaching up to radius
+//   spot-light <x y z> <dx dy dz> <r g b> <radius> <outer> <inner>
+//                                                      spot light pointing along d, fading out between
+//                                                      the inner and outer cone half angles,
+//                                                      a trailing "shadows" gives it a shadow map
+//   random-point-lights <count> <x1 y1 z1> <x2 y2 z2> <radius> <intensity>
+//                                                      point lights of random colour placed in the box
+//   geometry <name> cube <size>                        geometry instances refer to by name
+//   geometry <name> sphere <radius> <latitudes> <longitudes>
+//   geometry <name> rectangle <x1 y1 x2 y2>
+//   texture <name> <file> [bilinear]                   PPM, TGA or QOI colour texture (path relative to the
+//                                                      scene file), filtered trilinearly unless bilinear,
+//                                                      levels finer than 64 texels stream in as they are sampled
+//   texture <name> checker <size> <squares> <r g b> <r g b> [bilinear]
+//                                                      checkerboard of size texels
+//   instance <geometry> [options]                      one mesh
+//   grid <geometry> <nx ny nz> <sx sy sz> [options]    nx * ny * nz meshes, mesh (i, j, k) placed at
+//                                                      the "at" position + (i * sx, j * sy, k * sz)
+//   camera <x y z>                                     fixed camera position, looking down -z
+//   camera-path <speed> loop|pingpong <x y z> <x y z> ...
+//                                                      camera moving along a polyline, a loop returns
+//                                                      to the first point, pingpong turns at the ends
+//
+// instance and grid options:
+//   at <x y z>                  position
+//   rotate <rx ry rz>           fixed rotation
+//   random-rotation             random rotation around one axis (makeRandomRotation)
+//   scale <s>                   uniform scale
+//   spin <rx ry rz>             rotation added every frame
+//   random-spin <s>             spin with every axis random in [-s, s]
+//   bounce <dx dy dz> <distance> <speed>
+//                               moves along the direction and back, up to distance from its position
+//   name <label>                names a single instance so later statements can attach to it
+//   parent <label>              placement is relative to the named instance and follows its animation
+//   shading <model>             unlit, flat, gouraud (lit per vertex), lambert (default) or blinn-phong
+//   specular <ks> <shininess>   specular highlight of blinn-phong
+//   no-depth-test               drawn over everything in front of it
+//   no-depth-write              hides nothing drawn after it
+//   no-colour-write             only writes depth (occluder)
+//   texture <name>              colour texture multiplying the vertex colour
+//   texture-repeat <n>          times the texture repeats across the mesh
+//
+// Instances share the vertices of their geometry (Mesh::makeInstance), so a file can hold
+// millions of them. Lines are parsed in parallel chunks and the meshes are built with
+// parallelGenerate, the random values only depend on the seed. Point and spot lights light the
+// lambert and blinn-phong meshes, every pixel only sees the lights reaching its screen tile.
+
+// one instance or grid statement
+struct instanceSpec {
+	std::string geometry;				// geometry name
+	unsigned int line = 0;				// line in the file
+	unsigned int count[3] = { 1, 1, 1 };// grid size
+	float spacing[3] = { 0.f, 0.f, 0.f };
+	float position[3] = { 0.f, 0.f, 0.f };
+	float rotate[3] = { 0.f, 0.f, 0.f };
+	bool randomRotation = false;
+	float scale = 1.f;
+	float spin[3] = { 0.f, 0.f, 0.f };
+	float randomSpin = 0.f;
+	float bounce[3] = { 0.f, 0.f, 0.f };	// bounce direction
+	float bounceDistance = 0.f, bounceSpeed = 0.f;
+	std::string name;					// label of a single instance
+	std::string parentName;				// label of the parent instance
+	std::string texture;				// texture name
+	Material material;					// shading model and pixel features
+
+	unsigned int first = 0;				// index of the first mesh
+	unsigned int firstAnimated = 0;		// index of the first instance in the scene animation
+	unsigned int firstBouncing = 0;		// index of the first bounce state
+	const Mesh* source = nullptr;		// resolved geometry
+	int parentNode = -1;				// resolved parent transform node
+
+	unsigned long long meshCount() const { return (unsigned long long)count[0] * count[1] * count[2]; }
+	bool animated() const { return randomSpin != 0.f || spin[0] != 0.f || spin[1] != 0.f || spin[2] != 0.f || bouncing(); }
+	bool bouncing() const { return bounceSpeed != 0.f; }
+};
+
+// one parsed line
+struct statement {
+	enum Kind { Light, PointLight, SpotLight, RandomPointLights, Geometry, TextureImage, Instance, Camera, CameraPath } kind;
+	unsigned int line = 0;
+	std::string name;					// geometry name
+	std::string word;					// geometry shape, camera path mode, texture file
+	std::string option;					// texture filter
+	std::vector<float> numbers;			// numeric arguments in order
+	instanceSpec instance;				// instance and grid statements
+};
+
+// Words and numbers of one line
+struct lineReader {
+	const char* p;
+	const char* end;
+
+	void skipSpace() {
+		while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+	}
+
+	bool done() {
+		skipSpace();
+		return p >= end || *p == '#';
+	}
+
+	bool word(std::string& out) {
+		if (done()) return false;
+		const char* start = p;
+		while (p < end && *p != ' ' && *p != '\t' && *p != '\r') p++;
+		out.assign(start, p);
+		return true;
+	}
+
+	bool number(float& out) {
+		if (done()) return false;
+		char* stop;
+		out = strtof(p, &stop);
+		if (stop == p || (stop < end && *stop != ' ' && *stop != '\t' && *stop != '\r')) return false;
+		p = stop;
+		return true;
+	}
+
+	bool numbers(float* out, int count) {
+		for (int i = 0; i < count; i++)
+			if (!number(out[i])) return false;
+		return true;
+	}
+};
+
+// Returns true if a count read as float can be converted to an integer, least <= v < limit
+// (false for NaN, a conversion out of range is undefined behaviour)
+static bool countInRange(float v, float least, float limit) {
+	return v >= least && v < limit;
+}
+
+// Parses the options of an instance or grid statement
+static bool parseInstanceOptions(lineReader& r, instanceSpec& spec, std::string& error) {
+	std::string option;
+	while (r.word(option)) {
+		bool ok = true;
+		if (option == "at") ok = r.numbers(spec.position, 3);
+		else if (option == "rotate") ok = r.numbers(spec.rotate, 3);
+		else if (option == "random-rotation") spec.randomRotation = true;
+		else if (option == "scale") ok = r.number(spec.scale);
+		else if (option == "spin") ok = r.numbers(spec.spin, 3);
+		else if (option == "random-spin") ok = r.number(spec.randomSpin);
+		else if (option == "bounce") ok = r.numbers(spec.bounce, 3) && r.number(spec.bounceDistance) && r.number(spec.bounceSpeed);
+		else if (option == "name") ok = r.word(spec.name);
+		else if (option == "parent") ok = r.word(spec.parentName);
+		else if (option == "shading") {
+			std::string model;
+			ok = r.word(model);
+			unsigned int m = 0;
+			while (ok && m < SHADING_MODELS && model != shadingModelNames[m]) m++;
+			if (m == SHADING_MODELS) ok = false;
+			else spec.material.model = static_cast<ShadingModel>(m);
+		}
+		else if (option == "specular") ok = r.number(spec.material.ks) && r.number(spec.material.shininess);
+		else if (option == "no-depth-test") spec.material.features &= ~PIXEL_DEPTH_TEST;
+		else if (option == "no-depth-write") spec.material.features &= ~PIXEL_DEPTH_WRITE;
+		else if (option == "no-colour-write") spec.material.features &= ~PIXEL_COLOUR_WRITE;
+		else if (option == "texture") ok = r.word(spec.texture);
+		else if (option == "texture-repeat") ok = r.number(spec.material.textureRepeat);
+		else {
+			error = "unknown option '" + option + "'";
+			return false;
+		}
+		if (!ok) {
+			error = "bad arguments of '" + option + "'";
+			return false;
+		}
+	}
+	return true;
+}
+
+// Parses one line
+// Output Variables:
+// - s : statement of the line
+// - error : reason when the line is invalid
+// Returns false for empty lines and errors (error is set for errors only).
+static bool parseLine(lineReader r, unsigned int line, statement& s, std::string& error) {
+	std::string keyword;
+	if (!r.word(keyword)) return false;
+	s.line = line;
+	s.numbers.clear();
+	s.word.clear();
+	s.option.clear();
+
+	float value;
+	if (keyword == "light") {
+		s.kind = statement::Light;
+		while (r.number(value)) s.numbers.push_back(value);
+		if (s.numbers.size() != 9) error = "light needs direction, colour and ambient colour (9 numbers)";
+		else if (r.word(s.word)) {
+			if (s.word != "shadows") error = "unknown light option '" + s.word + "'";
+			else if (r.number(value)) s.numbers.push_back(value);
+		}
+	}
+	else if (keyword == "point-light") {
+		s.kind = statement::PointLight;
+		while (r.number(value)) s.numbers.push_back(value);
+		if (s.numbers.size() != 7) error = "point-light needs a position, colour and radius (7 numbers)";
+	}
+	else if (keyword == "spot-light") {
+		s.kind = statement::SpotLight;
+		while (r.number(value)) s.numbers.push_back(value);
+		if (s.numbers.size() != 12) error = "spot-light needs a position, direction, colour, radius and two angles (12 numbers)";
+		else if (r.word(s.word) && s.word != "shadows") error = "unknown spot-light option '" + s.word + "'";
+	}
+	else if (keyword == "random-point-lights") {
+		s.kind = statement::RandomPointLights;
+		while (r.number(value)) s.numbers.push_back(value);
+		if (s.numbers.size() != 9 || !countInRange(s.numbers[0], 0.f, 4294967296.f)) error = "random-point-lights needs a count, two corners, a radius and an intensity (9 numbers)";
+	}
+	else if (keyword == "geometry") {
+		s.kind = statement::Geometry;
+		const std::string& shape = s.word;
+		if (!r.word(s.name) || !r.word(s.word)) error = "geometry needs a name and a shape";
+		while (r.number(value)) s.numbers.push_back(value);
+		size_t expected = shape == "cube" ? 1 : shape == "sphere" ? 3 : shape == "rectangle" ? 4 : 0;
+		if (error.empty() && expected == 0) error = "unknown shape '" + shape + "'";
+		else if (error.empty() && s.numbers.size() != expected) error = "wrong number of arguments for " + shape;
+		else if (error.empty() && shape == "sphere" && (!countInRange(s.numbers[1], 2.f, 65536.f) || !countInRange(s.numbers[2], 3.f, 65536.f)))
+			error = "a sphere needs 2 to 65535 latitudes and 3 to 65535 longitudes";
+	}
+	else if (keyword == "texture") {
+		s.kind = statement::TextureImage;
+		if (!r.word(s.name) || !r.word(s.word)) error = "texture needs a name and a file";
+		while (r.number(value)) s.numbers.push_back(value);
+		if (error.empty() && s.numbers.size() != (s.word == "checker" ? 8u : 0u))
+			error = s.word == "checker" ? "checker needs a size, a square count and two colours (8 numbers)" : "unexpected numbers after the texture file";
+		else if (error.empty() && s.word == "checker" && (!countInRange(s.numbers[0], 1.f, 16385.f) || !countInRange(s.numbers[1], 1.f, 16385.f)))
+			error = "bad checker size";
+		else if (error.empty() && r.word(s.option) && s.option != "bilinear") error = "unknown texture option '" + s.option + "'";
+	}
+	else if (keyword == "instance" || keyword == "grid") {
+		s.kind = statement::Instance;
+		s.instance = instanceSpec();
+		s.instance.line = line;
+		if (!r.word(s.instance.geometry)) error = keyword + " needs a geometry name";
+		else if (keyword == "grid") {
+			float n[3] = { 1.f, 1.f, 1.f };
+			if (!r.numbers(n, 3) || !r.numbers(s.instance.spacing, 3))
+				error = "grid needs a size and a spacing";
+			else if (!countInRange(n[0], 1.f, 4294967296.f) || !countInRange(n[1], 1.f, 4294967296.f) || !countInRange(n[2], 1.f, 4294967296.f))
+				error = "grid size must be between 1 and 4294967295";
+			else for (int a = 0; a < 3; a++)
+				s.instance.count[a] = static_cast<unsigned int>(n[a]);
+		}
+		if (error.empty()) parseInstanceOptions(r, s.instance, error);
+	}
+	else if (keyword == "camera") {
+		s.kind = statement::Camera;
+		while (r.number(value)) s.numbers.push_back(value);
+		if (s.numbers.size() != 3) error = "camera needs a position";
+	}
+	else if (keyword == "camera-path") {
+		s.kind = statement::CameraPath;
+		if (!r.number(value) || !r.word(s.word) || (s.word != "loop" && s.word != "pingpong"))
+			error = "camera-path needs a speed and loop or pingpong";
+		s.numbers.push_back(value);
+		while (r.number(value)) s.numbers.push_back(value);
+		if (error.empty() && (s.numbers.size() < 7 || (s.numbers.size() - 1) % 3 != 0))
+			error = "camera-path needs at least two points";
+	}
+	else
+		error = "unknown statement '" + keyword + "'";
+
+	if (error.empty() && !r.done()) error = "unexpected '" + std::string(r.p, r.end) + "'";
+	return error.empty();
+}
+
+// Statements of a range of lines
+struct parsedChunk {
+	std::vector<statement> statements;
+	std::string error;		// first error in the chunk, prefixed with its line
+};
+
+// Parses the lines of a chunk
+// Input Variables:
+// - begin, end : text of the chunk (whole lines)
+// - firstLine : line number of the first line
+static void parseChunk(const char* begin, const char* end, unsigned int firstLine, parsedChunk& out) {
+	unsigned int line = firstLine;
+	statement s;
+	for (const char* p = begin; p < end; line++) {
+		const char* eol = static_cast<const char*>(memchr(p, '\n', end - p));
+		if (!eol) eol = end;
+		std::string error;
+		if (parseLine({ p, eol }, line, s, error))
+			out.statements.push_back(s);
+		else if (!error.empty()) {
+			out.error = "line " + std::to_string(line) + ": " + error;
+			return;
+		}
+		p = eol + 1;
+	}
+}
+
+// per frame state of a bouncing mesh (spinning is left to the scene animation)
+struct bouncingMesh {
+	unsigned int animation;	// instance in the scene animation
+	vec4 position;			// position without the bounce offset
+	vec4 direction;			// bounce direction
+	float offset = 0.f, step = 0.f, distance = 0.f;
+};
+
+// camera moving along a polyline
+struct cameraPath {
+	std::vector<vec4> points;
+	std::vector<float> lengths;	// length of each segment
+	float total = 0.f;			// length of the polyline
+	float speed = 0.f;			// distance per frame
+	bool pingpong = false;
+	float distance = 0.f;		// distance travelled from the first point
+
+	vec4 position() const {
+		float d = distance;
+		for (size_t i = 0; i < lengths.size(); i++) {
+			if (d <= lengths[i] || i + 1 == lengths.size()) {
+				float t = lengths[i] > 0.f ? min(d / lengths[i], 1.f) : 0.f;
+				return points[i] + (points[i + 1] - points[i]) * t;
+			}
+			d -= lengths[i];
+		}
+		return points[0];
+	}
+
+	void advance() {
+		distance += speed;
+		if (pingpong) {
+			if (distance > total || distance < 0.f) {
+				speed = -speed;
+				distance = distance > total ? total : 0.f;
+			}
+		}
+		else if (total > 0.f)
+			distance = std::fmod(distance, total);
+	}
+};
+
+// Everything the update function of a loaded scene needs
+struct sceneFileState {
+	SpinAnimator* animation;
+	std::vector<bouncingMesh> bouncing;
+	cameraPath path;
+	vec4 camera;
+};
+
+bool loadSceneFile(const std::string& filename, Scene& scene, unsigned int seed) {
+	std::ifstream file(filename, std::ios::binary);
+	if (!file) {
+		std::cerr << "could not open " << filename << std::endl;
+		return false;
+	}
+	std::stringstream buffer;
+	buffer << file.rdbuf();
+	std::string text = buffer.str();
+
+	// split the text into chunks of whole lines and parse them in parallel
+	unsigned int totalThreads = max(1u, std::thread::hardware_concurrency());
+	size_t chunkSize = std::max<size_t>(text.size() / totalThreads + 1, 1 << 16);
+	std::vector<const char*> starts;
+	std::vector<unsigned int> firstLines;
+	const char* end = text.data() + text.size();
+	unsigned int line = 1;
+	for (const char* p = text.data(); p < end;) {
+		const char* stop = min(p + chunkSize, end);
+		const char* eol = static_cast<const char*>(memchr(stop, '\n', end - stop));
+		stop = eol ? eol + 1 : end;
+		starts.push_back(p);
+		firstLines.push_back(line);
+		line += static_cast<unsigned int>(std::count(p, stop, '\n'));
+		p = stop;
+	}
+	starts.push_back(end);
+
+	std::vector<parsedChunk> chunks(firstLines.size());
+	std::vector<std::thread> threads;
+	for (size_t c = 0; c < chunks.size(); c++)
+		threads.emplace_back(parseChunk, starts[c], starts[c + 1], firstLines[c], std::ref(chunks[c]));
+	for (auto& t : threads)
+		t.join();
+
+	// apply the statements in file order
+	auto fail = [&](const std::string& error) {
+		std::cerr << filename << ": " << error << std::endl;
+		return false;
+	};
+	auto state = std::make_shared<sceneFileState>();
+	state->animation = &scene.animation;
+	state->camera = vec4(0.f, 0.f, 0.f);
+	std::unordered_map<std::string, const Mesh*> geometry;
+	std::unordered_map<std::string, const Texture*> textures;
+	std::unordered_map<std::string, int> named;		// transform nodes of named instances
+	std::vector<instanceSpec> instances;
+	unsigned int meshCount = 0, animatedCount = 0, bouncingCount = 0;
+	RandomStream lightRng(seed ^ 0x6c69676874ull);	// random lights, a stream apart from the mesh streams
+	for (auto& chunk : chunks) {
+		if (!chunk.error.empty()) return fail(chunk.error);
+		for (auto& s : chunk.statements) {
+			const std::vector<float>& n = s.numbers;
+			switch (s.kind) {
+			case statement::Light:
+				scene.L.omega_i = vec4(n[0], n[1], n[2], 0.f);
+				scene.L.L = color(n[3], n[4], n[5]);
+				scene.L.ambient = color(n[6], n[7], n[8]);
+				scene.L.castShadows = s.word == "shadows";
+				if (s.numbers.size() == 10) scene.L.shadowDistance = n[9];
+				break;
+			case statement::PointLight:
+				scene.L.locals.push_back(makePointLight(vec4(n[0], n[1], n[2]), color(n[3], n[4], n[5]), n[6]));
+				break;
+			case statement::SpotLight:
+				scene.L.locals.push_back(makeSpotLight(vec4(n[0], n[1], n[2]), vec4(n[3], n[4], n[5], 0.f),
+					color(n[6], n[7], n[8]), n[9], n[10], n[11]));
+				scene.L.locals.back().castShadows = s.word == "shadows";
+				break;
+			case statement::RandomPointLights:
+				for (unsigned int i = 0; i < static_cast<unsigned int>(n[0]); i++) {
+					vec4 position(lightRng.getRandomFloat(n[1], n[4]), lightRng.getRandomFloat(n[2], n[5]), lightRng.getRandomFloat(n[3], n[6]));
+					color c(lightRng.getRandomFloat(0.f, n[8]), lightRng.getRandomFloat(0.f, n[8]), lightRng.getRandomFloat(0.f, n[8]));
+					scene.L.locals.push_back(makePointLight(position, c, n[7]));
+				}
+				break;
+			case statement::Geometry: {
+				const std::string& shape = s.word;
+				Mesh* m = new Mesh();
+				if (shape == "cube") *m = Mesh::makeCube(n[0]);
+				else if (shape == "rectangle") *m = Mesh::makeRectangle(n[0], n[1], n[2], n[3]);
+				else *m = Mesh::makeSphere(n[0], static_cast<int>(n[1]), static_cast<int>(n[2]));
+				scene.geometry.push_back(m);
+				geometry[s.name] = m;
+				break;
+			}
+			case statement::TextureImage: {
+				Texture* t = new Texture();
+				scene.textures.push_back(t);
+				if (s.word == "checker")
+					t->makeChecker(static_cast<int>(n[0]), static_cast<int>(n[1]), color(n[2], n[3], n[4]), color(n[5], n[6], n[7]));
+				else {
+					// relative to the directory of the scene file
+					std::string path = s.word;
+					size_t slash = filename.find_last_of("/\\");
+					if (slash != std::string::npos && path[0] != '/' && path[0] != '\\' && path.find(':') == std::string::npos)
+						path = filename.substr(0, slash + 1) + path;
+					std::string error;
+					if (!scene.streaming.add(t, path, error)) return fail("line " + std::to_string(s.line) + ": " + error);
+				}
+				if (s.option == "bilinear") t->setFilter(TextureFilter::Bilinear);
+				textures[s.name] = t;
+				break;
+			}
+			case statement::Instance: {
+				auto g = geometry.find(s.instance.geometry);
+				if (g == geometry.end())
+					return fail("line " + std::to_string(s.line) + ": unknown geometry '" + s.instance.geometry + "'");
+				instances.push_back(s.instance);
+				instanceSpec& spec = instances.back();
+				spec.source = g->second;
+				if (!spec.texture.empty()) {
+					auto t = textures.find(spec.texture);
+					if (t == textures.end())
+						return fail("line " + std::to_string(s.line) + ": unknown texture '" + spec.texture + "'");
+					spec.material.texture = t->second;
+				}
+				if (!spec.parentName.empty()) {
+					auto p = named.find(spec.parentName);
+					if (p == named.end())
+						return fail("line " + std::to_string(s.line) + ": unknown parent '" + spec.parentName + "'");
+					spec.parentNode = p->second;
+				}
+				if (!spec.name.empty()) {
+					if (spec.meshCount() != 1)
+						return fail("line " + std::to_string(s.line) + ": only single instances can be named");
+					named[spec.name] = static_cast<int>(meshCount);
+				}
+				spec.first = meshCount;
+				spec.firstAnimated = animatedCount;
+				spec.firstBouncing = bouncingCount;
+				if (meshCount + spec.meshCount() > 0xFFFFFFFFull)
+					return fail("line " + std::to_string(s.line) + ": too many meshes");
+				meshCount += static_cast<unsigned int>(spec.meshCount());
+				if (spec.animated()) animatedCount += static_cast<unsigned int>(spec.meshCount());
+				if (spec.bouncing()) bouncingCount += static_cast<unsigned int>(spec.meshCount());
+				break;
+			}
+			case statement::Camera:
+				state->camera = vec4(n[0], n[1], n[2]);
+				break;
+			case statement::CameraPath: {
+				cameraPath& path = state->path;
+				path = cameraPath();
+				path.speed = n[0];
+				path.pingpong = s.word == "pingpong";
+				for (size_t i = 1; i + 2 < n.size(); i += 3)
+					path.points.push_back(vec4(n[i], n[i + 1], n[i + 2]));
+				if (!path.pingpong) path.points.push_back(path.points[0]); // close the loop
+				for (size_t i = 0; i + 1 < path.points.size(); i++) {
+					vec4 d = path.points[i + 1] - path.points[i];
+					path.lengths.push_back(std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]));
+					path.total += path.lengths.back();
+				}
+				break;
+			}
+			}
+		}
+	}
+
+	// build the meshes in parallel, mesh i draws from the random stream of its block
+	scene.meshes.resize(meshCount);
+	scene.transforms.resize(meshCount);
+	scene.animation.resize(animatedCount);
+	state->bouncing.resize(bouncingCount);
+	parallelGenerate(meshCount, seed, [&](unsigned int i, RandomStream& rng) {
+		// statement that created mesh i
+		auto it = std::upper_bound(instances.begin(), instances.end(), i, [](unsigned int i, const instanceSpec& s) { return i < s.first; });
+		const instanceSpec& spec = *(it - 1);
+		unsigned int local = i - spec.first;
+		unsigned int gx = local / (spec.count[1] * spec.count[2]), gy = (local / spec.count[2]) % spec.count[1], gz = local % spec.count[2];
+
+		vec4 position(spec.position[0] + gx * spec.spacing[0], spec.position[1] + gy * spec.spacing[1], spec.position[2] + gz * spec.spacing[2]);
+		matrix rotation = matrix::makeRotateXYZ(spec.rotate[0], spec.rotate[1], spec.rotate[2]);
+		if (spec.randomRotation) rotation = rotation * makeRandomRotation(rng);
+		if (spec.scale != 1.f) rotation = rotation * matrix::makeScale(spec.scale);
+
+		Mesh* m = new Mesh(Mesh::makeInstance(*spec.source));
+		m->material = spec.material;
+		matrix transform = matrix::makeTranslation(position[0], position[1], position[2]) * rotation;
+		scene.meshes[i] = m;
+		scene.transforms.set(i, transform, spec.parentNode, m);
+
+		if (!spec.animated()) return;
+		float spin[3] = { spec.spin[0], spec.spin[1], spec.spin[2] };
+		if (spec.randomSpin != 0.f)
+			for (int k = 0; k < 3; k++) spin[k] += rng.getRandomFloat(-spec.randomSpin, spec.randomSpin);
+		unsigned int animation = spec.firstAnimated + local;
+		scene.animation.set(animation, static_cast<int>(i), transform, spin[0], spin[1], spin[2]);
+
+		if (!spec.bouncing()) return;
+		bouncingMesh& b = state->bouncing[spec.firstBouncing + local];
+		b.animation = animation;
+		b.position = position;
+		b.direction = vec4(spec.bounce[0], spec.bounce[1], spec.bounce[2], 0.f);
+		b.step = spec.bounceSpeed;
+		b.distance = spec.bounceDistance;
+	});
+
+	scene.update = [state](Renderer& renderer) {
+		for (auto& b : state->bouncing) {
+			b.offset += b.step;
+			if (b.offset > b.distance || b.offset < -b.distance)
+				b.step *= -1.f;
+			vec4 p = b.position + b.direction * b.offset;
+			state->animation->setPosition(b.animation, p[0], p[1], p[2]);
+		}
+
+		vec4 eye = state->camera;
+		if (!state->path.points.empty()) {
+			eye = state->path.position();
+			state->path.advance();
+		}
+		// update view projection matrix before rendering
+		renderer.updateVP(matrix::makeTranslation(-eye[0], -eye[1], -eye[2]));
+	};
+	return true;
+}
+
+// Renders scene files, keys 1-9 switch to the n-th file and R reloads the current one
+// Input Variables:
+// - files : scene files
+void sceneFiles(const std::vector<std::string>& files) {
+	Renderer renderer;
+	std::unique_ptr<Scene> scene = std::make_unique<Scene>();
+	int current = 0;
+	if (files.empty() || !loadSceneFile(files[0], *scene, std::random_device{}())) return;
+
+	bool wasPressed = false;
+	while (true) {
+		renderer.canvas.checkInput();
+		if (renderer.canvas.keyPressed(VK_ESCAPE) || renderer.canvas.IsQuit()) break;
+
+		// switch on key press, not while the key is held
+		int requested = -1;
+		for (int k = 0; k < 9 && k < static_cast<int>(files.size()); k++)
+			if (renderer.canvas.keyPressed('1' + k)) requested = k;
+		if (renderer.canvas.keyPressed('R')) requested = current;
+		if (requested >= 0 && !wasPressed) {
+			std::unique_ptr<Scene> next = std::make_unique<Scene>();
+			if (loadSceneFile(files[requested], *next, std::random_device{}())) {
+				scene = std::move(next);
+				current = requested;
+			}
+		}
+		wasPressed = requested >= 0;
+
+		renderer.clear();
+
+		scene->step(renderer);
+
+		render(scene->meshes, renderer, scene->L);
+
+		renderer.present();
+	}
+}
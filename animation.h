@@ -0,0 +1,205 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <cmath>
+#include <immintrin.h>
+#include "matrix.h"
+#include "simdMath.h"
+#include "transforms.h"
+#include "workerPool.h"
+
+// Spinning instances.
+// Every instance is a translation, a uniform scale and an orientation quaternion that turns
+// with a constant angular velocity. The state is stored as structure of arrays padded to
+// groups of eight, update() integrates eight instances per step in AVX2 registers (one sincos
+// per lane for the frame rotation), renormalises the quaternions so repeated products do not
+// drift, and writes the resulting local matrices into the transform hierarchy.
+class SpinAnimator {
+	std::vector<int> node;					// transform node per instance, -1 for padding
+	std::vector<float> qw, qx, qy, qz;		// orientation quaternion
+	std::vector<float> wx, wy, wz;			// angular velocity (axis * radians per frame)
+	std::vector<float> tx, ty, tz;			// translation
+	std::vector<float> scale;				// uniform scale
+	unsigned int count = 0;					// instances
+
+	// groups of at least this many are split between the threads of WorkerPool::shared(), fewer
+	// are updated on the calling thread
+	static const unsigned int PARALLEL_GROUPS = 256;
+
+	// scalar quaternion used while setting instances up
+	struct quat { float w, x, y, z; };
+
+	static quat multiply(const quat& a, const quat& b) {
+		return { a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z,
+			a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+			a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+			a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w };
+	}
+
+	// Quaternion of a rotation matrix (upper 3x3, rows r0-r2)
+	static quat fromRotation(const float r[3][3]) {
+		quat q;
+		float trace = r[0][0] + r[1][1] + r[2][2];
+		if (trace > 0.f) {
+			float s = std::sqrt(trace + 1.f) * 2.f;
+			q = { 0.25f * s, (r[2][1] - r[1][2]) / s, (r[0][2] - r[2][0]) / s, (r[1][0] - r[0][1]) / s };
+		}
+		else if (r[0][0] > r[1][1] && r[0][0] > r[2][2]) {
+			float s = std::sqrt(1.f + r[0][0] - r[1][1] - r[2][2]) * 2.f;
+			q = { (r[2][1] - r[1][2]) / s, 0.25f * s, (r[0][1] + r[1][0]) / s, (r[0][2] + r[2][0]) / s };
+		}
+		else if (r[1][1] > r[2][2]) {
+			float s = std::sqrt(1.f + r[1][1] - r[0][0] - r[2][2]) * 2.f;
+			q = { (r[0][2] - r[2][0]) / s, (r[0][1] + r[1][0]) / s, 0.25f * s, (r[1][2] + r[2][1]) / s };
+		}
+		else {
+			float s = std::sqrt(1.f + r[2][2] - r[0][0] - r[1][1]) * 2.f;
+			q = { (r[1][0] - r[0][1]) / s, (r[0][2] + r[2][0]) / s, (r[1][2] + r[2][1]) / s, 0.25f * s };
+		}
+		float n = 1.f / std::sqrt(q.w * q.w + q.x * q.x + q.y * q.y + q.z * q.z);
+		return { q.w * n, q.x * n, q.y * n, q.z * n };
+	}
+
+	// Integrates groups [begin, end) and writes their local matrices
+	void updateGroups(unsigned int begin, unsigned int end, TransformHierarchy& transforms, float dt) {
+		const __m256 halfDt = _mm256_set1_ps(0.5f * dt), one = _mm256_set1_ps(1.f), two = _mm256_set1_ps(2.f);
+		alignas(32) float out[12][8];	// rows 0-2 of the local matrices, one lane per instance
+
+		for (unsigned int g = begin; g < end; g++) {
+			unsigned int i = g * 8;
+			__m256 vx = _mm256_loadu_ps(&wx[i]), vy = _mm256_loadu_ps(&wy[i]), vz = _mm256_loadu_ps(&wz[i]);
+
+			// frame rotation dq = (cos(|w| dt / 2), sin(|w| dt / 2) * w / |w|)
+			__m256 len2 = _mm256_fmadd_ps(vx, vx, _mm256_fmadd_ps(vy, vy, _mm256_mul_ps(vz, vz)));
+			__m256 still = _mm256_cmp_ps(len2, _mm256_set1_ps(1e-24f), _CMP_LT_OQ);
+			__m256 invLen = _mm256_andnot_ps(still, rsqrt8(_mm256_max_ps(len2, _mm256_set1_ps(1e-24f))));
+			__m256 len = _mm256_mul_ps(len2, invLen);
+			__m256 s, c;
+			sincos8(_mm256_mul_ps(len, halfDt), s, c);
+			__m256 k = _mm256_mul_ps(s, invLen);
+			__m256 dw = _mm256_blendv_ps(c, one, still);
+			__m256 dx = _mm256_mul_ps(vx, k), dy = _mm256_mul_ps(vy, k), dz = _mm256_mul_ps(vz, k);
+
+			// q = q * dq
+			__m256 w = _mm256_loadu_ps(&qw[i]), x = _mm256_loadu_ps(&qx[i]), y = _mm256_loadu_ps(&qy[i]), z = _mm256_loadu_ps(&qz[i]);
+			__m256 nw = _mm256_fnmadd_ps(z, dz, _mm256_fnmadd_ps(y, dy, _mm256_fnmadd_ps(x, dx, _mm256_mul_ps(w, dw))));
+			__m256 nx = _mm256_fnmadd_ps(z, dy, _mm256_fmadd_ps(y, dz, _mm256_fmadd_ps(x, dw, _mm256_mul_ps(w, dx))));
+			__m256 ny = _mm256_fmadd_ps(z, dx, _mm256_fmadd_ps(y, dw, _mm256_fnmadd_ps(x, dz, _mm256_mul_ps(w, dy))));
+			__m256 nz = _mm256_fmadd_ps(z, dw, _mm256_fnmadd_ps(y, dx, _mm256_fmadd_ps(x, dy, _mm256_mul_ps(w, dz))));
+
+			// renormalise against drift
+			__m256 n = rsqrt8(_mm256_fmadd_ps(nw, nw, _mm256_fmadd_ps(nx, nx, _mm256_fmadd_ps(ny, ny, _mm256_mul_ps(nz, nz)))));
+			w = _mm256_mul_ps(nw, n); x = _mm256_mul_ps(nx, n); y = _mm256_mul_ps(ny, n); z = _mm256_mul_ps(nz, n);
+			_mm256_storeu_ps(&qw[i], w); _mm256_storeu_ps(&qx[i], x); _mm256_storeu_ps(&qy[i], y); _mm256_storeu_ps(&qz[i], z);
+
+			// local = translation * rotation(q) * scale
+			__m256 sc = _mm256_loadu_ps(&scale[i]);
+			__m256 s2 = _mm256_mul_ps(two, sc);
+			__m256 xx = _mm256_mul_ps(x, x), yy = _mm256_mul_ps(y, y), zz = _mm256_mul_ps(z, z);
+			__m256 xy = _mm256_mul_ps(x, y), xz = _mm256_mul_ps(x, z), yz = _mm256_mul_ps(y, z);
+			__m256 wxq = _mm256_mul_ps(w, x), wyq = _mm256_mul_ps(w, y), wzq = _mm256_mul_ps(w, z);
+			_mm256_store_ps(out[0], _mm256_fnmadd_ps(s2, _mm256_add_ps(yy, zz), sc));
+			_mm256_store_ps(out[1], _mm256_mul_ps(s2, _mm256_sub_ps(xy, wzq)));
+			_mm256_store_ps(out[2], _mm256_mul_ps(s2, _mm256_add_ps(xz, wyq)));
+			_mm256_store_ps(out[3], _mm256_loadu_ps(&tx[i]));
+			_mm256_store_ps(out[4], _mm256_mul_ps(s2, _mm256_add_ps(xy, wzq)));
+			_mm256_store_ps(out[5], _mm256_fnmadd_ps(s2, _mm256_add_ps(xx, zz), sc));
+			_mm256_store_ps(out[6], _mm256_mul_ps(s2, _mm256_sub_ps(yz, wxq)));
+			_mm256_store_ps(out[7], _mm256_loadu_ps(&ty[i]));
+			_mm256_store_ps(out[8], _mm256_mul_ps(s2, _mm256_sub_ps(xz, wyq)));
+			_mm256_store_ps(out[9], _mm256_mul_ps(s2, _mm256_add_ps(yz, wxq)));
+			_mm256_store_ps(out[10], _mm256_fnmadd_ps(s2, _mm256_add_ps(xx, yy), sc));
+			_mm256_store_ps(out[11], _mm256_loadu_ps(&tz[i]));
+
+			for (int lane = 0; lane < 8; lane++) {
+				if (node[i + lane] < 0) continue;
+				matrix m; // identity, the last row stays 0 0 0 1
+				for (int e = 0; e < 12; e++)
+					m[e] = out[e][lane];
+				transforms.setLocal(node[i + lane], m);
+			}
+		}
+	}
+
+public:
+	// Sets the number of instances, new instances are padding until set()
+	void resize(unsigned int _count) {
+		count = _count;
+		size_t padded = (count + 7) & ~7u;
+		node.resize(padded, -1);
+		for (auto* v : { &qx, &qy, &qz, &wx, &wy, &wz, &tx, &ty, &tz })
+			v->resize(padded, 0.f);
+		qw.resize(padded, 1.f);
+		scale.resize(padded, 1.f);
+	}
+
+	// Defines an instance created by resize(), instances may be set from several threads at once
+	// Input Variables:
+	// - index : instance index
+	// - _node : transform node receiving the local matrix
+	// - local : initial local matrix (translation * rotation * uniform scale, no shear)
+	// - x, y, z : rotation added every frame, as the angles of matrix::makeRotateXYZ
+	void set(unsigned int index, int _node, matrix local, float x, float y, float z) {
+		node[index] = _node;
+		tx[index] = local[3];
+		ty[index] = local[7];
+		tz[index] = local[11];
+
+		// uniform scale is the length of a basis column
+		float s = std::sqrt(local[0] * local[0] + local[4] * local[4] + local[8] * local[8]);
+		scale[index] = s;
+		float r[3][3];
+		for (int row = 0; row < 3; row++)
+			for (int col = 0; col < 3; col++)
+				r[row][col] = local[row * 4 + col] / s;
+		quat q = fromRotation(r);
+		qw[index] = q.w; qx[index] = q.x; qy[index] = q.y; qz[index] = q.z;
+
+		// makeRotateXYZ is Rx * Ry * Rz, as quaternions qx * qy * qz, stored as axis * angle
+		quat d = multiply(multiply({ std::cos(x * 0.5f), std::sin(x * 0.5f), 0.f, 0.f },
+			{ std::cos(y * 0.5f), 0.f, std::sin(y * 0.5f), 0.f }), { std::cos(z * 0.5f), 0.f, 0.f, std::sin(z * 0.5f) });
+		if (d.w < 0.f) d = { -d.w, -d.x, -d.y, -d.z };	// shortest arc
+		float sinHalf = std::sqrt(d.x * d.x + d.y * d.y + d.z * d.z);
+		float angle = 2.f * std::atan2(sinHalf, d.w);
+		float k = sinHalf > 0.f ? angle / sinHalf : 0.f;
+		wx[index] = d.x * k; wy[index] = d.y * k; wz[index] = d.z * k;
+	}
+
+	// Appends an instance (see set)
+	// Returns the instance index.
+	unsigned int add(int _node, const matrix& local, float x, float y, float z) {
+		unsigned int index = count;
+		resize(count + 1);
+		set(index, _node, local, x, y, z);
+		return index;
+	}
+
+	// Moves an instance, its rotation is kept
+	void setPosition(unsigned int index, float x, float y, float z) {
+		tx[index] = x;
+		ty[index] = y;
+		tz[index] = z;
+	}
+
+	unsigned int size() const { return count; }
+
+	// Advances every instance and writes its local matrix into the hierarchy
+	// Input Variables:
+	// - transforms : hierarchy holding the instance nodes
+	// - dt : frames to advance
+	// - totalThreads : threads for large instance counts (0 for one per hardware thread)
+	void update(TransformHierarchy& transforms, float dt = 1.f, unsigned int totalThreads = 0) {
+		unsigned int groups = (count + 7) / 8;
+		if (totalThreads == 0) totalThreads = max(1u, std::thread::hardware_concurrency());
+		if (groups < PARALLEL_GROUPS || totalThreads == 1) {
+			updateGroups(0, groups, transforms, dt);
+			return;
+		}
+
+		// contiguous chunks on the threads of the shared pool, the calling thread takes the last one
+		WorkerPool::shared().forChunks(0, groups, totalThreads, [&](unsigned int begin, unsigned int end) {
+			updateGroups(begin, end, transforms, dt);
+		});
+	}
+};
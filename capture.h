@@ -0,0 +1,302 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include "framebuffer.h"
+#include "profiler.h"
+
+// File format of captured frames
+enum class CaptureFormat {
+	Raw,	// image sequence of opaque 32-bit RGBA pixels (red first), no header (<prefix>_000000.rgba)
+	PPM,	// image sequence of binary PPM files (<prefix>_000000.ppm)
+	QOI,	// image sequence of QOI files (<prefix>_000000.qoi), lossless and fast to encode
+	Y4M		// one YUV4MPEG2 raw video file (<prefix>.y4m, 4:4:4), readable by ffmpeg and most players
+};
+
+static const char* captureFormatNames[] = { "raw", "ppm", "qoi", "y4m" };
+
+// Streams rendered frames to disk.
+// submit() copies the frame into a buffer from a bounded pool and queues it; a few encoder
+// threads convert and write the frames in the background, so the render thread only pays for
+// one memcpy per frame. Image sequences are written in any order since every frame is its own
+// file, the video container appends frames strictly in submission order. When every pool
+// buffer is queued, submit() waits for an encoder (the disk is the bottleneck at that point)
+// and the wait is counted in getStalls().
+class FrameCapture {
+	// one captured frame
+	struct job {
+		std::vector<unsigned int> pixels;	// copy of the framebuffer
+		unsigned int index = 0;				// frame number in the sequence
+	};
+
+	std::vector<job> pool;
+	std::deque<int> freeJobs;			// pool entries available to submit()
+	std::deque<int> queuedJobs;			// filled entries waiting for an encoder
+	std::vector<std::thread> encoders;
+	std::mutex lock;
+	std::condition_variable changed;
+	bool stopping = false;
+
+	CaptureFormat format = CaptureFormat::PPM;
+	std::string prefix;					// path and file name prefix of the output
+	unsigned int width = 0, height = 0;
+	unsigned int frameCount = 0;		// frames submitted
+	unsigned int stalls = 0;			// submits that had to wait for a free buffer
+
+	std::ofstream video;				// output of the video container
+	unsigned int nextVideoFrame = 0;	// next frame index to append to the video
+
+	// File name of a frame of an image sequence
+	std::string frameName(unsigned int index) const {
+		static const char* ext[] = { "rgba", "ppm", "qoi", "y4m" };
+		char number[16];
+		snprintf(number, sizeof(number), "_%06u.", index);
+		return prefix + number + ext[static_cast<int>(format)];
+	}
+
+	// Packed pixels to tightly packed RGB bytes
+	void toRGB(const unsigned int* pixels, std::vector<unsigned char>& out) const {
+		size_t count = (size_t)width * height;
+		out.resize(count * 3);
+		for (size_t i = 0; i < count; i++) {
+			unsigned int px = pixels[i];
+			out[i * 3 + 0] = static_cast<unsigned char>(px);
+			out[i * 3 + 1] = static_cast<unsigned char>(px >> 8);
+			out[i * 3 + 2] = static_cast<unsigned char>(px >> 16);
+		}
+	}
+
+	// Packed pixels to RGBA words, alpha set to 255 (cleared pixels hold 0)
+	void toRGBA(const unsigned int* pixels, std::vector<unsigned char>& out) const {
+		size_t count = (size_t)width * height;
+		out.resize(count * sizeof(unsigned int));
+		for (size_t i = 0; i < count; i++) {
+			unsigned int px = pixels[i] | 0xFF000000u;
+			memcpy(&out[i * sizeof(unsigned int)], &px, sizeof(px));
+		}
+	}
+
+	// Encodes packed pixels as a QOI image (https://qoiformat.org, 3 channels)
+	void encodeQOI(const unsigned int* pixels, std::vector<unsigned char>& out) const {
+		size_t count = (size_t)width * height;
+		out.clear();
+		out.reserve(14 + count * 4 + 8);
+
+		auto put32 = [&](unsigned int v) {
+			out.push_back(static_cast<unsigned char>(v >> 24));
+			out.push_back(static_cast<unsigned char>(v >> 16));
+			out.push_back(static_cast<unsigned char>(v >> 8));
+			out.push_back(static_cast<unsigned char>(v));
+		};
+		out.insert(out.end(), { 'q', 'o', 'i', 'f' });
+		put32(width);
+		put32(height);
+		out.push_back(3);	// RGB
+		out.push_back(0);	// sRGB with linear alpha
+
+		unsigned int index[64] = {};
+		unsigned int prev = 0xFF000000u;	// r = g = b = 0, a = 255
+		int run = 0;
+		for (size_t i = 0; i < count; i++) {
+			unsigned int px = pixels[i] | 0xFF000000u;	// opaque, as the decoder sees 3 channel pixels
+			if (px == prev) {
+				if (++run == 62) { out.push_back(0xC0 | (run - 1)); run = 0; }
+				continue;
+			}
+			if (run) { out.push_back(0xC0 | (run - 1)); run = 0; }
+
+			int r = px & 0xFF, g = (px >> 8) & 0xFF, b = (px >> 16) & 0xFF;
+			int hash = (r * 3 + g * 5 + b * 7 + 255 * 11) % 64;
+			if (index[hash] == px) {
+				out.push_back(static_cast<unsigned char>(hash));	// QOI_OP_INDEX
+			}
+			else {
+				index[hash] = px;
+				signed char dr = static_cast<signed char>(r - (prev & 0xFF));
+				signed char dg = static_cast<signed char>(g - ((prev >> 8) & 0xFF));
+				signed char db = static_cast<signed char>(b - ((prev >> 16) & 0xFF));
+				signed char drg = dr - dg, dbg = db - dg;
+				if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+					out.push_back(static_cast<unsigned char>(0x40 | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2)));	// QOI_OP_DIFF
+				else if (drg >= -8 && drg <= 7 && dg >= -32 && dg <= 31 && dbg >= -8 && dbg <= 7) {
+					out.push_back(static_cast<unsigned char>(0x80 | (dg + 32)));	// QOI_OP_LUMA
+					out.push_back(static_cast<unsigned char>((drg + 8) << 4 | (dbg + 8)));
+				}
+				else {
+					out.insert(out.end(), { 0xFE, static_cast<unsigned char>(r), static_cast<unsigned char>(g), static_cast<unsigned char>(b) });	// QOI_OP_RGB
+				}
+			}
+			prev = px;
+		}
+		if (run) out.push_back(0xC0 | (run - 1));
+		out.insert(out.end(), { 0, 0, 0, 0, 0, 0, 0, 1 });	// end marker
+	}
+
+	// Converts packed pixels to a planar 4:4:4 Y4M frame (BT.601, studio range)
+	void encodeY4M(const unsigned int* pixels, std::vector<unsigned char>& out) const {
+		static const char header[] = "FRAME\n";
+		size_t count = (size_t)width * height;
+		out.resize(sizeof(header) - 1 + count * 3);
+		memcpy(out.data(), header, sizeof(header) - 1);
+		unsigned char* y = out.data() + sizeof(header) - 1;
+		unsigned char* u = y + count;
+		unsigned char* v = u + count;
+		for (size_t i = 0; i < count; i++) {
+			unsigned int px = pixels[i];
+			int r = px & 0xFF, g = (px >> 8) & 0xFF, b = (px >> 16) & 0xFF;
+			y[i] = static_cast<unsigned char>(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+			u[i] = static_cast<unsigned char>(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+			v[i] = static_cast<unsigned char>(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+		}
+	}
+
+	// Encodes and writes one frame (encoder thread)
+	void encode(const job& j, std::vector<unsigned char>& bytes) {
+		PROFILE_ZONE("encode");
+		if (format == CaptureFormat::Y4M) {
+			encodeY4M(j.pixels.data(), bytes);
+
+			// frames may finish encoding out of order, append them in sequence
+			std::unique_lock<std::mutex> guard(lock);
+			changed.wait(guard, [&] { return nextVideoFrame == j.index; });
+			video.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+			nextVideoFrame++;
+			guard.unlock();
+			changed.notify_all();
+			return;
+		}
+
+		std::ofstream file(frameName(j.index), std::ios::binary);
+		switch (format) {
+		case CaptureFormat::Raw:
+			toRGBA(j.pixels.data(), bytes);
+			file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+			break;
+		case CaptureFormat::PPM:
+			toRGB(j.pixels.data(), bytes);
+			file << "P6\n" << width << " " << height << "\n255\n";
+			file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+			break;
+		default:
+			encodeQOI(j.pixels.data(), bytes);
+			file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+			break;
+		}
+	}
+
+	// Encoder thread: encode queued frames until stopped
+	void run() {
+		std::vector<unsigned char> bytes; // encoding scratch, reused between frames
+		while (true) {
+			int j;
+			{
+				std::unique_lock<std::mutex> guard(lock);
+				changed.wait(guard, [&] { return stopping || !queuedJobs.empty(); });
+				if (queuedJobs.empty()) return; // stopping and nothing left to encode
+				j = queuedJobs.front();
+				queuedJobs.pop_front();
+			}
+
+			encode(pool[j], bytes);
+
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				freeJobs.push_back(j);
+			}
+			changed.notify_all();
+		}
+	}
+
+public:
+	FrameCapture() = default;
+	FrameCapture(const FrameCapture&) = delete;
+	FrameCapture& operator=(const FrameCapture&) = delete;
+
+	// Starts a capture
+	// Input Variables:
+	// - _prefix : path and file name prefix of the output files
+	// - _format : output format
+	// - w, h : size of the frames
+	// - totalEncoders : background encoder threads
+	// - poolSize : frames that can wait for an encoder before submit() blocks
+	// - fps : frame rate stored in the video container
+	// Returns false if the output file could not be created.
+	bool start(const std::string& _prefix, CaptureFormat _format, unsigned int w, unsigned int h,
+		unsigned int totalEncoders = 2, unsigned int poolSize = 6, unsigned int fps = 60)
+	{
+		stop();
+		prefix = _prefix;
+		format = _format;
+		width = w;
+		height = h;
+		frameCount = stalls = nextVideoFrame = 0;
+
+		if (format == CaptureFormat::Y4M) {
+			video.open(prefix + ".y4m", std::ios::binary);
+			if (!video) return false;
+			video << "YUV4MPEG2 W" << width << " H" << height << " F" << fps << ":1 Ip A1:1 C444\n";
+		}
+
+		pool = std::vector<job>(poolSize);
+		freeJobs.clear();
+		for (unsigned int i = 0; i < poolSize; i++) {
+			pool[i].pixels.resize((size_t)width * height);
+			freeJobs.push_back(i);
+		}
+
+		stopping = false;
+		for (unsigned int i = 0; i < totalEncoders; i++)
+			encoders.emplace_back(&FrameCapture::run, this);
+		return true;
+	}
+
+	bool active() const { return !encoders.empty(); }
+
+	// Queues a copy of a finished frame for encoding (render thread)
+	void submit(const Framebuffer& image) {
+		std::unique_lock<std::mutex> guard(lock);
+		if (freeJobs.empty()) {
+			stalls++;
+			changed.wait(guard, [&] { return !freeJobs.empty(); });
+		}
+		int j = freeJobs.front();
+		freeJobs.pop_front();
+		pool[j].index = frameCount++;
+		guard.unlock();
+
+		memcpy(pool[j].pixels.data(), image.data(), pool[j].pixels.size() * sizeof(unsigned int));
+
+		guard.lock();
+		queuedJobs.push_back(j);
+		guard.unlock();
+		changed.notify_all();
+	}
+
+	unsigned int getFrameCount() const { return frameCount; }
+	unsigned int getStalls() const { return stalls; }
+
+	// Encodes the remaining frames, joins the encoders and closes the output
+	void stop() {
+		if (encoders.empty()) return;
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			stopping = true;
+		}
+		changed.notify_all();
+		for (auto& t : encoders)
+			t.join();
+		encoders.clear();
+		if (video.is_open()) video.close();
+	}
+
+	~FrameCapture() {
+		stop();
+	}
+};
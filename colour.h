@@ -1,17 +1,26 @@
 #pragma once
 #include <Windows.h>
+#include <immintrin.h>
 
 // The `colour` class represents an RGB colour with floating-point precision.
 // It provides various utilities for manipulating and converting colours.
-class color {
+// The components are padded to four floats so that the arithmetic works on one SSE register.
+class alignas(16) color {
     union {
         struct {
             float r, g, b; // Red, Green, and Blue components of the colour
         };
-        float rgb[3];     // Array representation of the RGB components
+        float rgb[4];     // Array representation of the RGB components (the fourth is padding, kept at 0)
     };
+
 public:
 
+    // Constructs the colour from an SSE register (red in the lowest lane)
+    explicit color(__m128 v) { _mm_store_ps(rgb, v); }
+
+    // The components as an SSE register
+    __m128 simd() const { return _mm_load_ps(rgb); }
+
     // Enum for indexing the RGB components
     enum Color { RED = 0, GREEN = 1, BLUE = 2 };
 
@@ -21,7 +30,7 @@ public:
     // - _r: Red component (default 0.0f)
     // - _g: Green component (default 0.0f)
     // - _b: Blue component (default 0.0f)
-    color(float _r = 0, float _g = 0, float _b = 0) : r(_r), g(_g), b(_b) {}
+    color(float _r = 0, float _g = 0, float _b = 0) : r(_r), g(_g), b(_b) { rgb[3] = 0.f; }
 
     // Sets the RGB components of the colour.
     // Input Variables:
@@ -39,17 +48,14 @@ public:
     // Assigns the values of another colour to this one.
     // Input Variables:
     // - c: The source color
-    void operator = (color c) {
-        r = c.r;
-        g = c.g;
-        b = c.b;
+    color& operator = (const color& c) {
+        _mm_store_ps(rgb, c.simd());
+        return *this;
     }
 
     // Clamps the RGB components of the colour to the range [0, 1].
     void clampColour() {
-        r = min(r, 1.0f);
-        g = min(g, 1.0f);
-        b = min(b, 1.0f);
+        _mm_store_ps(rgb, _mm_min_ps(simd(), _mm_set1_ps(1.0f)));
     }
 
     // Converts the floating-point RGB values to integer values (0-255).
@@ -72,39 +78,36 @@ public:
         res[2] = static_cast<unsigned char>(std::floor(b * 255));
     }
 
+    // Converts the floating-point RGB values to a packed 32-bit pixel
+    // (red in the lowest byte, alpha set to 255), ready for a single store into the framebuffer.
+    // Components outside [0, 1] saturate to 0 or 255.
+    unsigned int toRGBA() const {
+        __m128i i = _mm_cvttps_epi32(_mm_mul_ps(simd(), _mm_set1_ps(255.f)));
+        i = _mm_packus_epi16(_mm_packs_epi32(i, i), i);
+        return static_cast<unsigned int>(_mm_cvtsi128_si32(i)) | 0xFF000000u;
+    }
+
     // Scales the RGB components of the colour by a scalar value.
     // Input Variables:
     // - scalar: The scaling factor
     // Returns a new `colour` object with scaled components.
-    color operator * (const float& scalar) {
-        color c;
-        c.r = r * scalar;
-        c.g = g * scalar;
-        c.b = b * scalar;
-        return c;
+    color operator * (const float& scalar) const {
+        return color(_mm_mul_ps(simd(), _mm_set1_ps(scalar)));
     }
 
     // Multiplies the RGB components of this colour with another colour.
     // Input Variables:
     // - col: The other color to multiply with
     // Returns a new `colour` object with multiplied components.
-    color operator * (const color& col) {
-        color c;
-        c.r = r * col.r;
-        c.g = g * col.g;
-        c.b = b * col.b;
-        return c;
+    color operator * (const color& col) const {
+        return color(_mm_mul_ps(simd(), col.simd()));
     }
 
     // Adds the RGB components of another colour to this one.
     // Input Variables:
     // - _c: The other colour to add
     // Returns a new `colour` object with added components.
-    color operator + (const color& _c) {
-        color c;
-        c.r = r + _c.r;
-        c.g = g + _c.g;
-        c.b = b + _c.b;
-        return c;
+    color operator + (const color& _c) const {
+        return color(_mm_add_ps(simd(), _c.simd()));
     }
 };
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <concepts>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <bit>
+
+// Storage formats for the depth buffers.
+// Each format describes how a depth value in [0, 1] is stored and compared. Buffers and the
+// renderer are templated on the format, so the depth test compiles to a single compare for
+// every format, without any run time branching on the format.
+//
+// Members every format provides:
+// - storage:		type of one stored depth value
+// - clearValue:	stored value of the farthest depth
+// - reversed:		true if the projection maps the near plane to 1 and the far plane to 0
+// - hasStencil:	true if writes must keep the stencil bits of the stored value
+// - encode/decode:	conversion between depth and storage
+// - nearer(a, b):	true if stored value a is nearer than stored value b
+// - merge(old, d):	value to store when writing encoded depth d over old (keeps stencil bits)
+// - farther(s):	next stored value farther than s (s nearer than clearValue, keeps stencil bits)
+// - key/fromKey:	32-bit key that orders like the depth with the nearest value smallest
+//					(used by the packed depth and colour buffer)
+// - visible(d):	near plane guard applied before the depth test
+
+template<typename F>
+concept DepthStorageFormat = requires(float d, typename F::storage s) {
+	{ F::encode(d) } -> std::same_as<typename F::storage>;
+	{ F::decode(s) } -> std::convertible_to<float>;
+	{ F::nearer(s, s) } -> std::same_as<bool>;
+	{ F::merge(s, s) } -> std::same_as<typename F::storage>;
+	{ F::farther(s) } -> std::same_as<typename F::storage>;
+	{ F::key(d) } -> std::same_as<uint32_t>;
+	{ F::fromKey(uint32_t{}) } -> std::convertible_to<float>;
+	{ F::visible(d) } -> std::same_as<bool>;
+	{ F::clearValue } -> std::convertible_to<typename F::storage>;
+	{ F::reversed } -> std::convertible_to<bool>;
+	{ F::hasStencil } -> std::convertible_to<bool>;
+};
+
+// 32-bit float depth, near = 0, far = 1 (4 bytes per pixel)
+struct DepthFloat {
+	using storage = float;
+	static constexpr storage clearValue = 1.0f;
+	static constexpr bool reversed = false;
+	static constexpr bool hasStencil = false;
+
+	static constexpr storage encode(float d) { return d; }
+	static constexpr float decode(storage s) { return s; }
+	static bool nearer(storage a, storage b) { return a < b; }
+	static storage merge(storage, storage d) { return d; }
+	static storage farther(storage s) { return std::nextafter(s, 2.0f); }
+	static constexpr uint32_t key(float d) { return std::bit_cast<uint32_t>(d); } // non-negative floats order like their bits
+	static float fromKey(uint32_t k) { float d; memcpy(&d, &k, sizeof(d)); return d; }
+	static bool visible(float d) { return d > 0.01f; }
+};
+
+// 32-bit float depth with a reversed projection, near = 1, far = 0 (4 bytes per pixel).
+// Float precision is densest around 0, which now lines up with the far range where the
+// perspective divide squeezes depth values together.
+struct DepthReversedFloat {
+	using storage = float;
+	static constexpr storage clearValue = 0.0f;
+	static constexpr bool reversed = true;
+	static constexpr bool hasStencil = false;
+
+	static constexpr storage encode(float d) { return d; }
+	static constexpr float decode(storage s) { return s; }
+	static bool nearer(storage a, storage b) { return a > b; }
+	static storage merge(storage, storage d) { return d; }
+	static storage farther(storage s) { return std::nextafter(s, -1.0f); }
+	static constexpr uint32_t key(float d) { return ~std::bit_cast<uint32_t>(d); }
+	static float fromKey(uint32_t k) { k = ~k; float d; memcpy(&d, &k, sizeof(d)); return d; }
+	static bool visible(float d) { return d < 0.99f; }
+};
+
+// 16-bit unsigned normalised depth, near = 0, far = 1 (2 bytes per pixel)
+struct DepthUnorm16 {
+	using storage = uint16_t;
+	static constexpr storage clearValue = 0xFFFF;
+	static constexpr bool reversed = false;
+	static constexpr bool hasStencil = false;
+
+	static constexpr storage encode(float d) { return static_cast<storage>((d < 1.0f ? d : 1.0f) * 65535.0f + 0.5f); }
+	static constexpr float decode(storage s) { return s * (1.0f / 65535.0f); }
+	static bool nearer(storage a, storage b) { return a < b; }
+	static storage merge(storage, storage d) { return d; }
+	static storage farther(storage s) { return static_cast<storage>(s + 1); }
+	static constexpr uint32_t key(float d) { return encode(d); }
+	static float fromKey(uint32_t k) { return decode(static_cast<storage>(k)); }
+	static bool visible(float d) { return d > 0.01f; }
+};
+
+// 24-bit unsigned normalised depth in the upper bits with an 8-bit stencil in the
+// lowest byte, near = 0, far = 1 (4 bytes per pixel)
+struct DepthUnorm24S8 {
+	using storage = uint32_t;
+	static constexpr storage clearValue = 0xFFFFFF00u;	// farthest depth, stencil 0
+	static constexpr bool reversed = false;
+	static constexpr bool hasStencil = true;
+	static constexpr storage STENCIL_MASK = 0xFFu;
+
+	static constexpr storage encode(float d) {
+		storage u = static_cast<storage>((d < 1.0f ? d : 1.0f) * 16777215.0f + 0.5f);	// 1.0f rounds up to 2^24 in float
+		return (u < 0xFFFFFFu ? u : 0xFFFFFFu) << 8;
+	}
+	static constexpr float decode(storage s) { return (s >> 8) * (1.0f / 16777215.0f); }
+	static bool nearer(storage a, storage b) { return (a | STENCIL_MASK) < (b | STENCIL_MASK); }
+	static storage merge(storage old, storage d) { return d | (old & STENCIL_MASK); }
+	static storage farther(storage s) { return s + (1u << 8); }
+	static constexpr uint32_t key(float d) { return encode(d) >> 8; }
+	static float fromKey(uint32_t k) { return decode(k << 8); }
+	static bool visible(float d) { return d > 0.01f; }
+
+	// stencil value held in a stored word
+	static unsigned char stencil(storage s) { return static_cast<unsigned char>(s & STENCIL_MASK); }
+};
+
+// the far plane has to encode to the farthest value, a wrap would make it the nearest
+static_assert(DepthUnorm16::key(1.f) == 0xFFFF);
+static_assert(DepthUnorm24S8::key(1.f) == 0xFFFFFF);
+
+// Depth format used by the renderer, chosen at compile time
+// (DepthUnorm16 halves depth bandwidth where its precision is enough)
+using DepthFormat = DepthFloat;
+//using DepthFormat = DepthReversedFloat;
+//using DepthFormat = DepthUnorm16;
+//using DepthFormat = DepthUnorm24S8;
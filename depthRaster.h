@@ -0,0 +1,184 @@
+#pragma once
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <immintrin.h>
+#include "vec4.h"
+#include "matrix.h"
+#include "mesh.h"
+#include "tiles.h"
+#include "profiler.h"
+
+// Depth only render target: one float per pixel, no colour (shadow maps and occlusion buffers).
+class DepthTarget {
+	std::vector<float> depth;	// width * height depth values, row by row
+	int width = 0, height = 0;
+
+public:
+	// Allocates the target
+	// Input Variables:
+	// - w, h : size in pixels
+	void create(int w, int h) {
+		width = w;
+		height = h;
+		depth.assign((size_t)w * h, 1.f);
+	}
+
+	// Sets every pixel to a depth (1 = far for the standard projections, 0 for the reversed one)
+	void clear(float value = 1.f) {
+		std::fill(depth.begin(), depth.end(), value);
+	}
+
+	int getWidth() const { return width; }
+	int getHeight() const { return height; }
+
+	float* row(int y) { return depth.data() + (size_t)y * width; }
+	const float* row(int y) const { return depth.data() + (size_t)y * width; }
+};
+
+// Rasterises the depth of a screen space triangle into a depth target.
+// The stripped down kernel of the depth only passes: no attribute setup, shading or colour,
+// just the three edge functions and the depth plane stepped eight pixels at a time, with the
+// depth test and the masked store done in registers. Pixels are sampled at integer positions
+// like the colour kernels, both windings are drawn.
+// Template Variables:
+// - Reversed : true if nearer depths are larger (reversed projection)
+// Input Variables:
+// - target : depth target
+// - v0, v1, v2 : screen x, screen y and depth of the corners
+// - clip : rectangle the triangle is clipped to (inside the target)
+template<bool Reversed = false>
+static void rasterDepth(DepthTarget& target, const vec4& v0, const vec4& v1, const vec4& v2, const tileRect& clip) {
+	// bounds clipped to the rectangle (max exclusive)
+	int minX = max((int)std::ceil(min(v0[0], min(v1[0], v2[0]))), clip.minX);
+	int minY = max((int)std::ceil(min(v0[1], min(v1[1], v2[1]))), clip.minY);
+	int maxX = min((int)std::floor(max(v0[0], max(v1[0], v2[0]))) + 1, clip.maxX);
+	int maxY = min((int)std::floor(max(v0[1], max(v1[1], v2[1]))) + 1, clip.maxY);
+	if (minX >= maxX || minY >= maxY) return;
+
+	float area = (v1[0] - v0[0]) * (v2[1] - v0[1]) - (v1[1] - v0[1]) * (v2[0] - v0[0]);
+	if (area == 0.f) return;
+	float invArea = 1.f / area;
+
+	// normalised edge functions, weight of vertex i: w_i = a_i dx + b_i dy + w_i(v0) with (dx, dy) relative to v0
+	// (relative to v0 rather than the screen origin, the constant terms would cancel badly far from it)
+	float a0 = (v1[1] - v2[1]) * invArea, b0 = (v2[0] - v1[0]) * invArea;
+	float a1 = (v2[1] - v0[1]) * invArea, b1 = (v0[0] - v2[0]) * invArea;
+	float a2 = (v0[1] - v1[1]) * invArea, b2 = (v1[0] - v0[0]) * invArea;
+
+	// depth plane z = v0 depth + dzdx dx + dzdy dy
+	float dzdx = a1 * (v1[2] - v0[2]) + a2 * (v2[2] - v0[2]);
+	float dzdy = b1 * (v1[2] - v0[2]) + b2 * (v2[2] - v0[2]);
+
+	const __m256 lanes = _mm256_setr_ps(0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f);
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 step0 = _mm256_set1_ps(a0 * 8.f), step1 = _mm256_set1_ps(a1 * 8.f), step2 = _mm256_set1_ps(a2 * 8.f);
+	const __m256 stepZ = _mm256_set1_ps(dzdx * 8.f);
+	const __m256i lanesI = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+	for (int y = minY; y < maxY; y++) {
+		float dy = (float)y - v0[1], dx = (float)minX - v0[0];
+		__m256 w0 = _mm256_fmadd_ps(lanes, _mm256_set1_ps(a0), _mm256_set1_ps(1.f + a0 * dx + b0 * dy));
+		__m256 w1 = _mm256_fmadd_ps(lanes, _mm256_set1_ps(a1), _mm256_set1_ps(a1 * dx + b1 * dy));
+		__m256 w2 = _mm256_fmadd_ps(lanes, _mm256_set1_ps(a2), _mm256_set1_ps(a2 * dx + b2 * dy));
+		__m256 z = _mm256_fmadd_ps(lanes, _mm256_set1_ps(dzdx), _mm256_set1_ps(v0[2] + dzdx * dx + dzdy * dy));
+		float* dst = target.row(y);
+
+		for (int x = minX; x < maxX; x += 8) {
+			// inside all three edges, inside the clip rectangle and nearer than the stored depth
+			__m256 inside = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(w0, zero, _CMP_GE_OQ), _mm256_cmp_ps(w1, zero, _CMP_GE_OQ)),
+				_mm256_cmp_ps(w2, zero, _CMP_GE_OQ));
+			__m256i inClip = _mm256_cmpgt_epi32(_mm256_set1_epi32(maxX - x), lanesI);
+			__m256 stored = _mm256_maskload_ps(dst + x, inClip);	// lanes past maxX are never touched
+			__m256 nearer = Reversed ? _mm256_cmp_ps(z, stored, _CMP_GT_OQ) : _mm256_cmp_ps(z, stored, _CMP_LT_OQ);
+			__m256 mask = _mm256_and_ps(_mm256_and_ps(inside, nearer), _mm256_castsi256_ps(inClip));
+			_mm256_maskstore_ps(dst + x, _mm256_castps_si256(mask), z);
+
+			w0 = _mm256_add_ps(w0, step0);
+			w1 = _mm256_add_ps(w1, step1);
+			w2 = _mm256_add_ps(w2, step2);
+			z = _mm256_add_ps(z, stepZ);
+		}
+	}
+}
+
+// Draws the depth of meshes into a depth target, the depth only render pass shared by shadow
+// maps and occlusion buffers. Only positions are transformed (no normals,
+// colours or shading constants), then horizontal bands of the target are rasterised in parallel,
+// one band per thread at a time. Each band is cleared by the thread drawing it, so the clear runs
+// in parallel while the band is in cache. Triangles with a corner behind the camera or outside the
+// depth range are dropped.
+// Template Variables:
+// - Reversed : true if nearer depths are larger (reversed projection)
+// Input Variables:
+// - meshes : meshes to draw
+// - vp : view projection matrix of the pass
+// - target : depth target
+// - totalThreads : number of threads to use for multithreading
+template<bool Reversed = false>
+static void renderDepthPass(const std::vector<Mesh*>& meshes, const matrix& vp, DepthTarget& target, unsigned int totalThreads = 3) {
+	PROFILE_ZONE("depth pass");
+	if (totalThreads == 0) totalThreads = 1;
+	int width = target.getWidth(), height = target.getHeight();
+	std::vector<std::vector<vec4>> corners(totalThreads);	// screen space corners of every thread, three per triangle
+	std::atomic<unsigned int> next{ 0 };					// next mesh, then next band
+
+	// runs work(thread) on every thread, the calling thread included
+	auto parallel = [totalThreads](auto&& work) {
+		std::vector<std::thread> threads;
+		for (unsigned int i = 1; i < totalThreads; i++)
+			threads.emplace_back([&work, i]() { work(i); });
+		work(0u);
+		for (auto& t : threads)
+			t.join();
+	};
+
+	parallel([&](unsigned int thread) {
+		std::vector<vec4>& out = corners[thread];
+		std::vector<vec4> positions;
+		unsigned int m;
+		while ((m = next.fetch_add(1)) < meshes.size()) {
+			const Mesh* mesh = meshes[m];
+			const std::vector<Vertex>& vertices = mesh->getVertices();
+			if (vertices.empty()) continue;
+
+			positions.resize(vertices.size());
+			matrix::transformPoints(vp * mesh->world, &vertices[0].p, sizeof(Vertex), positions.data(), sizeof(vec4), vertices.size());
+			for (vec4& p : positions) {
+				if (p[3] <= 1e-6f) { p[2] = -1.f; continue; } // behind the camera, dropped below
+				float invW = 1.f / p[3];
+				p[0] = (p[0] * invW + 1.f) * 0.5f * width;
+				p[1] = height - (p[1] * invW + 1.f) * 0.5f * height;
+				p[2] *= invW;
+			}
+
+			for (const triIndices& ind : mesh->getTriangles()) {
+				const vec4& a = positions[ind.v[0]], & b = positions[ind.v[1]], & c = positions[ind.v[2]];
+				if (a[2] < 0.f || a[2] > 1.f || b[2] < 0.f || b[2] > 1.f || c[2] < 0.f || c[2] > 1.f) continue;
+				out.push_back(a);
+				out.push_back(b);
+				out.push_back(c);
+			}
+		}
+	});
+
+	next.store(0);
+	unsigned int bands = (height + TILE_SIZE - 1) / TILE_SIZE;
+	parallel([&](unsigned int) {
+		unsigned int b;
+		while ((b = next.fetch_add(1)) < bands) {
+			tileRect band = { 0, (int)b * TILE_SIZE, width, min((int)(b + 1) * TILE_SIZE, height) };
+			std::fill(target.row(band.minY), target.row(band.maxY - 1) + width, Reversed ? 0.f : 1.f);
+			float top = (float)band.minY, bottom = (float)band.maxY;
+			for (const std::vector<vec4>& list : corners)
+				for (size_t i = 0; i < list.size(); i += 3) {
+					const vec4* t = &list[i];
+					if (max(t[0][1], max(t[1][1], t[2][1])) < top || min(t[0][1], min(t[1][1], t[2][1])) >= bottom) continue;
+					rasterDepth<Reversed>(target, t[0], t[1], t[2], band);
+				}
+		}
+	});
+}
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <Windows.h>
+#include <immintrin.h>
+#include <cstring>
+#include <new>
+#include <utility>
+
+// Framebuffer class storing one packed 32-bit RGBA value per pixel (red in the lowest byte).
+// The buffer is 64-byte aligned so rows of 16 pixels map onto whole cache lines, and is backed
+// by large pages when the process is allowed to lock them (falls back to an aligned heap block).
+// There are no atomics: concurrent writers must own disjoint pixels, e.g. separate screen tiles.
+class Framebuffer {
+	unsigned int* buffer = nullptr;		// packed pixel data
+	unsigned int width = 0, height = 0;	// dimensions of the framebuffer
+	size_t bytes = 0;					// size of the allocation in bytes
+	bool largePages = false;			// true if the buffer came from VirtualAlloc with MEM_LARGE_PAGES
+
+	// Releases the pixel memory using the allocator it came from
+	void release() {
+		if (!buffer) return;
+		if (largePages) VirtualFree(buffer, 0, MEM_RELEASE);
+		else _aligned_free(buffer);
+		buffer = nullptr;
+	}
+
+public:
+	static constexpr unsigned int ALIGNMENT = 64;	// cache line alignment of the buffer
+
+	// Default constructor for creating an unallocated framebuffer.
+	Framebuffer() = default;
+
+	// Constructor to allocate a framebuffer with the given width and height.
+	// Input Variables:
+	// - w: Width of the framebuffer.
+	// - h: Height of the framebuffer.
+	// - useLargePages: try to back the buffer with large pages.
+	Framebuffer(unsigned int w, unsigned int h, bool useLargePages = true) {
+		create(w, h, useLargePages);
+	}
+
+	Framebuffer(const Framebuffer&) = delete;
+	Framebuffer& operator=(const Framebuffer&) = delete;
+
+	// Creates or reinitializes the framebuffer with the given width and height.
+	// Input Variables:
+	// - w: Width of the framebuffer.
+	// - h: Height of the framebuffer.
+	// - useLargePages: try to back the buffer with large pages.
+	void create(unsigned int w, unsigned int h, bool useLargePages = true) {
+		release();
+		width = w;
+		height = h;
+
+		// round the size up to a whole number of cache lines so spans never run past the end
+		bytes = ((size_t)width * height * sizeof(unsigned int) + ALIGNMENT - 1) & ~(size_t)(ALIGNMENT - 1);
+
+		largePages = false;
+		SIZE_T pageSize = useLargePages ? GetLargePageMinimum() : 0;
+		if (pageSize) {
+			size_t large = (bytes + pageSize - 1) & ~(pageSize - 1);
+			buffer = static_cast<unsigned int*>(VirtualAlloc(nullptr, large, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE));
+			largePages = buffer != nullptr;
+		}
+
+		if (!buffer)
+			buffer = static_cast<unsigned int*>(_aligned_malloc(bytes, ALIGNMENT));
+		if (!buffer)
+			throw std::bad_alloc();
+
+		clear();
+	}
+
+	// Exchanges the pixel memory of two framebuffers (no pixels are copied)
+	void swap(Framebuffer& other) {
+		std::swap(buffer, other.buffer);
+		std::swap(width, other.width);
+		std::swap(height, other.height);
+		std::swap(bytes, other.bytes);
+		std::swap(largePages, other.largePages);
+	}
+
+	// Packs 8-bit colour channels into a single 32-bit pixel
+	static unsigned int pack(unsigned char r, unsigned char g, unsigned char b) {
+		return r | (g << 8) | (b << 16) | 0xFF000000u;
+	}
+
+	unsigned int getWidth() const { return width; }
+	unsigned int getHeight() const { return height; }
+	bool usesLargePages() const { return largePages; }
+
+	// Returns the packed pixel data (row major, width * height pixels)
+	unsigned int* data() { return buffer; }
+	const unsigned int* data() const { return buffer; }
+
+	// Writes a packed pixel at the specified linear index (index = width * y + x)
+	void draw(unsigned int index, unsigned int colour) {
+		buffer[index] = colour;
+	}
+
+	// Writes a packed pixel at (x, y)
+	void draw(unsigned int x, unsigned int y, unsigned int colour) {
+		buffer[y * width + x] = colour;
+	}
+
+	// Copies a horizontal run of packed pixels starting at the given linear index
+	// Input Variables:
+	// - index: linear index of the first pixel
+	// - pixels: source pixels
+	// - count: number of pixels to copy
+	void drawSpan(unsigned int index, const unsigned int* pixels, unsigned int count) {
+		unsigned int* dst = buffer + index;
+		unsigned int i = 0;
+		for (; i + 8 <= count; i += 8)
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pixels + i)));
+		for (; i < count; i++)
+			dst[i] = pixels[i];
+	}
+
+	// Writes 8 consecutive pixels where the sign bit of the matching mask lane is set
+	// Input Variables:
+	// - index: linear index of the first pixel
+	// - pixels: 8 packed pixels
+	// - mask: per lane write mask (all ones to write)
+	void drawSpan8(unsigned int index, __m256i pixels, __m256i mask) {
+		_mm256_maskstore_epi32(reinterpret_cast<int*>(buffer + index), mask, pixels);
+	}
+
+	// Fills a horizontal run of pixels with a single colour
+	// Input Variables:
+	// - index: linear index of the first pixel
+	// - colour: packed colour
+	// - count: number of pixels to fill
+	void fillSpan(unsigned int index, unsigned int colour, unsigned int count) {
+		unsigned int* dst = buffer + index;
+		__m256i value = _mm256_set1_epi32(static_cast<int>(colour));
+		unsigned int i = 0;
+		for (; i + 8 <= count; i += 8)
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), value);
+		for (; i < count; i++)
+			dst[i] = colour;
+	}
+
+	// Fills the rectangle [minX, maxX) x [minY, maxY) with a single colour
+	void fillRect(unsigned int minX, unsigned int minY, unsigned int maxX, unsigned int maxY, unsigned int colour) {
+		for (unsigned int y = minY; y < maxY; y++)
+			fillSpan(y * width + minX, colour, maxX - minX);
+	}
+
+	// Clears the whole framebuffer to black
+	void clear() {
+		memset(buffer, 0, bytes);
+	}
+
+	// Destructor to free the pixel memory
+	~Framebuffer() {
+		release();
+	}
+};
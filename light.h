@@ -1,12 +1,69 @@
 #pragma once
 
+#include <vector>
+#include <cmath>
 #include "vec4.h"
 #include "colour.h"
 
+// Point or spot light with a finite radius
+// A point light has cosOuter = -1 (every direction is inside its cone).
+struct LocalLight {
+    vec4 position;          // world space position
+    vec4 direction;         // normalised direction the spot light points at
+    color L;                // light colour
+    float radius = 1.f;     // no light reaches beyond this distance
+    float cosOuter = -1.f;  // cosine of the cone half angle where the light ends
+    float cosInner = -1.f;  // cosine of the cone half angle where the light starts to fade
+    bool castShadows = false; // spot lights only, draws a shadow map every frame (see ShadowMaps)
+};
+
+// Creates a point light
+// Input Variables:
+// - position : world space position
+// - L : light colour
+// - radius : distance the light reaches
+static inline LocalLight makePointLight(const vec4& position, const color& L, float radius) {
+    LocalLight l;
+    l.position = position;
+    l.position[3] = 1.f;
+    l.direction = vec4(0.f, 0.f, -1.f, 0.f);
+    l.L = L;
+    l.radius = radius;
+    return l;
+}
+
+// Creates a spot light
+// Input Variables:
+// - position : world space position
+// - direction : direction the light points at
+// - L : light colour
+// - radius : distance the light reaches
+// - outer, inner : cone half angles in radians, the light fades out between inner and outer
+static inline LocalLight makeSpotLight(const vec4& position, const vec4& direction, const color& L, float radius, float outer, float inner) {
+    LocalLight l = makePointLight(position, L, radius);
+    l.direction = direction;
+    l.direction[3] = 0.f;
+    l.direction.normalise();
+    l.cosOuter = std::cos(outer);
+    l.cosInner = std::cos(min(inner, outer));
+    return l;
+}
+
 // keep light straightforward - struct for storing information
 struct Light {
     vec4 omega_i; // light direction
     color L; // light colour
-    color ambient; // ambient light component 
-};
+    color ambient; // ambient light component
+    std::vector<LocalLight> locals; // point and spot lights of the scene
+    bool castShadows = false; // draws a shadow map of the directional light every frame (see ShadowMaps)
+    float shadowDistance = 30.f; // radius of the region in front of the camera the shadow map covers
+
+    Light() = default;
 
+    // Creates the directional light, without local lights and shadows
+    // Input Variables:
+    // - _omega_i : light direction
+    // - _L : light colour
+    // - _ambient : ambient light component
+    Light(const vec4& _omega_i, const color& _L, const color& _ambient) : omega_i(_omega_i), L(_L), ambient(_ambient) {}
+};
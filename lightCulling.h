@@ -0,0 +1,123 @@
+#pragma once
+
+#include <vector>
+#include "light.h"
+#include "matrix.h"
+#include "tiles.h"
+#include "stats.h"
+
+// Point and spot lights of a frame binned into the screen tiles (tiled forward shading).
+// The bounding sphere of every light is projected to a screen rectangle once per frame and each
+// tile keeps the indices of the lights whose rectangle overlaps it, so a fragment only loops over
+// the lights that can reach its tile, however many lights the scene has.
+class TileLights {
+	std::vector<LocalLight> lights;		// lights of the frame
+	std::vector<unsigned int> first;	// start of the light indices of every tile (tiles + 1 entries)
+	std::vector<unsigned int> indices;	// light indices, tile by tile
+	std::vector<int> rects;				// tile range of every light (tx0, ty0, tx1, ty1), empty when off screen
+	matrix screenToWorld;				// (screen x, screen y, depth, 1) to homogeneous world position
+
+	// Computes the tiles a light's bounding sphere covers on screen
+	// Input Variables:
+	// - l : light
+	// - vp : view projection matrix
+	// - tiles : tile grid of the canvas
+	// - width, height : size of the canvas
+	// Output Variables:
+	// - r : first and last tile along each axis (tx0, ty0, tx1, ty1)
+	// Returns false if the sphere is off screen
+	static bool tileRange(const LocalLight& l, const matrix& vp, const TileGrid& tiles, int width, int height, int* r) {
+		float minX = (float)width, minY = (float)height, maxX = 0.f, maxY = 0.f;
+		int behind = 0;
+		for (int c = 0; c < 8; c++) {
+			// corner of the bounding box of the sphere
+			vec4 corner(l.position[0] + ((c & 1) ? l.radius : -l.radius),
+				l.position[1] + ((c & 2) ? l.radius : -l.radius),
+				l.position[2] + ((c & 4) ? l.radius : -l.radius), 1.f);
+			vec4 clip = vp.mul_point(corner);
+			if (clip[3] <= 1e-4f) { behind++; continue; }
+
+			float x = (clip[0] / clip[3] + 1.f) * 0.5f * width;
+			float y = height - (clip[1] / clip[3] + 1.f) * 0.5f * height;
+			minX = min(minX, x); maxX = max(maxX, x);
+			minY = min(minY, y); maxY = max(maxY, y);
+		}
+		if (behind == 8) return false;
+		if (behind > 0) { minX = 0.f; minY = 0.f; maxX = (float)width; maxY = (float)height; } // crosses the camera plane
+
+		int x0 = max((int)minX, 0), y0 = max((int)minY, 0);
+		int x1 = min((int)std::ceil(maxX), width), y1 = min((int)std::ceil(maxY), height);
+		if (x0 >= x1 || y0 >= y1) return false;
+		tiles.getRange(x0, y0, x1, y1, r[0], r[1], r[2], r[3]);
+		return true;
+	}
+
+public:
+	// Bins the lights of a frame into the tiles (capacity is kept between frames)
+	// Input Variables:
+	// - locals : point and spot lights
+	// - vp : view projection matrix of the frame
+	// - tiles : tile grid of the canvas
+	// - width, height : size of the canvas
+	void build(const std::vector<LocalLight>& locals, const matrix& vp, const TileGrid& tiles, int width, int height) {
+		lights = locals;
+		first.assign(tiles.count() + 1, 0);
+		indices.clear();
+		if (lights.empty()) return;
+
+		// screen space back to normalised device coordinates, then through the inverse view projection
+		matrix toNDC;
+		toNDC[0] = 2.f / width; toNDC[3] = -1.f;
+		toNDC[5] = -2.f / height; toNDC[7] = 1.f;
+		screenToWorld = matrix::makeInverse(vp) * toNDC;
+
+		// count the lights of every tile, then fill the indices in light order
+		rects.resize(lights.size() * 4);
+		int tilesX = tiles.getTilesX();
+		for (unsigned int i = 0; i < lights.size(); i++) {
+			int* r = &rects[i * 4];
+			if (!tileRange(lights[i], vp, tiles, width, height, r)) { r[0] = 0; r[2] = -1; continue; }
+			for (int ty = r[1]; ty <= r[3]; ty++)
+				for (int tx = r[0]; tx <= r[2]; tx++)
+					first[ty * tilesX + tx + 1]++;
+		}
+		for (size_t t = 1; t < first.size(); t++)
+			first[t] += first[t - 1];
+
+		indices.resize(first.back());
+		std::vector<unsigned int> next(first.begin(), first.end() - 1);
+		for (unsigned int i = 0; i < lights.size(); i++) {
+			const int* r = &rects[i * 4];
+			if (r[0] > r[2]) continue; // off screen
+			for (int ty = r[1]; ty <= r[3]; ty++)
+				for (int tx = r[0]; tx <= r[2]; tx++)
+					indices[next[ty * tilesX + tx]++] = i;
+		}
+		RENDER_STAT(lightTiles, indices.size());
+	}
+
+	// true if the frame has no point or spot lights
+	bool empty() const { return lights.empty(); }
+
+	const LocalLight* getLights() const { return lights.data(); }
+
+	// Indices of the lights reaching a tile
+	// Input Variables:
+	// - tile : linear tile index
+	// Output Variables:
+	// - count : number of lights
+	const unsigned int* getTileLights(int tile, unsigned int& count) const {
+		if (lights.empty()) { count = 0; return nullptr; }
+		count = first[tile + 1] - first[tile];
+		return indices.data() + first[tile];
+	}
+
+	// World space position of a screen space point
+	// Input Variables:
+	// - screen : screen x, screen y and depth of a fragment
+	vec4 toWorld(const vec4& screen) const {
+		vec4 p = screenToWorld.mul_point(vec4(screen[0], screen[1], screen[2], 1.f));
+		p.divideW();
+		return p;
+	}
+};
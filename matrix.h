@@ -3,6 +3,7 @@
 #include <iostream>
 #include <immintrin.h>
 #include <vector>
+#include <span>
 #include "vec4.h"
 
 // Matrix class for 4x4 transformation matrices
@@ -36,6 +37,11 @@ public:
 		return a[i];
 	}
 
+	float operator[](const int& i) const
+	{
+		return a[i];
+	}
+
 	float& operator()(const int& i1, const int& i2)
 	{
 		return m[i1][i2];
@@ -52,24 +58,66 @@ public:
 	}
 
 	vec4 mul_point_avx(const vec4& v) const {
-		vec4 result;
-
-		// Load the vector `v` into a SIMD register
-		__m128 vec = _mm_loadu_ps(v.v);
-
-		// Perform dot products for each row
-		__m128 res0 = _mm_dp_ps(_mm_loadu_ps(&a[0]), vec, 0xF1);
-		__m128 res1 = _mm_dp_ps(_mm_loadu_ps(&a[4]), vec, 0xF1);
-		__m128 res2 = _mm_dp_ps(_mm_loadu_ps(&a[8]), vec, 0xF1);
-		__m128 res3 = _mm_dp_ps(_mm_loadu_ps(&a[12]), vec, 0xF1);
+		__m128 vec = v.simd();
+
+		// products of every row with the vector, then two rounds of horizontal adds
+		// give the four row sums in one register (no dot product instructions)
+		__m128 r0 = _mm_mul_ps(_mm_load_ps(&a[0]), vec);
+		__m128 r1 = _mm_mul_ps(_mm_load_ps(&a[4]), vec);
+		__m128 r2 = _mm_mul_ps(_mm_load_ps(&a[8]), vec);
+		__m128 r3 = _mm_mul_ps(_mm_load_ps(&a[12]), vec);
+		return vec4(_mm_hadd_ps(_mm_hadd_ps(r0, r1), _mm_hadd_ps(r2, r3)));
+	}
 
-		// Store results back into the `result` vector
-		result[0] = _mm_cvtss_f32(res0);
-		result[1] = _mm_cvtss_f32(res1);
-		result[2] = _mm_cvtss_f32(res2);
-		result[3] = _mm_cvtss_f32(res3);
+	// Transforms points by a matrix
+	// The matrix columns are broadcast into both halves of AVX registers once, then every two
+	// points take four in-lane broadcasts, a multiply and three FMAs.
+	// Input Variables:
+	// - mx : transformation matrix
+	// - in : points to transform
+	// - inStride : bytes from one input point to the next (e.g. the position inside a vertex struct)
+	// - count : number of points
+	// - outStride : bytes from one output point to the next
+	// Output Variables:
+	// - out : transformed points, may be the same memory as in
+	static void transformPoints(const matrix& mx, const vec4* in, size_t inStride, vec4* out, size_t outStride, size_t count) {
+		matrix t = makeTranspose(mx);
+		__m256 c0 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&t.a[0]));
+		__m256 c1 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&t.a[4]));
+		__m256 c2 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&t.a[8]));
+		__m256 c3 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&t.a[12]));
+
+		const char* src = reinterpret_cast<const char*>(in);
+		char* dst = reinterpret_cast<char*>(out);
+		size_t i = 0;
+		for (; i + 2 <= count; i += 2, src += 2 * inStride, dst += 2 * outStride) {
+			__m256 p = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_load_ps(reinterpret_cast<const float*>(src))),
+				_mm_load_ps(reinterpret_cast<const float*>(src + inStride)), 1);
+			__m256 r = _mm256_mul_ps(_mm256_permute_ps(p, 0x00), c0);
+			r = _mm256_fmadd_ps(_mm256_permute_ps(p, 0x55), c1, r);
+			r = _mm256_fmadd_ps(_mm256_permute_ps(p, 0xAA), c2, r);
+			r = _mm256_fmadd_ps(_mm256_permute_ps(p, 0xFF), c3, r);
+			_mm_store_ps(reinterpret_cast<float*>(dst), _mm256_castps256_ps128(r));
+			_mm_store_ps(reinterpret_cast<float*>(dst + outStride), _mm256_extractf128_ps(r, 1));
+		}
+		if (i < count) {
+			__m128 p = _mm_load_ps(reinterpret_cast<const float*>(src));
+			__m128 r = _mm_mul_ps(_mm_permute_ps(p, 0x00), _mm256_castps256_ps128(c0));
+			r = _mm_fmadd_ps(_mm_permute_ps(p, 0x55), _mm256_castps256_ps128(c1), r);
+			r = _mm_fmadd_ps(_mm_permute_ps(p, 0xAA), _mm256_castps256_ps128(c2), r);
+			r = _mm_fmadd_ps(_mm_permute_ps(p, 0xFF), _mm256_castps256_ps128(c3), r);
+			_mm_store_ps(reinterpret_cast<float*>(dst), r);
+		}
+	}
 
-		return result;
+	// Transforms an array of points by a matrix
+	// Input Variables:
+	// - mx : transformation matrix
+	// - in : points to transform
+	// Output Variables:
+	// - out : transformed points (at least in.size()), may be the same array as in
+	static void transformPoints(const matrix& mx, std::span<const vec4> in, std::span<vec4> out) {
+		transformPoints(mx, in.data(), sizeof(vec4), out.data(), sizeof(vec4), in.size());
 	}
 
 	// Multiply the matrix by a 4D vector
@@ -111,50 +159,59 @@ public:
 		return ret;
 	}
 
+	// 4x4 multiply with broadcasts and FMAs, two rows of the result per AVX register:
+	// row i of the result is the sum of a(i, k) * row k of mx
 	matrix mul_avx(const matrix& mx) const
 	{
 		matrix ret;
 
-		matrix t = makeTranspose(mx); // transpose matrix b for better memory access
-
-		__m128 ra0, ra1, ra2, ra3; // matrix a resistors
-		__m128 rb0, rb1, rb2, rb3; // matrix b resistors
-
-		// load matrix a to resistors
-		ra0 = _mm_load_ps(&a[0]); ra1 = _mm_load_ps(&a[4]);
-		ra2 = _mm_load_ps(&a[8]); ra3 = _mm_load_ps(&a[12]);
-
-		// load mix b to risistors
-		rb0 = _mm_load_ps(&t.a[0]); rb1 = _mm_load_ps(&t.a[4]);
-		rb2 = _mm_load_ps(&t.a[8]); rb3 = _mm_load_ps(&t.a[12]);
-
-		// row 0 
-		ret.a[0] = _mm_cvtss_f32(_mm_dp_ps(ra0, rb0, 0xF1));
-		ret.a[1] = _mm_cvtss_f32(_mm_dp_ps(ra0, rb1, 0xF1));
-		ret.a[2] = _mm_cvtss_f32(_mm_dp_ps(ra0, rb2, 0xF1));
-		ret.a[3] = _mm_cvtss_f32(_mm_dp_ps(ra0, rb3, 0xF1));
-
-		// row 1
-		ret.a[4] = _mm_cvtss_f32(_mm_dp_ps(ra1, rb0, 0xF1));
-		ret.a[5] = _mm_cvtss_f32(_mm_dp_ps(ra1, rb1, 0xF1));
-		ret.a[6] = _mm_cvtss_f32(_mm_dp_ps(ra1, rb2, 0xF1));
-		ret.a[7] = _mm_cvtss_f32(_mm_dp_ps(ra1, rb3, 0xF1));
-
-		// row 2
-		ret.a[8] = _mm_cvtss_f32(_mm_dp_ps(ra2, rb0, 0xF1));
-		ret.a[9] = _mm_cvtss_f32(_mm_dp_ps(ra2, rb1, 0xF1));
-		ret.a[10] = _mm_cvtss_f32(_mm_dp_ps(ra2, rb2, 0xF1));
-		ret.a[11] = _mm_cvtss_f32(_mm_dp_ps(ra2, rb3, 0xF1));
-
-		// row 3
-		ret.a[12] = _mm_cvtss_f32(_mm_dp_ps(ra3, rb0, 0xF1));
-		ret.a[13] = _mm_cvtss_f32(_mm_dp_ps(ra3, rb1, 0xF1));
-		ret.a[14] = _mm_cvtss_f32(_mm_dp_ps(ra3, rb2, 0xF1));
-		ret.a[15] = _mm_cvtss_f32(_mm_dp_ps(ra3, rb3, 0xF1));
+		// rows of mx, repeated in both halves of the registers
+		__m256 b0 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&mx.a[0]));
+		__m256 b1 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&mx.a[4]));
+		__m256 b2 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&mx.a[8]));
+		__m256 b3 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&mx.a[12]));
+
+		// rows 0 and 1, then rows 2 and 3
+		for (int r = 0; r < 16; r += 8) {
+			__m256 ra = _mm256_loadu_ps(&a[r]);
+			__m256 res = _mm256_mul_ps(_mm256_permute_ps(ra, 0x00), b0);
+			res = _mm256_fmadd_ps(_mm256_permute_ps(ra, 0x55), b1, res);
+			res = _mm256_fmadd_ps(_mm256_permute_ps(ra, 0xAA), b2, res);
+			res = _mm256_fmadd_ps(_mm256_permute_ps(ra, 0xFF), b3, res);
+			_mm256_storeu_ps(&ret.a[r], res);
+		}
 
 		return ret;
 	}
 
+	// Multiplies one matrix by many: out[i] = mx * in[i]
+	// The rows of mx are broadcast once for the whole batch.
+	// Input Variables:
+	// - mx : left hand matrix
+	// - in : right hand matrices
+	// Output Variables:
+	// - out : products (at least in.size()), may be the same array as in
+	static void multiplyMany(const matrix& mx, std::span<const matrix> in, std::span<matrix> out) {
+		__m256 ra01 = _mm256_loadu_ps(&mx.a[0]);
+		__m256 ra23 = _mm256_loadu_ps(&mx.a[8]);
+		__m256 a0 = _mm256_permute_ps(ra01, 0x00), a1 = _mm256_permute_ps(ra01, 0x55);
+		__m256 a2 = _mm256_permute_ps(ra01, 0xAA), a3 = _mm256_permute_ps(ra01, 0xFF);
+		__m256 a4 = _mm256_permute_ps(ra23, 0x00), a5 = _mm256_permute_ps(ra23, 0x55);
+		__m256 a6 = _mm256_permute_ps(ra23, 0xAA), a7 = _mm256_permute_ps(ra23, 0xFF);
+
+		for (size_t i = 0; i < in.size(); i++) {
+			const float* b = in[i].a;
+			__m256 b0 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(b));
+			__m256 b1 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(b + 4));
+			__m256 b2 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(b + 8));
+			__m256 b3 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(b + 12));
+			__m256 r01 = _mm256_fmadd_ps(a3, b3, _mm256_fmadd_ps(a2, b2, _mm256_fmadd_ps(a1, b1, _mm256_mul_ps(a0, b0))));
+			__m256 r23 = _mm256_fmadd_ps(a7, b3, _mm256_fmadd_ps(a6, b2, _mm256_fmadd_ps(a5, b1, _mm256_mul_ps(a4, b0))));
+			_mm256_storeu_ps(&out[i].a[0], r01);
+			_mm256_storeu_ps(&out[i].a[8], r23);
+		}
+	}
+
 	// Multiply the matrix by another matrix
 	// Input Variables:
 	// - mx: Another matrix to multiply with
@@ -174,6 +231,70 @@ public:
 		return t;
 	}
 
+	// Inverse of a matrix
+	// The matrix is split into 2x2 blocks A B / C D and inverted blockwise with adjugates, four
+	// 2x2 blocks per SSE register. A singular matrix gives non finite values.
+	// Input Variables:
+	// - mat : matrix to invert
+	// Returns the inverse matrix
+	static matrix makeInverse(const matrix& mat)
+	{
+		__m128 r0 = _mm_load_ps(&mat.a[0]), r1 = _mm_load_ps(&mat.a[4]);
+		__m128 r2 = _mm_load_ps(&mat.a[8]), r3 = _mm_load_ps(&mat.a[12]);
+
+		// blocks stored as (m00, m01, m10, m11)
+		__m128 A = _mm_movelh_ps(r0, r1), B = _mm_movehl_ps(r1, r0);
+		__m128 C = _mm_movelh_ps(r2, r3), D = _mm_movehl_ps(r3, r2);
+
+		// determinants of the blocks (|A|, |B|, |C|, |D|)
+		__m128 det = _mm_fmsub_ps(_mm_shuffle_ps(r0, r2, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(r1, r3, _MM_SHUFFLE(3, 1, 3, 1)),
+			_mm_mul_ps(_mm_shuffle_ps(r0, r2, _MM_SHUFFLE(3, 1, 3, 1)), _mm_shuffle_ps(r1, r3, _MM_SHUFFLE(2, 0, 2, 0))));
+		__m128 detA = _mm_shuffle_ps(det, det, 0x00), detB = _mm_shuffle_ps(det, det, 0x55);
+		__m128 detC = _mm_shuffle_ps(det, det, 0xAA), detD = _mm_shuffle_ps(det, det, 0xFF);
+
+		__m128 DC = mat2AdjMul(D, C);	// D# C
+		__m128 AB = mat2AdjMul(A, B);	// A# B
+		__m128 X = _mm_sub_ps(_mm_mul_ps(detD, A), mat2Mul(B, DC));		// |D| A - B (D# C)
+		__m128 W = _mm_sub_ps(_mm_mul_ps(detA, D), mat2Mul(C, AB));		// |A| D - C (A# B)
+		__m128 Y = _mm_sub_ps(_mm_mul_ps(detB, C), mat2MulAdj(D, AB));	// |B| C - D (A# B)#
+		__m128 Z = _mm_sub_ps(_mm_mul_ps(detC, B), mat2MulAdj(A, DC));	// |C| B - A (D# C)#
+
+		// |M| = |A| |D| + |B| |C| - tr((A# B)(D# C))
+		__m128 tr = _mm_mul_ps(AB, _mm_shuffle_ps(DC, DC, _MM_SHUFFLE(3, 1, 2, 0)));
+		tr = _mm_hadd_ps(tr, tr);
+		tr = _mm_hadd_ps(tr, tr);
+		__m128 detM = _mm_sub_ps(_mm_fmadd_ps(detB, detC, _mm_mul_ps(detA, detD)), tr);
+
+		__m128 rDetM = _mm_div_ps(_mm_setr_ps(1.f, -1.f, -1.f, 1.f), detM);
+		X = _mm_mul_ps(X, rDetM);
+		Y = _mm_mul_ps(Y, rDetM);
+		Z = _mm_mul_ps(Z, rDetM);
+		W = _mm_mul_ps(W, rDetM);
+
+		// adjugate of the blocks and the transposed block layout in one shuffle per row
+		matrix ret;
+		_mm_store_ps(&ret.a[0], _mm_shuffle_ps(X, Y, _MM_SHUFFLE(1, 3, 1, 3)));
+		_mm_store_ps(&ret.a[4], _mm_shuffle_ps(X, Y, _MM_SHUFFLE(0, 2, 0, 2)));
+		_mm_store_ps(&ret.a[8], _mm_shuffle_ps(Z, W, _MM_SHUFFLE(1, 3, 1, 3)));
+		_mm_store_ps(&ret.a[12], _mm_shuffle_ps(Z, W, _MM_SHUFFLE(0, 2, 0, 2)));
+		return ret;
+	}
+
+	// Inverse transpose of a matrix, transforms normals when the matrix scales non-uniformly or shears
+	// Input Variables:
+	// - mat : matrix (usually a world matrix)
+	// Returns the transposed inverse
+	static matrix makeInverseTranspose(const matrix& mat)
+	{
+		matrix ret = makeInverse(mat);
+		__m128 r0 = _mm_load_ps(&ret.a[0]), r1 = _mm_load_ps(&ret.a[4]);
+		__m128 r2 = _mm_load_ps(&ret.a[8]), r3 = _mm_load_ps(&ret.a[12]);
+		_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+		_mm_store_ps(&ret.a[0], r0); _mm_store_ps(&ret.a[4], r1);
+		_mm_store_ps(&ret.a[8], r2); _mm_store_ps(&ret.a[12], r3);
+		return ret;
+	}
+
 	// Create a perspective projection matrix
 	// Input Variables:
 	// - fov: Field of view in radians
@@ -194,6 +315,26 @@ public:
 		return m;
 	}
 
+	// Create a reversed depth perspective projection matrix (near plane at depth 1, far plane at 0)
+	// Input Variables:
+	// - fov: Field of view in radians
+	// - aspect: Aspect ratio of the viewport
+	// - n: Near clipping plane
+	// - f: Far clipping plane
+	// Returns the perspective matrix
+	static matrix makePerspectiveReversed(float fov, float aspect, float n, float f) {
+		matrix m;
+		m.zero();
+		float tanHalfFov = std::tan(fov / 2.0f);
+
+		m.a[0] = 1.0f / (aspect * tanHalfFov);
+		m.a[5] = 1.0f / tanHalfFov;
+		m.a[10] = n / (f - n);
+		m.a[11] = (f * n) / (f - n);
+		m.a[14] = -1.0f;
+		return m;
+	}
+
 	// Create a translation matrix
 	// Input Variables:
 	// - tx, ty, tz: Translation amounts along the X, Y, and Z axes
@@ -272,6 +413,46 @@ public:
 		return m;
 	}
 
+	// Create an orthographic projection matrix (depth 0 at the near plane, 1 at the far plane)
+	// Input Variables:
+	// - halfWidth, halfHeight: Half extents of the view volume
+	// - n: Near clipping plane
+	// - f: Far clipping plane
+	// Returns the orthographic matrix
+	static matrix makeOrthographic(float halfWidth, float halfHeight, float n, float f) {
+		matrix m;
+		m.identity();
+		m.a[0] = 1.0f / halfWidth;
+		m.a[5] = 1.0f / halfHeight;
+		m.a[10] = -1.0f / (f - n);
+		m.a[11] = -n / (f - n);
+		return m;
+	}
+
+	// Create a view matrix looking from a point towards another (the view looks down its -z axis)
+	// Input Variables:
+	// - eye: Position of the viewer
+	// - target: Point looked at
+	// - up: Approximate up direction, must not be parallel to target - eye
+	// Returns the view matrix
+	static matrix makeLookAt(const vec4& eye, const vec4& target, const vec4& up) {
+		vec4 forward = target - eye;
+		forward.normalise();
+		vec4 right = vec4::cross(forward, up);
+		right.normalise();
+		vec4 trueUp = vec4::cross(right, forward);
+
+		matrix m;
+		m.identity();
+		m.a[0] = right[0]; m.a[1] = right[1]; m.a[2] = right[2];
+		m.a[4] = trueUp[0]; m.a[5] = trueUp[1]; m.a[6] = trueUp[2];
+		m.a[8] = -forward[0]; m.a[9] = -forward[1]; m.a[10] = -forward[2];
+		m.a[3] = -vec4::dot(right, eye);
+		m.a[7] = -vec4::dot(trueUp, eye);
+		m.a[11] = vec4::dot(forward, eye);
+		return m;
+	}
+
 	// Create an identity matrix
 	// Returns an identity matrix
 	static matrix makeIdentity() {
@@ -281,6 +462,25 @@ public:
 	}
 
 private:
+	// 2x2 matrices stored as (m00, m01, m10, m11) for makeInverse
+	// A B
+	static __m128 mat2Mul(__m128 a, __m128 b) {
+		return _mm_fmadd_ps(a, _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 3, 0)),
+			_mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 2, 1, 2))));
+	}
+
+	// adjugate(A) B
+	static __m128 mat2AdjMul(__m128 a, __m128 b) {
+		return _mm_fmsub_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(0, 0, 3, 3)), b,
+			_mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 2, 1, 1)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 0, 3, 2))));
+	}
+
+	// A adjugate(B)
+	static __m128 mat2MulAdj(__m128 a, __m128 b) {
+		return _mm_fmsub_ps(a, _mm_shuffle_ps(b, b, _MM_SHUFFLE(0, 3, 0, 3)),
+			_mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 2, 1, 2))));
+	}
+
 	// Set all elements of the matrix to 0
 	void zero() {
 		memset(a, 0, 64);
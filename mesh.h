@@ -7,6 +7,7 @@
 #include "vec4.h"
 #include "matrix.h"
 #include "colour.h"
+#include "shading.h"
 
 // Represents a vertex in a 3D mesh, including its position, normal, and color
 struct Vertex {
@@ -15,6 +16,11 @@ struct Vertex {
     color rgb;     // Color of the vertex
 };
 
+// Texture coordinates of a vertex, kept beside the vertices so untextured meshes never carry them
+struct TexCoord {
+    float u, v;
+};
+
 // Stores indices of vertices that form a triangle in a mesh
 struct triIndices {
     unsigned int v[3]; // Indices into the vertex array
@@ -33,9 +39,38 @@ public:
     color col;       // Uniform color for the mesh
     float kd;         // Diffuse reflection coefficient
     float ka;         // Ambient reflection coefficient
+    Material material; // Shading model and pixel pipeline features the mesh is drawn with
     matrix world;     // Transformation matrix for the mesh
+    matrix mvp;       // Projection matrix cached by a TransformHierarchy (vp * world)
+    unsigned int mvpStamp = 0;  // Renderer view projection stamp mvp was computed for, 0 if none
     std::vector<Vertex> vertices;       // List of vertices in the mesh
     std::vector<triIndices> triangles;  // List of triangles in the mesh
+    std::vector<TexCoord> texCoords;    // Texture coordinates of the vertices (same order as vertices)
+    const Mesh* instanceOf = nullptr;   // Mesh whose geometry is drawn instead of our own (instances), must outlive this mesh
+
+    // Vertices drawn for this mesh (shared with the source mesh for instances)
+    const std::vector<Vertex>& getVertices() const { return instanceOf ? instanceOf->vertices : vertices; }
+
+    // Triangles drawn for this mesh (shared with the source mesh for instances)
+    const std::vector<triIndices>& getTriangles() const { return instanceOf ? instanceOf->triangles : triangles; }
+
+    // Texture coordinates of the vertices drawn for this mesh (shared with the source mesh for instances)
+    const std::vector<TexCoord>& getTexCoords() const { return instanceOf ? instanceOf->texCoords : texCoords; }
+
+    // Create a mesh drawing the geometry of another mesh with its own world matrix,
+    // without copying vertices and triangles
+    // Input Variables:
+    // - geometry: Mesh providing vertices, triangles and material
+    // Returns a Mesh object referencing the geometry
+    static Mesh makeInstance(const Mesh& geometry) {
+        Mesh mesh;
+        mesh.col = geometry.col;
+        mesh.ka = geometry.ka;
+        mesh.kd = geometry.kd;
+        mesh.material = geometry.material;
+        mesh.instanceOf = geometry.instanceOf ? geometry.instanceOf : &geometry;
+        return mesh;
+    }
 
     // Set the uniform color and reflection coefficients for the mesh
     // Input Variables:
@@ -59,9 +94,11 @@ public:
     // Input Variables:
     // - vertex: Position of the vertex
     // - normal: Normal vector for the vertex
-    void addVertex(const vec4& vertex, const vec4& normal) {
-        Vertex v = { vertex, normal, col };
-        vertices.push_back(v);
+    // - u, v: Texture coordinates of the vertex
+    void addVertex(const vec4& vertex, const vec4& normal, float u = 0.f, float v = 0.f) {
+        Vertex added = { vertex, normal, col };
+        vertices.push_back(added);
+        texCoords.push_back({ u, v });
     }
 
     // Add a triangle to the mesh
@@ -94,6 +131,7 @@ public:
         Mesh mesh;
         mesh.vertices.clear();
         mesh.triangles.clear();
+        mesh.texCoords.clear();
 
         // Define the four corners of the rectangle
         vec4 v1(x1, y1, 0);
@@ -107,11 +145,11 @@ public:
         vec4 normal = vec4::cross(edge1, edge2);
         normal.normalise();
 
-        // Add vertices with the calculated normal
-        mesh.addVertex(v1, normal);
-        mesh.addVertex(v2, normal);
-        mesh.addVertex(v3, normal);
-        mesh.addVertex(v4, normal);
+        // Add vertices with the calculated normal, the texture covers the rectangle once (v grows towards y1)
+        mesh.addVertex(v1, normal, 0.f, 1.f);
+        mesh.addVertex(v2, normal, 1.f, 1.f);
+        mesh.addVertex(v3, normal, 1.f, 0.f);
+        mesh.addVertex(v4, normal, 0.f, 0.f);
 
         // Add two triangles forming the rectangle
         mesh.addTriangle(0, 2, 1);
@@ -166,11 +204,11 @@ public:
             int v2 = faceIndices[i][2];
             int v3 = faceIndices[i][3];
 
-            // Add vertices with their normals
-            mesh.addVertex(positions[v0], normals[i]);
-            mesh.addVertex(positions[v1], normals[i]);
-            mesh.addVertex(positions[v2], normals[i]);
-            mesh.addVertex(positions[v3], normals[i]);
+            // Add vertices with their normals, the texture covers every face once
+            mesh.addVertex(positions[v0], normals[i], 0.f, 1.f);
+            mesh.addVertex(positions[v1], normals[i], 1.f, 1.f);
+            mesh.addVertex(positions[v2], normals[i], 1.f, 0.f);
+            mesh.addVertex(positions[v3], normals[i], 0.f, 0.f);
 
             // Add two triangles for the face
             int baseIndex = i * 4;
@@ -194,6 +232,7 @@ public:
 
         mesh.vertices.clear();
         mesh.triangles.clear();
+        mesh.texCoords.clear();
 
         // Create vertices
         for (int lat = 0; lat <= latitudeDivisions; ++lat) {
@@ -217,7 +256,8 @@ public:
                 normal.normalise();
                 normal[3] = 0.f;
 
-                mesh.addVertex(position, normal);
+                // u around the axis, v from pole to pole (the seam repeats the first column)
+                mesh.addVertex(position, normal, (float)lon / longitudeDivisions, (float)lat / latitudeDivisions);
             }
         }
 
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <immintrin.h>
+#include "tileDepth.h"
+
+constexpr unsigned int MAX_MSAA_SAMPLES = 8;	// samples per pixel of the densest pattern
+
+// Sample positions relative to the pixel centre in 1/16 pixel (the standard 4x and 8x patterns),
+// rotated grids so that near horizontal and near vertical edges get distinct coverage steps
+static const float MSAA_PATTERN_4[4][2] = { { -2, -6 }, { 6, -2 }, { -6, 2 }, { 2, 6 } };
+static const float MSAA_PATTERN_8[8][2] = { { 1, -3 }, { -1, 3 }, { 5, 1 }, { -3, -5 }, { -5, 5 }, { -7, -1 }, { 3, 7 }, { 7, -7 } };
+
+// Colour and depth of 4 or 8 samples per pixel (multisample anti-aliasing).
+// A triangle is shaded once per pixel and its colour lands on the samples it covers and wins.
+// Most pixels are covered by a single triangle, so a pixel starts out compressed: one colour and
+// the depth plane of the triangle at the pixel (depth at the centre and its change along x and y),
+// from which the depth of every sample is evaluated. Only when a triangle lands on some of the
+// samples is the pixel expanded into per sample colours and depths; it compresses again when a
+// triangle covers all of them. Clears and interior pixels touch 16 bytes per pixel instead of
+// 8 bytes per sample. Pixels are addressed with the PixelLayout index of the canvas.
+class MultisampleTarget {
+	unsigned int samples = 1;					// samples per pixel, 1 when unused
+	alignas(32) float offsetX[MAX_MSAA_SAMPLES];	// sample positions relative to the pixel centre
+	alignas(32) float offsetY[MAX_MSAA_SAMPLES];
+	__m256i laneMask;							// all ones in the lanes of the samples
+	float clearDepth = 1.f;						// farthest depth
+
+	std::vector<unsigned char> expanded;		// 1 if the pixel keeps per sample values
+	std::vector<depthPlane> planes;				// depth of a compressed pixel, c at the centre, a and b per pixel along x and y
+	std::vector<unsigned int> colours;			// colour of a compressed pixel
+	std::vector<float> sampleDepth;				// depth of every sample of an expanded pixel
+	std::vector<unsigned int> sampleColours;	// colour of every sample of an expanded pixel
+
+	// depth of the samples from a depth plane
+	__m256 evaluate(const depthPlane& p) const {
+		return _mm256_fmadd_ps(_mm256_set1_ps(p.a), _mm256_load_ps(offsetX),
+			_mm256_fmadd_ps(_mm256_set1_ps(p.b), _mm256_load_ps(offsetY), _mm256_set1_ps(p.c)));
+	}
+
+	// Switches a compressed pixel to per sample values
+	void expand(unsigned int i) {
+		expanded[i] = 1;
+		_mm256_maskstore_ps(&sampleDepth[(size_t)i * samples], laneMask, evaluate(planes[i]));
+		_mm256_maskstore_epi32(reinterpret_cast<int*>(&sampleColours[(size_t)i * samples]), laneMask, _mm256_set1_epi32(static_cast<int>(colours[i])));
+	}
+
+	// Average of the colours of the samples of an expanded pixel, rounded
+	unsigned int average(unsigned int i) const {
+		const unsigned int* s = &sampleColours[(size_t)i * samples];
+		__m128i sum;
+		if (samples == 8) {
+			__m256i p = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s));
+			__m256i pairs = _mm256_add_epi16(_mm256_unpacklo_epi8(p, _mm256_setzero_si256()), _mm256_unpackhi_epi8(p, _mm256_setzero_si256()));
+			sum = _mm_add_epi16(_mm256_castsi256_si128(pairs), _mm256_extracti128_si256(pairs, 1));
+		}
+		else {
+			__m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s));
+			sum = _mm_add_epi16(_mm_unpacklo_epi8(p, _mm_setzero_si128()), _mm_unpackhi_epi8(p, _mm_setzero_si128()));
+		}
+		sum = _mm_add_epi16(sum, _mm_srli_si128(sum, 8));	// 16 bit channel sums in the low 8 bytes
+		int shift = samples == 8 ? 3 : 2;
+		sum = _mm_srl_epi16(_mm_add_epi16(sum, _mm_set1_epi16(static_cast<short>(samples / 2))), _mm_cvtsi32_si128(shift));
+		return static_cast<unsigned int>(_mm_cvtsi128_si32(_mm_packus_epi16(sum, sum)));
+	}
+
+public:
+	// Allocates the samples of a canvas
+	// Input Variables:
+	// - pixels: pixels of the canvas (PixelLayout::size)
+	// - _samples: 4 or 8, anything else releases the buffers
+	void create(size_t pixels, unsigned int _samples) {
+		samples = _samples == 4 || _samples == 8 ? _samples : 1;
+		if (samples == 1) pixels = 0;
+		const float (*pattern)[2] = samples == 8 ? MSAA_PATTERN_8 : MSAA_PATTERN_4;
+		alignas(32) int lanes[MAX_MSAA_SAMPLES];
+		for (unsigned int s = 0; s < MAX_MSAA_SAMPLES; s++) {
+			offsetX[s] = s < samples ? pattern[s][0] / 16.f : 0.f;
+			offsetY[s] = s < samples ? pattern[s][1] / 16.f : 0.f;
+			lanes[s] = s < samples ? -1 : 0;
+		}
+		laneMask = _mm256_load_si256(reinterpret_cast<const __m256i*>(lanes));
+		clearDepth = DepthFormat::decode(DepthFormat::clearValue);
+
+		std::vector<unsigned char>(pixels, 0).swap(expanded);
+		std::vector<depthPlane>(pixels).swap(planes);
+		std::vector<unsigned int>(pixels).swap(colours);
+		std::vector<float>(pixels * samples).swap(sampleDepth);
+		std::vector<unsigned int>(pixels * samples).swap(sampleColours);
+	}
+
+	unsigned int getSamples() const { return samples; }
+
+	// coverage mask with every sample set
+	int fullMask() const { return (1 << samples) - 1; }
+
+	// sample positions relative to the pixel centre, MAX_MSAA_SAMPLES entries (unused ones are 0)
+	const float* getOffsetsX() const { return offsetX; }
+	const float* getOffsetsY() const { return offsetY; }
+
+	// Clears count pixels starting at index first to black and the farthest depth
+	void clearRange(unsigned int first, unsigned int count) {
+		memset(&expanded[first], 0, count);
+		std::fill(planes.begin() + first, planes.begin() + first + count, depthPlane{ 0.f, 0.f, clearDepth });
+		std::fill(colours.begin() + first, colours.begin() + first + count, 0u);
+	}
+
+	// Samples of a pixel where a fragment is nearer than the stored depth, one bit per sample
+	// Input Variables:
+	// - i: pixel index
+	// - depth: depth of the fragment at every sample
+	int test(unsigned int i, __m256 depth) const {
+		__m256 stored = expanded[i] ? _mm256_maskload_ps(&sampleDepth[(size_t)i * samples], laneMask) : evaluate(planes[i]);
+		__m256 nearer = DepthFormat::reversed ? _mm256_cmp_ps(depth, stored, _CMP_GT_OQ) : _mm256_cmp_ps(depth, stored, _CMP_LT_OQ);
+		return _mm256_movemask_ps(nearer) & fullMask();
+	}
+
+	// Stores a fragment on some samples of a pixel
+	// DepthWrite, ColourWrite : parts of the fragment that are stored (see PixelFeature)
+	// Input Variables:
+	// - i: pixel index
+	// - mask: samples to write, one bit per sample
+	// - plane: depth plane of the fragment at the pixel (c at the centre, a and b per pixel along x and y)
+	// - depth: depth of the fragment at every sample (plane evaluated at the samples)
+	// - colour: packed colour of the fragment
+	template<bool DepthWrite, bool ColourWrite>
+	void write(unsigned int i, int mask, const depthPlane& plane, __m256 depth, unsigned int colour) {
+		if (mask == fullMask() && (DepthWrite || !expanded[i]) && (ColourWrite || !expanded[i])) {
+			expanded[i] = 0;
+			if constexpr (DepthWrite) planes[i] = plane;
+			if constexpr (ColourWrite) colours[i] = colour;
+			return;
+		}
+		if (!expanded[i]) expand(i);
+		// per sample lane mask from the sample bits
+		__m256i bits = _mm256_and_si256(_mm256_set1_epi32(mask), _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128));
+		__m256i lanes = _mm256_cmpeq_epi32(bits, _mm256_setzero_si256());
+		lanes = _mm256_andnot_si256(lanes, laneMask);
+		if constexpr (DepthWrite) _mm256_maskstore_ps(&sampleDepth[(size_t)i * samples], lanes, depth);
+		if constexpr (ColourWrite) _mm256_maskstore_epi32(reinterpret_cast<int*>(&sampleColours[(size_t)i * samples]), lanes, _mm256_set1_epi32(static_cast<int>(colour)));
+	}
+
+	// Resolves count pixels starting at index first into one colour per pixel (sample average).
+	// Runs of 8 compressed pixels are copied with a single load and store.
+	// Input Variables:
+	// - image: colour buffer with the same layout
+	void resolveRange(unsigned int* image, unsigned int first, unsigned int count) const {
+		unsigned int i = first, end = first + count;
+		for (; i + 8 <= end; i += 8) {
+			unsigned long long flags;
+			memcpy(&flags, &expanded[i], sizeof(flags));
+			if (!flags) {
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(image + i), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&colours[i])));
+				continue;
+			}
+			for (unsigned int j = i; j < i + 8; j++)
+				image[j] = expanded[j] ? average(j) : colours[j];
+		}
+		for (; i < end; i++)
+			image[i] = expanded[i] ? average(i) : colours[i];
+	}
+};
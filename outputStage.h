@@ -0,0 +1,133 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include "framebuffer.h"
+
+// Output stage running on its own thread.
+// Finished frames are handed over through a small ring of framebuffers: the render thread
+// acquires a free slot, swaps its framebuffer with the one in the slot (no pixels are copied)
+// and submits it. The output thread passes submitted frames to the sink in order (upload to the
+// window, encode to disk, ...) and then returns the slot to the free list. The render thread
+// only waits when every slot is still queued, i.e. when output is slower than rendering.
+class OutputStage {
+public:
+	// one frame in flight
+	struct slot {
+		Framebuffer image;					// finished frame
+		std::vector<unsigned char> blank;	// per tile clear state of the image (see Renderer)
+	};
+
+	// consumer of finished frames, called on the output thread
+	using Sink = std::function<void(const Framebuffer&)>;
+
+private:
+	std::vector<slot> slots;
+	std::deque<int> freeSlots;		// slots the render thread may fill
+	std::deque<int> readySlots;		// submitted slots in submission order
+	std::mutex lock;
+	std::condition_variable changed;
+	std::thread worker;
+	Sink sink;
+	bool stopping = false;
+	int lastSubmitted = -1;			// slot of the newest frame, -1 before the first submit
+
+	// Output thread: drain submitted frames until stopped
+	void run() {
+		while (true) {
+			int s;
+			{
+				std::unique_lock<std::mutex> guard(lock);
+				changed.wait(guard, [&] { return stopping || !readySlots.empty(); });
+				if (readySlots.empty()) return; // stopping and nothing left to output
+				s = readySlots.front();
+				readySlots.pop_front();
+			}
+
+			sink(slots[s].image);
+
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				freeSlots.push_back(s);
+			}
+			changed.notify_all();
+		}
+	}
+
+public:
+	OutputStage() = default;
+	OutputStage(const OutputStage&) = delete;
+	OutputStage& operator=(const OutputStage&) = delete;
+
+	// Allocates the ring and starts the output thread
+	// Input Variables:
+	// - width, height : size of the frames
+	// - tileCount : number of tiles tracked in slot::blank
+	// - ringSize : frames that can be in flight (2 or 3 is enough to hide the output)
+	// - _sink : consumer of finished frames
+	void start(unsigned int width, unsigned int height, int tileCount, int ringSize, Sink _sink) {
+		stop();
+		sink = std::move(_sink);
+		slots = std::vector<slot>(ringSize);
+		freeSlots.clear();
+		for (int i = 0; i < ringSize; i++) {
+			slots[i].image.create(width, height);
+			slots[i].blank.assign(tileCount, 1); // allocated black
+			freeSlots.push_back(i);
+		}
+		stopping = false;
+		lastSubmitted = -1;
+		worker = std::thread(&OutputStage::run, this);
+	}
+
+	bool running() const { return worker.joinable(); }
+
+	// Waits for a free slot and returns its index (render thread)
+	int acquire() {
+		std::unique_lock<std::mutex> guard(lock);
+		changed.wait(guard, [&] { return !freeSlots.empty(); });
+		int s = freeSlots.front();
+		freeSlots.pop_front();
+		return s;
+	}
+
+	slot& get(int s) { return slots[s]; }
+
+	// Queues a filled slot for output (render thread)
+	void submit(int s) {
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			readySlots.push_back(s);
+		}
+		lastSubmitted = s;
+		changed.notify_all();
+	}
+
+	// Slot of the newest submitted frame, -1 if none was submitted since start (render thread)
+	int last() const { return lastSubmitted; }
+
+	// Blocks until every submitted frame has been output
+	void flush() {
+		std::unique_lock<std::mutex> guard(lock);
+		changed.wait(guard, [&] { return freeSlots.size() == slots.size(); });
+	}
+
+	// Outputs the remaining frames and joins the output thread
+	void stop() {
+		if (!worker.joinable()) return;
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			stopping = true;
+		}
+		changed.notify_all();
+		worker.join();
+	}
+
+	~OutputStage() {
+		stop();
+	}
+};
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <functional>
+#include "render.h"
+
+// Pipelined frame loop.
+// Every call to frame() overlaps three frames: the geometry (update, vertex processing and
+// binning) of frame N+1 runs on its own thread while the tiles of frame N are rasterized by
+// the worker threads and the main thread presents frame N-1 from the renderer back buffer.
+// Geometry results are double buffered in two frame slots, colour is double buffered by the
+// renderer (framebuffer and back buffer), so no stage reads data another stage is writing.
+// The displayed image lags input by one extra frame in exchange for the higher throughput.
+class FramePipeline {
+	// per frame data produced by the geometry stage and consumed by the raster stage
+	struct frameSlot {
+		std::vector<triangleData> triangles;			// screen space triangles
+		std::vector<std::vector<unsigned int>> bins;	// triangle indices per tile
+		TileLights tileLights;							// point and spot lights binned into tiles
+		ShadowMaps shadows;								// shadow maps of the lights casting shadows
+		LightParams light;								// light of the frame
+	};
+
+	Renderer& renderer;
+	unsigned int totalThreads;	// raster threads
+	frameSlot slots[2];
+	int current = 0;			// slot rasterized this frame
+	bool primed = false;		// current slot holds geometry
+	bool hasPrevious = false;	// back buffer holds a finished frame
+
+	// Runs the geometry stage into a slot
+	// Input Variables:
+	// - slot : slot to fill
+	// - meshes : array of meshes
+	// - L : light
+	// - update : scene update applied before the geometry is processed
+	void geometry(frameSlot& slot, const std::vector<Mesh*>& meshes, Light L, const std::function<void()>& update) {
+		PROFILE_ZONE("geometry");
+		if (update) {
+			PROFILE_ZONE("update");
+			update();
+		}
+
+		L.omega_i.normalise();
+
+		unsigned int width = renderer.framebuffer.getWidth();
+		unsigned int height = renderer.framebuffer.getHeight();
+		processGeometry(meshes, renderer.vp, renderer.getVPStamp(), L, renderer.getEye(), renderer.gouraudDistance, width, height, slot.triangles);
+		binTriangles(slot.triangles, renderer.tiles, width, height, renderer.getMultisampling() > 1, slot.bins);
+		slot.tileLights.build(L.locals, renderer.vp, renderer.tiles, width, height);
+		slot.light = makeLightParams(L, renderer.getViewDir(), &slot.tileLights, drawShadowMaps(meshes, renderer, L, slot.shadows, totalThreads));
+	}
+
+public:
+	// Input Variables:
+	// - _renderer : renderer drawing the frames (gets a back buffer)
+	// - _totalThreads : number of raster threads
+	FramePipeline(Renderer& _renderer, unsigned int _totalThreads = 3) : renderer(_renderer), totalThreads(_totalThreads) {
+		renderer.createBackBuffer();
+	}
+
+	// Renders one frame of the pipeline
+	// Input Variables:
+	// - meshes : array of meshes (read by the geometry stage only)
+	// - L : light
+	// - update : scene update for the next frame (camera, animation and renderer.updateVP),
+	//			  runs on the geometry thread and must not touch the canvas
+	void frame(const std::vector<Mesh*>& meshes, Light& L, const std::function<void()>& update) {
+		PROFILE_ZONE("frame");
+
+		// the first frame has nothing to overlap with
+		if (!primed) {
+			geometry(slots[current], meshes, L, update);
+			primed = true;
+		}
+
+		frameSlot& next = slots[current ^ 1];
+		frameSlot& draw = slots[current];
+
+		renderer.clear();
+
+		std::thread geometryThread(&FramePipeline::geometry, this, std::ref(next), std::cref(meshes), L, std::cref(update));
+		std::thread rasterThread(rasterTiles, std::ref(draw.triangles), std::cref(draw.bins), std::ref(renderer), std::cref(draw.light), totalThreads);
+
+		// present stays on the main thread, the window belongs to it
+		if (hasPrevious) renderer.presentBackBuffer();
+
+		rasterThread.join();
+		geometryThread.join();
+
+		renderer.finishFrame();
+		hasPrevious = true;
+		current ^= 1;
+	}
+
+	// Presents the last finished frame (call after the final frame() when leaving the loop)
+	void finish() {
+		if (hasPrevious) renderer.presentBackBuffer();
+		hasPrevious = false;
+	}
+};
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <vector>
+#include <immintrin.h>
+#include "tiles.h"
+
+constexpr int SWIZZLE_BLOCK = 8;								// edge length of the pixel blocks inside a tile
+constexpr int BLOCK_PIXELS = SWIZZLE_BLOCK * SWIZZLE_BLOCK;		// pixels of a block
+constexpr int TILE_PIXELS = TILE_SIZE * TILE_SIZE;				// pixels of a tile, edge tiles are padded to the full size
+
+// Memory order of the per pixel buffers written while drawing a frame (colour target and depth).
+// Tiles are stored one after the other in tile order (see TileGrid), the 8x8 blocks of a tile
+// follow the Morton curve and the pixels of a block are row major. A triangle's footprint in a
+// tile then touches a few neighbouring cache lines instead of one line per canvas row, a tile
+// is one contiguous range (clears, resolves), and a block row is still 8 contiguous pixels.
+// The index of (x, y) is the sum of a part depending only on x and a part depending only on y,
+// both kept in tables, so raster loops look up a row offset once and add a column offset.
+class PixelLayout {
+	std::vector<unsigned int> columns;	// part of the index depending on x
+	std::vector<unsigned int> rows;		// part of the index depending on y
+	int width = 0, height = 0;			// dimensions of the canvas
+	int tilesX = 0, tilesY = 0;			// number of tiles along each axis
+
+	// Moves bit i of v to bit 2i
+	static unsigned int spreadBits(unsigned int v) {
+		v = (v | (v << 4)) & 0x0F0F0F0Fu;
+		v = (v | (v << 2)) & 0x33333333u;
+		v = (v | (v << 1)) & 0x55555555u;
+		return v;
+	}
+
+public:
+	// Creates the layout of a canvas
+	// Input Variables:
+	// - w: Width of the canvas.
+	// - h: Height of the canvas.
+	void create(int w, int h) {
+		width = w;
+		height = h;
+		tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+		tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+
+		// block x takes the even bits of the Morton index, block y the odd ones
+		columns.resize(width);
+		for (int x = 0; x < width; x++) {
+			unsigned int block = spreadBits((x % TILE_SIZE) / SWIZZLE_BLOCK);
+			columns[x] = (x / TILE_SIZE) * TILE_PIXELS + block * BLOCK_PIXELS + x % SWIZZLE_BLOCK;
+		}
+		rows.resize(height);
+		for (int y = 0; y < height; y++) {
+			unsigned int block = spreadBits((y % TILE_SIZE) / SWIZZLE_BLOCK) << 1;
+			rows[y] = (y / TILE_SIZE) * tilesX * TILE_PIXELS + block * BLOCK_PIXELS + (y % SWIZZLE_BLOCK) * SWIZZLE_BLOCK;
+		}
+	}
+
+	// pixels of a buffer with this layout, including the padding of the edge tiles
+	size_t size() const { return (size_t)tilesX * tilesY * TILE_PIXELS; }
+
+	// index of the pixel at (x, y)
+	unsigned int index(int x, int y) const { return rows[y] + columns[x]; }
+
+	// part of the index of a pixel depending on its row (index = rowOffset(y) + columnOffset(x))
+	unsigned int rowOffset(int y) const { return rows[y]; }
+
+	// part of the index of a pixel depending on its column
+	unsigned int columnOffset(int x) const { return columns[x]; }
+
+	// index of the first pixel of a tile, the tile's TILE_PIXELS pixels follow it
+	// Input Variables:
+	// - tile: linear tile index (tile = tilesX * ty + tx)
+	unsigned int tileOffset(int tile) const { return tile * TILE_PIXELS; }
+
+	// Copies the pixels of a tile into a row major image, 8 pixels per load and store
+	// Input Variables:
+	// - pixels: buffer in this layout (64-byte aligned)
+	// - image: row major image of the canvas
+	// - r: pixel rectangle of the tile (see TileGrid::getRect)
+	void resolveTile(const unsigned int* pixels, unsigned int* image, const tileRect& r) const {
+		for (int y = r.minY; y < r.maxY; y++) {
+			const unsigned int* src = pixels + rows[y];
+			unsigned int* dst = image + (size_t)y * width;
+			int x = r.minX;
+			for (; x + SWIZZLE_BLOCK <= r.maxX; x += SWIZZLE_BLOCK)
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x), _mm256_load_si256(reinterpret_cast<const __m256i*>(src + columns[x])));
+			for (; x < r.maxX; x++)
+				dst[x] = src[columns[x]];
+		}
+	}
+};
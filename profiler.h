@@ -0,0 +1,163 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Scoped profiler.
+// A zone measures the lifetime of a PROFILE_ZONE object and is recorded when it ends, so zones
+// nested in the same thread form a hierarchy by time containment. Every thread writes into its
+// own ring buffer without locks or atomic read-modify-write (only the owner thread writes, the
+// head is published with a release store); when a ring is full the oldest zones are overwritten.
+// Rings are returned to a pool when their thread exits and reused by the next thread, so the
+// short lived worker threads of the render functions do not allocate a ring every frame.
+// The recorded zones are exported as Chrome trace JSON, which chrome://tracing and
+// https://ui.perfetto.dev open directly, one track per ring (the first thread to record gets track 1).
+
+// zones are compiled out completely when 0
+#ifndef PROFILER_ENABLED
+#define PROFILER_ENABLED 1
+#endif
+
+class Profiler {
+public:
+	// one finished zone
+	struct zone {
+		const char* name;			// static string naming the zone
+		long long start, end;		// nanoseconds since the profiler epoch
+	};
+
+	// ring of zones written by a single thread
+	struct ring {
+		static constexpr unsigned int CAPACITY = 1 << 15;	// zones kept per ring (power of two)
+		zone zones[CAPACITY];
+		std::atomic<unsigned long long> head{ 0 };			// zones written so far
+		int track = 0;										// track id in the trace
+	};
+
+private:
+	std::mutex lock;								// guards the ring lists, never taken while recording
+	std::vector<std::unique_ptr<ring>> rings;		// every ring ever created
+	std::vector<ring*> freeRings;					// rings of exited threads
+	std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+	// Hands out a ring to a thread that records its first zone
+	ring* acquire() {
+		std::lock_guard<std::mutex> guard(lock);
+		if (!freeRings.empty()) {
+			ring* r = freeRings.back();
+			freeRings.pop_back();
+			return r;
+		}
+		rings.push_back(std::make_unique<ring>());
+		rings.back()->track = static_cast<int>(rings.size());
+		return rings.back().get();
+	}
+
+	void release(ring* r) {
+		std::lock_guard<std::mutex> guard(lock);
+		freeRings.push_back(r);
+	}
+
+	// Owner of the ring of the calling thread, returns it when the thread exits
+	struct threadRing {
+		ring* r = nullptr;
+		~threadRing() { if (r) get().release(r); }
+	};
+
+	Profiler() = default;
+
+public:
+	std::atomic<bool> enabled{ false };	// zones are only recorded while enabled
+
+	Profiler(const Profiler&) = delete;
+	Profiler& operator=(const Profiler&) = delete;
+
+	// Get the singleton instance
+	static Profiler& get() {
+		static Profiler instance;
+		return instance;
+	}
+
+	// Nanoseconds since the profiler epoch
+	long long now() const {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+	}
+
+	// Records a finished zone into the ring of the calling thread
+	void record(const char* name, long long start, long long end) {
+		static thread_local threadRing local;
+		if (!local.r) local.r = acquire();
+
+		ring& r = *local.r;
+		unsigned long long h = r.head.load(std::memory_order_relaxed);
+		r.zones[h & (ring::CAPACITY - 1)] = { name, start, end };
+		r.head.store(h + 1, std::memory_order_release);
+	}
+
+	// Drops all recorded zones (call while no thread is recording)
+	void reset() {
+		std::lock_guard<std::mutex> guard(lock);
+		for (auto& r : rings)
+			r->head.store(0, std::memory_order_relaxed);
+	}
+
+	// Writes the recorded zones as Chrome trace JSON (call while no thread is recording)
+	// Input Variables:
+	// - filename : output file
+	// Returns false if the file could not be written.
+	bool exportChromeTrace(const std::string& filename) {
+		std::ofstream file(filename);
+		if (!file) return false;
+
+		std::lock_guard<std::mutex> guard(lock);
+		file << std::fixed << std::setprecision(3);
+		file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+		bool first = true;
+		for (auto& r : rings) {
+			file << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << r->track
+				<< ",\"args\":{\"name\":\"thread " << r->track << "\"}}";
+			first = false;
+
+			unsigned long long head = r->head.load(std::memory_order_acquire);
+			unsigned long long begin = head > ring::CAPACITY ? head - ring::CAPACITY : 0;
+			for (unsigned long long i = begin; i < head; i++) {
+				const zone& z = r->zones[i & (ring::CAPACITY - 1)];
+				// complete events, timestamps and durations in microseconds
+				file << ",\n{\"name\":\"" << z.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << r->track
+					<< ",\"ts\":" << z.start / 1000.0 << ",\"dur\":" << (z.end - z.start) / 1000.0 << "}";
+			}
+		}
+		file << "\n]}\n";
+		return true;
+	}
+};
+
+// Zone measuring its own lifetime (use through PROFILE_ZONE)
+class ProfileZone {
+	const char* name;
+	long long start;
+public:
+	// Input Variables:
+	// - _name : static string naming the zone
+	ProfileZone(const char* _name) : name(_name), start(Profiler::get().enabled.load(std::memory_order_relaxed) ? Profiler::get().now() : -1) {}
+
+	~ProfileZone() {
+		if (start >= 0) Profiler::get().record(name, start, Profiler::get().now());
+	}
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+
+#if PROFILER_ENABLED
+// Profiles the rest of the enclosing scope under the given name
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#else
+#define PROFILE_ZONE(name)
+#endif
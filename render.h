@@ -1,27 +1,39 @@
 #pragma once
 #include "triangle.h"
 #include <vector>
+#include <span>
 #include <thread>
 #include "sentinelQueue.h"
 
 // store temporary data for triangle rendering
 struct triangleData
 {
-	triangle tri;	// triangle
-	color a;		// ambient light
-	color d;		// diffuse light
+	triangle tri;		// triangle
+	ShadeParams shade;	// shading constants of its mesh
 
 	triangleData() = default;
-	triangleData(triangle _tri, color _a, color _d) :tri(_tri), a(_a), d(_d) {
+	triangleData(triangle _tri, const ShadeParams& _shade) :tri(_tri), shade(_shade) {
 	}
 };
 
 static std::atomic<int> triCounter;		// atomic triangle index counter for threads
 static std::atomic<int> meshCounter;	// atomic mesh index counter for threads
 static std::atomic<bool> meshProcessed;	// indicator for triangle threads to join
+static std::atomic<int> tileCounter;	// atomic tile index counter for threads
 
 static SentinelQueue<triangleData> queue;
 
+static ShadowMaps shadowMaps;			// shadow maps of the frame drawn by the render functions
+
+// projection matrix of a mesh, cached by the transform hierarchy when it was computed for this view projection
+// Input Variables:
+// - mesh : mesh to draw
+// - vp : view projection matrix
+// - vpStamp : stamp of vp (Renderer::getVPStamp)
+static inline matrix meshProjection(const Mesh* mesh, const matrix& vp, unsigned int vpStamp) {
+	return mesh->mvpStamp == vpStamp ? mesh->mvp : vp * mesh->world;
+}
+
 // process vertex for triangle
 // Input Variables:
 // - p : projection matrix
@@ -49,17 +61,163 @@ static inline void processVertex(const matrix& p, const matrix& w, const Vertex&
 	out.rgb = mv.rgb;
 }
 
+// process all vertices of a mesh at once
+// positions and normals go through the batched matrix transforms (two vertices per AVX register),
+// then perspective division and the screen mapping run per vertex
+// Input Variables:
+// - p : projection matrix
+// - w : world matrix of mesh
+// - in : mesh vertices
+// - width : width of canvas
+// - height : height of canvas
+// Output Variables:
+// - out : transformed vertices (at least in.size())
+static inline void processVertices(const matrix& p, const matrix& w, std::span<const Vertex> in,
+	const unsigned int& width, const unsigned int& height, std::span<Vertex> out)
+{
+	if (in.empty()) return;
+	matrix::transformPoints(p, &in[0].p, sizeof(Vertex), &out[0].p, sizeof(Vertex), in.size());
+	matrix::transformPoints(w, &in[0].normal, sizeof(Vertex), &out[0].normal, sizeof(Vertex), in.size());
+
+	for (size_t i = 0; i < in.size(); i++) {
+		Vertex& v = out[i];
+		v.p.divideW();
+		v.normal.normalise();
+		v.p[0] = (v.p[0] + 1.f) * 0.5f * width;
+		v.p[1] = height - (v.p[1] + 1.f) * 0.5f * height;
+		v.rgb = in[i].rgb;
+	}
+}
+
+// process all vertices of a Gouraud mesh at once, lighting them in object space
+// only positions are transformed, the normals stay in object space and the Lambert term against the
+// object space light becomes the vertex colour, so fragments only interpolate a colour
+// Input Variables:
+// - p : projection matrix
+// - light : light of the mesh in object space (makeVertexLight)
+// - in : mesh vertices
+// - width : width of canvas
+// - height : height of canvas
+// Output Variables:
+// - out : transformed and lit vertices (at least in.size())
+static inline void processVerticesLit(const matrix& p, const VertexLight& light, std::span<const Vertex> in,
+	const unsigned int& width, const unsigned int& height, std::span<Vertex> out)
+{
+	if (in.empty()) return;
+	matrix::transformPoints(p, &in[0].p, sizeof(Vertex), &out[0].p, sizeof(Vertex), in.size());
+
+	for (size_t i = 0; i < in.size(); i++) {
+		Vertex& v = out[i];
+		v.p.divideW();
+		v.p[0] = (v.p[0] + 1.f) * 0.5f * width;
+		v.p[1] = height - (v.p[1] + 1.f) * 0.5f * height;
+		v.normal = in[i].normal;
+
+		color c = in[i].rgb;
+		c.clampColour();
+		float dot = max(vec4::dot(light.omega_i, in[i].normal), 0.0f);
+		v.rgb = c * dot * light.diffuse + light.ambient;
+	}
+}
+
+// 1 / w of the vertices of a textured mesh, kept in the unused w of the screen position
+// u / w, v / w and 1 / w vary linearly across the screen, the shaders build them from the mesh's
+// texture coordinates, interpolate them and divide per fragment (TexturedSurface). w is the last
+// row of the projection, recomputed here so the position loops of untextured meshes stay as they are.
+// Input Variables:
+// - p : projection matrix
+// - in : mesh vertices
+// Output Variables:
+// - out : transformed vertices (at least in.size())
+static inline void processInverseW(const matrix& p, std::span<const Vertex> in, std::span<Vertex> out)
+{
+	for (size_t i = 0; i < in.size(); i++) {
+		const vec4& pos = in[i].p;
+		out[i].p[3] = 1.f / (p[12] * pos[0] + p[13] * pos[1] + p[14] * pos[2] + p[15] * pos[3]);
+	}
+}
+
+// shading constants of a mesh
+// lambert meshes farther than gouraudDistance from the camera switch to per vertex lighting
+// Input Variables:
+// - mesh : mesh to draw
+// - L : light
+// - eye : world space camera position
+// - gouraudDistance : distance of the switch, 0 to never switch
+static inline ShadeParams meshShadeParams(const Mesh* mesh, const Light& L, const vec4& eye, float gouraudDistance)
+{
+	ShadeParams shade = makeShadeParams(L, mesh->ka, mesh->kd, mesh->material);
+	if (shade.texture) shade.mesh = mesh;
+	if (gouraudDistance > 0.f && shade.model == ShadingModel::Lambert) {
+		vec4 offset = mesh->world.mul_point(vec4(0.f, 0.f, 0.f, 1.f)) - eye;	// from the camera to the mesh origin
+		if (vec4::dot(offset, offset) > gouraudDistance * gouraudDistance)
+			shade.model = ShadingModel::Gouraud;
+	}
+	return shade;
+}
+
+// transforms the vertices of a mesh into a buffer of the calling thread
+// every vertex is transformed once, however many triangles share it. Meshes whose first triangle
+// is clipped are dropped by the triangle loops, so only that triangle is transformed for them.
+// Input Variables:
+// - mesh : mesh to draw
+// - p : projection matrix of the mesh
+// - width, height : size of the canvas
+// - omega_i : normalised world space direction towards the light
+// - shade : shading constants of the mesh, Gouraud meshes are lit here
+// Returns the screen space vertices, valid until the thread transforms the next mesh
+static const std::vector<Vertex>& transformMesh(const Mesh* mesh, const matrix& p, unsigned int width, unsigned int height,
+	const vec4& omega_i, const ShadeParams& shade)
+{
+	thread_local std::vector<Vertex> transformed; // capacity is kept between meshes
+	const std::vector<Vertex>& vertices = mesh->getVertices();
+	transformed.resize(vertices.size());
+	if (mesh->getTriangles().empty()) return transformed;
+
+	const triIndices& first = mesh->getTriangles()[0];
+	for (unsigned int k = 0; k < 3; k++) {
+		Vertex& v = transformed[first.v[k]];
+		processVertex(p, mesh->world, vertices[first.v[k]], width, height, v);
+		if (fabs(v.p[2]) > 1.0f) return transformed;
+	}
+
+	if (shade.model == ShadingModel::Gouraud)
+		processVerticesLit(p, makeVertexLight(omega_i, mesh->world, shade), vertices, width, height, transformed);
+	else
+		processVertices(p, mesh->world, vertices, width, height, transformed);
+	if (shade.texture)
+		processInverseW(p, vertices, transformed);
+	return transformed;
+}
+
+// Draws the shadow maps of the lights casting shadows with the depth only pass
+// Input Variables:
+// - meshes : shadow casters
+// - renderer : renderer of the frame (camera)
+// - L : light (direction already normalised)
+// - maps : shadow maps to draw into
+// - totalThreads : number of threads to use for multithreading
+// Returns the maps for LightParams, nullptr when no light casts shadows
+static const ShadowMaps* drawShadowMaps(const std::vector<Mesh*>& meshes, const Renderer& renderer, const Light& L,
+	ShadowMaps& maps, unsigned int totalThreads)
+{
+	maps.build(meshes, L, renderer.vp, renderer.getEye(), renderer.getViewDir(),
+		renderer.framebuffer.getWidth(), renderer.framebuffer.getHeight(), totalThreads);
+	return maps.empty() ? nullptr : &maps;
+}
+
 // Method to draw triangles with multi threading
 // Input Variables:
 // - tris		: pointer to triangle array 
 // - total		: size of triangle array 
 // - renderer	: reference to renderer 
-// - L			: reference to Light
-static void drawTriangles(triangleData* tris, int total, Renderer& renderer, vec4 lightDir)
+// - light		: light of the frame
+static void drawTriangles(triangleData* tris, int total, Renderer& renderer, LightParams light)
 {
+	PROFILE_ZONE("raster");
 	int i;
 	while ((i = triCounter.fetch_add(1)) < total)
-		tris[i].tri.draw(renderer, lightDir, tris[i].a, tris[i].d);
+		tris[i].tri.draw(renderer, light, tris[i].shade);
 }
 
 // method processes and draws triangles using caching
@@ -67,37 +225,46 @@ static void drawTriangles(triangleData* tris, int total, Renderer& renderer, vec
 // - renderer : reference to the renderer
 // - L : light
 // default value set to 3 works best for this value
-static void renderCaching(const std::vector<Mesh*>& meshes, Renderer& renderer, Light& L)
+static void renderCaching(const std::vector<Mesh*>& meshes, Renderer& renderer, Light L)
 {
-	L.omega_i.normalise(); // normalize light before rendering
+	PROFILE_ZONE("render caching");
+	L.omega_i.normalise(); // normalize this frame's copy of the light
 
 	// cache canvas width and height
-	unsigned int width = renderer.canvas.getWidth();
-	unsigned int height = renderer.canvas.getHeight();
+	unsigned int width = renderer.framebuffer.getWidth();
+	unsigned int height = renderer.framebuffer.getHeight();
+
+	TileLights tileLights;
+	tileLights.build(L.locals, renderer.vp, renderer.tiles, width, height);
+	LightParams light = makeLightParams(L, renderer.getViewDir(), &tileLights, drawShadowMaps(meshes, renderer, L, shadowMaps, 1));
 
 	for (auto& mesh : meshes)
 	{
-		matrix p = renderer.vp * mesh->world;	// calculate projection matrix for the mesh
+		matrix p = meshProjection(mesh, renderer.vp, renderer.getVPStamp());	// projection matrix of the mesh
+
+		// calculate the shading constants of the mesh
+		ShadeParams shade = meshShadeParams(mesh, L, renderer.getEye(), renderer.gouraudDistance);
+
+		RENDER_STAT(meshesSubmitted, 1);
+		RENDER_STAT(trianglesSubmitted, mesh->getTriangles().size());
 
-		// calculate diffuse and ambient lights for mesh
-		color ambient = L.ambient * mesh->ka;
-		color diffuse = L.L * mesh->kd;
+		const std::vector<Vertex>& vertices = transformMesh(mesh, p, width, height, L.omega_i, shade);
 
 		// process all triangles of mesh
-		for (int i = 0; i < mesh->triangles.size(); i++)
+		for (size_t i = 0; i < mesh->getTriangles().size(); i++)
 		{
-			Vertex t[3];						// Temporary array to store transformed triangle vertices
-
-			// process all 3 vertices of triangles (loop unrolling)
-			processVertex(p, mesh->world, mesh->vertices[mesh->triangles[i].v[0]], width, height, t[0]);
-			processVertex(p, mesh->world, mesh->vertices[mesh->triangles[i].v[1]], width, height, t[1]);
-			processVertex(p, mesh->world, mesh->vertices[mesh->triangles[i].v[2]], width, height, t[2]);
+			const triIndices& ind = mesh->getTriangles()[i];
+			const Vertex* t[3] = { &vertices[ind.v[0]], &vertices[ind.v[1]], &vertices[ind.v[2]] }; // transformed vertices of the triangle
 
 			// Clip triangles with Z-values outside [-1, 1]
-			if (fabs(t[0].p[2]) > 1.0f || fabs(t[1].p[2]) > 1.0f || fabs(t[2].p[2]) > 1.0f) break;
+			if (fabs(t[0]->p[2]) > 1.0f || fabs(t[1]->p[2]) > 1.0f || fabs(t[2]->p[2]) > 1.0f) {
+				RENDER_STAT(trianglesClipped, mesh->getTriangles().size() - i);
+				RENDER_STAT(meshesCulled, i == 0);
+				break;
+			}
 
 			// Create and render triangle object 
-			triangle(t[0], t[1], t[2]).draw(renderer, L.omega_i, ambient, diffuse);
+			triangle(*t[0], *t[1], *t[2], static_cast<unsigned int>(i)).draw(renderer, light, shade);
 		}
 	}
 }
@@ -108,39 +275,51 @@ static void renderCaching(const std::vector<Mesh*>& meshes, Renderer& renderer,
 // - L : light
 // - totalThreads : number of threads to use for multithreading
 // default value set to 3 works best for this value
-static void renderSharedCounter(const std::vector<Mesh*>& meshes, Renderer& renderer, Light& L, unsigned int totalThreads = 3)
+static void renderSharedCounter(const std::vector<Mesh*>& meshes, Renderer& renderer, Light L, unsigned int totalThreads = 3)
 {
-	L.omega_i.normalise(); // normalize light before rendering
+	PROFILE_ZONE("render shared counter");
+	L.omega_i.normalise(); // normalize this frame's copy of the light
 
 	// cache canvas width and height
-	unsigned int width = renderer.canvas.getWidth();
-	unsigned int height = renderer.canvas.getHeight();
+	unsigned int width = renderer.framebuffer.getWidth();
+	unsigned int height = renderer.framebuffer.getHeight();
+
+	TileLights tileLights;
+	tileLights.build(L.locals, renderer.vp, renderer.tiles, width, height);
+	LightParams light = makeLightParams(L, renderer.getViewDir(), &tileLights, drawShadowMaps(meshes, renderer, L, shadowMaps, totalThreads));
 
 	std::vector<triangleData> triangles;
 
-	for (auto& mesh : meshes)
 	{
-		matrix p = renderer.vp * mesh->world; // calculate projection matrix for the mesh
+		PROFILE_ZONE("vertex");
+		for (auto& mesh : meshes)
+		{
+			matrix p = meshProjection(mesh, renderer.vp, renderer.getVPStamp()); // projection matrix of the mesh
 
-		// calculate diffuse and ambient lights for mesh
-		color ambient = L.ambient * mesh->ka;
-		color diffuse = L.L * mesh->kd;
+			// calculate the shading constants of the mesh
+			ShadeParams shade = meshShadeParams(mesh, L, renderer.getEye(), renderer.gouraudDistance);
 
-		// process all triangles of mesh
-		for (int i = 0; i < mesh->triangles.size(); i++)
-		{
-			Vertex t[3]; // Temporary array to store transformed triangle vertices
+			RENDER_STAT(meshesSubmitted, 1);
+			RENDER_STAT(trianglesSubmitted, mesh->getTriangles().size());
 
-			// process all 3 vertices of triangles (loop unrolling)
-			processVertex(p, mesh->world, mesh->vertices[mesh->triangles[i].v[0]], width, height, t[0]);
-			processVertex(p, mesh->world, mesh->vertices[mesh->triangles[i].v[1]], width, height, t[1]);
-			processVertex(p, mesh->world, mesh->vertices[mesh->triangles[i].v[2]], width, height, t[2]);
+			const std::vector<Vertex>& vertices = transformMesh(mesh, p, width, height, L.omega_i, shade);
 
-			// Clip triangles with Z-values outside [-1, 1]
-			if (fabs(t[0].p[2]) > 1.0f || fabs(t[1].p[2]) > 1.0f || fabs(t[2].p[2]) > 1.0f) break;
+			// process all triangles of mesh
+			for (size_t i = 0; i < mesh->getTriangles().size(); i++)
+			{
+				const triIndices& ind = mesh->getTriangles()[i];
+				const Vertex* t[3] = { &vertices[ind.v[0]], &vertices[ind.v[1]], &vertices[ind.v[2]] }; // transformed vertices of the triangle
 
-			// add triangle to triangle list
-			triangles.emplace_back(triangleData(triangle(t[0], t[1], t[2]), ambient, diffuse));
+				// Clip triangles with Z-values outside [-1, 1]
+				if (fabs(t[0]->p[2]) > 1.0f || fabs(t[1]->p[2]) > 1.0f || fabs(t[2]->p[2]) > 1.0f) {
+					RENDER_STAT(trianglesClipped, mesh->getTriangles().size() - i);
+					RENDER_STAT(meshesCulled, i == 0);
+					break;
+				}
+
+				// add triangle to triangle list
+				triangles.emplace_back(triangleData(triangle(*t[0], *t[1], *t[2], static_cast<unsigned int>(i)), shade));
+			}
 		}
 	}
 
@@ -148,55 +327,66 @@ static void renderSharedCounter(const std::vector<Mesh*>& meshes, Renderer& rend
 
 	triCounter.store(0); // reset triangle counter
 
+	// threads share pixels, so depth test and write must be atomic
+	renderer.beginConcurrent();
+
 	// render triangle using multiple threads
 	std::vector<std::thread> threads; // threads array
-	for (int i = 0; i < totalThreads; i++)
-		threads.emplace_back(std::thread(drawTriangles, &triangles[0], size, std::ref(renderer), L.omega_i));
+	for (unsigned int i = 0; i < totalThreads; i++)
+		threads.emplace_back(std::thread(drawTriangles, triangles.data(), size, std::ref(renderer), light));
 
 	for (auto& t : threads)
 		t.join();
+
+	renderer.endConcurrent();
 }
 
 static void processMesh(const std::vector<Mesh*>& meshes, int total,
-	const unsigned int& width, const unsigned int& height, matrix vp, Light L)
+	const unsigned int& width, const unsigned int& height, matrix vp, unsigned int vpStamp, const Light& L, vec4 eye, float gouraudDistance)
 {
+	PROFILE_ZONE("mesh worker");
 	int i;
 	while ((i = meshCounter.fetch_add(1)) < total)
 	{
 		Mesh* mesh = meshes[i];
-		matrix p = vp * mesh->world; // calculate projection matrix for the mesh
+		matrix p = meshProjection(mesh, vp, vpStamp); // projection matrix of the mesh
 
-		// calculate diffuse and ambient lights for mesh
-		color ambient = L.ambient * mesh->ka;
-		color diffuse = L.L * mesh->kd;
+		// calculate the shading constants of the mesh
+		ShadeParams shade = meshShadeParams(mesh, L, eye, gouraudDistance);
+
+		RENDER_STAT(meshesSubmitted, 1);
+		RENDER_STAT(trianglesSubmitted, mesh->getTriangles().size());
+
+		const std::vector<Vertex>& vertices = transformMesh(mesh, p, width, height, L.omega_i, shade);
 
 		// process all triangles of mesh
-		for (int i = 0; i < mesh->triangles.size(); i++)
+		for (size_t i = 0; i < mesh->getTriangles().size(); i++)
 		{
-			Vertex t[3]; // Temporary array to store transformed triangle vertices
-
-			// process all 3 vertices of triangles (loop unrolling)
-			processVertex(p, mesh->world, mesh->vertices[mesh->triangles[i].v[0]], width, height, t[0]);
-			processVertex(p, mesh->world, mesh->vertices[mesh->triangles[i].v[1]], width, height, t[1]);
-			processVertex(p, mesh->world, mesh->vertices[mesh->triangles[i].v[2]], width, height, t[2]);
+			const triIndices& ind = mesh->getTriangles()[i];
+			const Vertex* t[3] = { &vertices[ind.v[0]], &vertices[ind.v[1]], &vertices[ind.v[2]] }; // transformed vertices of the triangle
 
 			// Clip triangles with Z-values outside [-1, 1]
-			if (fabs(t[0].p[2]) > 1.0f || fabs(t[1].p[2]) > 1.0f || fabs(t[2].p[2]) > 1.0f) break;
+			if (fabs(t[0]->p[2]) > 1.0f || fabs(t[1]->p[2]) > 1.0f || fabs(t[2]->p[2]) > 1.0f) {
+				RENDER_STAT(trianglesClipped, mesh->getTriangles().size() - i);
+				RENDER_STAT(meshesCulled, i == 0);
+				break;
+			}
 
 			// add triangle to triangle list
-			queue.enqueue(triangleData(triangle(t[0], t[1], t[2]), ambient, diffuse));
+			queue.enqueue(triangleData(triangle(*t[0], *t[1], *t[2], static_cast<unsigned int>(i)), shade));
 		}
 	}
 }
 
-static void processTriangles(Renderer& renderer, const vec4& dir)
+static void processTriangles(Renderer& renderer, const LightParams& light)
 {
+	PROFILE_ZONE("triangle worker");
 	triangleData data;	// to store triangle data when dequeue
 	bool process;		// to check if dequeue is successfull
 	while ((process = queue.dequeue(data)) || !meshProcessed) // check for dequeue or mesh processed by meshProcess threads
 	{
 		if (process)
-			data.tri.draw(renderer, dir, data.a, data.d);
+			data.tri.draw(renderer, light, data.shade);
 	}
 }
 
@@ -206,27 +396,35 @@ static void processTriangles(Renderer& renderer, const vec4& dir)
 // - L : light
 // - totalThreads : number of threads to use for multithreading
 // default value set to 3 works best for this value
-static void renderSentinelQueue(const std::vector<Mesh*>& meshes, Renderer& renderer, Light& L,
+static void renderSentinelQueue(const std::vector<Mesh*>& meshes, Renderer& renderer, Light L,
 	unsigned int meshThreadCount = 3, unsigned int triThreadCount = 3)
 {
-	L.omega_i.normalise(); // normalize light before rendering
+	PROFILE_ZONE("render sentinel queue");
+	L.omega_i.normalise(); // normalize this frame's copy of the light
 
 	// cache canvas width and height
-	unsigned int width = renderer.canvas.getWidth();
-	unsigned int height = renderer.canvas.getHeight();
+	unsigned int width = renderer.framebuffer.getWidth();
+	unsigned int height = renderer.framebuffer.getHeight();
+
+	TileLights tileLights;
+	tileLights.build(L.locals, renderer.vp, renderer.tiles, width, height);
+	LightParams light = makeLightParams(L, renderer.getViewDir(), &tileLights, drawShadowMaps(meshes, renderer, L, shadowMaps, triThreadCount));
 
 	triCounter.store(0);
 	meshCounter.store(0);
 	meshProcessed.store(0);
 
+	// threads share pixels, so depth test and write must be atomic
+	renderer.beginConcurrent();
+
 	std::vector<std::thread> meshThreads;	// mesh threads array
 	std::vector<std::thread> triThreads;	// triangles threads array
 
-	for (int i = 0; i < meshThreadCount; i++)
-		meshThreads.emplace_back(std::thread(processMesh, std::ref(meshes), meshes.size(), width, height, renderer.vp, L));
+	for (unsigned int i = 0; i < meshThreadCount; i++)
+		meshThreads.emplace_back(std::thread(processMesh, std::ref(meshes), meshes.size(), width, height, renderer.vp, renderer.getVPStamp(), std::cref(L), renderer.getEye(), renderer.gouraudDistance));
 
-	for (int i = 0; i < triThreadCount; i++)
-		triThreads.emplace_back(std::thread(processTriangles, std::ref(renderer), L.omega_i));
+	for (unsigned int i = 0; i < triThreadCount; i++)
+		triThreads.emplace_back(std::thread(processTriangles, std::ref(renderer), std::cref(light)));
 
 	for (auto& t : meshThreads)
 		t.join();
@@ -235,12 +433,241 @@ static void renderSentinelQueue(const std::vector<Mesh*>& meshes, Renderer& rend
 
 	for (auto& t : triThreads)
 		t.join();
+
+	renderer.endConcurrent();
+}
+
+// Depth pre-pass of a tile: the colour pass's pixel loop draws only the depth of the tile's
+// triangles first, so the colour pass only shades the visible fragment of each pixel and hidden
+// fragments fail the depth test before their shader runs. The image is the same as without it.
+// Tiles with triangles of other pixel features are drawn without the pre-pass, their depth
+// writes and untested fragments depend on the order the colour pass draws them in.
+// Input Variables:
+// - tris		: pointer to triangle array
+// - bin		: triangle indices overlapping the tile
+// - renderer	: reference to renderer (raw depth)
+// - light		: light of the tile
+// - t			: index of the tile
+static void depthPrepassTile(triangleData* tris, const std::vector<unsigned int>& bin, Renderer& renderer, const LightParams& light, int t)
+{
+	for (unsigned int i : bin)
+		if (tris[i].shade.features != PIXEL_DEFAULT) return;
+
+	tileRect rect = renderer.tiles.getRect(t);
+	for (unsigned int i : bin)
+		tris[i].tri.drawDepth(renderer, light, tris[i].shade, rect);
+	renderer.endDepthPrepass(t);
+}
+
+// Method to draw the binned triangles of whole tiles with multi threading
+// each tile is drawn by exactly one thread, so pixel writes never race
+// Input Variables:
+// - tris		: pointer to triangle array
+// - bins		: triangle indices overlapping each tile
+// - renderer	: reference to renderer
+// - light		: light of the frame
+static void drawTiles(triangleData* tris, const std::vector<std::vector<unsigned int>>& bins, Renderer& renderer, LightParams light)
+{
+	PROFILE_ZONE("raster tiles");
+	int t, total = bins.size();
+	while ((t = tileCounter.fetch_add(1)) < total)
+	{
+		if (bins[t].empty()) continue; // left to the fast-clear resolve at present
+
+		renderer.prepareTile(t);
+		LightParams tileLight = tileLightParams(light, t); // with the point and spot lights of the tile
+
+		if (renderer.compressingDepth())
+		{
+			// hierarchical Z: skip triangles behind everything already drawn in the tile
+			TileDepth& tileDepth = renderer.getTileDepth(t);
+			unsigned int culled = 0;
+			for (unsigned int i : bins[t])
+			{
+				// planes only describe fragments that test and write depth, other pixel features draw on raw depth
+				// (depth written without the test may move farther, so hierarchical Z can no longer reject behind it)
+				unsigned int features = tris[i].shade.features;
+				if (features != PIXEL_DEFAULT) {
+					if (!tileDepth.isRaw()) renderer.decompressTile(t);
+					if ((features & (PIXEL_DEPTH_TEST | PIXEL_DEPTH_WRITE)) == PIXEL_DEPTH_WRITE) tileDepth.resetFar();
+					tris[i].tri.draw(renderer, tileLight, tris[i].shade, renderer.tiles.getRect(t));
+					continue;
+				}
+				if (!tileDepth.mayPass(tris[i].tri.getNearestDepth())) { culled++; continue; }
+				tris[i].tri.drawCompressed(renderer, tileLight, tris[i].shade, t);
+			}
+			renderer.countHizCulled(culled);
+			continue;
+		}
+
+		tileRect rect = renderer.tiles.getRect(t);
+		if (renderer.depthPrepass && !renderer.multisampling()) depthPrepassTile(tris, bins[t], renderer, tileLight, t);
+		for (unsigned int i : bins[t])
+			tris[i].tri.draw(renderer, tileLight, tris[i].shade, rect);
+	}
+}
+
+// method transforms the triangles of all meshes into screen space
+// - meshes	: array of meshes
+// - vp : view projection matrix
+// - vpStamp : stamp of vp (Renderer::getVPStamp), selects cached mesh projections
+// - L : light (direction already normalised)
+// - eye : world space camera position
+// - gouraudDistance : lambert meshes farther than this from the camera are lit per vertex (0 = never)
+// - width, height : size of the canvas
+// - triangles : output triangle list (cleared first, capacity is kept between frames)
+static void processGeometry(const std::vector<Mesh*>& meshes, const matrix& vp, unsigned int vpStamp, const Light& L,
+	const vec4& eye, float gouraudDistance, unsigned int width, unsigned int height, std::vector<triangleData>& triangles)
+{
+	PROFILE_ZONE("vertex");
+	triangles.clear();
+
+	for (auto& mesh : meshes)
+	{
+		matrix p = meshProjection(mesh, vp, vpStamp); // projection matrix of the mesh
+
+		// calculate the shading constants of the mesh
+		ShadeParams shade = meshShadeParams(mesh, L, eye, gouraudDistance);
+
+		RENDER_STAT(meshesSubmitted, 1);
+		RENDER_STAT(trianglesSubmitted, mesh->getTriangles().size());
+
+		const std::vector<Vertex>& vertices = transformMesh(mesh, p, width, height, L.omega_i, shade);
+
+		// process all triangles of mesh
+		for (size_t i = 0; i < mesh->getTriangles().size(); i++)
+		{
+			const triIndices& ind = mesh->getTriangles()[i];
+			const Vertex* t[3] = { &vertices[ind.v[0]], &vertices[ind.v[1]], &vertices[ind.v[2]] }; // transformed vertices of the triangle
+
+			// Clip triangles with Z-values outside [-1, 1]
+			if (fabs(t[0]->p[2]) > 1.0f || fabs(t[1]->p[2]) > 1.0f || fabs(t[2]->p[2]) > 1.0f) {
+				RENDER_STAT(trianglesClipped, mesh->getTriangles().size() - i);
+				RENDER_STAT(meshesCulled, i == 0);
+				break;
+			}
+
+			// add triangle to triangle list
+			triangles.emplace_back(triangleData(triangle(*t[0], *t[1], *t[2], static_cast<unsigned int>(i)), shade));
+		}
+	}
+}
+
+// method bins triangles into every tile their clipped bounds overlap (keeps submission order per tile)
+// - triangles : screen space triangles
+// - tiles : tile grid of the canvas
+// - width, height : size of the canvas
+// - multisampled : the frame is drawn with several samples per pixel (see triangle::getScreenBounds)
+// - bins : output triangle indices per tile (capacity is kept between frames)
+static void binTriangles(std::vector<triangleData>& triangles, const TileGrid& tiles,
+	unsigned int width, unsigned int height, bool multisampled, std::vector<std::vector<unsigned int>>& bins)
+{
+	PROFILE_ZONE("bin");
+	bins.resize(tiles.count());
+	for (auto& bin : bins)
+		bin.clear();
+
+	int tilesX = tiles.getTilesX();
+	for (unsigned int i = 0; i < triangles.size(); i++)
+	{
+		int minX, minY, maxX, maxY, tx0, ty0, tx1, ty1;
+		triangles[i].tri.getScreenBounds(width, height, minX, minY, maxX, maxY, multisampled);
+		if (minX >= maxX || minY >= maxY) { RENDER_STAT(trianglesCulled, 1); continue; } // off screen
+
+		tiles.getRange(minX, minY, maxX, maxY, tx0, ty0, tx1, ty1);
+		for (int ty = ty0; ty <= ty1; ty++)
+			for (int tx = tx0; tx <= tx1; tx++)
+				bins[ty * tilesX + tx].push_back(i);
+	}
+}
+
+// method draws binned triangles with one thread per tile at a time
+// - triangles : screen space triangles
+// - bins : triangle indices per tile
+// - renderer : reference to the renderer
+// - light : light of the frame
+// - totalThreads : number of threads to use for multithreading
+static void rasterTiles(std::vector<triangleData>& triangles, const std::vector<std::vector<unsigned int>>& bins,
+	Renderer& renderer, const LightParams& light, unsigned int totalThreads)
+{
+	PROFILE_ZONE("raster");
+	tileCounter.store(0); // reset tile counter
+
+	// every tile has a single owner, so depth may be kept as compressed planes
+	// (multisampled frames keep their own per pixel planes and per sample depth, see MultisampleTarget)
+	bool compress = renderer.compressDepth && !renderer.multisampling();
+	if (compress) renderer.beginCompressed();
+
+	// render tiles using multiple threads
+	std::vector<std::thread> threads; // threads array
+	for (unsigned int i = 0; i < totalThreads; i++)
+		threads.emplace_back(std::thread(drawTiles, triangles.data(), std::cref(bins), std::ref(renderer), light));
+
+	for (auto& t : threads)
+		t.join();
+
+	if (compress) renderer.endCompressed();
+}
+
+// method processes triangles, bins them into screen tiles and draws the tiles in parallel
+// - meshes	: array of meshes
+// - renderer : reference to the renderer
+// - L : light
+// - totalThreads : number of threads to use for multithreading
+static void renderTiled(const std::vector<Mesh*>& meshes, Renderer& renderer, Light L, unsigned int totalThreads = 3)
+{
+	PROFILE_ZONE("render tiled");
+	L.omega_i.normalise(); // normalize this frame's copy of the light
+
+	// cache canvas width and height
+	unsigned int width = renderer.framebuffer.getWidth();
+	unsigned int height = renderer.framebuffer.getHeight();
+
+	std::vector<triangleData> triangles;
+	std::vector<std::vector<unsigned int>> bins;
+
+	TileLights tileLights;
+
+	processGeometry(meshes, renderer.vp, renderer.getVPStamp(), L, renderer.getEye(), renderer.gouraudDistance, width, height, triangles);
+	binTriangles(triangles, renderer.tiles, width, height, renderer.getMultisampling() > 1, bins);
+	tileLights.build(L.locals, renderer.vp, renderer.tiles, width, height);
+	const ShadowMaps* shadows = drawShadowMaps(meshes, renderer, L, shadowMaps, totalThreads);
+	rasterTiles(triangles, bins, renderer, makeLightParams(L, renderer.getViewDir(), &tileLights, shadows), totalThreads);
+}
+
+// Render strategies that can be selected at run time (benchmark harness)
+enum class RenderMode {
+	Caching,		// single thread, triangles drawn as they are processed
+	SharedCounter,	// triangle list drawn by threads sharing an atomic counter
+	SentinelQueue,	// mesh threads feed triangle threads through a queue
+	Tiled,			// triangles binned into screen tiles, one thread per tile
+	Pipelined		// tiled, with geometry, raster and present of consecutive frames overlapped (see FramePipeline)
+};
+
+static const char* renderModeNames[] = { "caching", "sharedcounter", "sentinelqueue", "tiled", "pipelined" };
+
+// Renders the meshes with the selected strategy
+// - meshes	: array of meshes
+// - renderer : reference to the renderer
+// - L : light, each strategy normalises a copy (normalising the scene light every frame would
+//       change the last bit of its direction and the image from the second frame on)
+// - mode : render strategy (Pipelined needs a FramePipeline and draws like Tiled here)
+// - totalThreads : number of threads for the multi threaded strategies
+static void render(const std::vector<Mesh*>& meshes, Renderer& renderer, const Light& L, RenderMode mode, unsigned int totalThreads)
+{
+	switch (mode) {
+	case RenderMode::Caching: renderCaching(meshes, renderer, L); break;
+	case RenderMode::SharedCounter: renderSharedCounter(meshes, renderer, L, totalThreads); break;
+	case RenderMode::SentinelQueue: renderSentinelQueue(meshes, renderer, L, totalThreads, totalThreads); break;
+	default: renderTiled(meshes, renderer, L, totalThreads); break;
+	}
 }
 
-static void render(const std::vector<Mesh*>& meshes, Renderer& renderer, Light& L)
+static void render(const std::vector<Mesh*>& meshes, Renderer& renderer, const Light& L)
 {
 	renderCaching(meshes, renderer, L);
 	//renderSharedCounter(meshes, renderer, L,1);
 	//renderSentinelQueue(meshes, renderer, L);
+	//renderTiled(meshes, renderer, L);
 }
 
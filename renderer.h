@@ -4,8 +4,57 @@
 #include "GamesEngineeringBase.h"
 #include "zbufferAtomic.h"
 #include "zbuffer.h"
+#include "zbufferPacked.h"
+#include "framebuffer.h"
+#include "tiles.h"
+#include "pixelLayout.h"
+#include "tileDepth.h"
+#include "multisample.h"
+#include "outputStage.h"
+#include "capture.h"
+#include "profiler.h"
+#include "stats.h"
 #include "matrix.h"
+#include "shading.h"
 #include <mutex>
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+// Where depth is stored while drawing a frame
+enum class DepthMode {
+	Raw,		// one value per pixel in the Z-buffer
+	Packed,		// depth and colour in one atomic word (threads share pixels)
+	Compressed,	// plane equations per tile (tiled renderer only), raw fallback per tile
+	Multisample	// colour and depth of several samples per pixel (see setMultisampling)
+};
+
+// Debug images replacing the shaded frame at present
+enum class DebugView {
+	None,
+	Overdraw,		// pixel writes per pixel
+	DepthComplexity	// depth tests per pixel (covered fragments, visible or not)
+};
+
+// Depth footprint of the tiles drawn in compressed frames and the work hierarchical Z saved
+struct DepthCompressionStats {
+	unsigned long long compressedTiles = 0;	// tiles still stored as planes at the end of the frame
+	unsigned long long rawTiles = 0;		// tiles that fell back to the Z-buffer
+	unsigned long long bytes = 0;			// depth memory of the drawn tiles
+	unsigned long long rawBytes = 0;		// depth memory of the same tiles stored raw
+	unsigned long long hizCulled = 0;		// triangle/tile pairs skipped by the hierarchical Z test
+
+	DepthCompressionStats& operator+=(const DepthCompressionStats& o) {
+		compressedTiles += o.compressedTiles;
+		rawTiles += o.rawTiles;
+		bytes += o.bytes;
+		rawBytes += o.rawBytes;
+		hizCulled += o.hizCulled;
+		return *this;
+	}
+};
 
 // The `Renderer` class handles rendering operations, including managing the
 // Z-buffer, canvas, and perspective transformations for a 3D scene.
@@ -16,45 +65,495 @@ class Renderer {
 	float f = 100.0f;							// Far clipping plane distance
 
 	matrix perspective;							// Perspective Projection matrix
-	ZbufferAtomic<float> zbuffer;						// Z-buffer for depth management
+	Framebuffer target;							// colour written by the rasterizer (PixelLayout order), resolved into framebuffer at the end of a frame
+	ZbufferAtomic<DepthFormat> zbuffer;			// Z-buffer for depth management
+	ZbufferPacked<DepthFormat> zbufferPacked;	// Depth and colour words used while drawing without tile ownership
+	std::vector<TileDepth> tileDepth;			// compressed depth and hierarchical Z of each tile
+	MultisampleTarget msaa;						// samples of every pixel while multisampling
+	DepthMode depthMode = DepthMode::Raw;		// depth storage used by the current frame
+	std::atomic<unsigned int> hizCulled{ 0 };	// triangle/tile pairs skipped by the hierarchical Z test
+	DepthCompressionStats compression;			// depth footprint of the last compressed frame (see endCompressed)
+
+	// Lazy clears: clear() only advances the frame epoch. A tile is cleared the first time
+	// something is drawn into it during a frame, and tiles nobody drew into are reset at present.
+	// Epochs advance by 2 so that (frame + 1) can mark a tile that is being cleared right now.
+	unsigned int frame = 2;								// current clear epoch
+	std::vector<std::atomic<unsigned int>> tileEpoch;	// epoch in which each tile was last cleared
+	std::vector<unsigned char> tileBlank;				// 1 if the tile colour of the framebuffer still holds the clear colour
+	std::vector<unsigned char> backBlank;				// tileBlank of the back buffer
+	std::vector<unsigned char> tileMultisampled;		// 1 if the tile was drawn into the multisample target this frame
+
+	unsigned int vpStamp = 1;							// changes whenever vp changes (see getVPStamp)
+
+	bool headless = false;								// no window, frames only go to capture/benchmarks
+	OutputStage output;									// presents frames on an output thread (see startAsyncPresent)
+	FrameCapture capture;								// streams presented frames to disk (see startCapture)
+
+	DebugView debugView = DebugView::None;				// image shown instead of the frame
+	std::vector<std::atomic<unsigned int>> debugCounts;	// per pixel writes or tests of the debug view
+
+	// Depth storage of frames drawn without a switch to another mode
+	DepthMode defaultMode() const {
+		return msaa.getSamples() > 1 ? DepthMode::Multisample : DepthMode::Raw;
+	}
+
+	// Clears colour and depth of a single tile (one contiguous range of the target and depth)
+	void clearTile(int tile) {
+		unsigned int first = layout.tileOffset(tile);
+		tileMultisampled[tile] = depthMode == DepthMode::Multisample;
+		switch (depthMode) {
+		case DepthMode::Multisample: msaa.clearRange(first, TILE_PIXELS); return; // resolved into the target at the end of the frame
+		case DepthMode::Packed: zbufferPacked.clearRange(first, TILE_PIXELS); return; // colour lives in the packed words
+		case DepthMode::Compressed: {
+			tileRect r = tiles.getRect(tile);
+			tileDepth[tile].clear(r.maxX - r.minX, r.maxY - r.minY);
+			break;
+		}
+		default: zbuffer.clearRange(first, TILE_PIXELS); break;
+		}
+		target.fillSpan(first, 0, TILE_PIXELS);
+	}
+
+	// Copies the tiles drawn this frame from the target into the row major framebuffer and
+	// resets the tiles that were not drawn (fast-clear resolve)
+	// Input Variables:
+	// - all : resolve every tile, drawn or not (debug views write the whole target)
+	void resolveFrame(bool all) {
+		PROFILE_ZONE("resolve");
+		for (int t = 0; t < tiles.count(); t++) {
+			tileRect r = tiles.getRect(t);
+			if (all || tileEpoch[t].load(std::memory_order_relaxed) == frame) {
+				if (!all && tileMultisampled[t]) msaa.resolveRange(target.data(), layout.tileOffset(t), TILE_PIXELS);
+				layout.resolveTile(target.data(), framebuffer.data(), r);
+				tileBlank[t] = 0;
+			}
+			else if (!tileBlank[t]) {
+				framebuffer.fillRect(r.minX, r.minY, r.maxX, r.maxY, 0);
+				tileBlank[t] = 1;
+			}
+		}
+	}
+
+	// Replaces the frame with a heat map of the debug counts and restarts the counts
+	// black 0, blue 1, green 2, yellow 3, orange 4, red 5-7, white 8 or more
+	void resolveDebugView() {
+		static const unsigned int ramp[] = {
+			Framebuffer::pack(0, 0, 0), Framebuffer::pack(0, 0, 255), Framebuffer::pack(0, 200, 0),
+			Framebuffer::pack(255, 255, 0), Framebuffer::pack(255, 128, 0), Framebuffer::pack(255, 0, 0),
+			Framebuffer::pack(255, 0, 0), Framebuffer::pack(255, 0, 0), Framebuffer::pack(255, 255, 255) };
+		unsigned int* pixels = target.data();
+		for (size_t i = 0; i < debugCounts.size(); i++) {
+			unsigned int c = debugCounts[i].load(std::memory_order_relaxed);
+			pixels[i] = ramp[c < 8 ? c : 8];
+			debugCounts[i].store(0, std::memory_order_relaxed);
+		}
+	}
+
+	// Work done at the end of every frame, before the frame leaves the framebuffer
+	void endFrame() {
+		if (debugView != DebugView::None) resolveDebugView();
+		resolveFrame(debugView != DebugView::None);	// row major colour, blank tiles that were not drawn this frame
+		RenderStats::endFrame();
+	}
 public:
 	GamesEngineeringBase::Window canvas;		// Canvas for rendering the scene
-	matrix vp;									// view projection matrix
+	Framebuffer framebuffer;					// Packed 32-bit row major colour of the last finished frame
+	Framebuffer backBuffer;						// Finished frame waiting to be presented (pipelined rendering)
+	TileGrid tiles;								// Screen tiles used to split work between threads
+	PixelLayout layout;							// order of the pixels in the colour target and the depth buffers
+	matrix vp;									// view projection matrix (set through updateVP)
+	vec4 viewDir = vec4(0.f, 0.f, 1.f, 0.f);	// world space direction towards the camera (set through updateVP)
+	vec4 eye = vec4(0.f, 0.f, 0.f, 1.f);		// world space camera position (set through updateVP)
+	float gouraudDistance = 0.f;				// lambert meshes farther than this from the camera are lit per vertex (0 = never)
+	bool compressDepth = false;					// store depth as per tile planes in the tiled renderer
+	bool depthPrepass = false;					// tiled renderer: lay down the depth of each tile before shading it
 
 	// Constructor initializes the canvas, Z-buffer, and perspective projection matrix.
-	Renderer() {
-		canvas.create(1024, 768, "Raster");		// Create a canvas with specified dimensions and title
-		zbuffer.create(1024, 768);				// Initialize the Z-buffer with the same dimensions
-		perspective = matrix::makePerspective(fov, aspect, n, f);	// Set up the perspective matrix
+	// Input Variables:
+	// - _headless : render without creating a window (benchmarks, capture)
+	Renderer(bool _headless = false) : headless(_headless) {
+		if (!headless)
+			canvas.create(1024, 768, "Raster");	// Create a canvas with specified dimensions and title
+		framebuffer.create(1024, 768);			// Colour buffer matching the canvas
+		tiles.create(1024, 768);				// Tile grid covering the canvas
+		layout.create(1024, 768);				// Tiled pixel order of the buffers drawn into
+		int paddedWidth = tiles.getTilesX() * TILE_SIZE, paddedHeight = tiles.getTilesY() * TILE_SIZE;
+		target.create(paddedWidth, paddedHeight);			// Colour drawn into, whole tiles
+		zbuffer.create(paddedWidth, paddedHeight);			// Z-buffer covering the same tiles
+		zbufferPacked.create(paddedWidth, paddedHeight);	// Packed depth and colour for the concurrent paths
+		tileEpoch = std::vector<std::atomic<unsigned int>>(tiles.count());	// every tile starts stale
+		tileBlank.assign(tiles.count(), 1);		// the framebuffer starts out black
+		tileMultisampled.assign(tiles.count(), 0);
+		tileDepth.resize(tiles.count());
+		// Set up the perspective matrix (reversed depth formats need the reversed projection)
+		perspective = DepthFormat::reversed ? matrix::makePerspectiveReversed(fov, aspect, n, f) : matrix::makePerspective(fov, aspect, n, f);
+	}
+
+	// The output thread uses the canvas, so it has to finish before the canvas is destroyed
+	~Renderer() {
+		output.stop();
 	}
 
 	// Clears the canvas and resets the Z-buffer.
+	// Nothing is written here, tiles are cleared on first use (see prepareTile)
 	void clear() {
-		canvas.clear();		// Clear the canvas (sets all pixels to the background color)
-		zbuffer.clear();	// Reset the Z-buffer to the farthest depth
+		PROFILE_ZONE("clear");
+		frame += 2;
 	}
 
 	// Presents the current canvas frame to the display.
+	// With async present the frame is handed to the output thread and drawing can continue at once.
 	void present() {
-		canvas.present();	// Display the rendered frame
+		PROFILE_ZONE("present");
+		endFrame();
+		if (capture.active()) capture.submit(framebuffer);
+		if (output.running()) {
+			int s = output.acquire();			// only waits if every ring slot is still queued
+			OutputStage::slot& out = output.get(s);
+			framebuffer.swap(out.image);		// next frame draws into the slot's old buffer
+			tileBlank.swap(out.blank);
+			output.submit(s);
+			return;
+		}
+		if (!headless) canvas.present(framebuffer.data());	// Display the rendered frame
+	}
+
+	// Moves the window upload and Present() to a dedicated output thread fed by a ring of
+	// framebuffers. The thread calling present() must keep pumping window messages (checkInput).
+	// Input Variables:
+	// - ringSize : frames in flight between the render and the output thread
+	void startAsyncPresent(int ringSize = 3) {
+		output.start(framebuffer.getWidth(), framebuffer.getHeight(), tiles.count(), ringSize,
+			[this](const Framebuffer& image) {
+				PROFILE_ZONE("output");
+				if (!headless) canvas.display(image.data());
+			});
+	}
+
+	// Presents the frames still in the ring and returns to presenting on the calling thread.
+	// The last presented frame is moved back into the framebuffer, as after a synchronous present.
+	void stopAsyncPresent() {
+		if (!output.running()) return;
+		output.stop();
+		int s = output.last();
+		if (s < 0) return;
+		framebuffer.swap(output.get(s).image);
+		tileBlank.swap(output.get(s).blank);
+	}
+
+	// Records every presented frame to disk, encoded on background threads
+	// Input Variables:
+	// - prefix : path and file name prefix of the output files
+	// - format : image sequence or video container (see CaptureFormat)
+	// - totalEncoders : encoder threads
+	// Returns false if the output could not be created.
+	bool startCapture(const std::string& prefix, CaptureFormat format = CaptureFormat::QOI, unsigned int totalEncoders = 2) {
+		return capture.start(prefix, format, framebuffer.getWidth(), framebuffer.getHeight(), totalEncoders);
+	}
+
+	// Writes the frames still being encoded and ends the capture
+	void stopCapture() {
+		capture.stop();
+	}
+
+	// frames recorded since startCapture
+	unsigned int getCapturedFrames() const { return capture.getFrameCount(); }
+
+	// recorded frames that waited for a free encoder
+	unsigned int getCaptureStalls() const { return capture.getStalls(); }
+
+	// Allocates the back buffer used to present one frame while the next one is drawn
+	void createBackBuffer() {
+		if (backBuffer.data()) return;
+		backBuffer.create(framebuffer.getWidth(), framebuffer.getHeight());
+		backBlank.assign(tiles.count(), 1);
+	}
+
+	// Completes the frame in the framebuffer and moves it to the back buffer,
+	// the old back buffer becomes the target of the next frame
+	void finishFrame() {
+		PROFILE_ZONE("finish frame");
+		endFrame();
+		if (capture.active()) capture.submit(framebuffer);
+		framebuffer.swap(backBuffer);
+		tileBlank.swap(backBlank);
+	}
+
+	// Presents the frame last completed with finishFrame().
+	// Does not touch the framebuffer, so it can run while the next frame is drawn.
+	void presentBackBuffer() {
+		PROFILE_ZONE("present");
+		if (!headless) canvas.present(backBuffer.data());
+	}
+
+	// Makes sure a tile has been cleared this frame before drawing into it.
+	// Safe to call from several threads, only one of them performs the clear.
+	// Input Variables:
+	// - tile: linear tile index
+	void prepareTile(int tile) {
+		std::atomic<unsigned int>& epoch = tileEpoch[tile];
+		unsigned int e = epoch.load(std::memory_order_acquire);
+		while (e != frame) {
+			if (e != frame + 1 && epoch.compare_exchange_weak(e, frame + 1, std::memory_order_acquire)) {
+				clearTile(tile);
+				epoch.store(frame, std::memory_order_release);
+				return;
+			}
+			if (e == frame + 1) {
+				_mm_pause(); // another thread is clearing this tile
+				e = epoch.load(std::memory_order_acquire);
+			}
+		}
+	}
+
+	// Prepares every tile overlapped by a pixel rectangle
+	// Input Variables:
+	// - minX, minY, maxX, maxY: pixel bounds (max exclusive), clipped to the canvas
+	void prepareRect(int minX, int minY, int maxX, int maxY) {
+		int tx0, ty0, tx1, ty1;
+		tiles.getRange(minX, minY, maxX, maxY, tx0, ty0, tx1, ty1);
+		for (int ty = ty0; ty <= ty1; ty++)
+			for (int tx = tx0; tx <= tx1; tx++)
+				prepareTile(ty * tiles.getTilesX() + tx);
+	}
+
+	bool isHeadless() const { return headless; }
+
+	// Draws the following frames with several samples per pixel (multisample anti-aliasing):
+	// coverage and depth are tested per sample, fragments are shaded once per pixel and the
+	// samples are averaged at the end of the frame. Frames drawn by threads sharing pixels
+	// (beginConcurrent) stay single sampled.
+	// Input Variables:
+	// - samples : 4 or 8, 1 to turn multisampling off
+	void setMultisampling(unsigned int samples) {
+		msaa.create(layout.size(), samples);
+		depthMode = defaultMode();
+	}
+
+	// Samples per pixel of the following frames
+	unsigned int getMultisampling() const { return msaa.getSamples(); }
+
+	// true while the frame is drawn into the multisample target
+	bool multisampling() const { return depthMode == DepthMode::Multisample; }
+
+	// Samples of every pixel, used by the multisample raster kernel
+	MultisampleTarget& getMultisampleTarget() { return msaa; }
+
+	// Shows overdraw or depth complexity instead of the shaded image from the next frame on
+	// Input Variables:
+	// - view : debug image, DebugView::None for the normal frame
+	void setDebugView(DebugView view) {
+		debugView = view;
+		if (view == DebugView::None) debugCounts.clear();
+		else if (debugCounts.empty()) debugCounts = std::vector<std::atomic<unsigned int>>(layout.size());
+	}
+
+	DebugView getDebugView() const { return debugView; }
+
+	// Counts a fragment depth test done outside of depthTest() for the depth complexity view
+	// index : index of the pixel (index = layout.index(x, y))
+	void countTested(unsigned int index) {
+		if (debugView == DebugView::DepthComplexity) debugCounts[index].fetch_add(1, std::memory_order_relaxed);
+	}
+
+	// Counts a pixel write for the overdraw view
+	// index : index of the pixel (index = layout.index(x, y))
+	void countWrite(unsigned int index) {
+		if (debugView == DebugView::Overdraw) debugCounts[index].fetch_add(1, std::memory_order_relaxed);
 	}
 
 	// update view projection matrix
 	void updateVP(const matrix& view) {
-		vp = perspective * view;
+		matrix next = perspective * view;
+		if (memcmp(&next, &vp, sizeof(matrix)) != 0) {
+			vp = next;
+			vpStamp++;	// projections cached for the old matrix are stale
+
+			// the camera looks down its -z axis
+			matrix camera = matrix::makeInverse(view);
+			viewDir = camera * vec4(0.f, 0.f, 1.f, 0.f);
+			viewDir.normalise();
+			eye = camera * vec4(0.f, 0.f, 0.f, 1.f);
+		}
+	}
+
+	// Normalised world space direction towards the camera
+	const vec4& getViewDir() const { return viewDir; }
+
+	// World space camera position
+	const vec4& getEye() const { return eye; }
+
+	// Identifies the current view projection matrix, cached mesh projections computed for
+	// another stamp are stale (see TransformHierarchy)
+	unsigned int getVPStamp() const { return vpStamp; }
+
+	// Switches depth testing to the packed depth and colour buffer, where the test and the
+	// write are one atomic operation. Call before threads start drawing triangles that may
+	// overlap the same pixels (no tile ownership). A frame should use a single mode.
+	void beginConcurrent() {
+		depthMode = DepthMode::Packed;
+	}
+
+	// Copies the colours drawn since beginConcurrent() into the target.
+	// Call after all drawing threads have joined.
+	void endConcurrent() {
+		for (int t = 0; t < tiles.count(); t++) {
+			if (tileEpoch[t].load(std::memory_order_relaxed) == frame) {
+				zbufferPacked.resolveRange(target.data(), layout.tileOffset(t), TILE_PIXELS);
+			}
+		}
+		depthMode = defaultMode();
+	}
+
+	// Switches depth storage to per tile plane equations. Only valid while every tile
+	// is drawn by a single thread (renderTiled). A frame should use a single mode.
+	void beginCompressed() {
+		depthMode = DepthMode::Compressed;
+		hizCulled.store(0, std::memory_order_relaxed);
+		compression = DepthCompressionStats();
+	}
+
+	// Returns to the default depth storage after a compressed frame and measures the depth
+	// memory of the tiles drawn in it against the memory of raw depth.
+	// Call after all drawing threads have joined.
+	void endCompressed() {
+		for (int t = 0; t < tiles.count(); t++) {
+			if (tileEpoch[t].load(std::memory_order_relaxed) != frame) continue;
+			tileRect r = tiles.getRect(t);
+			(tileDepth[t].isRaw() ? compression.rawTiles : compression.compressedTiles)++;
+			compression.bytes += tileDepth[t].footprint();
+			compression.rawBytes += (size_t)(r.maxX - r.minX) * (r.maxY - r.minY) * sizeof(DepthFormat::storage);
+		}
+		compression.hizCulled = hizCulled.load(std::memory_order_relaxed);
+		depthMode = defaultMode();
+	}
+
+	bool compressingDepth() const { return depthMode == DepthMode::Compressed; }
+
+	// True between beginConcurrent() and endConcurrent(). Triangles pick their pixel loop from
+	// it once per draw, so fragments never branch on the depth storage.
+	bool packedDepth() const { return depthMode == DepthMode::Packed; }
+
+	// Adds to the number of triangle/tile pairs rejected by the hierarchical Z test
+	void countHizCulled(unsigned int count) {
+		if (count) hizCulled.fetch_add(count, std::memory_order_relaxed);
+		RENDER_STAT(trianglesCulled, count);
+	}
+
+	// Ends the depth pre-pass of a tile: the nearest depth it left in the Z-buffer is moved one
+	// stored step farther, so in the colour pass the first fragment at that depth passes the
+	// strict depth test, like it would without the pre-pass, and the fragments behind it fail.
+	// tile : linear tile index, drawn by the calling thread only
+	void endDepthPrepass(int tile) {
+		zbuffer.stepFartherRange(layout.tileOffset(tile), TILE_PIXELS);
+	}
+
+	// Compressed depth and hierarchical Z of a tile
+	TileDepth& getTileDepth(int tile) { return tileDepth[tile]; }
+
+	// Expands a compressed tile into the Z-buffer, used when more triangles are visible in
+	// the tile than it can hold planes for
+	void decompressTile(int tile) {
+		tileRect r = tiles.getRect(tile);
+		tileDepth[tile].decompress(zbuffer, layout, r.minX, r.minY);
+	}
+
+	// Depth footprint and hierarchical Z culling of the last compressed frame
+	const DepthCompressionStats& getDepthCompression() const { return compression; }
+
+	// Number of compare exchange retries and lost depth races during the last frame (0 unless it
+	// was drawn concurrently), the cost paid for sharing pixels between threads compared to tile
+	// ownership (renderTiled). The drawing threads count into their own RenderStats blocks, so
+	// measuring adds no shared cache line traffic, and the blocks are summed when the frame ends.
+	// Both stay 0 when RENDER_STATS_ENABLED is 0.
+	void getContention(unsigned long long& retries, unsigned long long& lost) const {
+		const RenderStats& last = RenderStats::lastFrame();
+		retries = last.casRetries;
+		lost = last.lostRaces;
 	}
 
 	// draw and set depth of the pixel
-	// index : linear index of the pixel (index = width * y + x)
-	// _color : array of unsigned char for color
+	// index : index of the pixel (index = layout.index(x, y))
+	// _color : packed 32-bit colour (see Framebuffer::pack)
 	// val : float value between 0 and 1 for zbuffer
-	void drawAndSetDepth(const unsigned int& index, unsigned char* _color, const float& val)
+	// Packed : the frame draws into the packed depth and colour buffer (see packedDepth)
+	template<bool Packed>
+	void drawAndSetDepth(const unsigned int& index, unsigned int _color, const float& val)
 	{
-		zbuffer.set(index, val);
-		canvas.drawCaching(index, _color);
+		countWrite(index);
+		if constexpr (Packed) {
+			zbufferPacked.testAndSet(index, val, _color);
+		}
+		else {
+			zbuffer.set(index, val);
+			target.draw(index, _color);
+		}
 	}
 
+	// store a fragment that passed the depth test of its pixel pipeline (or has none)
+	// Features : PixelFeature flags of the pipeline, only the enabled parts are written
+	// Packed : the frame draws into the packed depth and colour buffer (see packedDepth)
+	// index : index of the pixel (index = layout.index(x, y))
+	// _color : packed 32-bit colour
+	// val : float value between 0 and 1 for zbuffer
+	template<unsigned int Features, bool Packed>
+	void writeFragment(const unsigned int& index, unsigned int _color, const float& val)
+	{
+		constexpr bool depthTest = (Features & PIXEL_DEPTH_TEST) != 0;
+		constexpr bool depthWrite = (Features & PIXEL_DEPTH_WRITE) != 0;
+		constexpr bool colourWrite = (Features & PIXEL_COLOUR_WRITE) != 0;
+		if constexpr (depthTest && depthWrite && colourWrite) {
+			drawAndSetDepth<Packed>(index, _color, val);
+			return;
+		}
+		if constexpr (colourWrite) countWrite(index);
+		if constexpr (Packed) {
+			zbufferPacked.write<depthTest, depthWrite, colourWrite>(index, val, _color);
+			return;
+		}
+		if constexpr (depthWrite) zbuffer.set(index, val);
+		if constexpr (colourWrite) target.draw(index, _color);
+	}
+
+	// store a fragment on the samples of a pixel that passed its pixel pipeline (multisampling)
+	// Features : PixelFeature flags of the pipeline, only the enabled parts are written
+	// index : index of the pixel (index = layout.index(x, y))
+	// mask : samples to write, one bit per sample
+	// plane : depth plane of the fragment at the pixel
+	// depth : depth of the fragment at every sample
+	// _color : packed 32-bit colour
+	template<unsigned int Features>
+	void writeSamples(const unsigned int& index, int mask, const depthPlane& plane, __m256 depth, unsigned int _color)
+	{
+		constexpr bool depthWrite = (Features & PIXEL_DEPTH_WRITE) != 0;
+		constexpr bool colourWrite = (Features & PIXEL_COLOUR_WRITE) != 0;
+		if constexpr (colourWrite) countWrite(index);
+		msaa.write<depthWrite, colourWrite>(index, mask, plane, depth, _color);
+	}
+
+	template<bool Packed>
 	float getDepth(const unsigned int& index) {
-		return zbuffer.get(index);
+		if constexpr (Packed) return zbufferPacked.get(index);
+		else return zbuffer.get(index);
+	}
+
+	// Depth test of a fragment against the stored depth, including the near plane guard.
+	// The comparison is fixed by DepthFormat and the buffer by Packed at compile time.
+	// Packed : the frame draws into the packed depth and colour buffer (see packedDepth)
+	// index : index of the pixel (index = layout.index(x, y))
+	// depth : interpolated fragment depth
+	template<bool Packed>
+	bool depthTest(const unsigned int& index, const float& depth) {
+		countTested(index);
+		if constexpr (Packed) return DepthFormat::visible(depth) && zbufferPacked.test(index, depth);
+		else return DepthFormat::visible(depth) && zbuffer.test(index, depth);
+	}
+
+	// draw a pixel without touching depth (depth kept elsewhere, e.g. a compressed tile)
+	// index : index of the pixel (index = layout.index(x, y))
+	// _color : packed 32-bit colour
+	void draw(const unsigned int& index, unsigned int _color) {
+		countWrite(index);
+		target.draw(index, _color);
 	}
-};
\ No newline at end of file
+};
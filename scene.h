@@ -0,0 +1,102 @@
+#pragma once
+
+#include <vector>
+#include <functional>
+#include <string>
+#include "mesh.h"
+#include "texture.h"
+#include "textureStreamer.h"
+#include "light.h"
+#include "renderer.h"
+#include "transforms.h"
+#include "animation.h"
+
+// Keys held down during a frame, copied from the window on the thread pumping its messages.
+// Scene updates read keys from here and never from the canvas, because the pipelined frame
+// loop runs them on its geometry thread (see FramePipeline::frame).
+struct SceneInput {
+	bool keys[256] = {};	// true while the key is held
+
+	// Copies the key state of the window, call between frames on the thread calling checkInput
+	void sample(GamesEngineeringBase::Window& canvas) {
+		for (int k = 0; k < 256; k++)
+			keys[k] = canvas.keyPressed(k);
+	}
+
+	bool keyPressed(int key) const { return keys[key]; }
+};
+
+// Meshes, light and per frame animation of a test scene.
+// Shared by the interactive scene loops and the benchmark harness, so both render exactly
+// the same frames. Builders draw random values from streams of the seed they are given
+// (see parallelGenerate), so a seed always builds the same scene whatever the thread count.
+// Mesh i is drawn with the world transform of node i of the transform hierarchy, updates move
+// meshes through transforms.setLocal() so static meshes keep their cached projections.
+struct Scene {
+	std::vector<Mesh*> meshes;							// meshes owned by the scene
+	std::vector<Mesh*> geometry;						// shared geometry of instanced meshes (not drawn)
+	std::vector<Texture*> textures;						// textures of the meshes
+	TextureStreamer streaming;							// streams the mip levels of the file textures
+	Light L{ vec4(0.f, 1.f, 1.f, 0.f), color(1.0f, 1.0f, 1.0f), color(0.1f, 0.1f, 0.1f) };
+	TransformHierarchy transforms;						// node i places mesh i
+	SpinAnimator animation;								// spinning meshes, advanced every step
+	std::function<void(Renderer&)> update;				// advances one frame: animation, camera and renderer.updateVP
+	SceneInput input;									// keys of the frame read by update (empty in headless runs)
+
+	Scene() = default;
+	Scene(const Scene&) = delete;
+	Scene& operator=(const Scene&) = delete;
+
+	// Adds a root node for every mesh without one, its local transform is the mesh world matrix
+	void attachMeshes() {
+		size_t first = transforms.size();
+		transforms.resize(meshes.size());
+		for (size_t i = first; i < meshes.size(); i++)
+			transforms.set(static_cast<int>(i), meshes[i]->world, -1, meshes[i]);
+	}
+
+	// Advances one frame: streams texture levels, runs update, spins the animated meshes, then
+	// refreshes the changed world transforms and projections
+	// Input Variables:
+	// - renderer : renderer the frame is drawn with
+	void step(Renderer& renderer) {
+		streaming.update();
+		if (update) update(renderer);
+		animation.update(transforms);
+		transforms.update(renderer);
+	}
+
+	// number of triangles submitted per frame
+	size_t triangleCount() const {
+		size_t count = 0;
+		for (auto& m : meshes)
+			count += m->getTriangles().size();
+		return count;
+	}
+
+	~Scene() {
+		streaming.stop();
+		for (auto& m : meshes)
+			delete m;
+		for (auto& g : geometry)
+			delete g;
+		for (auto& t : textures)
+			delete t;
+	}
+};
+
+// scene builders (Scene1.cpp, Scene2.cpp, Scene3.cpp)
+// Input Variables:
+// - scene : scene to fill
+// - seed : seed of the random values
+void makeScene1(Scene& scene, unsigned int seed);
+void makeScene2(Scene& scene, unsigned int seed);
+void makeScene3(Scene& scene, unsigned int seed);
+
+// Builds a scene from a scene description file (format in SceneFile.cpp)
+// Input Variables:
+// - filename : scene file
+// - scene : empty scene to fill
+// - seed : seed of the random values
+// Returns false and prints the reason if the file could not be loaded.
+bool loadSceneFile(const std::string& filename, Scene& scene, unsigned int seed);
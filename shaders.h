@@ -0,0 +1,274 @@
+#pragma once
+
+#include <cmath>
+#include "mesh.h"
+#include "shading.h"
+#include "shadowMap.h"
+#include "texture.h"
+
+// Pixel shaders, one per shading model.
+// A shader is built once per triangle (per triangle setup like vertex lighting happens there)
+// and shade() returns the colour of a fragment from its barycentric weights, w0, w1 and w2
+// weighting vertex 0, 1 and 2. The raster loops are templated on the shader, so every model
+// and ShaderFeature combination gets its own inner loop without branches on the model, the
+// texture, the local lights or the shadows.
+template<ShadingModel M, unsigned int Features>
+struct Shader;
+
+// Shader features of a triangle drawn with the given shading constants and light
+// (only the features its model uses, see shaderFeaturesOf)
+// Input Variables:
+// - shade : shading constants of the mesh
+// - light : light of the tile the triangle is drawn in (tileLightParams)
+static inline unsigned int shaderFeatures(const ShadeParams& shade, const LightParams& light) {
+	unsigned int features = shade.texture ? SHADER_TEXTURE : 0;
+	if (!perPixelLighting(shade.model)) return features;
+	if (light.localCount) features |= SHADER_LOCAL_LIGHTS;
+	if (light.shadows) {
+		if (light.shadows->hasSunMap()) features |= SHADER_SUN_SHADOW;
+		if (light.localCount) features |= SHADER_SPOT_SHADOWS;
+	}
+	return features;
+}
+
+// barycentric interpolation of a vertex attribute
+template<typename T>
+static inline T interpolateVertices(float w0, float w1, float w2, const T& a0, const T& a1, const T& a2) {
+	return (a0 * w0) + (a1 * w1) + (a2 * w2);
+}
+
+// Lambert term of a normal
+// Input Variables:
+// - c : surface colour
+// - normal : normalised normal
+// - light : light of the frame
+// - shade : shading constants of the mesh
+// - visibility : fraction of the light reaching the surface (shadows)
+static inline color lambert(const color& c, const vec4& normal, const LightParams& light, const ShadeParams& shade, float visibility = 1.f) {
+	float dot = max(vec4::dot(light.omega_i, normal), 0.0f);
+	return c * (dot * visibility) * shade.diffuse + shade.ambient;
+}
+
+// Light of the point and spot lights reaching the tile of a fragment
+// The light fades to zero at the radius, spot lights also fade between their inner and outer cone
+// and are looked up in their shadow map when they cast shadows.
+// Input Variables:
+// - c : surface colour
+// - normal : normalised normal
+// - world : world space position of the fragment
+// - light : light of the tile (tileLightParams)
+// - shade : shading constants of the mesh
+// Specular adds the Blinn-Phong highlight, Shadows looks spot lights up in their shadow maps.
+template<bool Specular, bool Shadows>
+static inline color localLights(const color& c, const vec4& normal, const vec4& world, const LightParams& light, const ShadeParams& shade) {
+	color sum(0.f, 0.f, 0.f);
+	const LocalLight* lights = light.tileLights->getLights();
+	for (unsigned int i = 0; i < light.localCount; i++) {
+		const LocalLight& l = lights[light.localIndex[i]];
+		vec4 toLight = l.position - world;
+		float d2 = vec4::dot(toLight, toLight), r2 = l.radius * l.radius;
+		if (d2 >= r2) continue;
+
+		toLight = toLight * (1.f / std::sqrt(d2));
+		float dot = vec4::dot(toLight, normal);
+		if (dot <= 0.f) continue;
+
+		float falloff = 1.f - d2 / r2;
+		float attenuation = falloff * falloff;
+		if (l.cosOuter > -1.f) {
+			float cosAngle = -vec4::dot(toLight, l.direction);
+			if (cosAngle <= l.cosOuter) continue;
+			if (cosAngle < l.cosInner) attenuation *= (cosAngle - l.cosOuter) / (l.cosInner - l.cosOuter);
+			if constexpr (Shadows)
+				if (const ShadowMap* map = light.shadows->spot(light.localIndex[i])) attenuation *= map->visibility(world, dot);
+		}
+
+		sum = sum + l.L * c * (dot * attenuation * shade.kd);
+		if constexpr (Specular) {
+			vec4 halfway = toLight + light.viewDir;
+			halfway.normalise();
+			sum = sum + l.L * (shade.ks * attenuation * std::pow(max(vec4::dot(halfway, normal), 0.0f), shade.shininess));
+		}
+	}
+	return sum;
+}
+
+// screen x, screen y and depth of a fragment
+static inline vec4 fragmentScreen(const Vertex* v, float w0, float w1, float w2) {
+	return interpolateVertices(w0, w1, w2, v[0].p, v[1].p, v[2].p);
+}
+
+// Sun shadow of a triangle's fragments
+// The sun map position of the corners is computed once per triangle and interpolated per fragment
+// like the other attributes (ShadowMaps::toSun), leaving a divide and the filtered lookup per fragment.
+// Enabled is false when the sun casts no shadow, every fragment is then fully lit.
+template<bool Enabled>
+struct SunShadow {
+	const ShadowMaps* maps = nullptr;
+	__m128 corner[3];					// homogeneous sun map position of every vertex
+
+	SunShadow(const Vertex* v, const LightParams& light) {
+		if constexpr (Enabled) {
+			maps = light.shadows;
+			for (int i = 0; i < 3; i++)
+				corner[i] = maps->toSun(v[i].p).simd();
+		}
+	}
+
+	// fraction of the sun light reaching the fragment with barycentric weights w0, w1 and w2
+	float visibility(float w0, float w1, float w2, const vec4& normal, const LightParams& light) const {
+		if constexpr (Enabled) {
+			__m128 p = _mm_fmadd_ps(corner[0], _mm_set1_ps(w0), _mm_fmadd_ps(corner[1], _mm_set1_ps(w1), _mm_mul_ps(corner[2], _mm_set1_ps(w2))));
+			return maps->sunVisibility(vec4(p), vec4::dot(light.omega_i, normal));
+		}
+		else return 1.f;
+	}
+};
+
+// Colour texture of a triangle's fragments
+// The corners carry (u / w, v / w, 1 / w), built from the texture coordinates of the triangle in
+// its mesh and the 1 / w the vertex stage keeps in the screen position (processInverseW). They vary
+// linearly across the screen, so their change per pixel is set up once per triangle. Per fragment
+// they are interpolated and divided back to (u, v), and the quotient rule turns their per pixel
+// change into the derivatives of (u, v) that pick the mip level.
+// Enabled is false for untextured meshes, the surface colour is then used as it is.
+template<bool Enabled>
+struct TexturedSurface {
+	const Texture* texture = nullptr;
+	__m128 corner[3];					// (u / w, v / w, 1 / w) of every vertex
+	__m128 ddx, ddy;					// change per pixel along screen x and y
+
+	// Input Variables:
+	// - v : screen space vertices of the triangle
+	// - shade : shading constants of its mesh (texture and ShadeParams::mesh)
+	// - source : index of the triangle in its mesh
+	TexturedSurface(const Vertex* v, const ShadeParams& shade, unsigned int source) {
+		if constexpr (Enabled) {
+			texture = shade.texture;
+			float x1 = v[1].p[0] - v[0].p[0], y1 = v[1].p[1] - v[0].p[1];
+			float x2 = v[2].p[0] - v[0].p[0], y2 = v[2].p[1] - v[0].p[1];
+			float area = x1 * y2 - x2 * y1;
+			__m128 invArea = _mm_set1_ps(area != 0.f ? 1.f / area : 0.f);
+			const triIndices& ind = shade.mesh->getTriangles()[source];
+			const std::vector<TexCoord>& texCoords = shade.mesh->getTexCoords();
+			float repeat = shade.mesh->material.textureRepeat;
+			for (int i = 0; i < 3; i++) {
+				const TexCoord& t = texCoords[ind.v[i]];
+				float q = v[i].p[3], s = repeat * q;
+				corner[i] = _mm_setr_ps(t.u * s, t.v * s, q, 0.f);
+			}
+			__m128 d1 = _mm_sub_ps(corner[1], corner[0]), d2 = _mm_sub_ps(corner[2], corner[0]);
+			ddx = _mm_mul_ps(_mm_fmsub_ps(d1, _mm_set1_ps(y2), _mm_mul_ps(d2, _mm_set1_ps(y1))), invArea);
+			ddy = _mm_mul_ps(_mm_fmsub_ps(d2, _mm_set1_ps(x1), _mm_mul_ps(d1, _mm_set1_ps(x2))), invArea);
+		}
+	}
+
+	// surface colour times the texture at the fragment with barycentric weights w0, w1 and w2
+	color modulate(const color& c, float w0, float w1, float w2) const {
+		if constexpr (Enabled) {
+			__m128 s = _mm_fmadd_ps(corner[0], _mm_set1_ps(w0), _mm_fmadd_ps(corner[1], _mm_set1_ps(w1), _mm_mul_ps(corner[2], _mm_set1_ps(w2))));
+			__m128 invQ = _mm_div_ps(_mm_set1_ps(1.f), _mm_shuffle_ps(s, s, _MM_SHUFFLE(2, 2, 2, 2)));
+			__m128 uv = _mm_mul_ps(s, invQ);
+			// d(a / q) = (da - (a / q) dq) / q
+			__m128 dx = _mm_mul_ps(_mm_fnmadd_ps(uv, _mm_shuffle_ps(ddx, ddx, _MM_SHUFFLE(2, 2, 2, 2)), ddx), invQ);
+			__m128 dy = _mm_mul_ps(_mm_fnmadd_ps(uv, _mm_shuffle_ps(ddy, ddy, _MM_SHUFFLE(2, 2, 2, 2)), ddy), invQ);
+			vec4 at(uv);
+			return c * texture->sample(at[0], at[1], texture->lod(vec4(dx), vec4(dy)));
+		}
+		else return c;
+	}
+};
+
+// texture of the shaders with the features F
+template<unsigned int F>
+using ShaderSurface = TexturedSurface<(F & SHADER_TEXTURE) != 0>;
+
+// sun shadow of the shaders with the features F
+template<unsigned int F>
+using ShaderSunShadow = SunShadow<(F & SHADER_SUN_SHADOW) != 0>;
+
+template<unsigned int Features>
+struct Shader<ShadingModel::Unlit, Features> {
+	const Vertex* v;
+	ShaderSurface<Features> surface;
+
+	Shader(const Vertex* _v, const LightParams&, const ShadeParams& shade, unsigned int source) : v(_v), surface(_v, shade, source) {}
+
+	color shade(float w0, float w1, float w2) const {
+		return surface.modulate(interpolateVertices(w0, w1, w2, v[0].rgb, v[1].rgb, v[2].rgb), w0, w1, w2);
+	}
+};
+
+template<unsigned int Features>
+struct Shader<ShadingModel::Flat, Features> {
+	color c;	// colour of the whole triangle
+	ShaderSurface<Features> surface;
+
+	Shader(const Vertex* v, const LightParams& light, const ShadeParams& shade, unsigned int source) : surface(v, shade, source) {
+		vec4 normal = v[0].normal + v[1].normal + v[2].normal;
+		normal.normalise();
+		c = lambert((v[0].rgb + v[1].rgb + v[2].rgb) * (1.f / 3.f), normal, light, shade);
+	}
+
+	color shade(float w0, float w1, float w2) const { return surface.modulate(c, w0, w1, w2); }
+};
+
+// the vertex colours were lit by the vertex stage (processVerticesLit), only the colour is interpolated
+template<unsigned int Features>
+struct Shader<ShadingModel::Gouraud, Features> {
+	const Vertex* v;
+	ShaderSurface<Features> surface;
+
+	Shader(const Vertex* _v, const LightParams&, const ShadeParams& shade, unsigned int source) : v(_v), surface(_v, shade, source) {}
+
+	color shade(float w0, float w1, float w2) const {
+		return surface.modulate(interpolateVertices(w0, w1, w2, v[0].rgb, v[1].rgb, v[2].rgb), w0, w1, w2);
+	}
+};
+
+template<unsigned int Features>
+struct Shader<ShadingModel::Lambert, Features> {
+	const Vertex* v;
+	const LightParams& light;
+	const ShadeParams& params;
+	ShaderSunShadow<Features> sunShadow;
+	ShaderSurface<Features> surface;
+
+	Shader(const Vertex* _v, const LightParams& _light, const ShadeParams& _params, unsigned int source)
+		: v(_v), light(_light), params(_params), sunShadow(_v, _light), surface(_v, _params, source) {}
+
+	color shade(float w0, float w1, float w2) const {
+		color c = surface.modulate(interpolateVertices(w0, w1, w2, v[0].rgb, v[1].rgb, v[2].rgb), w0, w1, w2);
+		vec4 normal = interpolateVertices(w0, w1, w2, v[0].normal, v[1].normal, v[2].normal);
+		normal.normalise();
+		color lit = lambert(c, normal, light, params, sunShadow.visibility(w0, w1, w2, normal, light));
+		if constexpr ((Features & SHADER_LOCAL_LIGHTS) != 0)
+			lit = lit + localLights<false, (Features & SHADER_SPOT_SHADOWS) != 0>(c, normal, light.tileLights->toWorld(fragmentScreen(v, w0, w1, w2)), light, params);
+		return lit;
+	}
+};
+
+template<unsigned int Features>
+struct Shader<ShadingModel::BlinnPhong, Features> {
+	const Vertex* v;
+	const LightParams& light;
+	const ShadeParams& params;
+	color specular;	// light colour * ks
+	ShaderSunShadow<Features> sunShadow;
+	ShaderSurface<Features> surface;
+
+	Shader(const Vertex* _v, const LightParams& _light, const ShadeParams& _params, unsigned int source)
+		: v(_v), light(_light), params(_params), specular(_light.L * _params.ks), sunShadow(_v, _light), surface(_v, _params, source) {}
+
+	color shade(float w0, float w1, float w2) const {
+		color c = surface.modulate(interpolateVertices(w0, w1, w2, v[0].rgb, v[1].rgb, v[2].rgb), w0, w1, w2);
+		vec4 normal = interpolateVertices(w0, w1, w2, v[0].normal, v[1].normal, v[2].normal);
+		normal.normalise();
+		float highlight = std::pow(max(vec4::dot(light.halfway, normal), 0.0f), params.shininess);
+		float sun = sunShadow.visibility(w0, w1, w2, normal, light);
+		color lit = lambert(c, normal, light, params, sun) + specular * (highlight * sun);
+		if constexpr ((Features & SHADER_LOCAL_LIGHTS) != 0)
+			lit = lit + localLights<true, (Features & SHADER_SPOT_SHADOWS) != 0>(c, normal, light.tileLights->toWorld(fragmentScreen(v, w0, w1, w2)), light, params);
+		return lit;
+	}
+};
@@ -0,0 +1,164 @@
+#pragma once
+
+#include "vec4.h"
+#include "colour.h"
+#include "light.h"
+#include "matrix.h"
+#include "lightCulling.h"
+
+class ShadowMaps;	// shadowMap.h
+class Texture;		// texture.h
+class Mesh;			// mesh.h
+
+// Shading models a mesh can be drawn with (the pixel loop is compiled once per model, see shaders.h)
+enum class ShadingModel : unsigned char {
+	Unlit,		// interpolated vertex colour, no lighting
+	Flat,		// one Lambert colour per triangle from the averaged vertex normals
+	Gouraud,	// Lambert evaluated per vertex by the vertex stage (in object space), the lit colour is interpolated
+	Lambert,	// Lambert with the interpolated normal normalised per pixel
+	BlinnPhong	// per pixel Lambert plus a Blinn-Phong specular highlight
+};
+
+// true for the models lit per pixel, only these see the point and spot lights
+constexpr bool perPixelLighting(ShadingModel model) {
+	return model == ShadingModel::Lambert || model == ShadingModel::BlinnPhong;
+}
+
+const unsigned int SHADING_MODELS = 5;
+
+static const char* shadingModelNames[] = { "unlit", "flat", "gouraud", "lambert", "blinn-phong" };
+
+// Features of the pixel pipeline, combined as bit flags (every combination has its own pixel loop)
+enum PixelFeature : unsigned char {
+	PIXEL_DEPTH_TEST = 1,		// fragments behind the stored depth are discarded
+	PIXEL_DEPTH_WRITE = 2,		// fragments store their depth
+	PIXEL_COLOUR_WRITE = 4,		// fragments store their colour
+	PIXEL_DEFAULT = PIXEL_DEPTH_TEST | PIXEL_DEPTH_WRITE | PIXEL_COLOUR_WRITE
+};
+
+const unsigned int PIXEL_FEATURE_COMBINATIONS = 8;
+
+// Features of the pixel shader, combined as bit flags and picked per triangle from its mesh and
+// the light of the tile it is drawn in (see shaderFeatures in shaders.h). Every combination has
+// its own pixel loop, so shading never branches on the material or the light.
+enum ShaderFeature : unsigned char {
+	SHADER_TEXTURE = 1,			// the mesh has a colour texture
+	SHADER_LOCAL_LIGHTS = 2,	// point or spot lights reach the tile (per pixel models)
+	SHADER_SUN_SHADOW = 4,		// the sun casts a shadow map (per pixel models)
+	SHADER_SPOT_SHADOWS = 8		// the local lights are looked up in their shadow maps (per pixel models)
+};
+
+const unsigned int SHADER_FEATURE_COMBINATIONS = 16;
+
+// Shader features a shading model uses, the others are dropped when its kernels are compiled
+constexpr unsigned int shaderFeaturesOf(ShadingModel model) {
+	return perPixelLighting(model) ? SHADER_TEXTURE | SHADER_LOCAL_LIGHTS | SHADER_SUN_SHADOW | SHADER_SPOT_SHADOWS : SHADER_TEXTURE;
+}
+
+// How a mesh is shaded
+struct Material {
+	ShadingModel model = ShadingModel::Lambert;
+	unsigned char features = PIXEL_DEFAULT;	// PixelFeature flags
+	float ks = 0.5f;						// specular reflection coefficient (BlinnPhong)
+	float shininess = 32.f;					// specular exponent (BlinnPhong)
+	const Texture* texture = nullptr;		// colour texture multiplying the vertex colour, nullptr for none
+	float textureRepeat = 1.f;				// times the texture repeats across the texture coordinates of the mesh
+};
+
+// Shading constants of a mesh for one frame, stored with each of its triangles
+struct ShadeParams {
+	color ambient;			// ambient light of the mesh (light ambient * ka)
+	color diffuse;			// diffuse light of the mesh (light colour * kd)
+	float kd = 1.f;			// diffuse reflection coefficient (point and spot lights)
+	float ks = 0.f;			// specular reflection coefficient
+	float shininess = 1.f;	// specular exponent
+	ShadingModel model = ShadingModel::Lambert;
+	unsigned char features = PIXEL_DEFAULT;
+	const Texture* texture = nullptr;	// colour texture, nullptr for none
+	const Mesh* mesh = nullptr;			// mesh providing the texture coordinates (set with texture, see meshShadeParams)
+};
+
+// Light of a frame as the pixel shaders see it
+struct LightParams {
+	vec4 omega_i;	// normalised direction towards the light
+	vec4 halfway;	// normalised halfway vector between the light and the viewer (Blinn-Phong)
+	vec4 viewDir;	// normalised direction towards the viewer
+	color L;		// light colour (the Blinn-Phong shader scales it by ks for the highlight)
+	const TileLights* tileLights = nullptr;	// point and spot lights binned into tiles, nullptr when there are none
+	const unsigned int* localIndex = nullptr;	// lights reaching the tile being drawn (see tileLightParams)
+	unsigned int localCount = 0;
+	const ShadowMaps* shadows = nullptr;	// shadow maps of the frame, nullptr when no light casts shadows
+};
+
+// Light of a mesh in its object space, lights the mesh vertices before they are transformed (Gouraud)
+struct VertexLight {
+	vec4 omega_i;	// normalised direction towards the light in object space
+	color ambient;	// ambient light of the mesh
+	color diffuse;	// diffuse light of the mesh
+};
+
+// Shading constants of a mesh
+// Input Variables:
+// - L : light
+// - ka, kd : ambient and diffuse reflection coefficients of the mesh
+// - material : material of the mesh
+static inline ShadeParams makeShadeParams(const Light& L, float ka, float kd, const Material& material) {
+	ShadeParams s;
+	s.ambient = L.ambient * ka;
+	s.diffuse = L.L * kd;
+	s.kd = kd;
+	s.ks = material.ks;
+	s.shininess = material.shininess;
+	s.model = material.model;
+	s.features = material.features;
+	s.texture = material.texture;
+	return s;
+}
+
+// Light of a mesh in its object space
+// The light direction is moved into object space once (inverse world matrix) instead of moving
+// every vertex normal into world space. After normalising, the Lambert term is exact for world
+// matrices made of rotations, translations and uniform scales.
+// Input Variables:
+// - omega_i : normalised world space direction towards the light
+// - world : world matrix of the mesh
+// - shade : shading constants of the mesh
+static inline VertexLight makeVertexLight(const vec4& omega_i, const matrix& world, const ShadeParams& shade) {
+	VertexLight l;
+	l.omega_i = matrix::makeInverse(world) * omega_i;
+	l.omega_i.normalise();
+	l.ambient = shade.ambient;
+	l.diffuse = shade.diffuse;
+	return l;
+}
+
+// Light constants of a frame
+// The viewer is treated as infinitely far away (one view direction for the whole frame), so
+// the halfway vector is a constant as well.
+// Input Variables:
+// - L : light (direction already normalised)
+// - viewDir : normalised world space direction towards the viewer (Renderer::getViewDir)
+// - tileLights : point and spot lights of the frame binned into tiles (optional)
+// - shadows : shadow maps of the frame (optional, see ShadowMaps::empty)
+static inline LightParams makeLightParams(const Light& L, const vec4& viewDir, const TileLights* tileLights = nullptr,
+	const ShadowMaps* shadows = nullptr) {
+	LightParams p;
+	p.omega_i = L.omega_i;
+	p.halfway = L.omega_i + viewDir;
+	p.halfway.normalise();
+	p.viewDir = viewDir;
+	p.L = L.L;
+	if (tileLights && !tileLights->empty()) p.tileLights = tileLights;
+	p.shadows = shadows;
+	return p;
+}
+
+// Light of a frame for drawing one tile, with the point and spot lights reaching the tile
+// Input Variables:
+// - frame : light of the frame
+// - tile : linear tile index
+static inline LightParams tileLightParams(const LightParams& frame, int tile) {
+	LightParams p = frame;
+	if (p.tileLights) p.localIndex = p.tileLights->getTileLights(tile, p.localCount);
+	return p;
+}
@@ -0,0 +1,206 @@
+#pragma once
+
+#include <vector>
+#include <cmath>
+#include "depthRaster.h"
+#include "light.h"
+#include "matrix.h"
+
+static const int SHADOW_MAP_SIZE = 1024;		// texels along each side of the sun shadow map
+static const int SPOT_SHADOW_MAP_SIZE = 512;	// texels along each side of a spot light shadow map
+static const float SHADOW_BIAS_TEXELS = 1.5f;	// depth bias in texels, keeps lit surfaces from shadowing themselves
+static const float SHADOW_MAX_SLOPE = 8.f;		// largest growth of the bias on surfaces almost parallel to the light
+
+// Depth of the scene seen from a light, drawn with the depth only pass (renderDepthPass)
+class ShadowMap {
+	DepthTarget depth;
+	matrix toTexel;			// world position to (texel x, texel y, depth) times w
+	float biasScale = 0.f;	// depth bias, divided by the light space w for perspective maps
+	bool perspective = false;
+
+	// Matrix mapping normalised device coordinates to texels (y down, like the screen)
+	static matrix makeTexelMapping(int size) {
+		matrix m;
+		m[0] = 0.5f * size; m[3] = 0.5f * size;
+		m[5] = -0.5f * size; m[7] = 0.5f * size;
+		return m;
+	}
+
+public:
+	// Draws the shadow map
+	// Input Variables:
+	// - meshes : shadow casters
+	// - view : view matrix of the light
+	// - projection : projection of the light (depth 0 at the near plane, 1 at the far plane)
+	// - size : texels along each side
+	// - texelWorld : world size of a texel (at unit distance from the light for perspective maps)
+	// - depthPerWorld : depth change per world unit along the light (times the squared distance for perspective maps)
+	// - _perspective : true for perspective projections
+	// - totalThreads : number of threads to use for multithreading
+	void draw(const std::vector<Mesh*>& meshes, const matrix& view, const matrix& projection, int size,
+		float texelWorld, float depthPerWorld, bool _perspective, unsigned int totalThreads) {
+		if (depth.getWidth() != size) depth.create(size, size);
+		matrix vp = projection * view;
+		toTexel = makeTexelMapping(size) * vp;
+		biasScale = SHADOW_BIAS_TEXELS * texelWorld * depthPerWorld;
+		perspective = _perspective;
+		renderDepthPass(meshes, vp, depth, totalThreads);
+	}
+
+	// Matrix from world positions to texels, for lookups through another space (see ShadowMaps::toSun)
+	const matrix& getToTexel() const { return toTexel; }
+
+	// Fraction of the 2x2 texels around a texel position that are nearer to the light than the
+	// depth (percentage closer filtering, weighted bilinearly)
+	// Input Variables:
+	// - x, y : texel position
+	// - d : depth of the point seen from the light
+	// - w : light space w of the point (1 for orthographic maps)
+	// - cosTheta : cosine between the surface normal and the direction towards the light (above 0)
+	// Returns 1 for a lit point, 0 for a point in shadow
+	float sample(float x, float y, float d, float w, float cosTheta) const {
+		int size = depth.getWidth();
+		if (!(x >= 0.f && y >= 0.f && x < size - 1 && y < size - 1) || d >= 1.f) return 1.f; // outside the map
+
+		// slope scaled bias: a texel covers more depth on surfaces seen at a grazing angle,
+		// 1 / cos grows like 1 + tan without a square root
+		float ref = d - (perspective ? biasScale / w : biasScale) * min(1.f / cosTheta, SHADOW_MAX_SLOPE);
+
+		int x0 = (int)x, y0 = (int)y;
+		float fx = x - x0, fy = y - y0;
+		const float* t = depth.row(y0) + x0;
+		float s00 = ref <= t[0] ? 1.f : 0.f;
+		float s10 = ref <= t[1] ? 1.f : 0.f;
+		float s01 = ref <= t[size] ? 1.f : 0.f;
+		float s11 = ref <= t[size + 1] ? 1.f : 0.f;
+		return (s00 + (s10 - s00) * fx) * (1.f - fy) + (s01 + (s11 - s01) * fx) * fy;
+	}
+
+	// Fraction of the light reaching a world position
+	// Input Variables:
+	// - world : world space position
+	// - cosTheta : cosine between the surface normal and the direction towards the light (above 0)
+	float visibility(const vec4& world, float cosTheta) const {
+		vec4 p = toTexel.mul_point(world);
+		if (p[3] <= 0.f) return 1.f; // behind the light
+		float invW = 1.f / p[3];
+		return sample(p[0] * invW, p[1] * invW, p[2] * invW, p[3], cosTheta);
+	}
+};
+
+// Shadow maps of a frame: one for the directional light (sun) and one for every spot light that casts shadows
+class ShadowMaps {
+	ShadowMap sunMap;
+	bool hasSun = false;
+	matrix screenToSun;				// screen x, screen y and depth of the camera to sun map texels
+	std::vector<ShadowMap> spotMaps;
+	std::vector<int> spotIndex;		// shadow map of every local light, -1 if it casts no shadows
+
+	// Any direction not parallel to a light direction
+	static vec4 upFor(const vec4& direction) {
+		return fabs(direction[1]) > 0.99f ? vec4(1.f, 0.f, 0.f, 0.f) : vec4(0.f, 1.f, 0.f, 0.f);
+	}
+
+	// Draws the sun map over a sphere of radius shadowDistance in front of the camera.
+	// The sphere centre is snapped to whole texels of the light view, so the map does not
+	// shimmer as the camera moves.
+	void drawSun(const std::vector<Mesh*>& meshes, const Light& L, const vec4& eye, const vec4& viewDir, unsigned int totalThreads) {
+		float radius = L.shadowDistance;
+		float texel = 2.f * radius / SHADOW_MAP_SIZE;
+		vec4 center = eye - viewDir * (radius * 0.5f);
+
+		vec4 up = upFor(L.omega_i);
+		vec4 right = vec4::cross(-L.omega_i, up);
+		right.normalise();
+		vec4 trueUp = vec4::cross(right, -L.omega_i);
+		float r = vec4::dot(center, right), u = vec4::dot(center, trueUp);
+		center = center + right * (std::floor(r / texel) * texel - r) + trueUp * (std::floor(u / texel) * texel - u);
+		center[3] = 1.f;
+
+		// casters up to two radii towards the light, receivers up to one radius away from it
+		vec4 from = center + L.omega_i * (2.f * radius);
+		from[3] = 1.f;
+		matrix view = matrix::makeLookAt(from, center, up);
+		matrix projection = matrix::makeOrthographic(radius, radius, 0.f, 3.f * radius);
+		sunMap.draw(meshes, view, projection, SHADOW_MAP_SIZE, texel, 1.f / (3.f * radius), false, totalThreads);
+	}
+
+	// Draws the map of a spot light, a perspective projection covering its outer cone
+	static void drawSpot(ShadowMap& map, const std::vector<Mesh*>& meshes, const LocalLight& l, unsigned int totalThreads) {
+		float fov = 2.f * std::acos(max(l.cosOuter, 0.05f));
+		float n = l.radius * 0.02f, f = l.radius;
+		vec4 target = l.position + l.direction;
+		target[3] = 1.f;
+		matrix view = matrix::makeLookAt(l.position, target, upFor(l.direction));
+		matrix projection = matrix::makePerspective(fov, 1.f, n, f);
+		map.draw(meshes, view, projection, SPOT_SHADOW_MAP_SIZE, 2.f * std::tan(fov * 0.5f) / SPOT_SHADOW_MAP_SIZE,
+			n * f / (f - n), true, totalThreads);
+	}
+
+public:
+	// Draws the shadow maps of the lights that cast shadows (maps are kept between frames)
+	// Input Variables:
+	// - meshes : shadow casters
+	// - L : light (direction already normalised)
+	// - vp : view projection matrix of the camera
+	// - eye : world space camera position
+	// - viewDir : normalised world space direction towards the camera
+	// - width, height : size of the canvas
+	// - totalThreads : number of threads to use for multithreading
+	void build(const std::vector<Mesh*>& meshes, const Light& L, const matrix& vp, const vec4& eye, const vec4& viewDir,
+		int width, int height, unsigned int totalThreads) {
+		PROFILE_ZONE("shadow maps");
+		hasSun = L.castShadows;
+		if (hasSun) {
+			drawSun(meshes, L, eye, viewDir, totalThreads);
+
+			// camera screen space back to normalised device coordinates, then to world and into the sun map
+			matrix toNDC;
+			toNDC[0] = 2.f / width; toNDC[3] = -1.f;
+			toNDC[5] = -2.f / height; toNDC[7] = 1.f;
+			screenToSun = sunMap.getToTexel() * (matrix::makeInverse(vp) * toNDC);
+		}
+
+		spotIndex.assign(L.locals.size(), -1);
+		unsigned int spots = 0;
+		for (unsigned int i = 0; i < L.locals.size(); i++) {
+			const LocalLight& l = L.locals[i];
+			if (!l.castShadows || l.cosOuter <= -1.f) continue; // point lights would need cube maps
+			if (spots == spotMaps.size()) spotMaps.emplace_back();
+			drawSpot(spotMaps[spots], meshes, l, totalThreads);
+			spotIndex[i] = spots++;
+		}
+		spotMaps.resize(spots);
+	}
+
+	// true if no light casts shadows this frame
+	bool empty() const { return !hasSun && spotMaps.empty(); }
+
+	// true if the directional light has a shadow map this frame
+	bool hasSunMap() const { return hasSun; }
+
+	// Homogeneous sun map position of a screen space point. The mapping is projective, so the
+	// position of a fragment may be interpolated from the positions of its triangle's corners.
+	// Input Variables:
+	// - screen : screen x, screen y and depth
+	vec4 toSun(const vec4& screen) const {
+		return screenToSun.mul_point(vec4(screen[0], screen[1], screen[2], 1.f));
+	}
+
+	// Fraction of the sun light reaching a fragment, surfaces facing away from the sun get none
+	// Input Variables:
+	// - sun : homogeneous sun map position of the fragment (toSun)
+	// - cosTheta : cosine between the surface normal and the direction towards the sun
+	float sunVisibility(const vec4& sun, float cosTheta) const {
+		if (cosTheta <= 0.f) return 0.f;
+		float invW = 1.f / sun[3];
+		return sunMap.sample(sun[0] * invW, sun[1] * invW, sun[2] * invW, 1.f, cosTheta);
+	}
+
+	// Shadow map of a local light, nullptr if it casts no shadows
+	// Input Variables:
+	// - light : index of the light in Light::locals
+	const ShadowMap* spot(unsigned int light) const {
+		return light < spotIndex.size() && spotIndex[light] >= 0 ? &spotMaps[spotIndex[light]] : nullptr;
+	}
+};
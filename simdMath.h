@@ -0,0 +1,42 @@
+#pragma once
+
+#include <immintrin.h>
+
+// Eight-wide math helpers for AVX2 kernels.
+
+// Sine and cosine of eight angles
+// Cody-Waite reduction to [-pi/4, pi/4] and minimax polynomials (about 1 ulp for |x| < 8192)
+// Input Variables:
+// - x : angles in radians
+// Output Variables:
+// - s, c : sine and cosine of x
+static inline void sincos8(__m256 x, __m256& s, __m256& c) {
+	// quadrant k = round(x / (pi / 2)), y = x - k * pi / 2 in two parts for precision
+	__m256 k = _mm256_round_ps(_mm256_mul_ps(x, _mm256_set1_ps(0.63661977236f)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+	__m256 y = _mm256_fnmadd_ps(k, _mm256_set1_ps(1.5703125f), x);
+	y = _mm256_fnmadd_ps(k, _mm256_set1_ps(4.837512969970703125e-4f), y);
+	y = _mm256_fnmadd_ps(k, _mm256_set1_ps(7.54978995489188216e-8f), y);
+	__m256i q = _mm256_cvtps_epi32(k);
+
+	__m256 y2 = _mm256_mul_ps(y, y);
+	__m256 ps = _mm256_fmadd_ps(y2, _mm256_set1_ps(-1.9515295891e-4f), _mm256_set1_ps(8.3321608736e-3f));
+	ps = _mm256_fmadd_ps(ps, y2, _mm256_set1_ps(-1.6666654611e-1f));
+	ps = _mm256_fmadd_ps(_mm256_mul_ps(ps, y2), y, y);
+	__m256 pc = _mm256_fmadd_ps(y2, _mm256_set1_ps(2.443315711809948e-5f), _mm256_set1_ps(-1.388731625493765e-3f));
+	pc = _mm256_fmadd_ps(pc, y2, _mm256_set1_ps(4.166664568298827e-2f));
+	pc = _mm256_fmadd_ps(_mm256_mul_ps(pc, y2), y2, _mm256_fnmadd_ps(y2, _mm256_set1_ps(0.5f), _mm256_set1_ps(1.f)));
+
+	// odd quadrants swap sine and cosine, the sign follows the quadrant
+	__m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(q, _mm256_set1_epi32(1)), _mm256_set1_epi32(1)));
+	__m256 signS = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(q, _mm256_set1_epi32(2)), 30));
+	__m256 signC = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(q, _mm256_set1_epi32(1)), _mm256_set1_epi32(2)), 30));
+	s = _mm256_xor_ps(_mm256_blendv_ps(ps, pc, swap), signS);
+	c = _mm256_xor_ps(_mm256_blendv_ps(pc, ps, swap), signC);
+}
+
+// 1 / sqrt(x) of eight values, hardware estimate refined by one Newton step (about 23 bits)
+static inline __m256 rsqrt8(__m256 x) {
+	__m256 r = _mm256_rsqrt_ps(x);
+	__m256 half = _mm256_mul_ps(_mm256_set1_ps(0.5f), x);
+	return _mm256_mul_ps(r, _mm256_fnmadd_ps(_mm256_mul_ps(half, r), r, _mm256_set1_ps(1.5f)));
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <mutex>
+#include <ostream>
+
+// Per frame render statistics.
+// Every thread counts into its own thread_local block with plain increments; kernels count pixels
+// in locals and add them once per triangle. A thread adds its block to the frame totals when it
+// exits (the render functions join their workers before the frame ends) and the thread ending the
+// frame adds its own block in endFrame(). In the pipelined renderer the geometry counters are
+// collected one frame early, since the geometry of the next frame runs during the current one.
+
+// counting is compiled out completely when 0
+#ifndef RENDER_STATS_ENABLED
+#define RENDER_STATS_ENABLED 1
+#endif
+
+struct RenderStats {
+	unsigned long long meshesSubmitted = 0;		// meshes handed to the renderer
+	unsigned long long meshesCulled = 0;		// meshes rejected before any triangle was drawn
+	unsigned long long trianglesSubmitted = 0;	// triangles of the submitted meshes
+	unsigned long long trianglesClipped = 0;	// triangles dropped by the depth range clip
+	unsigned long long trianglesCulled = 0;		// off screen, too small or behind the hierarchical Z
+	unsigned long long trianglesRasterised = 0;	// triangles scanned (per tile in the tiled renderer)
+	unsigned long long pixelsTested = 0;		// covered pixels that went through the depth test
+	unsigned long long pixelsShaded = 0;		// pixels that passed the depth test and were shaded
+	unsigned long long lightTiles = 0;			// (point or spot light, tile) pairs left by the light culling
+	unsigned long long casRetries = 0;			// packed depth compare exchanges lost to another thread (see Renderer::getContention)
+	unsigned long long lostRaces = 0;			// fragments nearer when read but rejected after losing an exchange
+
+	// pixels rejected by the depth test
+	unsigned long long depthRejected() const { return pixelsTested - pixelsShaded; }
+
+	void operator += (const RenderStats& s) {
+		meshesSubmitted += s.meshesSubmitted;
+		meshesCulled += s.meshesCulled;
+		trianglesSubmitted += s.trianglesSubmitted;
+		trianglesClipped += s.trianglesClipped;
+		trianglesCulled += s.trianglesCulled;
+		trianglesRasterised += s.trianglesRasterised;
+		pixelsTested += s.pixelsTested;
+		pixelsShaded += s.pixelsShaded;
+		lightTiles += s.lightTiles;
+		casRetries += s.casRetries;
+		lostRaces += s.lostRaces;
+	}
+
+	// Writes the counters as the members of a JSON object (depth contention is reported on its own)
+	// Input Variables:
+	// - os : output stream
+	// - scale : factor applied to every counter (e.g. 1 / frames for averages)
+	// - indent : prefix of every line
+	void writeJSON(std::ostream& os, double scale = 1.0, const char* indent = "  ") const {
+		os << indent << "\"meshesSubmitted\": " << meshesSubmitted * scale << ",\n"
+			<< indent << "\"meshesCulled\": " << meshesCulled * scale << ",\n"
+			<< indent << "\"trianglesSubmitted\": " << trianglesSubmitted * scale << ",\n"
+			<< indent << "\"trianglesClipped\": " << trianglesClipped * scale << ",\n"
+			<< indent << "\"trianglesCulled\": " << trianglesCulled * scale << ",\n"
+			<< indent << "\"trianglesRasterised\": " << trianglesRasterised * scale << ",\n"
+			<< indent << "\"pixelsTested\": " << pixelsTested * scale << ",\n"
+			<< indent << "\"pixelsShaded\": " << pixelsShaded * scale << ",\n"
+			<< indent << "\"lightTiles\": " << lightTiles * scale << ",\n"
+			<< indent << "\"depthRejected\": " << depthRejected() * scale << "\n";
+	}
+
+	// Counter block of the calling thread
+	static RenderStats& local();
+
+	// Ends the frame: collects the calling thread's counters and returns the frame totals
+	// (call after all render threads have joined)
+	static RenderStats endFrame() {
+		RenderStats& mine = local();
+		std::lock_guard<std::mutex> guard(frameLock());
+		frameTotals() += mine;
+		mine = RenderStats();
+		RenderStats frame = frameTotals();
+		frameTotals() = RenderStats();
+		lastFrame() = frame;
+		return frame;
+	}
+
+	// Totals of the last frame ended with endFrame()
+	static RenderStats& lastFrame() {
+		static RenderStats last;
+		return last;
+	}
+
+private:
+	friend struct RenderStatsBlock;
+
+	static std::mutex& frameLock() {
+		static std::mutex m;
+		return m;
+	}
+
+	static RenderStats& frameTotals() {
+		static RenderStats totals;
+		return totals;
+	}
+};
+
+// thread_local counter block, added to the frame totals when the thread exits
+struct RenderStatsBlock {
+	RenderStats stats;
+	~RenderStatsBlock() {
+		std::lock_guard<std::mutex> guard(RenderStats::frameLock());
+		RenderStats::frameTotals() += stats;
+	}
+};
+
+inline RenderStats& RenderStats::local() {
+	static thread_local RenderStatsBlock block;
+	return block.stats;
+}
+
+#if RENDER_STATS_ENABLED
+// Adds to a counter of the calling thread
+#define RENDER_STAT(counter, value) (RenderStats::local().counter += (value))
+#else
+#define RENDER_STAT(counter, value) ((void)0)
+#endif
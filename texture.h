@@ -0,0 +1,454 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <cmath>
+#include <cstring>
+#include <cctype>
+#include <atomic>
+#include <immintrin.h>
+#include "vec4.h"
+#include "colour.h"
+
+// How a texture is filtered between texels and between mip levels
+enum class TextureFilter : unsigned char {
+	Bilinear,	// 2x2 texels of the nearest mip level
+	Trilinear	// 2x2 texels of the two nearest mip levels, blended by the fractional level
+};
+
+// Decoded image: packed 32-bit RGBA pixels (red in the lowest byte, like the framebuffer), row by row
+struct ImageData {
+	std::vector<unsigned int> pixels;
+	int width = 0, height = 0;
+};
+
+// packs one pixel
+static inline unsigned int packRGBA(unsigned int r, unsigned int g, unsigned int b, unsigned int a = 255) {
+	return r | g << 8 | b << 16 | a << 24;
+}
+
+// true for image sizes the decoders accept
+static inline bool validImageSize(int width, int height) {
+	return width > 0 && height > 0 && width <= 16384 && height <= 16384;
+}
+
+// Decodes a binary (P6) or plain (P3) PPM file
+static bool decodePPM(const std::vector<unsigned char>& bytes, ImageData& image, std::string& error) {
+	size_t p = 2;
+	// next header number, skipping white space and comments
+	auto number = [&](int& out) {
+		while (p < bytes.size() && (isspace(bytes[p]) || bytes[p] == '#'))
+			if (bytes[p] == '#') while (p < bytes.size() && bytes[p] != '\n') p++;
+			else p++;
+		if (p >= bytes.size() || !isdigit(bytes[p])) return false;
+		out = 0;
+		while (p < bytes.size() && isdigit(bytes[p])) out = out * 10 + (bytes[p++] - '0');
+		return true;
+	};
+
+	bool plain = bytes[1] == '3';
+	int maxValue;
+	if (!number(image.width) || !number(image.height) || !number(maxValue) || maxValue <= 0 || maxValue > 255) {
+		error = "unsupported PPM header (8 bit P3 and P6 only)";
+		return false;
+	}
+	if (!validImageSize(image.width, image.height)) { error = "bad image size"; return false; }
+	size_t count = (size_t)image.width * image.height;
+	image.pixels.resize(count);
+	if (plain) {
+		for (size_t i = 0; i < count; i++) {
+			int c[3];
+			if (!number(c[0]) || !number(c[1]) || !number(c[2])) { error = "truncated PPM data"; return false; }
+			image.pixels[i] = packRGBA(c[0] * 255 / maxValue, c[1] * 255 / maxValue, c[2] * 255 / maxValue);
+		}
+		return true;
+	}
+
+	p++; // single white space after the maximum value
+	if (bytes.size() < p + count * 3) { error = "truncated PPM data"; return false; }
+	const unsigned char* s = &bytes[p];
+	for (size_t i = 0; i < count; i++, s += 3)
+		image.pixels[i] = packRGBA(s[0] * 255 / maxValue, s[1] * 255 / maxValue, s[2] * 255 / maxValue);
+	return true;
+}
+
+// Decodes an uncompressed or run length encoded true colour / grey TGA file (types 2, 3, 10 and 11)
+static bool decodeTGA(const std::vector<unsigned char>& bytes, ImageData& image, std::string& error) {
+	if (bytes.size() < 18) { error = "truncated TGA header"; return false; }
+	int type = bytes[2], bits = bytes[16], descriptor = bytes[17];
+	bool grey = type == 3 || type == 11, rle = type == 10 || type == 11;
+	if (bytes[1] != 0 || !(type == 2 || type == 3 || type == 10 || type == 11) ||
+		(grey ? bits != 8 : bits != 24 && bits != 32)) {
+		error = "unsupported TGA image (8 bit grey, 24 and 32 bit true colour only)";
+		return false;
+	}
+	image.width = bytes[12] | bytes[13] << 8;
+	image.height = bytes[14] | bytes[15] << 8;
+	if (!validImageSize(image.width, image.height)) { error = "bad image size"; return false; }
+	size_t count = (size_t)image.width * image.height;
+	image.pixels.resize(count);
+
+	size_t p = 18 + bytes[0];	// after the image id
+	int stride = bits / 8;
+	// pixel at p, stored as BGR(A)
+	auto read = [&]() {
+		const unsigned char* s = &bytes[p];
+		p += stride;
+		if (grey) return packRGBA(s[0], s[0], s[0]);
+		return packRGBA(s[2], s[1], s[0], stride == 4 ? s[3] : 255);
+	};
+
+	for (size_t i = 0; i < count;) {
+		size_t run = 1;
+		bool repeat = false;
+		if (rle) {
+			if (p >= bytes.size()) break;
+			run = (bytes[p] & 0x7F) + 1;
+			repeat = (bytes[p++] & 0x80) != 0;
+		}
+		if (p + (repeat ? 1 : run) * stride > bytes.size()) break;
+		unsigned int c = repeat ? read() : 0;
+		for (size_t k = 0; k < run && i < count; k++, i++)
+			image.pixels[i] = repeat ? c : read();
+		if (i == count) {
+			// rows are stored bottom up unless the descriptor says otherwise
+			if (!(descriptor & 0x20))
+				for (int y = 0; y < image.height / 2; y++)
+					std::swap_ranges(image.pixels.begin() + (size_t)y * image.width, image.pixels.begin() + (size_t)(y + 1) * image.width,
+						image.pixels.begin() + (size_t)(image.height - 1 - y) * image.width);
+			return true;
+		}
+	}
+	error = "truncated TGA data";
+	return false;
+}
+
+// Decodes a QOI file (https://qoiformat.org), the format FrameCapture writes
+static bool decodeQOI(const std::vector<unsigned char>& bytes, ImageData& image, std::string& error) {
+	if (bytes.size() < 22) { error = "truncated QOI header"; return false; }
+	auto be32 = [&](size_t i) { return (unsigned int)bytes[i] << 24 | bytes[i + 1] << 16 | bytes[i + 2] << 8 | bytes[i + 3]; };
+	image.width = (int)be32(4);
+	image.height = (int)be32(8);
+	if (!validImageSize(image.width, image.height)) { error = "bad image size"; return false; }
+	size_t count = (size_t)image.width * image.height;
+	image.pixels.resize(count);
+
+	unsigned int index[64] = {};
+	unsigned char r = 0, g = 0, b = 0, a = 255;
+	size_t p = 14, end = bytes.size() - 8;	// before the end marker
+	for (size_t i = 0; i < count;) {
+		if (p >= end) { error = "truncated QOI data"; return false; }
+		unsigned char op = bytes[p++];
+		size_t run = 1;
+		if (op == 0xFE) { r = bytes[p]; g = bytes[p + 1]; b = bytes[p + 2]; p += 3; }				// QOI_OP_RGB
+		else if (op == 0xFF) { r = bytes[p]; g = bytes[p + 1]; b = bytes[p + 2]; a = bytes[p + 3]; p += 4; }	// QOI_OP_RGBA
+		else if ((op & 0xC0) == 0x00) {																// QOI_OP_INDEX
+			unsigned int c = index[op];
+			r = c & 0xFF; g = (c >> 8) & 0xFF; b = (c >> 16) & 0xFF; a = c >> 24;
+		}
+		else if ((op & 0xC0) == 0x40) {																// QOI_OP_DIFF
+			r += ((op >> 4) & 3) - 2; g += ((op >> 2) & 3) - 2; b += (op & 3) - 2;
+		}
+		else if ((op & 0xC0) == 0x80) {																// QOI_OP_LUMA
+			int dg = (op & 0x3F) - 32, next = bytes[p++];
+			r += dg + ((next >> 4) & 0xF) - 8; g += dg; b += dg + (next & 0xF) - 8;
+		}
+		else run = (op & 0x3F) + 1;																	// QOI_OP_RUN
+
+		unsigned int c = packRGBA(r, g, b, a);
+		index[(r * 3 + g * 5 + b * 7 + a * 11) & 63] = c;
+		for (size_t k = 0; k < run && i < count; k++)
+			image.pixels[i++] = c;
+	}
+	return true;
+}
+
+// Loads a PPM, TGA or QOI image, the format is told by the file contents
+// Output Variables:
+// - image : decoded pixels
+// - error : reason when the file cannot be loaded
+static bool loadImage(const std::string& filename, ImageData& image, std::string& error) {
+	std::ifstream file(filename, std::ios::binary);
+	if (!file) { error = "cannot open '" + filename + "'"; return false; }
+	std::vector<unsigned char> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+	bool ok;
+	if (bytes.size() >= 2 && bytes[0] == 'P' && (bytes[1] == '3' || bytes[1] == '6')) ok = decodePPM(bytes, image, error);
+	else if (bytes.size() >= 4 && memcmp(bytes.data(), "qoif", 4) == 0) ok = decodeQOI(bytes, image, error);
+	else if (filename.size() >= 4 && (filename.compare(filename.size() - 4, 4, ".tga") == 0 || filename.compare(filename.size() - 4, 4, ".TGA") == 0))
+		ok = decodeTGA(bytes, image, error);	// TGA has no signature
+	else { error = "unknown image format"; ok = false; }
+	if (!ok) error = filename + ": " + error;
+	return ok;
+}
+
+const int MAX_TEXTURE_LEVELS = 15;	// mip levels of the largest texture (16384 texels)
+
+// Mip mapped texture sampled by the pixel shaders.
+// Every level is stored in 4x4 texel blocks (64 bytes, one cache line) with the texels of a block
+// in Morton order, so the 2x2 texels of a bilinear lookup share a cache line most of the time and
+// a walk across the texture in any direction touches the same number of lines. Textures repeat
+// outside [0, 1] and may have any size; levels halve down to 1x1 with a 2x2 box filter.
+// Levels have their own storage, so the finest ones may be left out: the sampler falls back to
+// the finest resident level and records the finest level it wanted (TextureStreamer).
+class Texture {
+public:
+	// size of one level of the mip chain
+	struct Level {
+		int width, height;	// texels
+		int blocksX;		// 4x4 blocks per row
+
+		size_t texelCount() const { return (size_t)blocksX * ((height + 3) / 4) * 16; }
+	};
+
+private:
+	std::vector<Level> levels;
+	std::vector<unsigned int> storage[MAX_TEXTURE_LEVELS];			// texels of the resident levels
+	std::atomic<const unsigned int*> texels[MAX_TEXTURE_LEVELS] = {};	// storage as the sampler sees it, kept after an eviction
+	std::atomic<int> finest{ 0 };									// finest resident level, every coarser level is resident too
+	mutable std::atomic<int> wanted{ MAX_TEXTURE_LEVELS };			// finest level sampled since takeWanted
+	TextureFilter filter = TextureFilter::Trilinear;
+
+	// index of a texel in its level: block, then Morton order inside the 4x4 block
+	static unsigned int tiledIndex(const Level& l, int x, int y) {
+		unsigned int inBlock = (x & 1) | (y & 1) << 1 | (x & 2) << 1 | (y & 2) << 2;
+		return (((unsigned int)(y >> 2) * l.blocksX + (x >> 2)) << 4) + inBlock;
+	}
+
+public:
+	Texture() = default;
+	Texture(const Texture&) = delete;
+	Texture& operator=(const Texture&) = delete;
+
+	// Sizes of the mip chain of an image
+	// Input Variables:
+	// - w, h : size of level 0 in texels
+	static std::vector<Level> layout(int w, int h) {
+		std::vector<Level> chain;
+		while (true) {
+			chain.push_back({ w, h, (w + 3) / 4 });
+			if ((w == 1 && h == 1) || chain.size() == MAX_TEXTURE_LEVELS) return chain;
+			w = max(w / 2, 1);
+			h = max(h / 2, 1);
+		}
+	}
+
+	// Builds the tiled texels of a mip chain
+	// Each level averages 2x2 texels of the one above (the last row or column of odd sizes is dropped).
+	// Input Variables:
+	// - w, h : size in texels
+	// - pixels : w * h packed RGBA pixels, row by row
+	// Output Variables:
+	// - out : texels of every level (layout(w, h))
+	static void buildLevels(int w, int h, const unsigned int* pixels, std::vector<std::vector<unsigned int>>& out) {
+		std::vector<Level> chain = layout(w, h);
+		out.resize(chain.size());
+		out[0].assign(chain[0].texelCount(), 0);
+		for (int y = 0; y < h; y++)
+			for (int x = 0; x < w; x++)
+				out[0][tiledIndex(chain[0], x, y)] = pixels[(size_t)y * w + x];
+
+		for (size_t l = 1; l < chain.size(); l++) {
+			const Level& src = chain[l - 1], & dst = chain[l];
+			const std::vector<unsigned int>& from = out[l - 1];
+			out[l].assign(dst.texelCount(), 0);
+			for (int y = 0; y < dst.height; y++)
+				for (int x = 0; x < dst.width; x++) {
+					int x0 = 2 * x, x1 = min(2 * x + 1, src.width - 1), y0 = 2 * y, y1 = min(2 * y + 1, src.height - 1);
+					unsigned int t[4] = { from[tiledIndex(src, x0, y0)], from[tiledIndex(src, x1, y0)],
+						from[tiledIndex(src, x0, y1)], from[tiledIndex(src, x1, y1)] };
+					unsigned int texel = 0;
+					for (int c = 0; c < 32; c += 8) {
+						unsigned int sum = 2;
+						for (int i = 0; i < 4; i++) sum += (t[i] >> c) & 0xFF;
+						texel |= (sum >> 2) << c;
+					}
+					out[l][tiledIndex(dst, x, y)] = texel;
+				}
+		}
+	}
+
+	// Builds the texture and its mip chain from row by row pixels
+	// Input Variables:
+	// - w, h : size in texels
+	// - pixels : w * h packed RGBA pixels
+	// - firstResident : finest level kept, the finer ones are left to streaming
+	void create(int w, int h, const unsigned int* pixels, int firstResident = 0) {
+		std::vector<std::vector<unsigned int>> chain;
+		buildLevels(w, h, pixels, chain);
+		levels = layout(w, h);
+		firstResident = min(max(firstResident, 0), (int)levels.size() - 1);
+		for (int l = 0; l < MAX_TEXTURE_LEVELS; l++) {
+			storage[l].clear();
+			if (l >= firstResident && l < (int)levels.size()) storage[l].swap(chain[l]);
+			texels[l].store(storage[l].empty() ? nullptr : storage[l].data(), std::memory_order_relaxed);
+		}
+		finest.store(firstResident, std::memory_order_release);
+		wanted.store(MAX_TEXTURE_LEVELS, std::memory_order_relaxed);
+	}
+
+	// Builds a checkerboard
+	// Input Variables:
+	// - size : texels along each side
+	// - squares : squares along each side
+	// - a, b : colours of the squares
+	void makeChecker(int size, int squares, const color& a, const color& b) {
+		std::vector<unsigned int> pixels((size_t)size * size);
+		unsigned int ca = a.toRGBA(), cb = b.toRGBA();
+		for (int y = 0; y < size; y++)
+			for (int x = 0; x < size; x++)
+				pixels[(size_t)y * size + x] = ((x * squares / size + y * squares / size) & 1) ? cb : ca;
+		create(size, size, pixels.data());
+	}
+
+	void setFilter(TextureFilter f) { filter = f; }
+
+	int getWidth() const { return levels.empty() ? 0 : levels[0].width; }
+	int getHeight() const { return levels.empty() ? 0 : levels[0].height; }
+	int getLevels() const { return (int)levels.size(); }
+	const Level& getLevel(int level) const { return levels[level]; }
+
+	// bytes of the resident levels
+	size_t getBytes() const {
+		size_t bytes = 0;
+		for (int l = finest.load(std::memory_order_relaxed); l < (int)levels.size(); l++)
+			bytes += storage[l].size() * sizeof(unsigned int);
+		return bytes;
+	}
+
+	// Packed RGBA texel of a resident level
+	unsigned int texel(int level, int x, int y) const { return texels[level].load(std::memory_order_relaxed)[tiledIndex(levels[level], x, y)]; }
+
+	// Streaming interface (TextureStreamer). Levels only change at the fine end of the resident
+	// range, and a level's storage outlives its eviction by the frames still sampling it, so
+	// the pixel threads never wait on the streamer.
+
+	// finest resident level
+	int finestResident() const { return finest.load(std::memory_order_acquire); }
+
+	// finest level the sampler asked for since the last call, MAX_TEXTURE_LEVELS if the texture was not sampled
+	int takeWanted() { return wanted.exchange(MAX_TEXTURE_LEVELS, std::memory_order_relaxed); }
+
+	// Makes the level above the finest resident one resident
+	// Input Variables:
+	// - t : texels of the level (buildLevels), taken over by the texture
+	void installLevel(std::vector<unsigned int>& t) {
+		int level = finest.load(std::memory_order_relaxed) - 1;
+		storage[level].swap(t);
+		texels[level].store(storage[level].data(), std::memory_order_relaxed);
+		finest.store(level, std::memory_order_release);
+	}
+
+	// Drops the finest resident level
+	// Output Variables:
+	// - retired : texels of the level, to be freed once no frame in flight samples them
+	void evictLevel(std::vector<unsigned int>& retired) {
+		int level = finest.load(std::memory_order_relaxed);
+		finest.store(level + 1, std::memory_order_release);
+		retired.swap(storage[level]);
+		storage[level].clear();
+	}
+
+	// Mip level for a fragment from the screen space derivatives of its texture coordinates:
+	// log2 of the texels the larger of the two pixel steps covers on level 0
+	// Input Variables:
+	// - ddx, ddy : change of (u, v) per pixel along screen x and y
+	float lod(const vec4& ddx, const vec4& ddy) const {
+		float w = (float)levels[0].width, h = (float)levels[0].height;
+		float x2 = ddx[0] * ddx[0] * w * w + ddx[1] * ddx[1] * h * h;
+		float y2 = ddy[0] * ddy[0] * w * w + ddy[1] * ddy[1] * h * h;
+		float rho2 = max(x2, y2);
+		if (!(rho2 > 1.f)) return 0.f;	// magnified (or degenerate)
+
+		// 0.5 * log2(rho2): exponent plus a quadratic fit of the mantissa (error below 0.01 levels)
+		int bits;
+		memcpy(&bits, &rho2, sizeof(bits));
+		float e = (float)((bits >> 23) - 127);
+		bits = (bits & 0x007FFFFF) | 0x3F800000;
+		float m;
+		memcpy(&m, &bits, sizeof(m));
+		m -= 1.f;
+		return 0.5f * (e + m * (1.3465557f - 0.3465557f * m));
+	}
+
+	// Filtered colour of the texture
+	// The 2x2 texels of both mip levels are fetched into eight lanes (one gather per level): lanes 0-3
+	// hold the taps of the finer level, lanes 4-7 those of the coarser one, each lane with its bilinear and
+	// level weight, so the filter is one weighted sum of eight texels. Bilinear filtering gives the
+	// coarser lanes zero weight, so does a finer level that is not resident (the finest resident
+	// level is filtered bilinearly instead).
+	// The lanes hold the taps of one fragment, not eight fragments: the raster kernels shade one
+	// pixel at a time (TexturedSurface::modulate), so there is no batch of fragments to spread over
+	// the lanes. A trilinear lookup still needs exactly eight taps, a bilinear one leaves half the
+	// lanes weighted zero.
+	// Input Variables:
+	// - u, v : texture coordinates (repeating)
+	// - lod : mip level (Texture::lod)
+	color sample(float u, float v, float lod) const {
+		int last = (int)levels.size() - 1;
+		lod = min(max(lod, 0.f), (float)last);
+		int l0 = filter == TextureFilter::Trilinear ? (int)lod : (int)(lod + 0.5f);
+		float t = filter == TextureFilter::Trilinear ? lod - l0 : 0.f;
+		if (l0 < wanted.load(std::memory_order_relaxed)) wanted.store(l0, std::memory_order_relaxed);	// racy minimum, a hint
+		int resident = finest.load(std::memory_order_acquire);
+		if (l0 < resident) { l0 = resident; t = 0.f; }
+		int l1 = min(l0 + 1, last);
+		const Level& a = levels[l0];
+		const Level& b = levels[l1];
+		// per lane level constants
+		__m256 size = _mm256_setr_ps((float)a.width, (float)a.width, (float)a.height, (float)a.height,
+			(float)b.width, (float)b.width, (float)b.height, (float)b.height);
+		__m256i width = _mm256_setr_epi32(a.width, a.width, a.width, a.width, b.width, b.width, b.width, b.width);
+		__m256i height = _mm256_setr_epi32(a.height, a.height, a.height, a.height, b.height, b.height, b.height, b.height);
+		__m256i blocksX = _mm256_setr_epi32(a.blocksX, a.blocksX, a.blocksX, a.blocksX, b.blocksX, b.blocksX, b.blocksX, b.blocksX);
+
+		// texel space position of both levels, (x, x, y, y) per level, in [-0.5, size - 0.5)
+		__m256 uv = _mm256_setr_ps(u, u, v, v, u, u, v, v);
+		uv = _mm256_sub_ps(uv, _mm256_floor_ps(uv));
+		__m256 pos = _mm256_fmsub_ps(uv, size, _mm256_set1_ps(0.5f));
+		__m256 base = _mm256_floor_ps(pos);
+		__m256 frac = _mm256_sub_ps(pos, base);
+		__m256i cell = _mm256_cvtps_epi32(base);
+
+		// spread (x0, x0 + 1, y0, y0 + 1) to the four taps of each level: (x0, y0) (x1, y0) (x0, y1) (x1, y1)
+		__m256i step = _mm256_setr_epi32(0, 1, 0, 1, 0, 1, 0, 1);
+		__m256i x = _mm256_add_epi32(_mm256_shuffle_epi32(cell, _MM_SHUFFLE(0, 0, 0, 0)), step);
+		__m256i y = _mm256_add_epi32(_mm256_shuffle_epi32(cell, _MM_SHUFFLE(2, 2, 2, 2)), _mm256_setr_epi32(0, 0, 1, 1, 0, 0, 1, 1));
+		__m256 fx = _mm256_shuffle_ps(frac, frac, _MM_SHUFFLE(0, 0, 0, 0));
+		__m256 fy = _mm256_shuffle_ps(frac, frac, _MM_SHUFFLE(2, 2, 2, 2));
+
+		// repeat: -1 wraps to the last texel, size wraps to 0
+		x = _mm256_add_epi32(x, _mm256_and_si256(_mm256_cmpgt_epi32(_mm256_setzero_si256(), x), width));
+		x = _mm256_sub_epi32(x, _mm256_andnot_si256(_mm256_cmpgt_epi32(width, x), width));
+		y = _mm256_add_epi32(y, _mm256_and_si256(_mm256_cmpgt_epi32(_mm256_setzero_si256(), y), height));
+		y = _mm256_sub_epi32(y, _mm256_andnot_si256(_mm256_cmpgt_epi32(height, y), height));
+
+		// tiled addresses (tiledIndex)
+		__m256i one = _mm256_set1_epi32(1), two = _mm256_set1_epi32(2);
+		__m256i inBlock = _mm256_or_si256(_mm256_or_si256(_mm256_and_si256(x, one), _mm256_slli_epi32(_mm256_and_si256(y, one), 1)),
+			_mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(x, two), 1), _mm256_slli_epi32(_mm256_and_si256(y, two), 2)));
+		__m256i block = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_srli_epi32(y, 2), blocksX), _mm256_srli_epi32(x, 2));
+		__m256i index = _mm256_add_epi32(_mm256_slli_epi32(block, 4), inBlock);
+		__m128i ta = _mm_i32gather_epi32(reinterpret_cast<const int*>(texels[l0].load(std::memory_order_relaxed)), _mm256_castsi256_si128(index), 4);
+		__m128i tb = _mm_i32gather_epi32(reinterpret_cast<const int*>(texels[l1].load(std::memory_order_relaxed)), _mm256_extracti128_si256(index, 1), 4);
+		__m256i t8 = _mm256_set_m128i(tb, ta);
+
+		// bilinear weight of every tap times the weight of its level
+		__m256 wx = _mm256_blend_ps(_mm256_sub_ps(_mm256_set1_ps(1.f), fx), fx, 0xAA);
+		__m256 wy = _mm256_blend_ps(_mm256_sub_ps(_mm256_set1_ps(1.f), fy), fy, 0xCC);
+		__m256 level = _mm256_setr_ps(1.f - t, 1.f - t, 1.f - t, 1.f - t, t, t, t, t);
+		__m256 weight = _mm256_mul_ps(_mm256_mul_ps(wx, wy), _mm256_mul_ps(level, _mm256_set1_ps(1.f / 255.f)));
+
+		// weighted sums of the channels, then across the lanes
+		__m256i byte = _mm256_set1_epi32(0xFF);
+		__m256 r = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(t8, byte)), weight);
+		__m256 g = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(t8, 8), byte)), weight);
+		__m256 bl = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(t8, 16), byte)), weight);
+		__m256 rg = _mm256_hadd_ps(r, g);			// r01 r23 g01 g23 | r45 r67 g45 g67
+		__m256 bb = _mm256_hadd_ps(bl, bl);			// b01 b23 b01 b23 | b45 b67 b45 b67
+		__m256 sum = _mm256_hadd_ps(rg, bb);		// r0-3 g0-3 b0-3 b0-3 | r4-7 g4-7 b4-7 b4-7
+		__m128 c = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+		return color(_mm_blend_ps(c, _mm_setzero_ps(), 0x8));
+	}
+};
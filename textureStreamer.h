@@ -0,0 +1,230 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "texture.h"
+#include "profiler.h"
+
+const int STREAMING_TAIL_SIZE = 64;					// levels up to this many texels along each side stay resident
+const unsigned int STREAMING_RETIRE_FRAMES = 2;		// frames an evicted level is kept alive, frames in flight may still sample it
+const size_t DEFAULT_TEXTURE_BUDGET = 256u << 20;	// bytes
+
+// Streams the mip levels of file textures.
+// A texture starts with its small coarse levels (the tail) resident and the sampler records the
+// finest level it wanted. Once per frame, update() queues the missing levels that were actually
+// sampled for a few I/O threads, which decode the file and build the levels in the background,
+// and installs the levels that have arrived. Until then the sampler uses the finest resident
+// level. Resident texels are capped by a budget: the finest level of the texture least recently
+// sampled at that level is evicted first, and a load is only queued if it fits next to the levels
+// sampled this frame, so the working set never thrashes.
+class TextureStreamer {
+	// one streamed texture
+	struct entry {
+		Texture* texture;
+		std::string file;
+		int tail;							// first level of the resident tail
+		std::vector<unsigned int> lastUsed;	// frame every level was last sampled
+		bool pending = false;				// a load is queued or running
+	};
+
+	// levels [first, end) of a texture to load
+	struct request {
+		unsigned int entry;
+		int first, end;
+		std::string file;
+	};
+
+	// loaded levels
+	struct result {
+		unsigned int entry;
+		int first, end;
+		std::vector<std::vector<unsigned int>> levels;	// texels of every level of the chain, [first, end) filled
+		std::string error;
+	};
+
+	// texels of an evicted level
+	struct retiredLevel {
+		std::vector<unsigned int> texels;
+		unsigned int frame;	// frame it was evicted in
+	};
+
+	std::vector<entry> entries;
+	std::deque<retiredLevel> retired;
+	size_t budget = DEFAULT_TEXTURE_BUDGET;
+	size_t resident = 0;		// bytes of the resident levels
+	unsigned int frame = 0;
+	unsigned int loads = 0, evictions = 0, failures = 0;
+
+	std::vector<std::thread> threads;	// I/O threads, started with the first texture
+	unsigned int threadCount;
+	std::deque<request> requests;
+	std::vector<result> results;
+	std::mutex lock;
+	std::condition_variable queued;
+	bool stopping = false;
+
+	static size_t levelBytes(const Texture& t, int level) { return t.getLevel(level).texelCount() * sizeof(unsigned int); }
+
+	// I/O thread: decode the file of a request and keep the requested levels
+	void run() {
+		while (true) {
+			request r;
+			{
+				std::unique_lock<std::mutex> guard(lock);
+				queued.wait(guard, [&] { return stopping || !requests.empty(); });
+				if (stopping) return;
+				r = requests.front();
+				requests.pop_front();
+			}
+
+			result out = { r.entry, r.first, r.end, {}, {} };
+			{
+				PROFILE_ZONE("texture load");
+				ImageData image;
+				if (loadImage(r.file, image, out.error)) {
+					Texture::buildLevels(image.width, image.height, image.pixels.data(), out.levels);
+					for (int l = 0; l < (int)out.levels.size(); l++)
+						if (l < r.first || l >= r.end) std::vector<unsigned int>().swap(out.levels[l]);
+				}
+			}
+
+			std::lock_guard<std::mutex> guard(lock);
+			results.push_back(std::move(out));
+		}
+	}
+
+	// Evicts the finest level of the texture whose finest level was sampled least recently
+	// Returns false if only tails are left
+	bool evictOne() {
+		entry* oldest = nullptr;
+		for (entry& e : entries) {
+			int l = e.texture->finestResident();
+			if (l < e.tail && (!oldest || e.lastUsed[l] < oldest->lastUsed[oldest->texture->finestResident()])) oldest = &e;
+		}
+		if (!oldest) return false;
+
+		int l = oldest->texture->finestResident();
+		resident -= levelBytes(*oldest->texture, l);
+		retired.push_back({ {}, frame });
+		oldest->texture->evictLevel(retired.back().texels);
+		evictions++;
+		return true;
+	}
+
+public:
+	// Input Variables:
+	// - ioThreads : threads decoding texture files
+	TextureStreamer(unsigned int ioThreads = 2) : threadCount(max(ioThreads, 1u)) {}
+	TextureStreamer(const TextureStreamer&) = delete;
+	TextureStreamer& operator=(const TextureStreamer&) = delete;
+	~TextureStreamer() { stop(); }
+
+	// Caps the bytes of resident texels (tails are always resident)
+	void setBudget(size_t bytes) { budget = bytes; }
+
+	// Loads a texture file with only its tail resident and streams the finer levels from then on
+	// Input Variables:
+	// - texture : texture to fill, must outlive the streamer or stop()
+	// - file : PPM, TGA or QOI file
+	// Output Variables:
+	// - error : reason when the file cannot be loaded
+	bool add(Texture* texture, const std::string& file, std::string& error) {
+		ImageData image;
+		if (!loadImage(file, image, error)) return false;
+		std::vector<Texture::Level> chain = Texture::layout(image.width, image.height);
+		int tail = 0;
+		while (chain[tail].width > STREAMING_TAIL_SIZE || chain[tail].height > STREAMING_TAIL_SIZE) tail++;
+		texture->create(image.width, image.height, image.pixels.data(), tail);
+
+		entries.push_back({ texture, file, tail, std::vector<unsigned int>(chain.size(), 0) });
+		resident += texture->getBytes();
+		if (threads.empty())
+			for (unsigned int i = 0; i < threadCount; i++)
+				threads.emplace_back(&TextureStreamer::run, this);
+		return true;
+	}
+
+	// Advances one frame: installs the loaded levels, queues the missing sampled levels and keeps
+	// the resident texels within the budget. Call once per frame from one thread, pixel threads
+	// may be sampling meanwhile.
+	void update() {
+		if (entries.empty()) return;
+		PROFILE_ZONE("texture streaming");
+		frame++;
+
+		// frames still sampling a retired level have finished
+		while (!retired.empty() && frame - retired.front().frame > STREAMING_RETIRE_FRAMES)
+			retired.pop_front();
+
+		std::vector<result> arrived;
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			arrived.swap(results);
+		}
+		for (result& r : arrived) {
+			entry& e = entries[r.entry];
+			e.pending = false;
+			if (!r.error.empty()) { failures++; continue; }
+			// levels go in next to the finest resident one (dropped if an eviction made a gap)
+			for (int l = min(r.end, e.texture->finestResident()) - 1; l >= r.first && l == e.texture->finestResident() - 1; l--) {
+				resident += r.levels[l].size() * sizeof(unsigned int);
+				e.lastUsed[l] = frame;
+				e.texture->installLevel(r.levels[l]);
+				loads++;
+			}
+		}
+
+		// levels sampled last frame
+		size_t used = 0;
+		std::vector<int> wanted(entries.size());
+		for (unsigned int i = 0; i < entries.size(); i++) {
+			entry& e = entries[i];
+			wanted[i] = e.texture->takeWanted();
+			if (wanted[i] == MAX_TEXTURE_LEVELS) continue;
+			for (int l = max(wanted[i], e.texture->finestResident()); l < e.texture->getLevels(); l++) {
+				e.lastUsed[l] = frame;
+				used += levelBytes(*e.texture, l);
+			}
+		}
+
+		// queue the missing levels, as many as fit next to the ones in use
+		for (unsigned int i = 0; i < entries.size(); i++) {
+			entry& e = entries[i];
+			int end = e.texture->finestResident(), first = end;
+			if (e.pending || wanted[i] >= end) continue;
+			while (first > wanted[i] && used + levelBytes(*e.texture, first - 1) <= budget)
+				used += levelBytes(*e.texture, --first);
+			if (first == end) continue;
+			e.pending = true;
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				requests.push_back({ i, first, end, e.file });
+			}
+			queued.notify_one();
+		}
+
+		while (resident > budget && evictOne()) {}
+	}
+
+	// Stops the I/O threads (pending loads are dropped)
+	void stop() {
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			stopping = true;
+		}
+		queued.notify_all();
+		for (auto& t : threads)
+			t.join();
+		threads.clear();
+	}
+
+	size_t getResidentBytes() const { return resident; }
+	unsigned int getLoads() const { return loads; }			// levels installed
+	unsigned int getEvictions() const { return evictions; }	// levels evicted
+	unsigned int getFailures() const { return failures; }	// loads that could not read their file
+	bool empty() const { return entries.empty(); }
+};
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <cstring>
+#include "tiles.h"
+#include "pixelLayout.h"
+#include "depthFormat.h"
+
+constexpr int MAX_DEPTH_PLANES = 4;	// planes a compressed tile can hold (2-bit selector per pixel)
+
+// Depth plane z = a * x + b * y + c, with x and y relative to the tile origin
+struct depthPlane {
+	float a, b, c;
+
+	// evaluate the plane at a pixel of the tile
+	float at(int x, int y) const { return a * x + b * y + c; }
+};
+
+// Compressed depth of a single screen tile.
+// Large flat surfaces cover a tile with only a few triangles, so instead of one depth value per
+// pixel the tile stores up to MAX_DEPTH_PLANES triangle depth planes and a 2-bit index per pixel
+// selecting the plane that covers it (1 KB instead of 16 KB for float depth). When more triangles
+// are visible than there are planes the tile is decompressed into the Z-buffer and stays raw
+// until the next clear. The tile also keeps a conservative farthest depth used as a
+// hierarchical Z value to skip triangles that are entirely behind everything in the tile.
+// Every plane counts the pixels selecting it, so the farthest depth only covers planes still
+// in use: once the clear plane is covered everywhere it no longer holds the farthest depth back.
+class TileDepth {
+	depthPlane planes[MAX_DEPTH_PLANES];					// depth planes referenced by the selector
+	unsigned short refs[MAX_DEPTH_PLANES] = {};				// pixels selecting each plane
+	unsigned char selector[TILE_SIZE * TILE_SIZE / 4];		// 2 bits per pixel, index into planes
+	int planeCount = 0;										// planes in use
+	int width = 0, height = 0;								// size of the tile (edge tiles are smaller)
+	bool raw = false;										// depth lives in the Z-buffer
+	float zfar = 1.0f;										// conservative farthest depth in the tile
+
+	// selector of a pixel (i = y * TILE_SIZE + x)
+	int getSelector(int i) const {
+		return (selector[i >> 2] >> ((i & 3) * 2)) & 3;
+	}
+
+	// write the selector of a pixel (i = y * TILE_SIZE + x) without counting references
+	void putSelector(int i, int plane) {
+		unsigned char& b = selector[i >> 2];
+		int shift = (i & 3) * 2;
+		b = static_cast<unsigned char>((b & ~(3 << shift)) | (plane << shift));
+	}
+
+	// Recompute the farthest depth from the corners of every referenced plane (planes are
+	// linear, so their extremes over the tile are at the corners)
+	void updateFar() {
+		int x1 = width - 1, y1 = height - 1;
+		bool first = true;
+		for (int i = 0; i < planeCount; i++) {
+			if (!refs[i]) continue;
+			float corners = farthest(farthest(planes[i].at(0, 0), planes[i].at(x1, 0)),
+				farthest(planes[i].at(0, y1), planes[i].at(x1, y1)));
+			zfar = first ? corners : farthest(zfar, corners);
+			first = false;
+		}
+	}
+
+	// Drop planes no pixel references any more
+	void compact() {
+		int remap[MAX_DEPTH_PLANES], count = 0;
+		for (int i = 0; i < planeCount; i++) {
+			remap[i] = count;
+			if (refs[i]) {
+				planes[count] = planes[i];
+				refs[count++] = refs[i];
+			}
+		}
+		if (count == planeCount) return;
+		for (int i = count; i < planeCount; i++) refs[i] = 0;
+
+		for (int y = 0; y < height; y++)
+			for (int x = 0; x < width; x++)
+				putSelector(y * TILE_SIZE + x, remap[getSelector(y * TILE_SIZE + x)]);
+		planeCount = count;
+	}
+
+public:
+	// Compare depths as the depth format stores them, so a compressed tile passes the same
+	// fragments as the Z-buffer does once the tile is raw (unorm formats round depths together)
+	static bool nearer(float a, float b) {
+		return DepthFormat::nearer(DepthFormat::encode(a), DepthFormat::encode(b));
+	}
+
+	static float farthest(float a, float b) {
+		return nearer(a, b) ? b : a;
+	}
+
+	// Fast clear: the whole tile becomes a single plane at the farthest depth
+	// Input Variables:
+	// - w, h: size of the tile in pixels
+	void clear(int w, int h) {
+		width = w;
+		height = h;
+		planes[0] = { 0.0f, 0.0f, DepthFormat::decode(DepthFormat::clearValue) };
+		planeCount = 1;
+		memset(refs, 0, sizeof(refs));
+		refs[0] = static_cast<unsigned short>(w * h);
+		memset(selector, 0, sizeof(selector));
+		raw = false;
+		zfar = planes[0].c;
+	}
+
+	bool isRaw() const { return raw; }
+
+	// Drops the farthest depth back to the far plane, for raw tiles drawn with fragments that
+	// write depth without testing it (they can store depth farther than zfar)
+	void resetFar() {
+		zfar = DepthFormat::decode(DepthFormat::clearValue);
+	}
+
+	// Hierarchical Z test: false if a triangle with the given nearest depth is
+	// behind everything already stored in the tile
+	bool mayPass(float nearest) const {
+		return nearer(nearest, zfar);
+	}
+
+	// Depth stored at a pixel of the tile (x, y relative to the tile origin)
+	float depthAt(int x, int y) const {
+		return planes[getSelector(y * TILE_SIZE + x)].at(x, y);
+	}
+
+	// Point a pixel at a plane (x, y relative to the tile origin)
+	// The farthest depth is recomputed when a plane gains its first pixel or loses its last one.
+	void setSelector(int x, int y, int plane) {
+		int i = y * TILE_SIZE + x;
+		int old = getSelector(i);
+		if (old == plane) return;
+		putSelector(i, plane);
+		bool changed = --refs[old] == 0;
+		changed |= refs[plane]++ == 0;
+		if (changed) updateFar();
+	}
+
+	// Adds a triangle depth plane, referenced by no pixel until setSelector points pixels at it
+	// Returns the plane index, or -1 if the tile is full and has to be decompressed
+	int addPlane(const depthPlane& p) {
+		if (planeCount == MAX_DEPTH_PLANES) compact();
+		if (planeCount == MAX_DEPTH_PLANES) return -1;
+		planes[planeCount] = p;
+		refs[planeCount] = 0;
+		return planeCount++;
+	}
+
+	// Writes the depth of every pixel into a Z-buffer and switches the tile to raw storage
+	// Input Variables:
+	// - zbuffer: buffer providing set(index, depth)
+	// - layout: pixel layout of the Z-buffer
+	// - originX, originY: pixel position of the tile
+	template<typename Buffer>
+	void decompress(Buffer& zbuffer, const PixelLayout& layout, int originX, int originY) {
+		for (int y = 0; y < height; y++) {
+			unsigned int row = layout.rowOffset(originY + y);
+			for (int x = 0; x < width; x++)
+				zbuffer.set(row + layout.columnOffset(originX + x), depthAt(x, y));
+		}
+		raw = true; // zfar stays valid while raw writes only bring depth nearer (see resetFar)
+	}
+
+	// Bytes of depth data the tile occupies
+	size_t footprint() const {
+		if (raw) return (size_t)width * height * sizeof(DepthFormat::storage);
+		return planeCount * sizeof(depthPlane) + ((size_t)width * height + 3) / 4;
+	}
+};
@@ -0,0 +1,60 @@
+#pragma once
+#include <Windows.h>
+
+constexpr int TILE_SIZE = 64;	// edge length of a screen tile in pixels
+
+// Screen space rectangle covering pixels [minX, maxX) x [minY, maxY)
+struct tileRect {
+	int minX, minY, maxX, maxY;
+};
+
+// Splits the canvas into TILE_SIZE x TILE_SIZE tiles.
+// Tiles are the unit of ownership for multi threaded rendering: a tile is
+// only ever written by the thread that picked it up, so no per-pixel locking is needed.
+class TileGrid {
+	int width = 0, height = 0;		// dimensions of the canvas
+	int tilesX = 0, tilesY = 0;		// number of tiles along each axis
+
+public:
+	// Creates the grid for a canvas of the given size
+	// Input Variables:
+	// - w: Width of the canvas.
+	// - h: Height of the canvas.
+	void create(int w, int h) {
+		width = w;
+		height = h;
+		tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+		tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+	}
+
+	int getTilesX() const { return tilesX; }
+	int getTilesY() const { return tilesY; }
+
+	// total number of tiles in the grid
+	int count() const { return tilesX * tilesY; }
+
+	// Returns the pixel rectangle covered by a tile (edge tiles are clipped to the canvas)
+	// Input Variables:
+	// - tile: linear tile index (tile = tilesX * ty + tx)
+	tileRect getRect(int tile) const {
+		int tx = tile % tilesX, ty = tile / tilesX;
+		tileRect r;
+		r.minX = tx * TILE_SIZE;
+		r.minY = ty * TILE_SIZE;
+		r.maxX = min(r.minX + TILE_SIZE, width);
+		r.maxY = min(r.minY + TILE_SIZE, height);
+		return r;
+	}
+
+	// Computes the inclusive range of tiles overlapped by a pixel rectangle
+	// Input Variables:
+	// - minX, minY, maxX, maxY: pixel bounds (max exclusive), already clipped to the canvas
+	// Output Variables:
+	// - tx0, ty0, tx1, ty1: first and last tile along each axis
+	void getRange(int minX, int minY, int maxX, int maxY, int& tx0, int& ty0, int& tx1, int& ty1) const {
+		tx0 = minX / TILE_SIZE;
+		ty0 = minY / TILE_SIZE;
+		tx1 = (max(maxX, 1) - 1) / TILE_SIZE;
+		ty1 = (max(maxY, 1) - 1) / TILE_SIZE;
+	}
+};
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include "matrix.h"
+#include "mesh.h"
+#include "renderer.h"
+#include "workerPool.h"
+
+// Transform hierarchy.
+// Every node has a local transform relative to its parent and a cached world transform; nodes
+// are stored in contiguous arrays and a parent always has a lower index than its children.
+// setLocal() only marks the node dirty; update() recomputes the world transforms of dirty nodes
+// and their descendants, then writes world and projection (vp * world) into the meshes attached
+// to the changed nodes. When the view projection changes (Renderer::getVPStamp) every attached
+// mesh gets a new projection, otherwise static meshes are not touched at all.
+// update() walks the nodes one depth level at a time, each large level split between the threads
+// of WorkerPool::shared(). A new view projection is applied to all nodes in one batched pass
+// (matrix::multiplyMany) afterwards.
+class TransformHierarchy {
+	std::vector<matrix> local;				// transform relative to the parent
+	std::vector<matrix> world;				// cached transform relative to the world
+	std::vector<int> parent;				// parent node, -1 for roots
+	std::vector<Mesh*> mesh;				// mesh drawn with the node's transform, may be null
+	std::vector<unsigned char> dirty;		// local changed since the last update
+	std::vector<unsigned char> changed;		// world changed in the running update
+
+	// nodes sorted by depth, rebuilt when nodes are added
+	std::vector<unsigned int> order;
+	std::vector<unsigned int> levelStart;	// first entry of each depth level in order (plus the end)
+	bool structureChanged = true;
+
+	unsigned int stamp = 0;					// view projection the mesh projections were computed for
+
+	// level at least this large are split between threads
+	static const unsigned int PARALLEL_LEVEL = 4096;
+
+	// nodes projected per matrix::multiplyMany call
+	static const unsigned int PROJECT_BATCH = 64;
+
+	// Calls range(begin, end) on contiguous chunks of [begin, end) run by the shared worker pool,
+	// small levels are updated on the calling thread
+	template<typename F>
+	static void forChunks(unsigned int begin, unsigned int end, unsigned int totalThreads, F&& range) {
+		if (end - begin < PARALLEL_LEVEL || totalThreads == 1) {
+			range(begin, end);
+			return;
+		}
+		WorkerPool::shared().forChunks(begin, end, totalThreads, range);
+	}
+
+	// Sorts the nodes by depth (a counting sort, parents come first in index order)
+	void buildLevels() {
+		std::vector<unsigned int> depth(parent.size());
+		unsigned int levels = 0;
+		for (size_t i = 0; i < parent.size(); i++) {
+			depth[i] = parent[i] < 0 ? 0 : depth[parent[i]] + 1;
+			levels = max(levels, depth[i] + 1);
+		}
+		levelStart.assign(levels + 1, 0);
+		for (unsigned int d : depth) levelStart[d + 1]++;
+		for (unsigned int l = 0; l < levels; l++) levelStart[l + 1] += levelStart[l];
+		std::vector<unsigned int> next(levelStart.begin(), levelStart.end() - 1);
+		order.resize(parent.size());
+		for (unsigned int i = 0; i < parent.size(); i++)
+			order[next[depth[i]]++] = i;
+		structureChanged = false;
+	}
+
+	// Updates the nodes order[begin, end) of one level
+	void updateRange(unsigned int begin, unsigned int end, const matrix& vp, unsigned int vpStamp, bool vpChanged) {
+		for (unsigned int k = begin; k < end; k++) {
+			unsigned int n = order[k];
+			int p = parent[n];
+			bool c = dirty[n] || (p >= 0 && changed[p]);
+			if (c) world[n] = p >= 0 ? world[p] * local[n] : local[n];
+			changed[n] = c;
+			dirty[n] = 0;
+
+			// a new view projection is applied to every node by projectRange
+			if (c && mesh[n]) {
+				Mesh* m = mesh[n];
+				m->world = world[n];
+				if (!vpChanged) {
+					m->mvp = vp * world[n];
+					m->mvpStamp = vpStamp;
+				}
+			}
+		}
+	}
+
+	// Writes vp * world into the meshes of the nodes [begin, end), in batches
+	void projectRange(unsigned int begin, unsigned int end, const matrix& vp, unsigned int vpStamp) {
+		matrix mvp[PROJECT_BATCH];
+		for (unsigned int b = begin; b < end; b += PROJECT_BATCH) {
+			unsigned int count = min(PROJECT_BATCH, end - b);
+			matrix::multiplyMany(vp, std::span<const matrix>(&world[b], count), mvp);
+			for (unsigned int k = 0; k < count; k++) {
+				if (Mesh* m = mesh[b + k]) {
+					m->mvp = mvp[k];
+					m->mvpStamp = vpStamp;
+				}
+			}
+		}
+	}
+
+public:
+	// Adds a node
+	// Input Variables:
+	// - _local : transform relative to the parent
+	// - _parent : parent node (added before), -1 for a root
+	// - _mesh : mesh drawn with the node's world transform, null for a pure group node
+	// Returns the node index.
+	int add(const matrix& _local, int _parent = -1, Mesh* _mesh = nullptr) {
+		int n = static_cast<int>(parent.size());
+		resize(n + 1);
+		set(n, _local, _parent, _mesh);
+		return n;
+	}
+
+	// Sets the number of nodes, new nodes are roots without a mesh until set()
+	void resize(size_t count) {
+		local.resize(count);
+		world.resize(count);
+		parent.resize(count, -1);
+		mesh.resize(count, nullptr);
+		dirty.resize(count, 1);
+		changed.resize(count, 0);
+		structureChanged = true;
+	}
+
+	// Defines a node created by resize(), nodes may be set from several threads at once
+	// Input Variables:
+	// - node : node index
+	// - _local : transform relative to the parent
+	// - _parent : parent node, lower than node, -1 for a root
+	// - _mesh : mesh drawn with the node's world transform, may be null
+	void set(int node, const matrix& _local, int _parent = -1, Mesh* _mesh = nullptr) {
+		local[node] = _local;
+		parent[node] = _parent < node ? _parent : -1;
+		mesh[node] = _mesh;
+		dirty[node] = 1;
+	}
+
+	size_t size() const { return parent.size(); }
+
+	// Changes the local transform of a node, its subtree is updated by the next update()
+	void setLocal(int node, const matrix& m) {
+		local[node] = m;
+		dirty[node] = 1;
+	}
+
+	const matrix& getLocal(int node) const { return local[node]; }
+
+	// World transform of a node as of the last update()
+	const matrix& getWorld(int node) const { return world[node]; }
+
+	// Recomputes changed world transforms and the projections of the attached meshes
+	// Input Variables:
+	// - renderer : renderer whose view projection the mesh projections are computed for
+	// - totalThreads : threads for large levels (0 for one per hardware thread)
+	void update(const Renderer& renderer, unsigned int totalThreads = 0) {
+		if (structureChanged) buildLevels();
+		const matrix& vp = renderer.vp;
+		unsigned int vpStamp = renderer.getVPStamp();
+		bool vpChanged = vpStamp != stamp;
+		stamp = vpStamp;
+
+		if (totalThreads == 0) totalThreads = max(1u, std::thread::hardware_concurrency());
+		for (size_t l = 0; l + 1 < levelStart.size(); l++)
+			forChunks(levelStart[l], levelStart[l + 1], totalThreads, [&](unsigned int begin, unsigned int end) {
+				updateRange(begin, end, vp, vpStamp, vpChanged);
+			});
+
+		if (vpChanged)
+			forChunks(0, static_cast<unsigned int>(size()), totalThreads, [&](unsigned int begin, unsigned int end) {
+				projectRange(begin, end, vp, vpStamp);
+			});
+	}
+};
@@ -4,7 +4,12 @@
 #include "colour.h"
 #include "renderer.h"
 #include "light.h"
+#include "shaders.h"
 #include <iostream>
+#include <array>
+#include <utility>
+#include <cmath>
+#include <bit>
 
 // Simple support class for a 2D vector
 class vec2D {
@@ -50,14 +55,22 @@ public:
 	}
 };
 
+// Pixel loops a triangle can be drawn with (selectable for benchmarks)
+enum class RasterKernel {
+	Caching,		// barycentric coordinates computed from scratch per pixel
+	Incremental,	// barycentric coordinates stepped per pixel and row
+	IncrementalSIMD,	// barycentric coordinates of the bounding box precomputed 8 at a time
+	Multisample		// coverage and depth of every sample of a pixel, shaded once per pixel (see MultisampleTarget)
+};
+
 // Class representing a triangle for rendering purposes
 class triangle {
 
 	Vertex v[3];       // Vertices of the triangle
 	vec2D e[3];		   // Edges of the triangle
-	color col[3];      // Colors for each vertex of the triangle
 
 	float invArea;	   // 1 / Area of the triangle
+	unsigned int source = 0;	// index of the triangle in its mesh (texture coordinates, see TexturedSurface)
 
 	// Helper function to compute the cross product for barycentric coordinates
 	// Input Variables:
@@ -92,6 +105,50 @@ class triangle {
 		return (a1 * alpha) + (a2 * beta) + (a3 * gamma);
 	}
 
+	// Depth plane of the triangle relative to the origin of a screen rectangle (see depthPlane).
+	// The single sample kernels evaluate fragment depth from it, the value a compressed tile
+	// stores, so raw and compressed depth test the same depth and draw the same image.
+	// Input Variables:
+	// - clip: rectangle whose top left pixel is the plane origin (the tile being drawn)
+	depthPlane getDepthPlane(const tileRect& clip) {
+		vec2D p(clip.minX, clip.minY);
+		float alpha = getCross(e[0], p - v[1].p) * invArea;
+		float beta = getCross(e[1], p - v[2].p) * invArea;
+		float gamma = getCross(e[2], p - v[0].p) * invArea;
+
+		depthPlane plane;
+		plane.a = interpolate(-e[1].y * invArea, -e[2].y * invArea, -e[0].y * invArea, v[0].p[2], v[1].p[2], v[2].p[2]);
+		plane.b = interpolate(e[1].x * invArea, e[2].x * invArea, e[0].x * invArea, v[0].p[2], v[1].p[2], v[2].p[2]);
+		plane.c = interpolate(beta, gamma, alpha, v[0].p[2], v[1].p[2], v[2].p[2]);
+		return plane;
+	}
+
+	// Depth test, shade and write one fragment with the pixel features F (PixelFeature flags)
+	// Colour is only computed when it is written, so depth only passes skip the shader.
+	// Packed selects the packed depth and colour buffer (concurrent frames) at compile time.
+	// Input Variables:
+	// - shader: shader of the triangle
+	// - index: pixel index
+	// - depth: interpolated depth of the fragment
+	// - w0, w1, w2: barycentric weights of vertex 0, 1 and 2
+	// Returns true if the fragment passed the depth test
+	template<ShadingModel M, unsigned int S, unsigned int F, bool Packed>
+	bool shadeFragment(Renderer& renderer, const Shader<M, S>& shader, int index, float depth, float w0, float w1, float w2) {
+		if constexpr ((F & PIXEL_DEPTH_TEST) != 0) {
+			if (!renderer.depthTest<Packed>(index, depth)) return false;
+		}
+		else {
+			renderer.countTested(index);
+			if (!DepthFormat::visible(depth)) return false;
+		}
+
+		unsigned int c = 0;
+		if constexpr ((F & PIXEL_COLOUR_WRITE) != 0)
+			c = shader.shade(w0, w1, w2).toRGBA();
+		renderer.writeFragment<F, Packed>(index, c, depth);
+		return true;
+	}
+
 	// Compute the 2D bounds of the triangle
 	// Output Variables:
 	// - minV, maxV: Minimum and maximum bounds in 2D space
@@ -106,13 +163,18 @@ class triangle {
 		}
 	}
 
-	void getBoundsWindow(const int& width, const int& height, int& minX, int& minY, int& maxX, int& maxY) {
+	// Compute the pixel bounds of the triangle clipped to a screen rectangle
+	// Input Variables:
+	// - clip: rectangle to clip against (whole canvas or a single tile)
+	// Output Variables:
+	// - minX, minY, maxX, maxY: clipped bounds (max exclusive)
+	void getBoundsClipped(const tileRect& clip, int& minX, int& minY, int& maxX, int& maxY) {
 
 		vec2D minV = vec2D::_min(v[0].p, vec2D::_min(v[1].p, v[2].p));
 		vec2D maxV = vec2D::_max(v[0].p, vec2D::_max(v[1].p, v[2].p));
 
-		minV = vec2D::_max(minV, vec2D(0, 0));
-		maxV = vec2D::_min(maxV, vec2D(width, height));
+		minV = vec2D::_max(minV, vec2D(clip.minX, clip.minY));
+		maxV = vec2D::_min(maxV, vec2D(clip.maxX, clip.maxY));
 		maxV.ceil();
 
 		minX = minV.x; minY = minV.y;
@@ -122,83 +184,75 @@ class triangle {
 	// Draw the triangle on the canvas
 	// Input Variables:
 	// - renderer: Renderer object for drawing
-	// - L: Light object for shading calculations
-	// - ka, kd: Ambient and diffuse lighting coefficients
-	void drawCaching(Renderer& renderer, const vec4& omega_i, const color& ambient, const color& diffuse) {
+	// - light, shade: light of the frame and shading constants of the mesh
+	// - clip: screen rectangle the triangle is clipped to
+	template<ShadingModel M, unsigned int S, unsigned int F, bool Packed>
+	void drawCaching(Renderer& renderer, const LightParams& light, const ShadeParams& shade, const tileRect& clip) {
 
 		// Skip very small triangles
-		if (invArea > 1.f) return;
+		if (invArea > 1.f) { RENDER_STAT(trianglesCulled, 1); return; }
+		RENDER_STAT(trianglesRasterised, 1);
+		unsigned int tested = 0, shaded = 0; // pixel counters, added to the render stats once
 
 		int minX, minY, maxX, maxY;
-		int canWidth = renderer.canvas.getWidth(), canHeight = renderer.canvas.getHeight();
-		getBoundsWindow(canWidth, canHeight, minX, minY, maxX, maxY);
+		const PixelLayout& layout = renderer.layout;
+		getBoundsClipped(clip, minX, minY, maxX, maxY);
 
 		// variable decalaration outside loops
-		color c;
-		vec4 normal;
-		unsigned char finalColor[3];
-		float depth, dot, alpha, beta, gamma;
+		Shader<M, S> shader(v, light, shade, source);
+		depthPlane plane = getDepthPlane(clip);
+		float depth, alpha, beta, gamma;
 
 		// Iterate over the bounding box and check each pixel
 		for (int y = minY; y < maxY; y++) {
 
 			// pre calculating buffer index for row
-			int rowIndex = y * canWidth;
+			int rowIndex = layout.rowOffset(y);
 
 			for (int x = minX; x < maxX; x++) {
 
 				// Check if the pixel lies inside the triangle
 				if (getCoordinates(vec2D(x, y), alpha, beta, gamma)) {
 					// calculate index for buffers
-					int index = rowIndex + x;
+					int index = rowIndex + layout.columnOffset(x);
 
 					alpha *= invArea;
 					beta *= invArea;
 					gamma *= invArea;
 
-					// Interpolate color, depth, and normals
-					depth = interpolate(beta, gamma, alpha, v[0].p[2], v[1].p[2], v[2].p[2]);
-					// Perform Z-buffer test and apply shading
-					if (depth > 0.01f && renderer.getDepth(index) > depth) {
-
-						c = interpolate(beta, gamma, alpha, v[0].rgb, v[1].rgb, v[2].rgb);
-
-						normal = interpolate(beta, gamma, alpha, v[0].normal, v[1].normal, v[2].normal);
-						normal.normalise();
-
-						// typical shader begin
-						dot = max(vec4::dot(omega_i, normal), 0.0f);
-						c = c * dot * diffuse + ambient;
-						// typical shader end
-
-						c.toRGB(finalColor);
-
-						renderer.drawAndSetDepth(index, finalColor, depth);
-					}
+					// Depth from the plane of the triangle
+					depth = plane.at(x - clip.minX, y - clip.minY);
+					tested++;
+					// Perform the depth test and shade the fragment
+					shaded += shadeFragment<M, S, F, Packed>(renderer, shader, index, depth, beta, gamma, alpha);
 				}
 			}
 		}
+
+		RENDER_STAT(pixelsTested, tested);
+		RENDER_STAT(pixelsShaded, shaded);
 	}
 
 	// Draw the triangle on the canvas
 	// Input Variables:
 	// - renderer: Renderer object for drawing
-	// - L: Light object for shading calculations
-	// - ka, kd: Ambient and diffuse lighting coefficients
-	void drawIncremental(Renderer& renderer, const vec4& omega_i, const color& ambient, const color& diffuse) {
+	// - light, shade: light of the frame and shading constants of the mesh
+	// - clip: screen rectangle the triangle is clipped to
+	template<ShadingModel M, unsigned int S, unsigned int F, bool Packed>
+	void drawIncremental(Renderer& renderer, const LightParams& light, const ShadeParams& shade, const tileRect& clip) {
 
 		// Skip very small triangles
-		if (invArea > 1.f) return;
+		if (invArea > 1.f) { RENDER_STAT(trianglesCulled, 1); return; }
+		RENDER_STAT(trianglesRasterised, 1);
+		unsigned int tested = 0, shaded = 0; // pixel counters, added to the render stats once
 
 		int minX, minY, maxX, maxY;
-		int canWidth = renderer.canvas.getWidth(), canHeight = renderer.canvas.getHeight();
-		getBoundsWindow(canWidth, canHeight, minX, minY, maxX, maxY);
+		const PixelLayout& layout = renderer.layout;
+		getBoundsClipped(clip, minX, minY, maxX, maxY);
 
 		// variable decalaration outside loops
-		color c;
-		vec4 normal;
-		float  depth, dot;
-		unsigned char finalColor[3];
+		Shader<M, S> shader(v, light, shade, source);
+		float depth;
 
 		vec2D p(minX, minY); // start pos
 
@@ -212,6 +266,9 @@ class triangle {
 		float deltaBetaX = -e[1].y * invArea, deltaBetaY = e[1].x * invArea;
 		float deltaGammaX = -e[2].y * invArea, deltaGammaY = e[2].x * invArea;
 
+		// depth plane of the triangle relative to the tile origin
+		depthPlane plane = getDepthPlane(clip);
+
 		// set initial values of barycentric coordinates
 		float alphaRow = alpha0,
 			betaRow = beta0,
@@ -223,7 +280,8 @@ class triangle {
 		for (int y = minY; y < maxY; y++) {
 
 			// pre calculating buffer index for row
-			int rowIndex = y * canWidth;
+			int rowIndex = layout.rowOffset(y);
+			int ty = y - clip.minY;
 
 			// set row barycentric coordinates
 			alpha = alphaRow;
@@ -235,29 +293,13 @@ class triangle {
 				// Check if the pixel lies inside the triangle
 				if (alpha >= 0.f && beta >= 0.f && gamma >= 0.f) {
 					// calculate index for buffers
-					int index = rowIndex + x;
+					int index = rowIndex + layout.columnOffset(x);
 
-					// Interpolate depth
-					depth = interpolate(beta, gamma, alpha, v[0].p[2], v[1].p[2], v[2].p[2]);
-					// Perform Z-buffer test and apply shading
-					if (depth > 0.01f && renderer.getDepth(index) > depth) {
-
-						// interpolate color
-						c = interpolate(beta, gamma, alpha, v[0].rgb, v[1].rgb, v[2].rgb);
-
-						// interpolate normal
-						normal = interpolate(beta, gamma, alpha, v[0].normal, v[1].normal, v[2].normal);
-						normal.normalise();
-
-						// typical shader begin
-						dot = max(vec4::dot(omega_i, normal), 0.0f);
-						c = c * dot * diffuse + ambient;
-						// typical shader end
-
-						c.toRGB(finalColor);
-
-						renderer.drawAndSetDepth(index, finalColor, depth);
-					}
+					// Depth from the plane of the triangle
+					depth = plane.at(x - clip.minX, ty);
+					tested++;
+					// Perform the depth test and shade the fragment
+					shaded += shadeFragment<M, S, F, Packed>(renderer, shader, index, depth, beta, gamma, alpha);
 				}
 
 				// horizontal increment of barycentric coordinates
@@ -271,10 +313,14 @@ class triangle {
 			betaRow += deltaBetaY;
 			gammaRow += deltaGammaY;
 		}
+
+		RENDER_STAT(pixelsTested, tested);
+		RENDER_STAT(pixelsShaded, shaded);
 	}
 
 	// calculate barycentric coordinates using avx256 and store into buffers
-	void calculate_barycentric_avx256(int minX, int maxX, int minY, int maxY,
+	// rows are pitch floats apart (width rounded up to 8), so 8-wide stores never spill into the next row
+	void calculate_barycentric_avx256(int minX, int maxX, int minY, int maxY, int pitch,
 		float alpha, float beta, float gamma,
 		float deltaAlphaX, float deltaBetaX, float deltaGammaX,
 		float deltaAlphaY, float deltaBetaY, float deltaGammaY,
@@ -289,15 +335,21 @@ class triangle {
 		__m256 vDeltaBetaX = _mm256_set1_ps(deltaBetaX);
 		__m256 vDeltaGammaX = _mm256_set1_ps(deltaGammaX);
 
-		int index, width = maxX - minX;
+		// per lane offsets 0..7 of the first 8 pixels in a row
+		__m256 lanes = _mm256_setr_ps(0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f);
+		__m256 vDeltaAlphaX8 = _mm256_mul_ps(vDeltaAlphaX, _mm256_set1_ps(stride));
+		__m256 vDeltaBetaX8 = _mm256_mul_ps(vDeltaBetaX, _mm256_set1_ps(stride));
+		__m256 vDeltaGammaX8 = _mm256_mul_ps(vDeltaGammaX, _mm256_set1_ps(stride));
+
+		int index;
 
 		for (int y = minY; y < maxY; y++)
 		{
-			__m256 vAlpha = _mm256_set1_ps(alpha);
-			__m256 vBeta = _mm256_set1_ps(beta);
-			__m256 vGamma = _mm256_set1_ps(gamma);
+			__m256 vAlpha = _mm256_add_ps(_mm256_set1_ps(alpha), _mm256_mul_ps(lanes, vDeltaAlphaX));
+			__m256 vBeta = _mm256_add_ps(_mm256_set1_ps(beta), _mm256_mul_ps(lanes, vDeltaBetaX));
+			__m256 vGamma = _mm256_add_ps(_mm256_set1_ps(gamma), _mm256_mul_ps(lanes, vDeltaGammaX));
 
-			index = (y - minY) * width;
+			index = (y - minY) * pitch;
 
 			for (int x = minX; x < maxX; x += stride)
 			{
@@ -307,9 +359,9 @@ class triangle {
 				_mm256_storeu_ps(&gammaBuffer[index], vGamma);
 
 				// Increment for next 8 pixels
-				vAlpha = _mm256_add_ps(vAlpha, vDeltaAlphaX);
-				vBeta = _mm256_add_ps(vBeta, vDeltaBetaX);
-				vGamma = _mm256_add_ps(vGamma, vDeltaGammaX);
+				vAlpha = _mm256_add_ps(vAlpha, vDeltaAlphaX8);
+				vBeta = _mm256_add_ps(vBeta, vDeltaBetaX8);
+				vGamma = _mm256_add_ps(vGamma, vDeltaGammaX8);
 
 				index += stride;
 			}
@@ -324,22 +376,23 @@ class triangle {
 	// Draw the triangle on the canvas using SIMD avx256
 	// Input Variables:
 	// - renderer: Renderer object for drawing
-	// - L: Light object for shading calculations
-	// - ka, kd: Ambient and diffuse lighting coefficients
-	void drawIncrementalSIMD(Renderer& renderer, const vec4& omega_i, const color& ambient, const color& diffuse) {
+	// - light, shade: light of the frame and shading constants of the mesh
+	// - clip: screen rectangle the triangle is clipped to
+	template<ShadingModel M, unsigned int S, unsigned int F, bool Packed>
+	void drawIncrementalSIMD(Renderer& renderer, const LightParams& light, const ShadeParams& shade, const tileRect& clip) {
 
 		// Skip very small triangles
-		if (invArea > 1.f) return;
+		if (invArea > 1.f) { RENDER_STAT(trianglesCulled, 1); return; }
+		RENDER_STAT(trianglesRasterised, 1);
+		unsigned int tested = 0, shaded = 0; // pixel counters, added to the render stats once
 
 		int minX, minY, maxX, maxY;
-		int canWidth = renderer.canvas.getWidth(), canHeight = renderer.canvas.getHeight();
-		getBoundsWindow(canWidth, canHeight, minX, minY, maxX, maxY);
+		const PixelLayout& layout = renderer.layout;
+		getBoundsClipped(clip, minX, minY, maxX, maxY);
 
 		// variable decalaration outside loops
-		color c;
-		vec4 normal;
-		float  depth, dot;
-		unsigned char finalColor[3];
+		Shader<M, S> shader(v, light, shade, source);
+		float depth;
 
 		vec2D p(minX, minY); // start pos
 
@@ -353,56 +406,184 @@ class triangle {
 		float deltaBetaX = -e[1].y * invArea, deltaBetaY = e[1].x * invArea;
 		float deltaGammaX = -e[2].y * invArea, deltaGammaY = e[2].x * invArea;
 
-		// calculate size and padding for buffers
+		if (minX >= maxX || minY >= maxY) return;
+
+		// calculate size of the buffers, rows padded to a multiple of 8 floats
 		int width = (maxX - minX);
-		int size = width * (maxY - minY);
-		int padding = (8 - (size % 8)) % 8;
+		int pitch = (width + 7) & ~7;
+		int size = pitch * (maxY - minY);
 
-		// create buffers (32 bit allignment for avx256)
-		alignas(32) float* alphaBuffer = new float[size + padding];
-		alignas(32) float* betaBuffer = new float[size + padding];
-		alignas(32) float* gammaBuffer = new float[size + padding];
+		// depth plane of the triangle relative to the tile origin
+		depthPlane plane = getDepthPlane(clip);
+
+		// create buffers
+		float* alphaBuffer = new float[size];
+		float* betaBuffer = new float[size];
+		float* gammaBuffer = new float[size];
 
 		// calculate baricentric coordinates and store in buffers
-		calculate_barycentric_avx256(minX, maxX, minY, maxY, alpha, beta, gamma,
+		calculate_barycentric_avx256(minX, maxX, minY, maxY, pitch, alpha, beta, gamma,
 			deltaAlphaX, deltaBetaX, deltaGammaX, deltaAlphaY, deltaBetaY, deltaGammaY,
 			alphaBuffer, betaBuffer, gammaBuffer);
 
-		// process triangle in a single loop (can be unrollerd)
-		for (int i = 0; i < size; i++)
+		// process triangle in a single loop over the bounding box (padding lanes skipped)
+		for (int j = 0; j < width * (maxY - minY); j++)
 		{
-			int index = (minX + i % width) + (minY + i / width) * width;
-			std::cout << index << " " << (int)(i < size) << std::endl;
+			int row = j / width, col = j % width;
+			int i = row * pitch + col;							// buffer index
+			int index = layout.index(minX + col, minY + row);	// pixel index
 			// Check if the pixel lies inside the triangle
 			if (alphaBuffer[i] >= 0.f && betaBuffer[i] >= 0.f && gammaBuffer[i] >= 0.f) {
-				// Interpolate depth
-				depth = interpolate(betaBuffer[i], gammaBuffer[i], alphaBuffer[i], v[0].p[2], v[1].p[2], v[2].p[2]);
-				// Perform Z-buffer test and apply shading
-				if (depth > 0.01f && renderer.getDepth(index) > depth) {
+				// Depth from the plane of the triangle
+				depth = plane.at(minX + col - clip.minX, minY + row - clip.minY);
+				tested++;
+				// Perform the depth test and shade the fragment
+				shaded += shadeFragment<M, S, F, Packed>(renderer, shader, index, depth, betaBuffer[i], gammaBuffer[i], alphaBuffer[i]);
+			}
+		}
 
-					// interpolate color
-					c = interpolate(betaBuffer[i], gammaBuffer[i], alphaBuffer[i], v[0].rgb, v[1].rgb, v[2].rgb);
+		// delete buffers
+		delete[] alphaBuffer;
+		delete[] betaBuffer;
+		delete[] gammaBuffer;
 
-					// interpolate normal
-					normal = interpolate(betaBuffer[i], gammaBuffer[i], alphaBuffer[i], v[0].normal, v[1].normal, v[2].normal);
-					normal.normalise();
+		RENDER_STAT(pixelsTested, tested);
+		RENDER_STAT(pixelsShaded, shaded);
+	}
 
-					// typical shader begin
-					dot = max(vec4::dot(omega_i, normal), 0.0f);
-					c = c * dot * diffuse + ambient;
-					// typical shader end
+	// Draw the triangle with several samples per pixel (see Renderer::setMultisampling)
+	// The edge functions and the depth are stepped per pixel like drawIncremental and offset to
+	// every sample of the pixel at once, 8 lanes wide. A pixel with samples that are covered and
+	// pass the depth test is shaded once, at its centre, or at the first covered sample when the
+	// centre lies outside the triangle.
+	// Input Variables:
+	// - renderer: Renderer object for drawing
+	// - light, shade: light of the frame and shading constants of the mesh
+	// - clip: screen rectangle the triangle is clipped to
+	template<ShadingModel M, unsigned int S, unsigned int F>
+	void drawMultisample(Renderer& renderer, const LightParams& light, const ShadeParams& shade, const tileRect& clip) {
 
-					c.toRGB(finalColor);
+		// Skip very small triangles
+		if (invArea > 1.f) { RENDER_STAT(trianglesCulled, 1); return; }
+		RENDER_STAT(trianglesRasterised, 1);
+		unsigned int tested = 0, shaded = 0; // pixel counters, added to the render stats once
+
+		// samples lie up to half a pixel past the pixel position, so one more column and row can be covered
+		int minX, minY, maxX, maxY;
+		const PixelLayout& layout = renderer.layout;
+		MultisampleTarget& target = renderer.getMultisampleTarget();
+		getBoundsClipped(clip, minX, minY, maxX, maxY);
+		maxX = min(maxX + 1, clip.maxX);
+		maxY = min(maxY + 1, clip.maxY);
 
-					renderer.drawAndSetDepth(index, finalColor, depth);
+		// variable decalaration outside loops
+		Shader<M, S> shader(v, light, shade, source);
+		float depth;
+
+		vec2D p(minX, minY); // start pos
+
+		// calculate starting value of barycentric coordinates
+		float alpha0 = getCross(e[0], p - v[1].p) * invArea;
+		float beta0 = getCross(e[1], p - v[2].p) * invArea;
+		float gamma0 = getCross(e[2], p - v[0].p) * invArea;
+
+		// calculate horozontal and verticle change in barycentric coordinates
+		float deltaAlphaX = -e[0].y * invArea, deltaAlphaY = e[0].x * invArea;
+		float deltaBetaX = -e[1].y * invArea, deltaBetaY = e[1].x * invArea;
+		float deltaGammaX = -e[2].y * invArea, deltaGammaY = e[2].x * invArea;
+
+		// depth plane of the triangle at a pixel, c is filled in per pixel
+		depthPlane plane;
+		plane.a = interpolate(deltaBetaX, deltaGammaX, deltaAlphaX, v[0].p[2], v[1].p[2], v[2].p[2]);
+		plane.b = interpolate(deltaBetaY, deltaGammaY, deltaAlphaY, v[0].p[2], v[1].p[2], v[2].p[2]);
+
+		// change of the barycentric coordinates and the depth from the pixel position to every
+		// sample, lanes without a sample are never covered
+		const float* ox = target.getOffsetsX();
+		const float* oy = target.getOffsetsY();
+		alignas(32) float sampleAlpha[MAX_MSAA_SAMPLES], sampleBeta[MAX_MSAA_SAMPLES], sampleGamma[MAX_MSAA_SAMPLES];
+		for (unsigned int s = 0; s < MAX_MSAA_SAMPLES; s++) {
+			bool used = s < target.getSamples();
+			sampleAlpha[s] = used ? deltaAlphaX * ox[s] + deltaAlphaY * oy[s] : -INFINITY;
+			sampleBeta[s] = deltaBetaX * ox[s] + deltaBetaY * oy[s];
+			sampleGamma[s] = deltaGammaX * ox[s] + deltaGammaY * oy[s];
+		}
+		__m256 offsetAlpha = _mm256_load_ps(sampleAlpha);
+		__m256 offsetBeta = _mm256_load_ps(sampleBeta);
+		__m256 offsetGamma = _mm256_load_ps(sampleGamma);
+		__m256 offsetDepth = _mm256_fmadd_ps(_mm256_set1_ps(plane.a), _mm256_loadu_ps(ox), _mm256_mul_ps(_mm256_set1_ps(plane.b), _mm256_loadu_ps(oy)));
+		__m256 zero = _mm256_setzero_ps();
+
+		// set initial values of barycentric coordinates
+		float alphaRow = alpha0,
+			betaRow = beta0,
+			gammaRow = gamma0;
+
+		float alpha, beta, gamma;
+
+		// Iterate over the bounding box and check the samples of each pixel
+		for (int y = minY; y < maxY; y++) {
+
+			// pre calculating buffer index for row
+			int rowIndex = layout.rowOffset(y);
+
+			// set row barycentric coordinates
+			alpha = alphaRow;
+			beta = betaRow;
+			gamma = gammaRow;
+
+			for (int x = minX; x < maxX; x++) {
+
+				// samples inside the triangle, one bit per sample
+				__m256 inside = _mm256_and_ps(
+					_mm256_and_ps(_mm256_cmp_ps(_mm256_add_ps(_mm256_set1_ps(alpha), offsetAlpha), zero, _CMP_GE_OQ),
+						_mm256_cmp_ps(_mm256_add_ps(_mm256_set1_ps(beta), offsetBeta), zero, _CMP_GE_OQ)),
+					_mm256_cmp_ps(_mm256_add_ps(_mm256_set1_ps(gamma), offsetGamma), zero, _CMP_GE_OQ));
+				int covered = _mm256_movemask_ps(inside);
+
+				if (covered) {
+					// calculate index for buffers
+					int index = rowIndex + layout.columnOffset(x);
+
+					// Interpolate depth at the pixel position and at the samples
+					depth = interpolate(beta, gamma, alpha, v[0].p[2], v[1].p[2], v[2].p[2]);
+					__m256 sampleDepth = _mm256_add_ps(_mm256_set1_ps(depth), offsetDepth);
+					tested++;
+
+					// Perform the depth test per sample and shade the pixel once
+					renderer.countTested(index);
+					int passed = DepthFormat::visible(depth) ? covered : 0;
+					if constexpr ((F & PIXEL_DEPTH_TEST) != 0)
+						if (passed) passed &= target.test(index, sampleDepth);
+					if (passed) {
+						shaded++;
+						float w0 = beta, w1 = gamma, w2 = alpha;
+						if (alpha < 0.f || beta < 0.f || gamma < 0.f) {
+							int s = std::countr_zero(static_cast<unsigned int>(covered));
+							w0 += sampleBeta[s]; w1 += sampleGamma[s]; w2 += sampleAlpha[s];
+						}
+						unsigned int c = 0;
+						if constexpr ((F & PIXEL_COLOUR_WRITE) != 0)
+							c = shader.shade(w0, w1, w2).toRGBA();
+						plane.c = depth;
+						renderer.writeSamples<F>(index, passed, plane, sampleDepth, c);
+					}
 				}
+
+				// horizontal increment of barycentric coordinates
+				alpha += deltaAlphaX;
+				beta += deltaBetaX;
+				gamma += deltaGammaX;
 			}
+
+			// verticle increment of barycentric coordinates
+			alphaRow += deltaAlphaY;
+			betaRow += deltaBetaY;
+			gammaRow += deltaGammaY;
 		}
 
-		// delete buffers
-		delete[] alphaBuffer;
-		delete[] betaBuffer;
-		delete[] gammaBuffer;
+		RENDER_STAT(pixelsTested, tested);
+		RENDER_STAT(pixelsShaded, shaded);
 	}
 
 public:
@@ -412,19 +593,21 @@ public:
 	// Constructor initializes the triangle with three vertices
 	// Input Variables:
 	// - v1, v2, v3: Vertices defining the triangle
-	triangle(const Vertex& v1, const Vertex& v2, const Vertex& v3) {
+	// - _source: Index of the triangle in its mesh
+	triangle(const Vertex& v1, const Vertex& v2, const Vertex& v3, unsigned int _source = 0) {
 		// set vertices
 		v[0] = v1; v[1] = v2; v[2] = v3;
+		source = _source;
 
 		// calculate edges
 		e[0] = v[1].p - v[0].p;
 		e[1] = v[2].p - v[1].p;
 		e[2] = v[0].p - v[2].p;
 
-		// clam colors
-		col[0].clampColour();
-		col[1].clampColour();
-		col[2].clampColour();
+		// clamp vertex colours
+		v[0].rgb.clampColour();
+		v[1].rgb.clampColour();
+		v[2].rgb.clampColour();
 
 		// Calculate the 2D area of the triangle
 		float area = getCross(e[0], e[1]);
@@ -433,18 +616,168 @@ public:
 
 	// Debugging utility to display the triangle bounds on the canvas
 	// Input Variables:
-	// - canvas: Reference to the rendering canvas
-	void drawBounds(GamesEngineeringBase::Window& canvas) {
+	// - canvas: Reference to the colour buffer
+	void drawBounds(Framebuffer& canvas) {
 		vec2D minV, maxV;
 		getBounds(minV, maxV);
 
 		for (int y = (int)minV.y; y < (int)maxV.y; y++) {
 			for (int x = (int)minV.x; x < (int)maxV.x; x++) {
-				canvas.drawCaching(x, y, 255, 0, 0);
+				canvas.draw(x, y, Framebuffer::pack(255, 0, 0));
 			}
 		}
 	}
 
+	// Compute the pixel bounds of the triangle clipped to the canvas, used for binning into tiles
+	// Input Variables:
+	// - width, height: dimensions of the canvas
+	// - multisampled: the samples of a pixel lie up to half a pixel past its position, so one more
+	//   column and row can be covered (the bounds drawMultisample walks)
+	// Output Variables:
+	// - minX, minY, maxX, maxY: clipped bounds (max exclusive)
+	void getScreenBounds(int width, int height, int& minX, int& minY, int& maxX, int& maxY, bool multisampled = false) {
+		getBoundsClipped(tileRect{ 0, 0, width, height }, minX, minY, maxX, maxY);
+		if (multisampled) {
+			maxX = min(maxX + 1, width);
+			maxY = min(maxY + 1, height);
+		}
+	}
+
+	// Draw the part of the triangle inside a tile whose depth is stored as plane equations
+	// (see TileDepth). The triangle's depth plane is added to the tile on the first pixel
+	// it wins; if the tile has no room left it is decompressed and drawing continues on raw depth.
+	// Input Variables:
+	// - renderer: Renderer object for drawing
+	// - light, shade: light of the frame and shading constants of the mesh
+	// - tile: index of the tile to draw into
+	template<ShadingModel M, unsigned int S>
+	void drawCompressed(Renderer& renderer, const LightParams& light, const ShadeParams& shade, int tile) {
+
+		// Skip very small triangles
+		if (invArea > 1.f) { RENDER_STAT(trianglesCulled, 1); return; }
+		RENDER_STAT(trianglesRasterised, 1);
+		unsigned int tested = 0, shaded = 0; // pixel counters, added to the render stats once
+
+		tileRect clip = renderer.tiles.getRect(tile);
+		TileDepth& tileDepth = renderer.getTileDepth(tile);
+
+		int minX, minY, maxX, maxY;
+		const PixelLayout& layout = renderer.layout;
+		getBoundsClipped(clip, minX, minY, maxX, maxY);
+
+		// variable decalaration outside loops
+		Shader<M, S> shader(v, light, shade, source);
+		float depth;
+
+		vec2D p(minX, minY); // start pos
+
+		// calculate starting value of barycentric coordinates
+		float alpha0 = getCross(e[0], p - v[1].p) * invArea;
+		float beta0 = getCross(e[1], p - v[2].p) * invArea;
+		float gamma0 = getCross(e[2], p - v[0].p) * invArea;
+
+		// calculate horozontal and verticle change in barycentric coordinates
+		float deltaAlphaX = -e[0].y * invArea, deltaAlphaY = e[0].x * invArea;
+		float deltaBetaX = -e[1].y * invArea, deltaBetaY = e[1].x * invArea;
+		float deltaGammaX = -e[2].y * invArea, deltaGammaY = e[2].x * invArea;
+
+		// depth plane of the triangle relative to the tile origin, the one the raw kernels test
+		depthPlane plane = getDepthPlane(clip);
+		int planeIndex = -1; // index of the plane in the tile, added on the first visible pixel
+
+		// set initial values of barycentric coordinates
+		float alphaRow = alpha0,
+			betaRow = beta0,
+			gammaRow = gamma0;
+
+		float alpha, beta, gamma;
+
+		// Iterate over the bounding box and check each pixel
+		for (int y = minY; y < maxY; y++) {
+
+			// pre calculating buffer index for row
+			int rowIndex = layout.rowOffset(y);
+			int ty = y - clip.minY;
+
+			// set row barycentric coordinates
+			alpha = alphaRow;
+			beta = betaRow;
+			gamma = gammaRow;
+
+			for (int x = minX; x < maxX; x++) {
+
+				// Check if the pixel lies inside the triangle
+				if (alpha >= 0.f && beta >= 0.f && gamma >= 0.f) {
+					// calculate index for buffers
+					int index = rowIndex + layout.columnOffset(x);
+					int tx = x - clip.minX;
+
+					// Depth from the plane the tile stores, so the tested and the stored depth are equal
+					depth = plane.at(tx, ty);
+					// Perform depth test against the tile planes (or the Z-buffer once the tile is raw)
+					tested++;
+					bool visible;
+					if (tileDepth.isRaw())
+						visible = renderer.depthTest<false>(index, depth);
+					else {
+						renderer.countTested(index);
+						visible = DepthFormat::visible(depth) && TileDepth::nearer(depth, tileDepth.depthAt(tx, ty));
+					}
+					if (visible) {
+						shaded++;
+
+						unsigned int c = shader.shade(beta, gamma, alpha).toRGBA();
+
+						if (!tileDepth.isRaw() && planeIndex < 0 && (planeIndex = tileDepth.addPlane(plane)) < 0)
+							renderer.decompressTile(tile); // too many planes, fall back to raw depth
+
+						if (tileDepth.isRaw())
+							renderer.drawAndSetDepth<false>(index, c, depth);
+						else {
+							tileDepth.setSelector(tx, ty, planeIndex);
+							renderer.draw(index, c);
+						}
+					}
+				}
+
+				// horizontal increment of barycentric coordinates
+				alpha += deltaAlphaX;
+				beta += deltaBetaX;
+				gamma += deltaGammaX;
+			}
+
+			// verticle increment of barycentric coordinates
+			alphaRow += deltaAlphaY;
+			betaRow += deltaBetaY;
+			gammaRow += deltaGammaY;
+		}
+
+		RENDER_STAT(pixelsTested, tested);
+		RENDER_STAT(pixelsShaded, shaded);
+	}
+
+	// Depth of the vertex nearest to the camera (used for hierarchical Z culling)
+	float getNearestDepth() const {
+		float d = v[0].p[2];
+		if (TileDepth::nearer(v[1].p[2], d)) d = v[1].p[2];
+		if (TileDepth::nearer(v[2].p[2], d)) d = v[2].p[2];
+		return d;
+	}
+
+	// Draws only the depth of the part of the triangle inside a screen rectangle (depth pre-pass).
+	// The pixel loop of the colour pass runs without colour write, so the pre-pass covers the
+	// same pixels and stores the same depth the colour pass tests.
+	// Input Variables:
+	// - renderer: Renderer object for drawing (raw depth)
+	// - light, shade: light of the frame and shading constants of the mesh
+	// - clip: screen rectangle the triangle is clipped to
+	void drawDepth(Renderer& renderer, const LightParams& light, const ShadeParams& shade, const tileRect& clip)
+	{
+		ShadeParams depthOnly = shade;
+		depthOnly.features = PIXEL_DEPTH_TEST | PIXEL_DEPTH_WRITE;
+		draw(RasterKernel::Incremental, renderer, light, depthOnly, clip);
+	}
+
 	// Debugging utility to display the coordinates of the triangle vertices
 	void display() {
 		for (unsigned int i = 0; i < 3; i++) {
@@ -453,11 +786,131 @@ public:
 		std::cout << std::endl;
 	}
 
-	void draw(Renderer& renderer, const vec4& omega_i, const color& ambient, const color& diffuse)
+	void draw(Renderer& renderer, const LightParams& light, const ShadeParams& shade)
+	{
+		int width = renderer.framebuffer.getWidth(), height = renderer.framebuffer.getHeight();
+
+		// clear the tiles under the triangle if this is the first draw into them this frame
+		int minX, minY, maxX, maxY;
+		getScreenBounds(width, height, minX, minY, maxX, maxY, renderer.multisampling());
+		if (minX >= maxX || minY >= maxY) { RENDER_STAT(trianglesCulled, 1); return; } // off screen
+		renderer.prepareRect(minX, minY, maxX, maxY);
+
+		// the triangle is drawn tile by tile, the order its pixels are stored in (see PixelLayout),
+		// with point or spot lights every tile is drawn with its own light list
+		bool tileLights = light.tileLights && perPixelLighting(shade.model);
+		int tx0, ty0, tx1, ty1, tilesX = renderer.tiles.getTilesX();
+		renderer.tiles.getRange(minX, minY, maxX, maxY, tx0, ty0, tx1, ty1);
+		for (int ty = ty0; ty <= ty1; ty++)
+			for (int tx = tx0; tx <= tx1; tx++) {
+				int tile = ty * tilesX + tx;
+				draw(renderer, tileLights ? tileLightParams(light, tile) : light, shade, renderer.tiles.getRect(tile));
+			}
+	}
+
+	// Draw the part of the triangle inside a screen rectangle with a specific pixel loop
+	// (the tiles under the rectangle must have been prepared)
+	void draw(RasterKernel kernel, Renderer& renderer, const LightParams& light, const ShadeParams& shade, const tileRect& clip)
+	{
+		// the mesh and the light of the tile pick the shader, so no fragment checks them
+		unsigned int variant = ((unsigned int)shade.model * SHADER_FEATURE_COMBINATIONS + shaderFeatures(shade, light)) * PIXEL_FEATURE_COMBINATIONS + shade.features;
+		if (kernel == RasterKernel::Multisample) { (this->*kernelTable<RasterKernel::Multisample, false>()[variant])(renderer, light, shade, clip); return; }
+		// the depth storage of the frame picks the kernel, so no fragment checks it
+		bool packed = renderer.packedDepth();
+		switch (kernel) {
+		case RasterKernel::Caching: (this->*(packed ? kernelTable<RasterKernel::Caching, true>() : kernelTable<RasterKernel::Caching, false>())[variant])(renderer, light, shade, clip); break;
+		case RasterKernel::Incremental: (this->*(packed ? kernelTable<RasterKernel::Incremental, true>() : kernelTable<RasterKernel::Incremental, false>())[variant])(renderer, light, shade, clip); break;
+		default: (this->*(packed ? kernelTable<RasterKernel::IncrementalSIMD, true>() : kernelTable<RasterKernel::IncrementalSIMD, false>())[variant])(renderer, light, shade, clip); break;
+		}
+	}
+
+	// Draw only the part of the triangle inside a screen rectangle (used by the tiled renderer)
+	void draw(Renderer& renderer, const LightParams& light, const ShadeParams& shade, const tileRect& clip)
 	{
-		//drawCaching(renderer, omega_i, ambient, diffuse);
-		drawIncremental(renderer, omega_i, ambient, diffuse);
-		//drawIncrementalSIMD(renderer, omega_i, ambient, diffuse);
+		if (renderer.multisampling()) { draw(RasterKernel::Multisample, renderer, light, shade, clip); return; }
+		//draw(RasterKernel::Caching, renderer, light, shade, clip);
+		draw(RasterKernel::Incremental, renderer, light, shade, clip);
+		//draw(RasterKernel::IncrementalSIMD, renderer, light, shade, clip);
+	}
+
+	// Draw into a compressed tile (only meshes with the default pixel features, see drawCompressed<M, S>)
+	void drawCompressed(Renderer& renderer, const LightParams& light, const ShadeParams& shade, int tile)
+	{
+		unsigned int variant = (unsigned int)shade.model * SHADER_FEATURE_COMBINATIONS + shaderFeatures(shade, light);
+		(this->*compressedTable()[variant])(renderer, light, shade, tile);
+	}
+
+private:
+
+	using KernelFn = void (triangle::*)(Renderer&, const LightParams&, const ShadeParams&, const tileRect&);
+
+	using CompressedFn = void (triangle::*)(Renderer&, const LightParams&, const ShadeParams&, int);
+
+	// Shader features kernel variants of model M compile with: the ones the model uses, none when
+	// the pixel pipeline writes no colour (the shader is never run), and spot shadows only with
+	// local lights. Variants differing only in dropped features share one kernel.
+	static constexpr unsigned int kernelShaderFeatures(ShadingModel M, unsigned int S, unsigned int F) {
+		if ((F & PIXEL_COLOUR_WRITE) == 0) return 0;
+		S &= shaderFeaturesOf(M);
+		return (S & SHADER_LOCAL_LIGHTS) != 0 ? S : S & ~SHADER_SPOT_SHADOWS;
+	}
+
+	// pixel loop K compiled for shading model M, shader features S and pixel features F, on the
+	// packed depth and colour buffer if Packed (multisampling keeps its own depth, so it has no
+	// packed variant)
+	template<RasterKernel K, ShadingModel M, unsigned int S, unsigned int F, bool Packed>
+	void drawWith(Renderer& renderer, const LightParams& light, const ShadeParams& shade, const tileRect& clip) {
+		if constexpr (K == RasterKernel::Caching) drawCaching<M, S, F, Packed>(renderer, light, shade, clip);
+		else if constexpr (K == RasterKernel::Incremental) drawIncremental<M, S, F, Packed>(renderer, light, shade, clip);
+		else if constexpr (K == RasterKernel::IncrementalSIMD) drawIncrementalSIMD<M, S, F, Packed>(renderer, light, shade, clip);
+		else drawMultisample<M, S, F>(renderer, light, shade, clip);
 	}
 
+	// model, shader features and pixel features of kernel table entry I
+	static constexpr ShadingModel entryModel(size_t I) { return (ShadingModel)(I / (SHADER_FEATURE_COMBINATIONS * PIXEL_FEATURE_COMBINATIONS)); }
+	static constexpr unsigned int entryPixelFeatures(size_t I) { return (unsigned int)(I % PIXEL_FEATURE_COMBINATIONS); }
+	static constexpr unsigned int entryShaderFeatures(size_t I) {
+		return kernelShaderFeatures(entryModel(I), (unsigned int)(I / PIXEL_FEATURE_COMBINATIONS % SHADER_FEATURE_COMBINATIONS), entryPixelFeatures(I));
+	}
+
+	template<RasterKernel K, bool Packed, size_t... I>
+	static constexpr std::array<KernelFn, sizeof...(I)> makeKernelTable(std::index_sequence<I...>) {
+		return { &triangle::drawWith<K, entryModel(I), entryShaderFeatures(I), entryPixelFeatures(I), Packed>... };
+	}
+
+	// one pixel loop per shading model, shader feature and pixel feature combination,
+	// indexed by (model * SHADER_FEATURE_COMBINATIONS + shader features) * PIXEL_FEATURE_COMBINATIONS + pixel features
+	// (instantiated in one file each, see the end of this header)
+	template<RasterKernel K, bool Packed>
+	static const KernelFn* kernelTable();
+
+	template<size_t... I>
+	static constexpr std::array<CompressedFn, sizeof...(I)> makeCompressedTable(std::index_sequence<I...>) {
+		return { &triangle::drawCompressed<(ShadingModel)(I / SHADER_FEATURE_COMBINATIONS),
+			kernelShaderFeatures((ShadingModel)(I / SHADER_FEATURE_COMBINATIONS), (unsigned int)(I % SHADER_FEATURE_COMBINATIONS), PIXEL_DEFAULT)>... };
+	}
+
+	// compressed tile loop per shading model and shader feature combination,
+	// indexed by model * SHADER_FEATURE_COMBINATIONS + shader features (defined in RasterKernels.cpp)
+	static const CompressedFn* compressedTable();
+
 };
+
+template<RasterKernel K, bool Packed>
+const triangle::KernelFn* triangle::kernelTable() {
+	constexpr size_t size = SHADING_MODELS * SHADER_FEATURE_COMBINATIONS * PIXEL_FEATURE_COMBINATIONS;
+	static constexpr std::array<KernelFn, size> table = makeKernelTable<K, Packed>(std::make_index_sequence<size>());
+	return table.data();
+}
+
+// Every kernel table compiles a pixel loop per shading model, shader feature and pixel feature
+// combination, so each table is built in a single file instead of in every file drawing triangles:
+// the tables draw() uses in RasterKernels.cpp, the caching and SIMD tables only the micro-benchmarks
+// select in Microbench.cpp.
+extern template const triangle::KernelFn* triangle::kernelTable<RasterKernel::Incremental, false>();
+extern template const triangle::KernelFn* triangle::kernelTable<RasterKernel::Incremental, true>();
+extern template const triangle::KernelFn* triangle::kernelTable<RasterKernel::Multisample, false>();
+extern template const triangle::KernelFn* triangle::kernelTable<RasterKernel::Caching, false>();
+extern template const triangle::KernelFn* triangle::kernelTable<RasterKernel::Caching, true>();
+extern template const triangle::KernelFn* triangle::kernelTable<RasterKernel::IncrementalSIMD, false>();
+extern template const triangle::KernelFn* triangle::kernelTable<RasterKernel::IncrementalSIMD, true>();
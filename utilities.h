@@ -1,11 +1,17 @@
 #pragma once
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <climits>
+#include <cstdlib>
+#include <cmath>
 #include "matrix.h"
 #include "RNG.h"
 
 // Utility function to generate a random rotation matrix
-// No input variables
-static matrix makeRandomRotation() {
-	RandomNumberGenerator& rng = RandomNumberGenerator::getInstance();
+// Input Variables:
+// - rng : random stream of the calling thread
+static matrix makeRandomRotation(RandomStream& rng) {
 	unsigned int r = rng.getRandomInt(0, 3);
 
 	switch (r) {
@@ -16,4 +22,76 @@ static matrix makeRandomRotation() {
 	}
 }
 
+// Items generated in order from one random stream by parallelGenerate
+const unsigned int GENERATE_BLOCK = 64;
 
+// Calls body(i, rng) for every i in [0, count) on several threads.
+// Items are split into fixed blocks of GENERATE_BLOCK and block b draws from stream b of the
+// seed, in item order, so every item gets the same random values whatever the thread count.
+// Input Variables:
+// - count : number of items
+// - seed : seed of the random streams
+// - body : generates one item, called concurrently for different items
+// - totalThreads : number of threads (0 for one per hardware thread)
+template<typename F>
+static void parallelGenerate(unsigned int count, unsigned long long seed, F&& body, unsigned int totalThreads = 0) {
+	unsigned int blocks = (count + GENERATE_BLOCK - 1) / GENERATE_BLOCK;
+	if (blocks == 0) return;
+
+	// streams are derived by jumping, which is sequential but cheap (128 steps per jump)
+	std::vector<RandomStream> streams(blocks);
+	streams[0] = RandomStream(seed);
+	for (unsigned int b = 1; b < blocks; b++) {
+		streams[b] = streams[b - 1];
+		streams[b].jump();
+	}
+
+	std::atomic<unsigned int> nextBlock{ 0 };
+	auto worker = [&]() {
+		unsigned int b;
+		while ((b = nextBlock.fetch_add(1)) < blocks) {
+			unsigned int end = min(count, (b + 1) * GENERATE_BLOCK);
+			for (unsigned int i = b * GENERATE_BLOCK; i < end; i++)
+				body(i, streams[b]);
+		}
+	};
+
+	if (totalThreads == 0) totalThreads = max(1u, std::thread::hardware_concurrency());
+	totalThreads = min(totalThreads, blocks);
+	std::vector<std::thread> threads;
+	for (unsigned int t = 1; t < totalThreads; t++)
+		threads.emplace_back(worker);
+	worker(); // the calling thread works too
+	for (auto& t : threads)
+		t.join();
+}
+
+// Parses the value of a count option of the command line
+// The value is read signed, so a negative count is rejected instead of wrapping around
+// Input Variables:
+// - value : option value
+// - least : smallest accepted count
+// Output Variables:
+// - count : parsed count, unchanged when rejected
+// Returns false if the value is not a whole number, below least or above UINT_MAX
+static bool parseCount(const char* value, long long least, unsigned int& count) {
+	char* end;
+	long long n = strtoll(value, &end, 10);
+	if (end == value || *end != '\0' || n < least || n > UINT_MAX) return false;
+	count = static_cast<unsigned int>(n);
+	return true;
+}
+
+// Parses the value of a non-negative amount option of the command line (distances, megabytes)
+// Input Variables:
+// - value : option value
+// Output Variables:
+// - amount : parsed amount, unchanged when rejected
+// Returns false if the value is not a number, negative or not finite
+static bool parseAmount(const char* value, float& amount) {
+	char* end;
+	float n = strtof(value, &end);
+	if (end == value || *end != '\0' || !std::isfinite(n) || n < 0.f) return false;
+	amount = n;
+	return true;
+}
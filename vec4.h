@@ -1,11 +1,23 @@
 #pragma once
 
 #include <iostream>
+#include <immintrin.h>
 
 // The `vec4` class represents a 4D vector and provides operations such as scaling, addition, subtraction, 
 // normalization, and vector products (dot and cross).
+// The components live in one 16 byte aligned SSE register worth of memory, the arithmetic works on all four at once.
 class alignas(16) vec4 {
 
+	// mask keeping x, y and z of a register
+	static __m128 xyzMask() { return _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0)); }
+
+	// x * x' + y * y' + z * z' of two registers, in the lowest lane
+	static __m128 dot3(__m128 a, __m128 b) {
+		__m128 p = _mm_mul_ps(a, b);
+		__m128 s = _mm_add_ss(p, _mm_movehdup_ps(p));	// x + y
+		return _mm_add_ss(s, _mm_movehl_ps(p, p));		// + z
+	}
+
 public:
 	union {
 		struct {
@@ -24,6 +36,16 @@ public:
 		: x(_x), y(_y), z(_z), w(_w) {
 	}
 
+	// Constructs the vector from an SSE register (x in the lowest lane)
+	explicit vec4(__m128 r) {
+		_mm_store_ps(v, r);
+	}
+
+	// The components as an SSE register (x in the lowest lane)
+	__m128 simd() const {
+		return _mm_load_ps(v);
+	}
+
 	// Displays the components of the vector in a readable format.
 	void display() {
 		std::cout << x << '\t' << y << '\t' << z << '\t' << w << std::endl;
@@ -34,7 +56,7 @@ public:
 	// - scalar: Value to scale the vector by
 	// Returns a new scaled `vec4`.
 	vec4 operator*(float scalar) const {
-		return { x * scalar, y * scalar, z * scalar, w * scalar };
+		return vec4(_mm_mul_ps(simd(), _mm_set1_ps(scalar)));
 	}
 
 	// overloading unary minus 
@@ -45,11 +67,9 @@ public:
 	// Divides the vector by its W component and sets W to 1.
 	// Useful for normalizing the W component after transformations.
 	void divideW() {
-		float iw = 1.f / w;
-		x *= iw;
-		y *= iw;
-		z *= iw;
-		w = 1.f;
+		__m128 r = simd();
+		__m128 iw = _mm_div_ps(_mm_set1_ps(1.f), _mm_shuffle_ps(r, r, _MM_SHUFFLE(3, 3, 3, 3)));
+		_mm_store_ps(v, _mm_blend_ps(_mm_mul_ps(r, iw), _mm_set1_ps(1.f), 0x8));
 	}
 
 	// Accesses a vector component by index.
@@ -73,7 +93,7 @@ public:
 	// - other: The vector to subtract
 	// Returns a new `vec4` resulting from the subtraction.
 	vec4 operator-(const vec4& other) const {
-		return vec4(x - other.x, y - other.y, z - other.z, 0.0f);
+		return vec4(_mm_and_ps(_mm_sub_ps(simd(), other.simd()), xyzMask()));
 	}
 
 	// Adds another vector to this vector.
@@ -81,12 +101,12 @@ public:
 	// - other: The vector to add
 	// Returns a new `vec4` resulting from the addition.
 	vec4 operator+(const vec4& other) const {
-		return vec4(x + other.x, y + other.y, z + other.z, 0.0f);
+		return vec4(_mm_and_ps(_mm_add_ps(simd(), other.simd()), xyzMask()));
 	}
 
 	vec4 operator/(const float& val) {
 		float ival = 1 / val;
-		return vec4(x * ival, y * ival, z * ival, w * ival);
+		return vec4(_mm_mul_ps(simd(), _mm_set1_ps(ival)));
 	}
 
 	// Computes the cross product of two vectors.
@@ -95,12 +115,13 @@ public:
 	// - v2: The second vector
 	// Returns a new `vec4` representing the cross product.
 	static vec4 cross(const vec4& v1, const vec4& v2) {
-		return vec4(
-			v1.y * v2.z - v1.z * v2.y,
-			v1.z * v2.x - v1.x * v2.z,
-			v1.x * v2.y - v1.y * v2.x,
-			0.0f // The W component is set to 0 for cross products
-		);
+		__m128 a = v1.simd(), b = v2.simd();
+		__m128 ayzx = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+		__m128 bzxy = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 1, 0, 2));
+		__m128 azxy = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 1, 0, 2));
+		__m128 byzx = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+		// The W component is set to 0 for cross products
+		return vec4(_mm_and_ps(_mm_fmsub_ps(ayzx, bzxy, _mm_mul_ps(azxy, byzx)), xyzMask()));
 	}
 
 	// Computes the dot product of two vectors.
@@ -109,15 +130,15 @@ public:
 	// - v2: The second vector
 	// Returns the dot product as a float.
 	static float dot(const vec4& v1, const vec4& v2) {
-		return (v1.x * v2.x) + (v1.y * v2.y) + (v1.z * v2.z);
+		return _mm_cvtss_f32(dot3(v1.simd(), v2.simd()));
 	}
 
 	// Normalizes the vector to make its length equal to 1.
 	// This operation does not affect the W component.
 	void normalise() {
-		float ilength = 1 / std::sqrt(x * x + y * y + z * z);
-		x *= ilength;
-		y *= ilength;
-		z *= ilength;
+		__m128 r = simd();
+		__m128 len = _mm_sqrt_ss(dot3(r, r));
+		__m128 ilength = _mm_div_ps(_mm_set1_ps(1.f), _mm_shuffle_ps(len, len, 0));
+		_mm_store_ps(v, _mm_blend_ps(_mm_mul_ps(r, ilength), r, 0x8));
 	}
 };
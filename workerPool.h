@@ -0,0 +1,105 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+// Worker threads kept alive between the short parallel loops run every frame (transform and
+// animation updates). Starting and joining a std::thread costs more than updating a few thousand
+// nodes, so the workers are started once and sleep on a condition variable between loops.
+// Loops from several threads are run one after the other.
+class WorkerPool {
+public:
+	using Range = std::function<void(unsigned int, unsigned int)>;
+
+private:
+	std::vector<std::thread> workers;
+	std::mutex serial;					// held by the thread running a loop
+	std::mutex lock;
+	std::condition_variable wake;		// a loop started or the pool stops
+	std::condition_variable done;		// the last worker finished its chunk
+	const Range* range = nullptr;		// loop body of the running loop
+	unsigned int begin = 0, chunk = 0;	// running loop starts at begin, chunk values per worker
+	unsigned int active = 0;			// workers taking a chunk of the running loop
+	unsigned int remaining = 0;			// workers still running their chunk
+	unsigned long long generation = 0;	// loops started
+	bool stopping = false;
+
+	// Worker thread index: waits for a loop and runs chunk index of it
+	void run(unsigned int index) {
+		unsigned long long seen = 0;
+		std::unique_lock<std::mutex> guard(lock);
+		while (true) {
+			wake.wait(guard, [&] { return stopping || generation != seen; });
+			if (stopping) return;
+			seen = generation;
+			if (index >= active) continue; // not needed for this loop
+			unsigned int s = begin + index * chunk;
+			const Range& f = *range;
+			guard.unlock();
+			f(s, s + chunk);
+			guard.lock();
+			if (--remaining == 0) done.notify_one();
+		}
+	}
+
+public:
+	// Starts the worker threads
+	// Input Variables:
+	// - totalWorkers : threads besides the one calling forChunks
+	WorkerPool(unsigned int totalWorkers) {
+		for (unsigned int i = 0; i < totalWorkers; i++)
+			workers.emplace_back(&WorkerPool::run, this, i);
+	}
+
+	WorkerPool(const WorkerPool&) = delete;
+	WorkerPool& operator=(const WorkerPool&) = delete;
+
+	// Pool with one worker per hardware thread besides the calling thread
+	static WorkerPool& shared() {
+		static WorkerPool pool(std::thread::hardware_concurrency() > 1 ? std::thread::hardware_concurrency() - 1 : 0);
+		return pool;
+	}
+
+	// Calls f(begin, end) on contiguous chunks of [_begin, _end) and returns when all are done,
+	// the calling thread takes the last chunk
+	// Input Variables:
+	// - _begin, _end : range to split
+	// - totalThreads : chunks, at most one per worker plus the calling thread
+	// - f : loop body, called from several threads at once
+	void forChunks(unsigned int _begin, unsigned int _end, unsigned int totalThreads, const Range& f) {
+		unsigned int count = _end - _begin;
+		unsigned int threads = totalThreads < workers.size() + 1 ? totalThreads : static_cast<unsigned int>(workers.size()) + 1;
+		if (threads <= 1 || count < 2) {
+			f(_begin, _end);
+			return;
+		}
+		std::lock_guard<std::mutex> one(serial);
+		unsigned int c = (count + threads - 1) / threads;
+		unsigned int chunks = (count + c - 1) / c;
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			range = &f;
+			begin = _begin;
+			chunk = c;
+			active = remaining = chunks - 1;
+			generation++;
+		}
+		wake.notify_all();
+		f(_begin + (chunks - 1) * c, _end);
+		std::unique_lock<std::mutex> guard(lock);
+		done.wait(guard, [&] { return remaining == 0; });
+	}
+
+	~WorkerPool() {
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (auto& t : workers)
+			t.join();
+	}
+};
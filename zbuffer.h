@@ -1,12 +1,14 @@
 #pragma once
 
-#include <concepts>
+#include <algorithm>
+#include "depthFormat.h"
 
 // Zbuffer class for managing depth values during rendering.
-// This class is template-constrained to only work with floating-point types (`float` or `double`).
+// This class is templated on the depth storage format (see depthFormat.h).
 
-template<std::floating_point T> // Restricts T to be a floating-point type
+template<DepthStorageFormat Format> // Storage format of the depth values
 class Zbuffer {
+	using T = typename Format::storage;
 	T* buffer;                  // Pointer to the buffer storing depth values
 	unsigned int width, height; // Dimensions of the Z-buffer
 
@@ -35,29 +37,40 @@ public:
 		buffer = new T[width * height]; // Allocate memory for the buffer
 	}
 
-	// Accesses the depth value at the specified (x, y) coordinate.
+	// Accesses the stored depth value at the specified (x, y) coordinate.
 	// Input Variables:
 	// - x: X-coordinate of the pixel.
 	// - y: Y-coordinate of the pixel.
-	// Returns a reference to the depth value at (x, y).
+	// Returns a reference to the stored value at (x, y).
 	T& operator () (unsigned int x, unsigned int y) {
 		return buffer[(y * width) + x]; // Convert 2D coordinates to 1D index
 	}
 
 	void set(int index, float val) {
-		buffer[index] = val;
+		if constexpr (Format::hasStencil) // keep the stencil bits of the stored value
+			buffer[index] = Format::merge(buffer[index], Format::encode(val));
+		else
+			buffer[index] = Format::encode(val);
 	}
 
 	float get(int index) const{
-		return buffer[index];
+		return Format::decode(buffer[index]);
 	}
 
-	// Clears the Z-buffer by setting all depth values to 1.0f,
-	// which represents the farthest possible depth.
+	// Returns true if depth val is nearer than the stored depth
+	bool test(int index, float val) const {
+		return Format::nearer(Format::encode(val), buffer[index]);
+	}
+
+	// Clears the Z-buffer by setting all depth values to the farthest possible depth.
 	void clear() {
-		for (unsigned int i = 0; i < width * height; i++) {
-			buffer[i] = 1.0f; // Reset each depth value
-		}
+		std::fill(buffer, buffer + width * height, Format::clearValue);
+	}
+
+	// Clears the rectangle [minX, maxX) x [minY, maxY) to the farthest depth.
+	void clearRect(unsigned int minX, unsigned int minY, unsigned int maxX, unsigned int maxY) {
+		for (unsigned int y = minY; y < maxY; y++)
+			std::fill(buffer + y * width + minX, buffer + y * width + maxX, Format::clearValue);
 	}
 
 	// Destructor to clean up memory allocated for the Z-buffer.
@@ -1,12 +1,14 @@
 #pragma once
 
-#include <concepts>
+#include <atomic>
+#include "depthFormat.h"
 
 // Zbuffer class for managing depth values during rendering.
-// This class is template-constrained to only work with floating-point types (`float` or `double`).
+// This class is templated on the depth storage format (see depthFormat.h).
 
-template<std::floating_point T>		// Restricts T to be a floating-point type
+template<DepthStorageFormat Format>		// Storage format of the depth values
 class ZbufferAtomic {
+	using T = typename Format::storage;
 	std::atomic<T>* buffer;			// Pointer to the buffer storing depth values
 	unsigned int width, height;		// Dimensions of the Z-buffer
 
@@ -34,30 +36,55 @@ public:
 		buffer = new std::atomic<T>[width * height]; // Allocate memory for the buffer
 	}
 
-	// Accesses the depth value at the specified (x, y) coordinate.
+	// Reads the depth value at the specified (x, y) coordinate.
 	// Input Variables:
 	// - x: X-coordinate of the pixel.
 	// - y: Y-coordinate of the pixel.
-	// Returns a reference to the depth value at (x, y).
-	T& operator () (unsigned int x, unsigned int y) {
-		//return buffer[(y * width) + x]; // Convert 2D coordinates to 1D index
-		return buffer[(y * width) + x].load(std::memory_order_relaxed);
+	// Returns the depth value at (x, y).
+	float operator () (unsigned int x, unsigned int y) const {
+		return get((y * width) + x); // Convert 2D coordinates to 1D index
 	}
 
 	// Get depth value (non-thread-safe for writing)
-	T get(unsigned int i) const {
-		return buffer[i].load(std::memory_order_relaxed);
+	float get(unsigned int i) const {
+		return Format::decode(buffer[i].load(std::memory_order_relaxed));
+	}
+
+	// Returns true if depth val is nearer than the stored depth
+	bool test(unsigned int i, float val) const {
+		return Format::nearer(Format::encode(val), buffer[i].load(std::memory_order_relaxed));
 	}
 
 	void set(unsigned int i, float val) {
-		buffer[i].store(val);
+		T encoded = Format::encode(val);
+		if constexpr (Format::hasStencil) // keep the stencil bits of the stored value
+			encoded = Format::merge(buffer[i].load(std::memory_order_relaxed), encoded);
+		buffer[i].store(encoded);
 	}
 
-	// Clears the Z-buffer by setting all depth values to 1.0f,
-	// which represents the farthest possible depth.
+	// Clears the Z-buffer by setting all depth values to the farthest possible depth.
 	void clear() {
 		for (unsigned int i = 0; i < width * height; ++i) {
-			buffer[i].store(1.0f, std::memory_order_relaxed);
+			buffer[i].store(Format::clearValue, std::memory_order_relaxed);
+		}
+	}
+
+	// Clears count values starting at index first to the farthest depth.
+	// Used to clear single tiles lazily the first time they are drawn to in a frame
+	// (a tile is one contiguous range, see PixelLayout).
+	void clearRange(unsigned int first, unsigned int count) {
+		for (unsigned int i = first; i < first + count; i++)
+			buffer[i].store(Format::clearValue, std::memory_order_relaxed);
+	}
+
+	// Moves the depth of count values starting at index first one stored step farther, values
+	// still holding the farthest depth are kept. After a depth pre-pass the first fragment at the
+	// stored depth then passes the strict depth test and every fragment behind it fails.
+	void stepFartherRange(unsigned int first, unsigned int count) {
+		for (unsigned int i = first; i < first + count; i++) {
+			T stored = buffer[i].load(std::memory_order_relaxed);
+			if (Format::nearer(stored, Format::clearValue))
+				buffer[i].store(Format::farther(stored), std::memory_order_relaxed);
 		}
 	}
 
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <atomic>
+#include <cstring>
+#include <immintrin.h>
+#include "depthFormat.h"
+#include "stats.h"
+
+// Depth buffer that keeps depth and colour of a pixel together in one 64-bit word so that
+// the depth test and the colour write happen as a single atomic operation.
+// Used when several threads may draw into the same pixel at once (shared counter and
+// sentinel queue render paths). The upper 32 bits hold the depth key of the storage
+// format (see depthFormat.h), which orders with the nearest depth smallest, so the nearest
+// fragment is simply the smallest word. The lower 32 bits hold the packed colour.
+template<DepthStorageFormat Format>
+class ZbufferPacked {
+	std::atomic<unsigned long long>* buffer = nullptr;	// packed depth and colour per pixel
+	unsigned int width = 0, height = 0;				// Dimensions of the buffer
+
+	// Packs a depth value and a colour into a single word
+	static unsigned long long pack(float depth, unsigned int colour) {
+		return (static_cast<unsigned long long>(Format::key(depth)) << 32) | colour;
+	}
+
+	// farthest depth and black
+	static constexpr unsigned long long CLEAR = static_cast<unsigned long long>(Format::key(Format::decode(Format::clearValue))) << 32;
+
+public:
+	// Default constructor for creating an unallocated buffer.
+	ZbufferPacked() = default;
+
+	// Creates or reinitializes the buffer with the given width and height.
+	// Input Variables:
+	// - w: Width of the buffer.
+	// - h: Height of the buffer.
+	void create(unsigned int w, unsigned int h) {
+		delete[] buffer;
+		width = w;
+		height = h;
+		buffer = new std::atomic<unsigned long long>[width * height];
+	}
+
+	// Get depth value of a pixel
+	float get(unsigned int i) const {
+		return Format::fromKey(static_cast<uint32_t>(buffer[i].load(std::memory_order_relaxed) >> 32));
+	}
+
+	// Returns true if depth is nearer than the stored depth
+	bool test(unsigned int i, float depth) const {
+		return Format::key(depth) < static_cast<uint32_t>(buffer[i].load(std::memory_order_relaxed) >> 32);
+	}
+
+	// Atomic depth test and write: stores depth and colour only if the depth is nearer
+	// than the stored one. A farther fragment can never overwrite a nearer one,
+	// regardless of how threads interleave.
+	// Input Variables:
+	// - i: linear pixel index
+	// - depth: fragment depth
+	// - colour: packed fragment colour
+	// Returns true if the fragment was stored.
+	bool testAndSet(unsigned int i, float depth, unsigned int colour) {
+		unsigned long long desired = pack(depth, colour);
+		unsigned long long current = buffer[i].load(std::memory_order_relaxed);
+		bool contended = false;	// an exchange failed, the word was changed by another thread
+		while ((desired >> 32) < (current >> 32)) {
+			if (buffer[i].compare_exchange_weak(current, desired, std::memory_order_relaxed))
+				return true;
+			RENDER_STAT(casRetries, 1); // only paid under contention, counted per thread (see RenderStats)
+			contended = true;
+		}
+		if (contended) RENDER_STAT(lostRaces, 1); // a nearer fragment landed first
+		return false;
+	}
+
+	// Atomic write of the parts of a fragment a pixel pipeline stores (see PixelFeature).
+	// Without depth test the fragment always lands, otherwise only when nearer than the stored
+	// depth. The part that is not written (depth or colour) keeps its stored value.
+	// Input Variables:
+	// - i: linear pixel index
+	// - depth: fragment depth
+	// - colour: packed fragment colour
+	// Returns true if the fragment was stored.
+	template<bool DepthTest, bool DepthWrite, bool ColourWrite>
+	bool write(unsigned int i, float depth, unsigned int colour) {
+		const unsigned long long depthBits = static_cast<unsigned long long>(Format::key(depth)) << 32;
+		unsigned long long current = buffer[i].load(std::memory_order_relaxed);
+		bool contended = false;	// an exchange failed, the word was changed by another thread
+		while (!DepthTest || (depthBits >> 32) < (current >> 32)) {
+			unsigned long long desired = (DepthWrite ? depthBits : current & 0xFFFFFFFF00000000ull)
+				| (ColourWrite ? colour : current & 0xFFFFFFFFull);
+			if (buffer[i].compare_exchange_weak(current, desired, std::memory_order_relaxed))
+				return true;
+			RENDER_STAT(casRetries, 1);
+			contended = true;
+		}
+		if (contended) RENDER_STAT(lostRaces, 1); // a nearer fragment landed first
+		return false;
+	}
+
+	// Clears count pixels starting at index first to the farthest depth and black.
+	void clearRange(unsigned int first, unsigned int count) {
+		for (unsigned int i = first; i < first + count; i++)
+			buffer[i].store(CLEAR, std::memory_order_relaxed);
+	}
+
+	// Copies the colours of count pixels starting at index first into a packed colour buffer
+	// Input Variables:
+	// - image: packed colour buffer with the same layout as this buffer
+	void resolveRange(unsigned int* image, unsigned int first, unsigned int count) const {
+		for (unsigned int i = first; i < first + count; i++)
+			image[i] = static_cast<unsigned int>(buffer[i].load(std::memory_order_relaxed));
+	}
+
+	// Destructor to clean up memory allocated for the buffer.
+	~ZbufferPacked() {
+		delete[] buffer;
+	}
+};